@@ -0,0 +1,286 @@
+/*!
+ * @file NotecardEnvVarAsyncSerial_bench.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+// Many configuration consumers, each with its own manager, fetching from one
+// emulated Notecard served over a pty. The consumers are run two ways:
+//
+// - coroutines: one coroutine per consumer awaits its fetches on a single
+//   event-loop thread through nevm::AsyncSerial.
+// - threads: one thread per consumer makes blocking fetches through
+//   NotecardEnvVarSerial_requestFn, taking turns on the device with a mutex.
+//
+// The Notecard answers one request at a time either way, so throughput is
+// bounded by the transport. The benchmark reports fetches per second, the
+// latency of each fetch including its wait for the device, and the resident
+// memory added while all consumers are waiting.
+//
+// Usage: NotecardEnvVarAsyncSerial_bench [consumers] [rounds] [numVars]
+
+#include <algorithm>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string_view>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "note-c/note.h"
+
+#include "NotecardEmulator.h"
+#include "NotecardEmulatorPty.h"
+#include "NotecardEnvVarAsyncSerial.hpp"
+#include "NotecardEnvVarSerial.h"
+
+namespace
+{
+
+size_t rounds;
+
+struct Consumer {
+    nevm::Manager man;
+    std::vector<double> latencies;
+    size_t failures = 0;
+
+    void operator()(std::string_view var, std::string_view val)
+    {
+        (void)var;
+        (void)val;
+    }
+};
+
+double nowUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Resident memory in kB.
+long rssKb(void)
+{
+    FILE *file = fopen("/proc/self/status", "r");
+    char line[128];
+    long kb = 0;
+    while (file != NULL && fgets(line, sizeof(line), file) != NULL) {
+        if (strncmp(line, "VmRSS:", 6) == 0) {
+            kb = strtol(line + 6, NULL, 10);
+            break;
+        }
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+
+    return kb;
+}
+
+void report(const char *mode, std::vector<Consumer> &consumers, size_t threads,
+            double elapsedUs, long rssDeltaKb)
+{
+    std::vector<double> latencies;
+    size_t failures = 0;
+    for (Consumer &consumer : consumers) {
+        latencies.insert(latencies.end(), consumer.latencies.begin(),
+                         consumer.latencies.end());
+        failures += consumer.failures;
+    }
+    if (latencies.empty()) {
+        printf("%-10s no fetches completed\n", mode);
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-10s %7u threads %9.0f fetches/s  latency p50 %8.0f us  "
+           "p99 %8.0f us  +%6ld kB RSS  %u failed\n", mode, (unsigned)threads,
+           latencies.size() / (elapsedUs / 1e6),
+           latencies[latencies.size() / 2],
+           latencies[latencies.size() * 99 / 100], rssDeltaKb,
+           (unsigned)failures);
+}
+
+nevm::Task consume(nevm::AsyncSerial &serial, Consumer &consumer)
+{
+    for (size_t i = 0; i < rounds; ++i) {
+        double start = nowUs();
+        if (co_await serial.fetch(consumer.man) != NEVM_SUCCESS) {
+            ++consumer.failures;
+        }
+        consumer.latencies.push_back(nowUs() - start);
+    }
+}
+
+int runCoroutines(const char *device, size_t numConsumers)
+{
+    int fd = NotecardEnvVarSerial_openDevice(device, 115200);
+    long rssBefore = rssKb();
+    nevm::AsyncSerial serial(fd, 10000);
+    std::vector<Consumer> consumers(numConsumers);
+    int epollFd = epoll_create1(0);
+    if (fd < 0 || !serial || epollFd < 0) {
+        return 1;
+    }
+
+    double start = nowUs();
+    for (Consumer &consumer : consumers) {
+        consumer.man.setEnvVarCb(consumer);
+        consume(serial, consumer);
+    }
+    long rssDelta = rssKb() - rssBefore;
+
+    struct epoll_event ev;
+    ev.events = serial.events();
+    ev.data.ptr = NULL;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+    while (serial.pending() > 0) {
+        struct epoll_event events[1];
+        int n = epoll_wait(epollFd, events, 1,
+                           serial.timeout(NotecardEnvVarSerial_getMs()));
+        serial.handle(n > 0 ? events[0].events : 0,
+                      NotecardEnvVarSerial_getMs());
+        if (ev.events != serial.events()) {
+            ev.events = serial.events();
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev);
+        }
+    }
+    double elapsed = nowUs() - start;
+
+    report("coroutines", consumers, 1, elapsed, rssDelta);
+    close(epollFd);
+    close(fd);
+
+    return 0;
+}
+
+// The shared device for the threads.
+struct Device {
+    int fd;
+    pthread_mutex_t mutex;
+};
+
+J *lockedRequestFn(J *req, void *ctx)
+{
+    Device *device = static_cast<Device *>(ctx);
+
+    pthread_mutex_lock(&device->mutex);
+    J *rsp = NotecardEnvVarSerial_requestFn(req, &device->fd);
+    pthread_mutex_unlock(&device->mutex);
+
+    return rsp;
+}
+
+pthread_barrier_t barrier;
+
+void *consumerThread(void *arg)
+{
+    Consumer *consumer = static_cast<Consumer *>(arg);
+
+    pthread_barrier_wait(&barrier);
+    for (size_t i = 0; i < rounds; ++i) {
+        double start = nowUs();
+        if (consumer->man.fetch() != NEVM_SUCCESS) {
+            ++consumer->failures;
+        }
+        consumer->latencies.push_back(nowUs() - start);
+    }
+
+    return NULL;
+}
+
+int runThreads(const char *path, size_t numConsumers)
+{
+    Device device;
+    device.fd = NotecardEnvVarSerial_openDevice(path, 115200);
+    pthread_mutex_init(&device.mutex, NULL);
+    long rssBefore = rssKb();
+    std::vector<Consumer> consumers(numConsumers);
+    std::vector<pthread_t> threads(numConsumers);
+    if (device.fd < 0) {
+        return 1;
+    }
+
+    // Start every thread, measure, then release them all at once.
+    pthread_barrier_init(&barrier, NULL, (unsigned)numConsumers + 1);
+    for (size_t i = 0; i < numConsumers; ++i) {
+        consumers[i].man.setEnvVarCb(consumers[i]);
+        NotecardEnvVarManager_setRequestFn(consumers[i].man.get(),
+                                           lockedRequestFn, &device);
+        if (pthread_create(&threads[i], NULL, consumerThread, &consumers[i])
+                != 0) {
+            fprintf(stderr, "Failed to create thread %u.\n", (unsigned)i);
+            exit(1);
+        }
+    }
+    long rssDelta = rssKb() - rssBefore;
+    double start = nowUs();
+    pthread_barrier_wait(&barrier);
+    for (size_t i = 0; i < numConsumers; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = nowUs() - start;
+
+    report("threads", consumers, numConsumers, elapsed, rssDelta);
+    pthread_barrier_destroy(&barrier);
+    pthread_mutex_destroy(&device.mutex);
+    close(device.fd);
+
+    return 0;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    size_t numConsumers = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000;
+    rounds = argc > 2 ? strtoul(argv[2], NULL, 10) : 5;
+    size_t numVars = argc > 3 ? strtoul(argv[3], NULL, 10) : 16;
+    if (numConsumers == 0 || rounds == 0 || numVars == 0) {
+        fprintf(stderr, "Invalid arguments.\n");
+        return 1;
+    }
+
+    NoteSetFnDefault(malloc, free, NotecardEnvVarSerial_delayMs,
+                     NotecardEnvVarSerial_getMs);
+
+    NotecardEmulator *emu = NotecardEmulator_alloc();
+    if (emu == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+    char name[16];
+    char val[32];
+    for (size_t i = 0; i < numVars; ++i) {
+        snprintf(name, sizeof(name), "var_%04u", (unsigned)i);
+        snprintf(val, sizeof(val), "value_%u", (unsigned)i);
+        NotecardEmulator_setHubVar(emu, name, val);
+    }
+    NotecardEmulatorPty *pty = NotecardEmulatorPty_start(emu);
+    if (pty == NULL) {
+        fprintf(stderr, "Failed to start the emulator's pty.\n");
+        return 1;
+    }
+
+    printf("%u consumers, %u fetches each, %u vars\n", (unsigned)numConsumers,
+           (unsigned)rounds, (unsigned)numVars);
+    int ret = runCoroutines(NotecardEmulatorPty_path(pty), numConsumers);
+    if (ret == 0) {
+        ret = runThreads(NotecardEmulatorPty_path(pty), numConsumers);
+    }
+
+    NotecardEmulatorPty_stop(pty);
+    NotecardEmulator_free(emu);
+
+    return ret;
+}
@@ -0,0 +1,124 @@
+/*!
+ * @file NotecardEnvVarManager_fetch_bench.c
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+// Measures NotecardEnvVarManager_fetch end to end against the emulated
+// Notecard, including note-c's serial transaction and JSON handling.
+//
+// Usage: NotecardEnvVarManager_fetch_bench [numVars] [iterations] [tracePath]
+//
+// If tracePath is given, every fetch is traced to that file in the Chrome
+// trace_event format. Load it into Perfetto (ui.perfetto.dev) to see where
+// the time goes.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "note-c/note.h"
+
+#include "NotecardEmulator.h"
+#include "NotecardEnvVarChromeTrace.h"
+#include "NotecardEnvVarManager.h"
+
+static size_t callbacks = 0;
+
+static void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)var;
+    (void)val;
+    (void)ctx;
+
+    ++callbacks;
+}
+
+static double nowUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t numVars = argc > 1 ? strtoul(argv[1], NULL, 10) : 32;
+    size_t iterations = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000;
+    const char *tracePath = argc > 3 ? argv[3] : NULL;
+
+    NoteSetFnDefault(malloc, free, NotecardEmulator_delayMs,
+                     NotecardEmulator_getMs);
+
+    NotecardEmulator *emu = NotecardEmulator_alloc();
+    char **names = (char **)calloc(numVars, sizeof(char *));
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    if (emu == NULL || names == NULL || man == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+
+    char val[32];
+    for (size_t i = 0; i < numVars; ++i) {
+        names[i] = (char *)malloc(16);
+        snprintf(names[i], 16, "var_%04u", (unsigned)i);
+        snprintf(val, sizeof(val), "value_%u", (unsigned)i);
+        NotecardEmulator_setHubVar(emu, names[i], val);
+    }
+    NotecardEmulator_attach(emu);
+    NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL);
+
+    NotecardEnvVarChromeTrace *trace = NULL;
+    if (tracePath != NULL) {
+        trace = NotecardEnvVarChromeTrace_open(tracePath);
+        if (trace == NULL) {
+            fprintf(stderr, "Failed to open %s.\n", tracePath);
+            return 1;
+        }
+        NotecardEnvVarManager_setTraceCb(man, NotecardEnvVarChromeTrace_cb,
+                                         trace);
+    }
+
+    double start = nowUs();
+    for (size_t i = 0; i < iterations; ++i) {
+        if (NotecardEnvVarManager_fetch(man, (const char **)names, numVars)
+                != NEVM_SUCCESS) {
+            fprintf(stderr, "Fetch %u failed.\n", (unsigned)i);
+            return 1;
+        }
+    }
+    double elapsed = nowUs() - start;
+
+    if (trace != NULL) {
+        NotecardEnvVarManager_setTraceCb(man, NULL, NULL);
+        NotecardEnvVarChromeTrace_close(trace);
+    }
+
+    NotecardEmulatorStats stats;
+    NotecardEmulator_getStats(emu, &stats);
+    printf("vars=%u iterations=%u callbacks=%u\n", (unsigned)numVars,
+           (unsigned)iterations, (unsigned)callbacks);
+    printf("fetch: %.2f us/op, %.0f ops/s\n", elapsed / iterations,
+           iterations / (elapsed / 1e6));
+    printf("serial: %u bytes in, %u bytes out per fetch\n",
+           (unsigned)(stats.bytesIn / iterations),
+           (unsigned)(stats.bytesOut / iterations));
+
+    NotecardEnvVarManager_free(man);
+    NotecardEmulator_free(emu);
+    for (size_t i = 0; i < numVars; ++i) {
+        free(names[i]);
+    }
+    free(names);
+
+    return 0;
+}
@@ -0,0 +1,183 @@
+/*!
+ * @file NotecardEnvVarManager_multi_bench.c
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+// Scaling of independent managers, one per thread, each with its own emulated
+// Notecard installed through NotecardEnvVarManager_setRequestFn. Nothing is
+// shared between the threads but the allocator, so the aggregate fetch rate
+// should grow with the thread count until the cores run out.
+//
+// Usage: NotecardEnvVarManager_multi_bench [maxThreads] [numVars] [fetches]
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "note-c/note.h"
+
+#include "NotecardEmulator.h"
+#include "NotecardEnvVarManager.h"
+
+typedef struct {
+    NotecardEmulator *emu;
+    NotecardEnvVarManager *man;
+    size_t fetches;
+    int result;
+} Worker;
+
+static size_t numVars;
+
+static double nowUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)var;
+    (void)val;
+    (void)ctx;
+}
+
+static void *workerThread(void *arg)
+{
+    Worker *worker = (Worker *)arg;
+    char val[32];
+
+    // Change one variable before each fetch so that every fetch applies a
+    // full body rather than getting {env-not-modified}.
+    for (size_t i = 0; i < worker->fetches; ++i) {
+        snprintf(val, sizeof(val), "round_%u", (unsigned)i);
+        NotecardEmulator_setHubVar(worker->emu, "var_0000", val);
+        if (NotecardEnvVarManager_fetch(worker->man, NULL, NEVM_ENV_VAR_ALL)
+                != NEVM_SUCCESS) {
+            worker->result = NEVM_FAILURE;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static int setUp(Worker *worker, size_t fetches)
+{
+    char name[16];
+    char val[32];
+
+    worker->emu = NotecardEmulator_alloc();
+    worker->man = NotecardEnvVarManager_alloc();
+    worker->fetches = fetches;
+    worker->result = NEVM_SUCCESS;
+    if (worker->emu == NULL || worker->man == NULL) {
+        return NEVM_FAILURE;
+    }
+    for (size_t i = 0; i < numVars; ++i) {
+        snprintf(name, sizeof(name), "var_%04u", (unsigned)i);
+        snprintf(val, sizeof(val), "value_%u", (unsigned)i);
+        NotecardEmulator_setHubVar(worker->emu, name, val);
+    }
+
+    if (NotecardEnvVarManager_setEnvVarCb(worker->man, userCb, NULL)
+            != NEVM_SUCCESS ||
+            NotecardEnvVarManager_setRequestFn(worker->man,
+                    NotecardEmulator_requestFn, worker->emu) != NEVM_SUCCESS) {
+        return NEVM_FAILURE;
+    }
+
+    return NEVM_SUCCESS;
+}
+
+static int run(size_t numThreads, size_t fetches, double *rate)
+{
+    Worker *workers = (Worker *)calloc(numThreads, sizeof(Worker));
+    pthread_t *threads = (pthread_t *)calloc(numThreads, sizeof(pthread_t));
+    int ret = 0;
+    if (workers == NULL || threads == NULL) {
+        ret = 1;
+        goto done;
+    }
+    for (size_t i = 0; i < numThreads; ++i) {
+        if (setUp(&workers[i], fetches) != NEVM_SUCCESS) {
+            ret = 1;
+            goto done;
+        }
+    }
+
+    double start = nowUs();
+    for (size_t i = 0; i < numThreads; ++i) {
+        pthread_create(&threads[i], NULL, workerThread, &workers[i]);
+    }
+    for (size_t i = 0; i < numThreads; ++i) {
+        pthread_join(threads[i], NULL);
+        if (workers[i].result != NEVM_SUCCESS) {
+            ret = 1;
+        }
+    }
+    *rate = numThreads * fetches / ((nowUs() - start) / 1e6);
+
+done:
+    if (workers != NULL) {
+        for (size_t i = 0; i < numThreads; ++i) {
+            NotecardEnvVarManager_free(workers[i].man);
+            NotecardEmulator_free(workers[i].emu);
+        }
+    }
+    free(workers);
+    free(threads);
+
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t maxThreads = argc > 1 ? strtoul(argv[1], NULL, 10) :
+                        (cpus > 0 ? (size_t)cpus : 1);
+    numVars = argc > 2 ? strtoul(argv[2], NULL, 10) : 64;
+    size_t fetches = argc > 3 ? strtoul(argv[3], NULL, 10) : 2000;
+    if (maxThreads == 0 || numVars == 0 || fetches == 0) {
+        fprintf(stderr, "Invalid arguments.\n");
+        return 1;
+    }
+
+    NoteSetFnDefault(malloc, free, NotecardEmulator_delayMs,
+                     NotecardEmulator_getMs);
+
+    printf("%u vars, %u fetches per thread\n", (unsigned)numVars,
+           (unsigned)fetches);
+    printf("%8s %14s %8s\n", "threads", "fetches/s", "speedup");
+    double base = 0;
+    // 1, 2, 4, ... threads, ending with maxThreads.
+    for (size_t t = 1;; t = t * 2 < maxThreads ? t * 2 : maxThreads) {
+        double rate;
+        if (run(t, fetches, &rate) != 0) {
+            fprintf(stderr, "Run with %u threads failed.\n", (unsigned)t);
+            return 1;
+        }
+        if (t == 1) {
+            base = rate;
+        }
+        printf("%8u %14.0f %7.2fx\n", (unsigned)t, rate, rate / base);
+        if (t == maxThreads) {
+            break;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,214 @@
+/*!
+ * @file NotecardEnvVarManager_parse_bench.c
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+// Compares the library's number parsers with libc's on a corpus of random
+// values formatted as a Notecard would send them, reporting nanoseconds per
+// parse. Every parser sees the same strings, and their results are summed so
+// that none of the work can be optimized away.
+//
+// Usage: NotecardEnvVarManager_parse_bench [numValues] [passes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "NotecardEnvVarManager.h"
+
+static uint64_t rngState = 88172645463325252ull;
+
+static uint64_t rng(void)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 7;
+    rngState ^= rngState << 17;
+    return rngState;
+}
+
+static double nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// The corpus is one buffer of NUL-terminated strings, so that libc's parsers
+// can read them too, with their offsets and lengths.
+typedef struct {
+    char *buf;
+    size_t *offsets;
+    size_t *lens;
+    size_t count;
+} Corpus;
+
+static int corpusAlloc(Corpus *corpus, size_t count)
+{
+    corpus->buf = malloc(count * 32);
+    corpus->offsets = malloc(count * sizeof(size_t));
+    corpus->lens = malloc(count * sizeof(size_t));
+    corpus->count = count;
+
+    return (corpus->buf && corpus->offsets && corpus->lens) ? 0 : -1;
+}
+
+static void corpusFree(Corpus *corpus)
+{
+    free(corpus->buf);
+    free(corpus->offsets);
+    free(corpus->lens);
+}
+
+static void fillInts(Corpus *corpus)
+{
+    size_t offset = 0;
+    for (size_t i = 0; i < corpus->count; ++i) {
+        // Configuration integers are mostly small.
+        int32_t v = (int32_t)(uint32_t)rng() >> (rng() % 32);
+        int len = snprintf(corpus->buf + offset, 32, "%ld", (long)v);
+        corpus->offsets[i] = offset;
+        corpus->lens[i] = (size_t)len;
+        offset += (size_t)len + 1;
+    }
+}
+
+static void fillFloats(Corpus *corpus)
+{
+    size_t offset = 0;
+    for (size_t i = 0; i < corpus->count; ++i) {
+        int len;
+        if (i % 2 == 0) {
+            // Round-tripped floats from anywhere in the range.
+            uint32_t bits = (uint32_t)rng() & 0xBFFFFFFF;
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            len = snprintf(corpus->buf + offset, 32, "%.9g", f);
+        } else {
+            // Short decimals, as a person would type them on Notehub.
+            len = snprintf(corpus->buf + offset, 32, "%.*f",
+                           (int)(rng() % 4), (double)(rng() % 100000) / 100);
+        }
+        corpus->offsets[i] = offset;
+        corpus->lens[i] = (size_t)len;
+        offset += (size_t)len + 1;
+    }
+}
+
+static void report(const char *name, double elapsedNs, size_t parses,
+                   double sum)
+{
+    printf("%-32s %6.1f ns/parse  (checksum %g)\n", name, elapsedNs / parses,
+           sum);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t numValues = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    size_t passes = argc > 2 ? strtoul(argv[2], NULL, 10) : 20;
+    if (numValues == 0 || passes == 0) {
+        fprintf(stderr, "Invalid arguments.\n");
+        return 1;
+    }
+
+    Corpus ints;
+    Corpus floats;
+    if (corpusAlloc(&ints, numValues) != 0
+            || corpusAlloc(&floats, numValues) != 0) {
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+    fillInts(&ints);
+    fillFloats(&floats);
+    size_t parses = numValues * passes;
+    double start;
+    double sum;
+
+    printf("%u values, %u passes\n", (unsigned)numValues, (unsigned)passes);
+
+    start = nowNs();
+    sum = 0;
+    for (size_t p = 0; p < passes; ++p) {
+        for (size_t i = 0; i < numValues; ++i) {
+            int32_t v = 0;
+            NotecardEnvVarManager_parseInt32(ints.buf + ints.offsets[i],
+                                             ints.lens[i], &v);
+            sum += v;
+        }
+    }
+    report("NotecardEnvVarManager_parseInt32", nowNs() - start, parses, sum);
+
+    start = nowNs();
+    sum = 0;
+    for (size_t p = 0; p < passes; ++p) {
+        for (size_t i = 0; i < numValues; ++i) {
+            sum += strtol(ints.buf + ints.offsets[i], NULL, 10);
+        }
+    }
+    report("strtol", nowNs() - start, parses, sum);
+
+    start = nowNs();
+    sum = 0;
+    for (size_t p = 0; p < passes; ++p) {
+        for (size_t i = 0; i < numValues; ++i) {
+            sum += atoi(ints.buf + ints.offsets[i]);
+        }
+    }
+    report("atoi", nowNs() - start, parses, sum);
+
+    start = nowNs();
+    sum = 0;
+    for (size_t p = 0; p < passes; ++p) {
+        for (size_t i = 0; i < numValues; ++i) {
+            int32_t v = 0;
+            NotecardEnvVarManager_parseFixed(floats.buf + floats.offsets[i],
+                                             floats.lens[i], 3, &v);
+            sum += v;
+        }
+    }
+    report("NotecardEnvVarManager_parseFixed", nowNs() - start, parses, sum);
+
+    start = nowNs();
+    sum = 0;
+    for (size_t p = 0; p < passes; ++p) {
+        for (size_t i = 0; i < numValues; ++i) {
+            float v = 0;
+            NotecardEnvVarManager_parseFloat(floats.buf + floats.offsets[i],
+                                             floats.lens[i], &v);
+            sum += v;
+        }
+    }
+    report("NotecardEnvVarManager_parseFloat", nowNs() - start, parses, sum);
+
+    start = nowNs();
+    sum = 0;
+    for (size_t p = 0; p < passes; ++p) {
+        for (size_t i = 0; i < numValues; ++i) {
+            sum += strtof(floats.buf + floats.offsets[i], NULL);
+        }
+    }
+    report("strtof", nowNs() - start, parses, sum);
+
+    start = nowNs();
+    sum = 0;
+    for (size_t p = 0; p < passes; ++p) {
+        for (size_t i = 0; i < numValues; ++i) {
+            sum += strtod(floats.buf + floats.offsets[i], NULL);
+        }
+    }
+    report("strtod", nowNs() - start, parses, sum);
+
+    corpusFree(&ints);
+    corpusFree(&floats);
+
+    return 0;
+}
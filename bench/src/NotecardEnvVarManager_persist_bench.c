@@ -0,0 +1,112 @@
+/*!
+ * @file NotecardEnvVarManager_persist_bench.c
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+// Measures the flash wear of persisting fetched values. Each iteration
+// changes one variable on the emulated Notehub and fetches all of them, so
+// every fetch persists exactly one change.
+//
+// Usage: NotecardEnvVarManager_persist_bench [numVars] [iterations]
+//                                            [sectorSize]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "note-c/note.h"
+
+#include "NotecardEmulator.h"
+#include "NotecardEnvVarFileStorage.h"
+#include "NotecardEnvVarManager.h"
+
+static void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)var;
+    (void)val;
+    (void)ctx;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t numVars = argc > 1 ? strtoul(argv[1], NULL, 10) : 16;
+    size_t iterations = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000;
+    uint32_t sectorSize = argc > 3 ? strtoul(argv[3], NULL, 10) : 2048;
+    const char *path = "nevm_persist_bench.bin";
+
+    NoteSetFnDefault(malloc, free, NotecardEmulator_delayMs,
+                     NotecardEmulator_getMs);
+
+    remove(path);
+    NotecardEmulator *emu = NotecardEmulator_alloc();
+    NotecardEnvVarFileStorage *fs = NotecardEnvVarFileStorage_open(path,
+                                    2 * sectorSize, sectorSize);
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    if (emu == NULL || fs == NULL || man == NULL) {
+        fprintf(stderr, "Setup failed.\n");
+        return 1;
+    }
+
+    char name[16];
+    char val[32];
+    for (size_t i = 0; i < numVars; ++i) {
+        snprintf(name, sizeof(name), "var_%04u", (unsigned)i);
+        snprintf(val, sizeof(val), "value_%u", (unsigned)i);
+        NotecardEmulator_setHubVar(emu, name, val);
+    }
+    NotecardEmulator_attach(emu);
+    NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL);
+    if (NotecardEnvVarManager_setStorage(man,
+                                         NotecardEnvVarFileStorage_storage(fs))
+            != NEVM_SUCCESS) {
+        fprintf(stderr, "Invalid storage.\n");
+        return 1;
+    }
+
+    // The first fetch persists every variable.
+    if (NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL)
+            != NEVM_SUCCESS) {
+        fprintf(stderr, "Fetch failed.\n");
+        return 1;
+    }
+
+    NotecardEnvVarFileStorageStats start;
+    NotecardEnvVarFileStorage_getStats(fs, &start);
+    for (size_t i = 0; i < iterations; ++i) {
+        snprintf(name, sizeof(name), "var_%04u", (unsigned)(i % numVars));
+        snprintf(val, sizeof(val), "changed_%u", (unsigned)i);
+        NotecardEmulator_setHubVar(emu, name, val);
+        if (NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL)
+                != NEVM_SUCCESS) {
+            fprintf(stderr, "Fetch %u failed.\n", (unsigned)i);
+            return 1;
+        }
+    }
+
+    NotecardEnvVarFileStorageStats stats;
+    NotecardEnvVarFileStorage_getStats(fs, &stats);
+    uint32_t erases = stats.erases - start.erases;
+    uint32_t bytes = stats.bytesWritten - start.bytesWritten;
+    printf("vars=%u changes=%u sectorSize=%u\n", (unsigned)numVars,
+           (unsigned)iterations, (unsigned)sectorSize);
+    printf("erases: %u total, %.3f per change, %u on the most worn sector\n",
+           (unsigned)erases, (double)erases / iterations,
+           (unsigned)stats.maxSectorErases);
+    printf("writes: %u bytes total, %.1f bytes per change\n", (unsigned)bytes,
+           (double)bytes / iterations);
+
+    NotecardEnvVarManager_free(man);
+    NotecardEnvVarFileStorage_close(fs);
+    NotecardEmulator_free(emu);
+    remove(path);
+
+    return 0;
+}
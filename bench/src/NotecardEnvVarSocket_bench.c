@@ -0,0 +1,342 @@
+/*!
+ * @file NotecardEnvVarSocket_bench.c
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+// Load generator for the query socket. The service runs on its own thread
+// against the emulated Notecard, as the gateway daemon would.
+//
+// First, the client threads send batched GETs back to back and the
+// benchmark reports queries per second. Then the subscribers all subscribe
+// to one variable, which is changed once per round, and the benchmark
+// reports the fan-out latency from the service's notify to each subscriber
+// receiving the change.
+//
+// Usage: NotecardEnvVarSocket_bench [numVars] [batch] [clients] [seconds]
+//                                   [subscribers] [rounds]
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "note-c/note.h"
+
+#include "NotecardEmulator.h"
+#include "NotecardEnvVarManager.h"
+#include "NotecardEnvVarSocket.h"
+
+static const char *path = "nevm_socket_bench.sock";
+
+static NotecardEmulator *emu;
+static NotecardEnvVarManager *man;
+static NotecardEnvVarSocket *sock;
+
+static size_t numVars;
+static size_t batch;
+static double seconds;
+
+// Set by the main thread to stop the service thread, and to ask it for a
+// change of var_0000.
+static int stop;
+static int changeRequested;
+// The time of the last notify in ns, written by the service thread.
+static uint64_t notifyNs;
+
+static double nowUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static uint64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void userCb(const char *var, const char *val, void *ctx)
+{
+    uint32_t *before = (uint32_t *)ctx;
+    uint32_t generation;
+
+    if (NotecardEnvVarManager_getVarGeneration(man, var, &generation)
+            == NEVM_SUCCESS && generation > *before) {
+        __atomic_store_n(&notifyNs, nowNs(), __ATOMIC_RELEASE);
+        NotecardEnvVarSocket_notify(sock, var, val);
+    }
+}
+
+static void *serviceThread(void *arg)
+{
+    uint32_t round = 0;
+    (void)arg;
+
+    while (!__atomic_load_n(&stop, __ATOMIC_ACQUIRE)) {
+        NotecardEnvVarSocket_poll(sock, 1);
+
+        if (__atomic_exchange_n(&changeRequested, 0, __ATOMIC_ACQ_REL)) {
+            char val[32];
+            snprintf(val, sizeof(val), "round_%u", (unsigned)++round);
+            NotecardEmulator_setHubVar(emu, "var_0000", val);
+
+            uint32_t before = NotecardEnvVarManager_getGeneration(man);
+            NotecardEnvVarManager_setEnvVarCb(man, userCb, &before);
+            NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL);
+        }
+    }
+
+    return NULL;
+}
+
+static int connectClient(void)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+
+    return fd;
+}
+
+static void *queryThread(void *arg)
+{
+    size_t *queries = (size_t *)arg;
+    int fd = connectClient();
+    if (fd < 0) {
+        return NULL;
+    }
+
+    // GET var_0000 var_0001 ... var_<batch - 1>
+    char *req = (char *)malloc(4 + batch * 9 + 1);
+    char *p = req + sprintf(req, "GET");
+    for (size_t i = 0; i < batch; ++i) {
+        p += sprintf(p, " var_%04u", (unsigned)(i % numVars));
+    }
+    *p++ = '\n';
+    size_t reqLen = (size_t)(p - req);
+
+    char rsp[4096];
+    double end = nowUs() + seconds * 1e6;
+    while (nowUs() < end) {
+        if (send(fd, req, reqLen, 0) != (ssize_t)reqLen) {
+            break;
+        }
+        // Values never contain "END\n", so the reply is complete once it
+        // ends with it.
+        size_t len = 0;
+        for (;;) {
+            ssize_t n = recv(fd, rsp + len, sizeof(rsp) - len, 0);
+            if (n <= 0) {
+                goto done;
+            }
+            len += (size_t)n;
+            if (len >= 4 && memcmp(rsp + len - 4, "END\n", 4) == 0) {
+                break;
+            }
+            if (len > sizeof(rsp) - 4) {
+                memmove(rsp, rsp + len - 4, 4);
+                len = 4;
+            }
+        }
+        ++*queries;
+    }
+
+done:
+    free(req);
+    close(fd);
+
+    return NULL;
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+
+    return da < db ? -1 : da > db;
+}
+
+static int runQueries(size_t clients)
+{
+    pthread_t *threads = (pthread_t *)calloc(clients, sizeof(pthread_t));
+    size_t *queries = (size_t *)calloc(clients, sizeof(size_t));
+    if (threads == NULL || queries == NULL) {
+        return 1;
+    }
+
+    double start = nowUs();
+    for (size_t i = 0; i < clients; ++i) {
+        pthread_create(&threads[i], NULL, queryThread, &queries[i]);
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < clients; ++i) {
+        pthread_join(threads[i], NULL);
+        total += queries[i];
+    }
+    double elapsed = (nowUs() - start) / 1e6;
+
+    printf("queries: %.0f GET/s, %.0f lookups/s (%u clients, batch %u)\n",
+           total / elapsed, total * batch / elapsed, (unsigned)clients,
+           (unsigned)batch);
+    free(threads);
+    free(queries);
+
+    return 0;
+}
+
+static int runFanOut(size_t subscribers, size_t rounds)
+{
+    int *fds = (int *)calloc(subscribers, sizeof(int));
+    double *latencies = (double *)calloc(subscribers * rounds,
+                                         sizeof(double));
+    int epollFd = epoll_create1(0);
+    if (fds == NULL || latencies == NULL || epollFd < 0) {
+        return 1;
+    }
+
+    char buf[256];
+    for (size_t i = 0; i < subscribers; ++i) {
+        fds[i] = connectClient();
+        if (fds[i] < 0 || send(fds[i], "SUB var_0000\n", 13, 0) != 13 ||
+                recv(fds[i], buf, sizeof(buf), 0) != 3) {
+            fprintf(stderr, "Subscriber %u failed.\n", (unsigned)i);
+            return 1;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = i;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fds[i], &ev);
+    }
+
+    size_t numLatencies = 0;
+    struct epoll_event events[64];
+    for (size_t r = 0; r < rounds; ++r) {
+        __atomic_store_n(&changeRequested, 1, __ATOMIC_RELEASE);
+
+        size_t received = 0;
+        while (received < subscribers) {
+            int n = epoll_wait(epollFd, events, 64, 1000);
+            if (n <= 0) {
+                fprintf(stderr, "Round %u timed out.\n", (unsigned)r);
+                return 1;
+            }
+            uint64_t now = nowNs();
+            uint64_t sent = __atomic_load_n(&notifyNs, __ATOMIC_ACQUIRE);
+            for (int i = 0; i < n; ++i) {
+                // Each notification fits in one read.
+                if (recv(fds[events[i].data.u64], buf, sizeof(buf), 0) > 0) {
+                    latencies[numLatencies++] = (now - sent) / 1e3;
+                    ++received;
+                }
+            }
+        }
+    }
+
+    qsort(latencies, numLatencies, sizeof(double), compareDoubles);
+    printf("fan-out: %u subscribers, %u rounds, latency p50 %.1f us, "
+           "p99 %.1f us, max %.1f us\n", (unsigned)subscribers,
+           (unsigned)rounds, latencies[numLatencies / 2],
+           latencies[numLatencies * 99 / 100], latencies[numLatencies - 1]);
+
+    for (size_t i = 0; i < subscribers; ++i) {
+        close(fds[i]);
+    }
+    close(epollFd);
+    free(fds);
+    free(latencies);
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    numVars = argc > 1 ? strtoul(argv[1], NULL, 10) : 256;
+    batch = argc > 2 ? strtoul(argv[2], NULL, 10) : 16;
+    size_t clients = argc > 3 ? strtoul(argv[3], NULL, 10) : 4;
+    seconds = argc > 4 ? strtod(argv[4], NULL) : 2;
+    size_t subscribers = argc > 5 ? strtoul(argv[5], NULL, 10) : 1000;
+    size_t rounds = argc > 6 ? strtoul(argv[6], NULL, 10) : 100;
+    if (numVars == 0 || batch == 0 || batch > 256 || subscribers == 0 ||
+            rounds == 0) {
+        fprintf(stderr, "Invalid arguments.\n");
+        return 1;
+    }
+
+    // Each subscriber takes a descriptor on both ends.
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    NoteSetFnDefault(malloc, free, NotecardEmulator_delayMs,
+                     NotecardEmulator_getMs);
+
+    emu = NotecardEmulator_alloc();
+    man = NotecardEnvVarManager_alloc();
+    if (emu == NULL || man == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+
+    char name[16];
+    char val[32];
+    for (size_t i = 0; i < numVars; ++i) {
+        snprintf(name, sizeof(name), "var_%04u", (unsigned)i);
+        snprintf(val, sizeof(val), "value_%u", (unsigned)i);
+        NotecardEmulator_setHubVar(emu, name, val);
+    }
+    NotecardEmulator_attach(emu);
+
+    uint32_t before = 0;
+    NotecardEnvVarManager_setEnvVarCb(man, userCb, &before);
+    sock = NotecardEnvVarSocket_open(path, man);
+    if (sock == NULL ||
+            NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL)
+            != NEVM_SUCCESS) {
+        fprintf(stderr, "Setup failed.\n");
+        return 1;
+    }
+
+    pthread_t service;
+    pthread_create(&service, NULL, serviceThread, NULL);
+    int ret = runQueries(clients);
+    if (ret == 0) {
+        ret = runFanOut(subscribers, rounds);
+    }
+    __atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+    pthread_join(service, NULL);
+
+    NotecardEnvVarSocket_close(sock);
+    NotecardEnvVarManager_free(man);
+    NotecardEmulator_free(emu);
+
+    return ret;
+}
@@ -15,6 +15,9 @@
 #define HUB_SET_RETRY_SECONDS 5
 // Fetch every 20 seconds.
 #define FETCH_INTERVAL_MS (20 * 1000)
+// Deliver at most 4 variables or 1 ms worth of callbacks per loop().
+#define DISPATCH_MAX_PAIRS 4
+#define DISPATCH_MAX_US 1000
 
 // A struct to cache the values of environment variables.
 typedef struct {
@@ -60,6 +63,26 @@ void envVarManagerCb(const char *var, const char *val, void *userCtx)
     Serial.println(envVarCache.valueC);
 }
 
+void envVarRemovedCb(const char *var, void *userCtx)
+{
+    EnvVarCache *cache = (EnvVarCache *)userCtx;
+
+    Serial.print("\nVariable \"");
+    Serial.print(var);
+    Serial.println("\" was deleted.");
+
+    // Clear the cached value of a deleted variable.
+    if (strcmp(var, "variable_a") == 0) {
+        cache->valueA[0] = '\0';
+    }
+    else if (strcmp(var, "variable_b") == 0) {
+        cache->valueB[0] = '\0';
+    }
+    else if (strcmp(var, "variable_c") == 0) {
+        cache->valueC[0] = '\0';
+    }
+}
+
 // These are the environment variables we'll be fetching from the Notecard.
 const char *envVars[] = {
     "variable_a",
@@ -70,6 +93,11 @@ static const size_t numEnvVars = sizeof(envVars) / sizeof(envVars[0]);
 
 static bool failure = false;
 
+uint32_t microsFn(void)
+{
+    return micros();
+}
+
 void setup()
 {
     Serial.begin(115200);
@@ -123,6 +151,23 @@ void setup()
         failure = true;
         return;
     }
+
+    // Clear cached values when their variables are deleted.
+    if (NotecardEnvVarManager_setEnvVarRemovedCb(envVarManager,
+        envVarRemovedCb, &envVarCache) != NEVM_SUCCESS) {
+        Serial.println("Failed to set env var manager removal callback.");
+        failure = true;
+        return;
+    }
+
+    // Queue fetched variables and deliver them a few at a time from loop(),
+    // so that a large fetch doesn't stall the rest of the loop.
+    if (NotecardEnvVarManager_setDispatchBudget(envVarManager,
+        DISPATCH_MAX_PAIRS, DISPATCH_MAX_US, microsFn) != NEVM_SUCCESS) {
+        Serial.println("Failed to set env var manager dispatch budget.");
+        failure = true;
+        return;
+    }
 }
 
 void loop()
@@ -147,4 +192,7 @@ void loop()
             Serial.println("NotecardEnvVarManager_fetch failed.");
         }
     }
+
+    // Deliver the next slice of fetched variables to the callbacks.
+    NotecardEnvVarManager_service(envVarManager);
 }
@@ -0,0 +1,488 @@
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarAsyncSerial.h"
+
+// The Notecard's serial receive buffer is small, so, like note-c, requests
+// are sent in segments with a pause between them.
+#define NEVM_ASYNC_SERIAL_SEGMENT_LEN      250
+#define NEVM_ASYNC_SERIAL_SEGMENT_DELAY_MS 250
+// The longest response line accepted.
+#define NEVM_ASYNC_SERIAL_MAX_RSP (1024 * 1024)
+
+typedef struct nevmAsyncFetch {
+    NotecardEnvVarManager *man;
+    const char **vars;
+    size_t numVars;
+    NotecardEnvVarAsyncSerialDoneCb doneCb;
+    void *ctx;
+
+    // The request line, including its newline.
+    uint32_t id;
+    char *tx;
+    size_t txLen;
+    // The response, once the fetch is on the ready queue. NULL on failure.
+    J *rsp;
+
+    struct nevmAsyncFetch *next;
+} nevmAsyncFetch;
+
+struct NotecardEnvVarAsyncSerial {
+    int fd;
+    uint32_t timeoutMs;
+    uint32_t nextId;
+
+    // Queued fetches. head is the one in flight once started is set.
+    nevmAsyncFetch *head;
+    nevmAsyncFetch *tail;
+    size_t numPending;
+    bool started;
+    uint32_t startMs;
+    size_t txPos;
+    // Where the current segment ends, and when the next one may be sent.
+    size_t segEnd;
+    uint32_t segReadyMs;
+
+    // Completed fetches whose response hasn't been applied and whose done
+    // callback hasn't been called yet.
+    nevmAsyncFetch *readyHead;
+    nevmAsyncFetch *readyTail;
+    bool draining;
+    // Set once NotecardEnvVarAsyncSerial_free is called.
+    bool closing;
+
+    // Received bytes not yet forming a complete line.
+    char *rx;
+    size_t rxLen;
+    size_t rxCap;
+};
+
+// Completing a fetch never calls back into the application. The fetch is
+// moved to a ready queue, taking its response (NULL on failure) with it, so
+// the next one can start, and the queue is drained at the end of
+// NotecardEnvVarAsyncSerial_handle and in NotecardEnvVarAsyncSerial_free,
+// once the transport is done with its buffers. The manager's callbacks and the
+// done callback can therefore queue fetches, call
+// NotecardEnvVarAsyncSerial_handle or free the transport, as a resumed
+// coroutine might, without pulling state out from under a read in progress.
+
+/**
+ * Internal function to move the fetch in flight to the ready queue.
+ */
+static void _complete(NotecardEnvVarAsyncSerial *serial, J *rsp)
+{
+    nevmAsyncFetch *fetch = serial->head;
+
+    serial->head = fetch->next;
+    if (serial->head == NULL) {
+        serial->tail = NULL;
+    }
+    --serial->numPending;
+    serial->started = false;
+
+    fetch->rsp = rsp;
+    fetch->next = NULL;
+    if (serial->readyTail != NULL) {
+        serial->readyTail->next = fetch;
+    } else {
+        serial->readyHead = fetch;
+    }
+    serial->readyTail = fetch;
+}
+
+/**
+ * Internal function to apply the responses of the fetches on the ready queue
+ * and call their done callbacks, then free the transport if it's closing. A
+ * callback that calls NotecardEnvVarAsyncSerial_handle or
+ * NotecardEnvVarAsyncSerial_free leaves the rest of the queue, and the
+ * freeing, to the drain already running.
+ */
+static void _drain(NotecardEnvVarAsyncSerial *serial)
+{
+    if (serial->draining) {
+        return;
+    }
+
+    serial->draining = true;
+    while (serial->readyHead != NULL) {
+        nevmAsyncFetch *fetch = serial->readyHead;
+        serial->readyHead = fetch->next;
+        if (serial->readyHead == NULL) {
+            serial->readyTail = NULL;
+        }
+
+        int ret = NotecardEnvVarManager_applyFetchResponse(fetch->man,
+                  fetch->rsp, fetch->vars, fetch->numVars);
+        JDelete(fetch->rsp);
+        if (fetch->doneCb != NULL) {
+            fetch->doneCb(fetch->man, ret, fetch->ctx);
+        }
+        free(fetch->tx);
+        free(fetch);
+    }
+    serial->draining = false;
+
+    if (serial->closing) {
+        free(serial->rx);
+        free(serial);
+    }
+}
+
+static void _write(NotecardEnvVarAsyncSerial *serial, uint32_t nowMs)
+{
+    nevmAsyncFetch *fetch = serial->head;
+
+    while (serial->txPos < fetch->txLen) {
+        if (serial->txPos == serial->segEnd) {
+            if ((int32_t)(nowMs - serial->segReadyMs) < 0) {
+                return;
+            }
+            serial->segEnd += NEVM_ASYNC_SERIAL_SEGMENT_LEN;
+            if (serial->segEnd > fetch->txLen) {
+                serial->segEnd = fetch->txLen;
+            }
+        }
+
+        ssize_t n = write(serial->fd, fetch->tx + serial->txPos,
+                          serial->segEnd - serial->txPos);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            // The device is full, or failed and the fetch will time out.
+            return;
+        }
+        serial->txPos += (size_t)n;
+        if (serial->txPos == serial->segEnd) {
+            serial->segReadyMs = nowMs + NEVM_ASYNC_SERIAL_SEGMENT_DELAY_MS;
+        }
+    }
+}
+
+static void _handleLine(NotecardEnvVarAsyncSerial *serial, char *line,
+                        size_t len)
+{
+    if (len > 0 && line[len - 1] == '\r') {
+        --len;
+    }
+    line[len] = '\0';
+
+    // Only a complete request can have been answered.
+    if (serial->head == NULL || !serial->started ||
+            serial->txPos < serial->head->txLen || len == 0) {
+        return;
+    }
+
+    J *rsp = JParse(line);
+    if (rsp == NULL) {
+        return;
+    }
+    if ((uint32_t)JGetInt(rsp, "id") == serial->head->id) {
+        _complete(serial, rsp);
+    } else {
+        JDelete(rsp);
+    }
+}
+
+static void _read(NotecardEnvVarAsyncSerial *serial)
+{
+    for (;;) {
+        if (serial->rxCap - serial->rxLen < 256) {
+            size_t cap = serial->rxCap ? serial->rxCap * 2 : 1024;
+            char *rx = (cap <= NEVM_ASYNC_SERIAL_MAX_RSP) ?
+                       (char *)realloc(serial->rx, cap) : NULL;
+            if (rx == NULL) {
+                if (serial->rxCap < 256) {
+                    return;
+                }
+                // Drop the overlong line. The fetch will time out.
+                serial->rxLen = 0;
+                continue;
+            }
+            serial->rx = rx;
+            serial->rxCap = cap;
+        }
+
+        // Leave room for a terminator.
+        ssize_t n = read(serial->fd, serial->rx + serial->rxLen,
+                         serial->rxCap - serial->rxLen - 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+
+        size_t start = 0;
+        size_t end = serial->rxLen + (size_t)n;
+        for (size_t i = serial->rxLen; i < end; ++i) {
+            if (serial->rx[i] == '\n') {
+                _handleLine(serial, serial->rx + start, i - start);
+                start = i + 1;
+            }
+        }
+        memmove(serial->rx, serial->rx + start, end - start);
+        serial->rxLen = end - start;
+    }
+}
+
+/**
+ * Create a transport on an open serial device, such as one opened with
+ * NotecardEnvVarSerial_openDevice. The descriptor must be non-blocking, and
+ * stays owned by the caller.
+ *
+ * @param fd        The device's file descriptor.
+ * @param timeoutMs How long a fetch may take once its request starts being
+ *                  sent.
+ *
+ * @return A valid pointer on success and NULL on failure.
+ */
+NotecardEnvVarAsyncSerial *NotecardEnvVarAsyncSerial_alloc(int fd,
+        uint32_t timeoutMs)
+{
+    if (fd < 0 || timeoutMs == 0) {
+        return NULL;
+    }
+
+    NotecardEnvVarAsyncSerial *serial = (NotecardEnvVarAsyncSerial *)calloc(1,
+                                        sizeof(*serial));
+    if (serial != NULL) {
+        serial->fd = fd;
+        serial->timeoutMs = timeoutMs;
+        serial->nextId = 1;
+    }
+
+    return serial;
+}
+
+/**
+ * Get the device's file descriptor, for registering with the event loop.
+ *
+ * @param serial Pointer to a transport.
+ *
+ * @return The descriptor, or -1 if serial is NULL.
+ */
+int NotecardEnvVarAsyncSerial_fd(const NotecardEnvVarAsyncSerial *serial)
+{
+    return serial != NULL ? serial->fd : -1;
+}
+
+/**
+ * Get the events to wait for on the device's descriptor. These change as
+ * fetches progress, so re-check them after each call to
+ * NotecardEnvVarAsyncSerial_fetch or NotecardEnvVarAsyncSerial_handle.
+ *
+ * @param serial Pointer to a transport.
+ *
+ * @return EPOLLIN, plus EPOLLOUT while a request is ready to be sent. These
+ *         have the same values as poll's POLLIN and POLLOUT.
+ */
+uint32_t NotecardEnvVarAsyncSerial_events(
+    const NotecardEnvVarAsyncSerial *serial)
+{
+    if (serial == NULL) {
+        return 0;
+    }
+
+    // Between segments, the timeout covers the pause instead.
+    bool sending = serial->head != NULL &&
+                   (!serial->started || serial->txPos < serial->segEnd);
+
+    return EPOLLIN | (sending ? EPOLLOUT : 0);
+}
+
+/**
+ * Get how long the event loop may wait before calling
+ * NotecardEnvVarAsyncSerial_handle again, to time out the fetch in flight or
+ * send the next segment of its request.
+ *
+ * @param serial Pointer to a transport.
+ * @param nowMs  The current time in milliseconds.
+ *
+ * @return The time in milliseconds, or -1 if nothing is in flight.
+ */
+int NotecardEnvVarAsyncSerial_timeout(const NotecardEnvVarAsyncSerial *serial,
+                                      uint32_t nowMs)
+{
+    if (serial == NULL || serial->head == NULL) {
+        return -1;
+    }
+    if (!serial->started) {
+        return 0;
+    }
+
+    uint32_t elapsed = nowMs - serial->startMs;
+    uint32_t wait = elapsed < serial->timeoutMs ? serial->timeoutMs - elapsed
+                    : 0;
+    if (serial->txPos < serial->head->txLen &&
+            serial->txPos == serial->segEnd) {
+        int32_t untilSegment = (int32_t)(serial->segReadyMs - nowMs);
+        if (untilSegment < 0) {
+            untilSegment = 0;
+        }
+        if ((uint32_t)untilSegment < wait) {
+            wait = (uint32_t)untilSegment;
+        }
+    }
+
+    return wait > INT32_MAX ? INT32_MAX : (int)wait;
+}
+
+/**
+ * Queue a fetch. Its request is sent once the fetches queued before it have
+ * completed, and doneCb is called when it completes, from
+ * NotecardEnvVarAsyncSerial_handle or NotecardEnvVarAsyncSerial_free. A fetch
+ * queued from a done callback is sent on the next call to
+ * NotecardEnvVarAsyncSerial_handle, and once NotecardEnvVarAsyncSerial_free
+ * has been called, fetches can't be queued, so that freeing finishes even if
+ * the callbacks keep fetching.
+ *
+ * @param serial  Pointer to a transport.
+ * @param man     Pointer to the manager to fetch for. A manager can only have
+ *                one fetch queued at a time.
+ * @param vars    Pointer to an array of C-strings of variables to fetch,
+ *                which must stay valid until the fetch completes.
+ * @param numVars The number of variable strings in vars, or NEVM_ENV_VAR_ALL.
+ * @param doneCb  Called when the fetch completes. Can be NULL.
+ * @param ctx     Pointer passed to doneCb.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarAsyncSerial_fetch(NotecardEnvVarAsyncSerial *serial,
+                                    NotecardEnvVarManager *man,
+                                    const char **vars, size_t numVars,
+                                    NotecardEnvVarAsyncSerialDoneCb doneCb,
+                                    void *ctx)
+{
+    if (serial == NULL || man == NULL || serial->closing) {
+        return NEVM_FAILURE;
+    }
+
+    nevmAsyncFetch *fetch = (nevmAsyncFetch *)calloc(1, sizeof(*fetch));
+    J *req = NotecardEnvVarManager_buildFetchRequest(man, vars, numVars);
+    if (fetch == NULL || req == NULL) {
+        free(fetch);
+        JDelete(req);
+        return NEVM_FAILURE;
+    }
+    fetch->man = man;
+    fetch->vars = vars;
+    fetch->numVars = numVars;
+    fetch->doneCb = doneCb;
+    fetch->ctx = ctx;
+    fetch->id = serial->nextId++;
+    if (serial->nextId == 0) {
+        serial->nextId = 1;
+    }
+
+    JAddNumberToObject(req, "id", fetch->id);
+    char *json = JPrintUnformatted(req);
+    JDelete(req);
+    if (json != NULL) {
+        fetch->txLen = strlen(json) + 1;
+        fetch->tx = (char *)malloc(fetch->txLen);
+        if (fetch->tx != NULL) {
+            memcpy(fetch->tx, json, fetch->txLen - 1);
+            fetch->tx[fetch->txLen - 1] = '\n';
+        }
+        JFree(json);
+    }
+    if (fetch->tx == NULL) {
+        free(fetch);
+        return NEVM_FAILURE;
+    }
+
+    if (serial->tail != NULL) {
+        serial->tail->next = fetch;
+    } else {
+        serial->head = fetch;
+    }
+    serial->tail = fetch;
+    ++serial->numPending;
+
+    return NEVM_SUCCESS;
+}
+
+/**
+ * Make progress: send requests, read responses and complete fetches that got
+ * their response or timed out. Call this when the device's descriptor is
+ * ready or the timeout from NotecardEnvVarAsyncSerial_timeout has passed.
+ * The completed fetches' callbacks are called last, after which the transport
+ * isn't touched, so they may free it.
+ *
+ * @param serial  Pointer to a transport.
+ * @param revents The events that occurred on the descriptor, if any.
+ * @param nowMs   The current time in milliseconds.
+ */
+void NotecardEnvVarAsyncSerial_handle(NotecardEnvVarAsyncSerial *serial,
+                                      uint32_t revents, uint32_t nowMs)
+{
+    if (serial == NULL || serial->closing) {
+        return;
+    }
+
+    if (revents & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        _read(serial);
+    }
+
+    // A completed fetch starts the next one right away.
+    while (serial->head != NULL) {
+        if (!serial->started) {
+            serial->started = true;
+            serial->startMs = nowMs;
+            serial->txPos = 0;
+            serial->segEnd = 0;
+            serial->segReadyMs = nowMs;
+        }
+        _write(serial, nowMs);
+
+        if (nowMs - serial->startMs < serial->timeoutMs) {
+            break;
+        }
+        _complete(serial, NULL);
+    }
+
+    _drain(serial);
+}
+
+/**
+ * Get the number of fetches queued or in flight.
+ *
+ * @param serial Pointer to a transport.
+ *
+ * @return The number of fetches, or 0 if serial is NULL.
+ */
+size_t NotecardEnvVarAsyncSerial_pending(
+    const NotecardEnvVarAsyncSerial *serial)
+{
+    return serial != NULL ? serial->numPending : 0;
+}
+
+/**
+ * Free a transport. Fetches still queued are completed with NEVM_FAILURE, and
+ * fetches their callbacks try to queue fail right away. The device's
+ * descriptor isn't closed. When called from a done callback, the transport is
+ * freed once the callbacks still due have been called.
+ *
+ * @param serial Pointer to a transport.
+ */
+void NotecardEnvVarAsyncSerial_free(NotecardEnvVarAsyncSerial *serial)
+{
+    if (serial == NULL || serial->closing) {
+        return;
+    }
+
+    serial->closing = true;
+    while (serial->head != NULL) {
+        _complete(serial, NULL);
+    }
+    _drain(serial);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "NotecardEnvVarManager.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A non-blocking Notecard serial transport for event loops. Instead of
+// blocking in note-c's transaction, NotecardEnvVarAsyncSerial_fetch queues
+// the fetch's request and returns, and the event loop drives the exchange by
+// calling NotecardEnvVarAsyncSerial_handle whenever the device's descriptor
+// is ready. One thread can run fetches for any number of managers, on any
+// number of Notecards, alongside its other I/O.
+//
+// Fetches on one transport run one at a time, in the order they were queued.
+// Each request carries an id, and responses that don't match the request in
+// flight (e.g. a late answer to one that timed out) are discarded.
+//
+// Typical use with epoll:
+//
+//   struct epoll_event ev = {NotecardEnvVarAsyncSerial_events(serial), ...};
+//   epoll_ctl(epollFd, EPOLL_CTL_ADD, NotecardEnvVarAsyncSerial_fd(serial),
+//             &ev);
+//   NotecardEnvVarAsyncSerial_fetch(serial, man, NULL, NEVM_ENV_VAR_ALL,
+//                                   doneCb, ctx);
+//   for (;;) {
+//       // Update the registration if NotecardEnvVarAsyncSerial_events
+//       // changed.
+//       int n = epoll_wait(epollFd, events, maxEvents,
+//                          NotecardEnvVarAsyncSerial_timeout(serial, now));
+//       NotecardEnvVarAsyncSerial_handle(serial, revents, now);
+//   }
+
+struct NotecardEnvVarAsyncSerial;
+typedef struct NotecardEnvVarAsyncSerial NotecardEnvVarAsyncSerial;
+
+// Called when a fetch completes, with NEVM_SUCCESS or NEVM_FAILURE (including
+// on a timeout). The manager's callbacks have already been called. It's only
+// called at the end of NotecardEnvVarAsyncSerial_handle, or from
+// NotecardEnvVarAsyncSerial_free, so it may queue fetches or free the
+// transport.
+typedef void (*NotecardEnvVarAsyncSerialDoneCb)(NotecardEnvVarManager *man,
+        int result, void *ctx);
+
+NotecardEnvVarAsyncSerial *NotecardEnvVarAsyncSerial_alloc(int fd,
+        uint32_t timeoutMs);
+int NotecardEnvVarAsyncSerial_fd(const NotecardEnvVarAsyncSerial *serial);
+uint32_t NotecardEnvVarAsyncSerial_events(
+    const NotecardEnvVarAsyncSerial *serial);
+int NotecardEnvVarAsyncSerial_timeout(const NotecardEnvVarAsyncSerial *serial,
+                                      uint32_t nowMs);
+int NotecardEnvVarAsyncSerial_fetch(NotecardEnvVarAsyncSerial *serial,
+                                    NotecardEnvVarManager *man,
+                                    const char **vars, size_t numVars,
+                                    NotecardEnvVarAsyncSerialDoneCb doneCb,
+                                    void *ctx);
+void NotecardEnvVarAsyncSerial_handle(NotecardEnvVarAsyncSerial *serial,
+                                      uint32_t revents, uint32_t nowMs);
+size_t NotecardEnvVarAsyncSerial_pending(
+    const NotecardEnvVarAsyncSerial *serial);
+void NotecardEnvVarAsyncSerial_free(NotecardEnvVarAsyncSerial *serial);
+
+#ifdef __cplusplus
+}
+#endif
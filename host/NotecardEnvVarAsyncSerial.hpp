@@ -0,0 +1,190 @@
+#pragma once
+
+// C++20 coroutine layer over NotecardEnvVarAsyncSerial. Inside a coroutine,
+//
+//   int ret = co_await serial.fetch(manager, vars, numVars);
+//
+// queues the fetch and suspends the coroutine until it completes. The
+// coroutine is resumed from nevm::AsyncSerial::handle, on the event loop's
+// thread, after the manager's callbacks have been called. Any number of
+// coroutines can wait on one transport, each costing only its frame, so
+// thousands of consumers can share the event loop's thread instead of each
+// blocking a thread of its own in a transaction.
+//
+// nevm::Task is a minimal coroutine type for this: it starts running when
+// called, and its frame is freed when it finishes.
+
+#if __cplusplus < 202002L
+#error "NotecardEnvVarAsyncSerial.hpp requires C++20."
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+#include "NotecardEnvVarAsyncSerial.h"
+#include "NotecardEnvVarManager.hpp"
+
+namespace nevm
+{
+
+class Task
+{
+public:
+    struct promise_type {
+        Task get_return_object() noexcept
+        {
+            return {};
+        }
+        std::suspend_never initial_suspend() noexcept
+        {
+            return {};
+        }
+        std::suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept
+        {
+            std::terminate();
+        }
+    };
+};
+
+// Awaiting a fetch yields NEVM_SUCCESS or NEVM_FAILURE. If the fetch can't be
+// queued, the coroutine isn't suspended and gets NEVM_FAILURE right away.
+class FetchAwaiter
+{
+public:
+    FetchAwaiter(NotecardEnvVarAsyncSerial *serial, NotecardEnvVarManager *man,
+                 const char **vars, size_t numVars) noexcept
+        : serial_(serial), man_(man), vars_(vars), numVars_(numVars) {}
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) noexcept
+    {
+        handle_ = handle;
+        return NotecardEnvVarAsyncSerial_fetch(serial_, man_, vars_, numVars_,
+                                               done, this) == NEVM_SUCCESS;
+    }
+
+    int await_resume() const noexcept
+    {
+        return result_;
+    }
+
+private:
+    // Resumes the coroutine. The transport only calls this from the ready
+    // queue it drains at the end of NotecardEnvVarAsyncSerial_handle (and in
+    // NotecardEnvVarAsyncSerial_free), once it's done with its own state, so
+    // the coroutine may await another fetch, or destroy the AsyncSerial,
+    // before it suspends again.
+    static void done(NotecardEnvVarManager *man, int result, void *ctx)
+    {
+        (void)man;
+
+        FetchAwaiter *self = static_cast<FetchAwaiter *>(ctx);
+        self->result_ = result;
+        self->handle_.resume();
+    }
+
+    NotecardEnvVarAsyncSerial *serial_;
+    NotecardEnvVarManager *man_;
+    const char **vars_;
+    size_t numVars_;
+    std::coroutine_handle<> handle_;
+    int result_ = NEVM_FAILURE;
+};
+
+// Owns a NotecardEnvVarAsyncSerial. Destroying it resumes the coroutines
+// still waiting on it with NEVM_FAILURE.
+class AsyncSerial
+{
+public:
+    AsyncSerial(int fd, uint32_t timeoutMs) noexcept
+        : serial_(NotecardEnvVarAsyncSerial_alloc(fd, timeoutMs)) {}
+
+    // Resumes the coroutines still waiting with NEVM_FAILURE. Once teardown
+    // has started, fetches they await fail right away without suspending, so
+    // a coroutine that fetches again on failure can't keep the transport
+    // alive.
+    ~AsyncSerial()
+    {
+        NotecardEnvVarAsyncSerial_free(serial_);
+    }
+
+    AsyncSerial(const AsyncSerial &) = delete;
+    AsyncSerial &operator=(const AsyncSerial &) = delete;
+
+    AsyncSerial(AsyncSerial &&other) noexcept
+        : serial_(std::exchange(other.serial_, nullptr)) {}
+
+    AsyncSerial &operator=(AsyncSerial &&other) noexcept
+    {
+        if (this != &other) {
+            NotecardEnvVarAsyncSerial_free(serial_);
+            serial_ = std::exchange(other.serial_, nullptr);
+        }
+        return *this;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return serial_ != nullptr;
+    }
+
+    NotecardEnvVarAsyncSerial *get() const noexcept
+    {
+        return serial_;
+    }
+
+    // vars must stay valid until the fetch completes, which it does if it's
+    // declared in the awaiting coroutine.
+    FetchAwaiter fetch(NotecardEnvVarManager *man, const char **vars = nullptr,
+                       size_t numVars = NEVM_ENV_VAR_ALL) noexcept
+    {
+        return FetchAwaiter(serial_, man, vars, numVars);
+    }
+
+    FetchAwaiter fetch(Manager &man, const char **vars = nullptr,
+                       size_t numVars = NEVM_ENV_VAR_ALL) noexcept
+    {
+        return FetchAwaiter(serial_, man.get(), vars, numVars);
+    }
+
+    int fd() const noexcept
+    {
+        return NotecardEnvVarAsyncSerial_fd(serial_);
+    }
+
+    uint32_t events() const noexcept
+    {
+        return NotecardEnvVarAsyncSerial_events(serial_);
+    }
+
+    int timeout(uint32_t nowMs) const noexcept
+    {
+        return NotecardEnvVarAsyncSerial_timeout(serial_, nowMs);
+    }
+
+    // Resumes the coroutines whose fetches complete.
+    void handle(uint32_t revents, uint32_t nowMs) noexcept
+    {
+        NotecardEnvVarAsyncSerial_handle(serial_, revents, nowMs);
+    }
+
+    size_t pending() const noexcept
+    {
+        return NotecardEnvVarAsyncSerial_pending(serial_);
+    }
+
+private:
+    NotecardEnvVarAsyncSerial *serial_;
+};
+
+}
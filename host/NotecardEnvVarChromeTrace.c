@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "NotecardEnvVarChromeTrace.h"
+
+struct NotecardEnvVarChromeTrace {
+    FILE *file;
+    bool first;
+    int pid;
+};
+
+static const char *phaseNames[] = {
+    "fetch",
+    "_buildEnvGetRequest",
+    "transaction",
+    "body",
+    "callback"
+};
+
+static double _nowUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static void _writeEscaped(FILE *file, const char *str)
+{
+    for (; *str != '\0'; ++str) {
+        unsigned char ch = (unsigned char)*str;
+        if (ch == '"' || ch == '\\') {
+            fputc('\\', file);
+            fputc(ch, file);
+        } else if (ch < 0x20) {
+            fprintf(file, "\\u%04x", ch);
+        } else {
+            fputc(ch, file);
+        }
+    }
+}
+
+/**
+ * Open a trace file, truncating it if it exists.
+ *
+ * @param path The path of the trace file.
+ *
+ * @return A valid pointer to a NotecardEnvVarChromeTrace on success and NULL
+ *         on failure.
+ */
+NotecardEnvVarChromeTrace *NotecardEnvVarChromeTrace_open(const char *path)
+{
+    NotecardEnvVarChromeTrace *trace = (NotecardEnvVarChromeTrace *)malloc(
+                                           sizeof(*trace));
+    if (trace == NULL) {
+        return NULL;
+    }
+
+    trace->file = fopen(path, "w");
+    if (trace->file == NULL) {
+        free(trace);
+        return NULL;
+    }
+    trace->first = true;
+    trace->pid = (int)getpid();
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", trace->file);
+
+    return trace;
+}
+
+/**
+ * Complete the trace file and free the trace.
+ *
+ * @param trace Pointer to a NotecardEnvVarChromeTrace.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE if the file couldn't be
+ *         written.
+ */
+int NotecardEnvVarChromeTrace_close(NotecardEnvVarChromeTrace *trace)
+{
+    if (trace == NULL) {
+        return NEVM_FAILURE;
+    }
+
+    fputs("\n]}\n", trace->file);
+    int ret = (ferror(trace->file) || fclose(trace->file) != 0) ?
+              NEVM_FAILURE : NEVM_SUCCESS;
+    free(trace);
+
+    return ret;
+}
+
+/**
+ * Trace callback for NotecardEnvVarManager_setTraceCb. ctx must point to an
+ * open NotecardEnvVarChromeTrace. Each phase is written as a duration event
+ * pair ("B"/"E"), with the variable name as an argument of callback events.
+ */
+void NotecardEnvVarChromeTrace_cb(int phase, bool begin, const char *detail,
+                                  void *ctx)
+{
+    NotecardEnvVarChromeTrace *trace = (NotecardEnvVarChromeTrace *)ctx;
+    if (trace == NULL || phase < 0 ||
+            phase >= (int)(sizeof(phaseNames) / sizeof(phaseNames[0]))) {
+        return;
+    }
+
+    fprintf(trace->file,
+            "%s{\"name\":\"%s\",\"cat\":\"nevm\",\"ph\":\"%c\","
+            "\"ts\":%.3f,\"pid\":%d,\"tid\":1",
+            trace->first ? "" : ",\n", phaseNames[phase], begin ? 'B' : 'E',
+            _nowUs(), trace->pid);
+    if (detail != NULL) {
+        fputs(",\"args\":{\"var\":\"", trace->file);
+        _writeEscaped(trace->file, detail);
+        fputs("\"}", trace->file);
+    }
+    fputc('}', trace->file);
+    trace->first = false;
+}
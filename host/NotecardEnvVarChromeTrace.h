@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "NotecardEnvVarManager.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A host trace backend that writes the manager's trace events in the Chrome
+// trace_event JSON format, which can be loaded into Perfetto or
+// chrome://tracing. Open a trace, pass NotecardEnvVarChromeTrace_cb and the
+// trace to NotecardEnvVarManager_setTraceCb, and close the trace when done to
+// complete the file.
+
+struct NotecardEnvVarChromeTrace;
+typedef struct NotecardEnvVarChromeTrace NotecardEnvVarChromeTrace;
+
+NotecardEnvVarChromeTrace *NotecardEnvVarChromeTrace_open(const char *path);
+int NotecardEnvVarChromeTrace_close(NotecardEnvVarChromeTrace *trace);
+void NotecardEnvVarChromeTrace_cb(int phase, bool begin, const char *detail,
+                                  void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,316 @@
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarDaemon.h"
+#include "NotecardEnvVarFileStorage.h"
+#include "NotecardEnvVarSerial.h"
+#include "NotecardEnvVarShm.h"
+#include "NotecardEnvVarSocket.h"
+
+// The daemon waits between fetches in slices of this length, so that it
+// notices a stop request promptly.
+#define NEVM_DAEMON_SLEEP_SLICE_MS 100
+// The persistence file, which simulates two sectors of flash.
+#define NEVM_DAEMON_STORAGE_SECTOR_SIZE 4096
+#define NEVM_DAEMON_STORAGE_SIZE        (2 * NEVM_DAEMON_STORAGE_SECTOR_SIZE)
+
+struct NotecardEnvVarDaemon {
+    NotecardEnvVarDaemonConfig config;
+    NotecardEnvVarManager *man;
+    NotecardEnvVarShm *shm;
+    NotecardEnvVarSocket *sock;
+#ifdef NEVM_ENABLE_PERSIST
+    NotecardEnvVarFileStorage *storage;
+#endif
+
+    // The variable:value pairs of the snapshot being published, pointing into
+    // the manager's value store.
+    const char **vars;
+    const char **vals;
+    size_t numPairs;
+    size_t capPairs;
+    bool pairsFailed;
+
+    bool published;
+    uint32_t publishedGeneration;
+    // The manager's generation before the current fetch. Variables changed
+    // by the fetch have a later generation.
+    uint32_t fetchGeneration;
+};
+
+static void _envVarCb(const char *var, const char *val, void *ctx)
+{
+    NotecardEnvVarDaemon *daemon = (NotecardEnvVarDaemon *)ctx;
+    if (val == NULL || daemon->sock == NULL) {
+        return;
+    }
+
+    uint32_t generation;
+    if (NotecardEnvVarManager_getVarGeneration(daemon->man, var, &generation)
+            == NEVM_SUCCESS && generation > daemon->fetchGeneration) {
+        NotecardEnvVarSocket_notify(daemon->sock, var, val);
+    }
+}
+
+static void _addPair(const char *var, size_t varLen, const char *val,
+                     size_t valLen, void *ctx)
+{
+    (void)varLen;
+    (void)valLen;
+    NotecardEnvVarDaemon *daemon = (NotecardEnvVarDaemon *)ctx;
+
+    if (daemon->numPairs == daemon->capPairs) {
+        size_t cap = daemon->capPairs ? daemon->capPairs * 2 : 16;
+        const char **vars = (const char **)realloc(daemon->vars,
+                            cap * sizeof(char *));
+        if (vars != NULL) {
+            daemon->vars = vars;
+        }
+        const char **vals = (const char **)realloc(daemon->vals,
+                            cap * sizeof(char *));
+        if (vals != NULL) {
+            daemon->vals = vals;
+        }
+        if (vars == NULL || vals == NULL) {
+            daemon->pairsFailed = true;
+            return;
+        }
+        daemon->capPairs = cap;
+    }
+
+    daemon->vars[daemon->numPairs] = var;
+    daemon->vals[daemon->numPairs] = val;
+    ++daemon->numPairs;
+}
+
+/**
+ * Internal function to publish a snapshot of every value in the manager's
+ * store, so that defaults and restored values reach readers too, not just the
+ * values a fetch returned.
+ */
+static int _publish(NotecardEnvVarDaemon *daemon)
+{
+    daemon->numPairs = 0;
+    daemon->pairsFailed = false;
+    if (NotecardEnvVarManager_forEach(daemon->man, _addPair, daemon)
+            != NEVM_SUCCESS || daemon->pairsFailed) {
+        return NEVM_FAILURE;
+    }
+
+    uint32_t generation = NotecardEnvVarManager_getGeneration(daemon->man);
+    if (NotecardEnvVarShm_publish(daemon->shm, daemon->vars, daemon->vals,
+                                  daemon->numPairs, generation)
+            != NEVM_SUCCESS) {
+        return NEVM_FAILURE;
+    }
+    daemon->published = true;
+    daemon->publishedGeneration = generation;
+
+    return NEVM_SUCCESS;
+}
+
+static void _envVarRemovedCb(const char *var, void *ctx)
+{
+    NotecardEnvVarDaemon *daemon = (NotecardEnvVarDaemon *)ctx;
+
+    NotecardEnvVarSocket_notify(daemon->sock, var, NULL);
+}
+
+/**
+ * Create a daemon: open the Notecard's serial device, create the
+ * shared-memory segment and set up the manager. This installs the serial
+ * transport and real-time clock with note-c. The defaults, and the values
+ * persisted by the last run if the daemon has a storage file, are published
+ * right away, so readers have a configuration before the first fetch.
+ *
+ * @param config The daemon's configuration. The variable names must stay
+ *               valid for the daemon's lifetime.
+ *
+ * @return A valid pointer on success and NULL on failure.
+ */
+NotecardEnvVarDaemon *NotecardEnvVarDaemon_alloc(
+    const NotecardEnvVarDaemonConfig *config)
+{
+    if (config == NULL) {
+        return NULL;
+    }
+
+    NotecardEnvVarDaemon *daemon = (NotecardEnvVarDaemon *)calloc(1,
+                                   sizeof(*daemon));
+    if (daemon == NULL) {
+        return NULL;
+    }
+    daemon->config = *config;
+
+    NoteSetFnDefault(malloc, free, NotecardEnvVarSerial_delayMs,
+                     NotecardEnvVarSerial_getMs);
+    if (NotecardEnvVarSerial_open(config->device, config->baud)
+            != NEVM_SUCCESS) {
+        free(daemon);
+        return NULL;
+    }
+
+    daemon->shm = NotecardEnvVarShm_create(config->shmName, config->shmSize);
+    daemon->man = NotecardEnvVarManager_alloc();
+    if (daemon->shm == NULL || daemon->man == NULL ||
+            NotecardEnvVarManager_setEnvVarCb(daemon->man, _envVarCb, daemon)
+            != NEVM_SUCCESS) {
+        NotecardEnvVarDaemon_free(daemon);
+        return NULL;
+    }
+
+    if (config->socketPath != NULL) {
+        daemon->sock = NotecardEnvVarSocket_open(config->socketPath,
+                       daemon->man);
+        if (daemon->sock == NULL ||
+                NotecardEnvVarManager_setEnvVarRemovedCb(daemon->man,
+                        _envVarRemovedCb, daemon) != NEVM_SUCCESS) {
+            NotecardEnvVarDaemon_free(daemon);
+            return NULL;
+        }
+    }
+
+    if (config->numDefaults > 0 &&
+            NotecardEnvVarManager_setDefaults(daemon->man, config->defaultVars,
+                    config->defaultVals, config->numDefaults)
+            != NEVM_SUCCESS) {
+        NotecardEnvVarDaemon_free(daemon);
+        return NULL;
+    }
+#ifdef NEVM_ENABLE_PERSIST
+    if (config->storagePath != NULL) {
+        daemon->storage = NotecardEnvVarFileStorage_open(config->storagePath,
+                          NEVM_DAEMON_STORAGE_SIZE,
+                          NEVM_DAEMON_STORAGE_SECTOR_SIZE);
+        if (daemon->storage == NULL ||
+                NotecardEnvVarManager_setStorage(daemon->man,
+                        NotecardEnvVarFileStorage_storage(daemon->storage))
+                != NEVM_SUCCESS) {
+            NotecardEnvVarDaemon_free(daemon);
+            return NULL;
+        }
+        // There's nothing to restore on the first run.
+        NotecardEnvVarManager_restore(daemon->man);
+    }
+#endif
+
+    if (_publish(daemon) != NEVM_SUCCESS) {
+        NotecardEnvVarDaemon_free(daemon);
+        return NULL;
+    }
+
+    return daemon;
+}
+
+/**
+ * Fetch the variables once and publish them if they changed, pushing the
+ * changes to the query socket's subscribers. A failed fetch leaves the last
+ * published snapshot in place.
+ *
+ * @param daemon Pointer to a daemon.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarDaemon_step(NotecardEnvVarDaemon *daemon)
+{
+    if (daemon == NULL) {
+        return NEVM_FAILURE;
+    }
+
+    daemon->fetchGeneration = NotecardEnvVarManager_getGeneration(daemon->man);
+    if (NotecardEnvVarManager_fetch(daemon->man, daemon->config.vars,
+                                    daemon->config.numVars) != NEVM_SUCCESS) {
+        return NEVM_FAILURE;
+    }
+
+    // Fetches that don't change anything leave the segment untouched, so
+    // readers never retry because of them.
+    uint32_t generation = NotecardEnvVarManager_getGeneration(daemon->man);
+    if (daemon->published && generation == daemon->publishedGeneration) {
+        return NEVM_SUCCESS;
+    }
+
+    return _publish(daemon);
+}
+
+/**
+ * Serve the query socket for up to timeoutMs, or just wait that long if the
+ * daemon has no socket.
+ *
+ * @param daemon    Pointer to a daemon.
+ * @param timeoutMs How long to serve or wait.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarDaemon_poll(NotecardEnvVarDaemon *daemon, uint32_t timeoutMs)
+{
+    if (daemon == NULL) {
+        return NEVM_FAILURE;
+    }
+
+    if (daemon->sock == NULL) {
+        NotecardEnvVarSerial_delayMs(timeoutMs);
+        return NEVM_SUCCESS;
+    }
+
+    return NotecardEnvVarSocket_poll(daemon->sock, (int)timeoutMs);
+}
+
+/**
+ * Run the fetch schedule until *stop becomes non-zero, e.g. from a signal
+ * handler, serving the query socket between fetches. Failed fetches are
+ * retried at the next interval.
+ *
+ * @param daemon Pointer to a daemon.
+ * @param stop   Pointer to the stop flag.
+ *
+ * @return NEVM_SUCCESS once stopped and NEVM_FAILURE on invalid parameters.
+ */
+int NotecardEnvVarDaemon_run(NotecardEnvVarDaemon *daemon,
+                             volatile sig_atomic_t *stop)
+{
+    if (daemon == NULL || stop == NULL) {
+        return NEVM_FAILURE;
+    }
+
+    while (!*stop) {
+        NotecardEnvVarDaemon_step(daemon);
+
+        uint32_t start = NotecardEnvVarSerial_getMs();
+        while (!*stop &&
+                NotecardEnvVarSerial_getMs() - start < daemon->config.intervalMs) {
+            NotecardEnvVarDaemon_poll(daemon, NEVM_DAEMON_SLEEP_SLICE_MS);
+        }
+    }
+
+    return NEVM_SUCCESS;
+}
+
+/**
+ * Free a daemon, closing the serial device. The shared-memory segment keeps
+ * the last snapshot, so readers still see the last known values.
+ *
+ * @param daemon Pointer to a daemon.
+ */
+void NotecardEnvVarDaemon_free(NotecardEnvVarDaemon *daemon)
+{
+    if (daemon == NULL) {
+        return;
+    }
+
+    NotecardEnvVarSocket_close(daemon->sock);
+    NotecardEnvVarManager_free(daemon->man);
+#ifdef NEVM_ENABLE_PERSIST
+    NotecardEnvVarFileStorage_close(daemon->storage);
+#endif
+    NotecardEnvVarShm_close(daemon->shm);
+    NotecardEnvVarSerial_close();
+    free(daemon->vars);
+    free(daemon->vals);
+    free(daemon);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "NotecardEnvVarManager.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A Linux gateway daemon that owns the Notecard's serial link, fetches the
+// environment variables on a schedule and publishes them to a shared-memory
+// segment (see NotecardEnvVarShm.h) for local readers. It can also serve
+// queries and change subscriptions on a Unix-domain socket (see
+// NotecardEnvVarSocket.h).
+
+struct NotecardEnvVarDaemon;
+typedef struct NotecardEnvVarDaemon NotecardEnvVarDaemon;
+
+typedef struct {
+    // Serial device of the Notecard and its baud rate.
+    const char *device;
+    uint32_t baud;
+    // Shared-memory segment name (e.g. "/nevm") and size in bytes.
+    const char *shmName;
+    size_t shmSize;
+    // Path of the query socket, or NULL for none.
+    const char *socketPath;
+    // Time between fetches.
+    uint32_t intervalMs;
+    // Variables to fetch. With numVars set to NEVM_ENV_VAR_ALL, all
+    // variables are fetched.
+    const char **vars;
+    size_t numVars;
+    // Defaults published until the Notecard provides the variables, or NULL.
+    const char **defaultVars;
+    const char **defaultVals;
+    size_t numDefaults;
+#ifdef NEVM_ENABLE_PERSIST
+    // File to keep the values in across restarts (see
+    // NotecardEnvVarFileStorage.h), or NULL for none.
+    const char *storagePath;
+#endif
+} NotecardEnvVarDaemonConfig;
+
+NotecardEnvVarDaemon *NotecardEnvVarDaemon_alloc(
+    const NotecardEnvVarDaemonConfig *config);
+int NotecardEnvVarDaemon_step(NotecardEnvVarDaemon *daemon);
+int NotecardEnvVarDaemon_poll(NotecardEnvVarDaemon *daemon, uint32_t timeoutMs);
+int NotecardEnvVarDaemon_run(NotecardEnvVarDaemon *daemon,
+                             volatile sig_atomic_t *stop);
+void NotecardEnvVarDaemon_free(NotecardEnvVarDaemon *daemon);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,133 @@
+#define _DEFAULT_SOURCE
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "NotecardEnvVarDaemon.h"
+
+// Usage: notecard_env_var_daemon [-d device] [-b baud] [-s shmName]
+//                                [-S shmSize] [-u socketPath]
+//                                [-i intervalSeconds] [-p storagePath]
+//                                [-D var=value]... [var...]
+//
+// Fetches the named variables (or all variables if none are named) from the
+// Notecard every interval, and publishes them to the shared-memory segment.
+// With -u, also serves queries and change subscriptions on a Unix-domain
+// socket. Each -D gives a variable a default, and with -p, the values are kept
+// in a file across restarts. Both are published before the first fetch.
+
+static volatile sig_atomic_t stop = 0;
+
+static void _onSignal(int sig)
+{
+    (void)sig;
+
+    stop = 1;
+}
+
+static void _usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-d device] [-b baud] [-s shmName] "
+            "[-S shmSize] [-u socketPath] [-i intervalSeconds] "
+            "[-p storagePath] [-D var=value]... [var...]\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    NotecardEnvVarDaemonConfig config = {
+        .device = "/dev/ttyACM0",
+        .baud = 115200,
+        .shmName = "/nevm",
+        .shmSize = 64 * 1024,
+        .socketPath = NULL,
+        .intervalMs = 60 * 1000,
+        .vars = NULL,
+        .numVars = NEVM_ENV_VAR_ALL
+    };
+
+    // There can't be more defaults than arguments.
+    const char **defaultVars = (const char **)calloc((size_t)argc,
+                               sizeof(char *));
+    const char **defaultVals = (const char **)calloc((size_t)argc,
+                               sizeof(char *));
+    if (defaultVars == NULL || defaultVals == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+    config.defaultVars = defaultVars;
+    config.defaultVals = defaultVals;
+
+    int opt;
+    char *sep;
+    while ((opt = getopt(argc, argv, "d:b:s:S:u:i:p:D:h")) != -1) {
+        switch (opt) {
+        case 'd':
+            config.device = optarg;
+            break;
+        case 'b':
+            config.baud = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            config.shmName = optarg;
+            break;
+        case 'S':
+            config.shmSize = strtoul(optarg, NULL, 10);
+            break;
+        case 'u':
+            config.socketPath = optarg;
+            break;
+        case 'i':
+            config.intervalMs = (uint32_t)strtoul(optarg, NULL, 10) * 1000;
+            break;
+        case 'p':
+#ifdef NEVM_ENABLE_PERSIST
+            config.storagePath = optarg;
+            break;
+#else
+            fprintf(stderr, "Built without NEVM_ENABLE_PERSIST.\n");
+            return 1;
+#endif
+        case 'D':
+            sep = strchr(optarg, '=');
+            if (sep == NULL || sep == optarg) {
+                _usage(argv[0]);
+                return 1;
+            }
+            *sep = '\0';
+            defaultVars[config.numDefaults] = optarg;
+            defaultVals[config.numDefaults] = sep + 1;
+            ++config.numDefaults;
+            break;
+        default:
+            _usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind < argc) {
+        config.vars = (const char **)&argv[optind];
+        config.numVars = (size_t)(argc - optind);
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = _onSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    NotecardEnvVarDaemon *daemon = NotecardEnvVarDaemon_alloc(&config);
+    if (daemon == NULL) {
+        fprintf(stderr, "Failed to start with device %s and segment %s.\n",
+                config.device, config.shmName);
+        return 1;
+    }
+
+    NotecardEnvVarDaemon_run(daemon, &stop);
+    NotecardEnvVarDaemon_free(daemon);
+    free(defaultVars);
+    free(defaultVals);
+
+    return 0;
+}
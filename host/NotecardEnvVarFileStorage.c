@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "NotecardEnvVarFileStorage.h"
+
+struct NotecardEnvVarFileStorage {
+    FILE *file;
+    NotecardEnvVarStorage storage;
+    NotecardEnvVarFileStorageStats stats;
+    uint32_t *sectorErases;
+};
+
+static int _inRange(const NotecardEnvVarFileStorage *fs, uint32_t offset,
+                    size_t len)
+{
+    return offset <= fs->storage.size && len <= fs->storage.size - offset;
+}
+
+static int _read(void *ctx, uint32_t offset, void *buf, size_t len)
+{
+    NotecardEnvVarFileStorage *fs = (NotecardEnvVarFileStorage *)ctx;
+    if (!_inRange(fs, offset, len) || fseek(fs->file, offset, SEEK_SET) != 0
+            || fread(buf, 1, len, fs->file) != len) {
+        return NEVM_FAILURE;
+    }
+
+    return NEVM_SUCCESS;
+}
+
+static int _write(void *ctx, uint32_t offset, const void *buf, size_t len)
+{
+    NotecardEnvVarFileStorage *fs = (NotecardEnvVarFileStorage *)ctx;
+    const uint8_t *src = (const uint8_t *)buf;
+    uint8_t chunk[64];
+
+    // Program in chunks, ANDing with what's already there like NOR flash.
+    while (len > 0) {
+        size_t n = len < sizeof(chunk) ? len : sizeof(chunk);
+        if (_read(ctx, offset, chunk, n) != NEVM_SUCCESS) {
+            return NEVM_FAILURE;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            chunk[i] &= src[i];
+        }
+        if (fseek(fs->file, offset, SEEK_SET) != 0
+                || fwrite(chunk, 1, n, fs->file) != n) {
+            return NEVM_FAILURE;
+        }
+        offset += (uint32_t)n;
+        src += n;
+        len -= n;
+    }
+
+    fs->stats.bytesWritten += (uint32_t)(src - (const uint8_t *)buf);
+    ++fs->stats.writes;
+
+    return fflush(fs->file) == 0 ? NEVM_SUCCESS : NEVM_FAILURE;
+}
+
+static int _fill(NotecardEnvVarFileStorage *fs, uint32_t offset, size_t len)
+{
+    uint8_t chunk[64];
+    memset(chunk, 0xFF, sizeof(chunk));
+
+    if (fseek(fs->file, offset, SEEK_SET) != 0) {
+        return NEVM_FAILURE;
+    }
+    while (len > 0) {
+        size_t n = len < sizeof(chunk) ? len : sizeof(chunk);
+        if (fwrite(chunk, 1, n, fs->file) != n) {
+            return NEVM_FAILURE;
+        }
+        len -= n;
+    }
+
+    return fflush(fs->file) == 0 ? NEVM_SUCCESS : NEVM_FAILURE;
+}
+
+static int _erase(void *ctx, uint32_t offset, size_t len)
+{
+    NotecardEnvVarFileStorage *fs = (NotecardEnvVarFileStorage *)ctx;
+    uint32_t sectorSize = fs->storage.sectorSize;
+
+    if (!_inRange(fs, offset, len) || offset % sectorSize != 0
+            || len % sectorSize != 0) {
+        return NEVM_FAILURE;
+    }
+    for (uint32_t sector = offset / sectorSize;
+            sector < (offset + len) / sectorSize; ++sector) {
+        ++fs->stats.erases;
+        if (++fs->sectorErases[sector] > fs->stats.maxSectorErases) {
+            fs->stats.maxSectorErases = fs->sectorErases[sector];
+        }
+    }
+
+    return _fill(fs, offset, len);
+}
+
+/**
+ * Open a file-backed storage region of size bytes. An existing file keeps its
+ * contents, so values persisted by one run can be restored by the next. A
+ * new or shorter file is extended with erased (0xFF) bytes.
+ *
+ * @param path       Path to the backing file.
+ * @param size       Size of the storage region in bytes.
+ * @param sectorSize Size of an erase sector in bytes. Must divide size.
+ *
+ * @return A valid pointer on success and NULL on failure.
+ */
+NotecardEnvVarFileStorage *NotecardEnvVarFileStorage_open(const char *path,
+        uint32_t size, uint32_t sectorSize)
+{
+    if (sectorSize == 0 || size % sectorSize != 0) {
+        return NULL;
+    }
+
+    NotecardEnvVarFileStorage *fs = (NotecardEnvVarFileStorage *)calloc(1,
+                                    sizeof(NotecardEnvVarFileStorage));
+    if (fs == NULL) {
+        return NULL;
+    }
+    fs->sectorErases = (uint32_t *)calloc(size / sectorSize,
+                                          sizeof(uint32_t));
+    if (fs->sectorErases == NULL) {
+        NotecardEnvVarFileStorage_close(fs);
+        return NULL;
+    }
+
+    fs->file = fopen(path, "r+b");
+    if (fs->file == NULL) {
+        fs->file = fopen(path, "w+b");
+    }
+    if (fs->file == NULL || fseek(fs->file, 0, SEEK_END) != 0) {
+        NotecardEnvVarFileStorage_close(fs);
+        return NULL;
+    }
+
+    long existing = ftell(fs->file);
+    fs->storage.read = _read;
+    fs->storage.write = _write;
+    fs->storage.erase = _erase;
+    fs->storage.size = size;
+    fs->storage.sectorSize = sectorSize;
+    fs->storage.ctx = fs;
+    if (existing >= 0 && (unsigned long)existing < size
+            && _fill(fs, (uint32_t)existing, size - (uint32_t)existing)
+            != NEVM_SUCCESS) {
+        NotecardEnvVarFileStorage_close(fs);
+        return NULL;
+    }
+
+    return fs;
+}
+
+/**
+ * Close a file-backed storage region.
+ *
+ * @param fs Pointer to the storage region.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarFileStorage_close(NotecardEnvVarFileStorage *fs)
+{
+    if (fs == NULL) {
+        return NEVM_FAILURE;
+    }
+
+    int ret = NEVM_SUCCESS;
+    if (fs->file != NULL && fclose(fs->file) != 0) {
+        ret = NEVM_FAILURE;
+    }
+    free(fs->sectorErases);
+    free(fs);
+
+    return ret;
+}
+
+/**
+ * Get the storage backend interface for a file-backed storage region.
+ *
+ * @param fs Pointer to the storage region.
+ *
+ * @return The storage backend, valid until the region is closed.
+ */
+const NotecardEnvVarStorage *NotecardEnvVarFileStorage_storage(
+    NotecardEnvVarFileStorage *fs)
+{
+    return fs != NULL ? &fs->storage : NULL;
+}
+
+/**
+ * Get the wear statistics of a file-backed storage region.
+ *
+ * @param fs    Pointer to the storage region.
+ * @param stats Filled in with the statistics since the region was opened.
+ */
+void NotecardEnvVarFileStorage_getStats(const NotecardEnvVarFileStorage *fs,
+                                        NotecardEnvVarFileStorageStats *stats)
+{
+    *stats = fs->stats;
+}
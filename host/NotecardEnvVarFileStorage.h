@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "NotecardEnvVarManager.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A host storage backend that simulates a region of NOR flash with a file.
+// A new file is filled with 0xFF (erased). Writes can only clear bits, as on
+// real flash, so writing without erasing first corrupts the data rather than
+// silently succeeding. Erases must cover whole sectors. Pass the result of
+// NotecardEnvVarFileStorage_storage to NotecardEnvVarManager_setStorage.
+
+struct NotecardEnvVarFileStorage;
+typedef struct NotecardEnvVarFileStorage NotecardEnvVarFileStorage;
+
+// Wear statistics since the storage was opened, for benchmarking.
+typedef struct {
+    // Sector erase cycles, in total and of the most erased sector.
+    uint32_t erases;
+    uint32_t maxSectorErases;
+    // Bytes written and write calls.
+    uint32_t bytesWritten;
+    uint32_t writes;
+} NotecardEnvVarFileStorageStats;
+
+NotecardEnvVarFileStorage *NotecardEnvVarFileStorage_open(const char *path,
+        uint32_t size, uint32_t sectorSize);
+int NotecardEnvVarFileStorage_close(NotecardEnvVarFileStorage *fs);
+const NotecardEnvVarStorage *NotecardEnvVarFileStorage_storage(
+    NotecardEnvVarFileStorage *fs);
+void NotecardEnvVarFileStorage_getStats(const NotecardEnvVarFileStorage *fs,
+                                        NotecardEnvVarFileStorageStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,353 @@
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarSerial.h"
+
+// How long a transmit waits for the device to accept more bytes.
+#define NEVM_SERIAL_WRITE_TIMEOUT_MS 1000
+// How long NotecardEnvVarSerial_requestFn waits for a response.
+#define NEVM_SERIAL_TRANSACTION_TIMEOUT_MS 10000
+// Like note-c, NotecardEnvVarSerial_requestFn sends requests in segments
+// with a pause between them, so as not to overrun the Notecard's serial
+// receive buffer.
+#define NEVM_SERIAL_SEGMENT_LEN      250
+#define NEVM_SERIAL_SEGMENT_DELAY_MS 250
+
+static int serialFd = -1;
+static uint8_t rxBuf[256];
+static size_t rxLen = 0;
+static size_t rxPos = 0;
+
+static speed_t _speed(uint32_t baud)
+{
+    switch (baud) {
+    case 9600:
+        return B9600;
+    case 19200:
+        return B19200;
+    case 38400:
+        return B38400;
+    case 57600:
+        return B57600;
+    case 115200:
+        return B115200;
+    case 230400:
+        return B230400;
+    default:
+        return B0;
+    }
+}
+
+static bool _serialReset(void)
+{
+    rxLen = 0;
+    rxPos = 0;
+
+    return serialFd >= 0 && tcflush(serialFd, TCIOFLUSH) == 0;
+}
+
+static void _serialTransmit(uint8_t *txBuf, size_t txBufLen, bool flush)
+{
+    (void)flush;
+
+    while (serialFd >= 0 && txBufLen > 0) {
+        ssize_t n = write(serialFd, txBuf, txBufLen);
+        if (n > 0) {
+            txBuf += n;
+            txBufLen -= (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EINTR) {
+            return;
+        }
+
+        struct pollfd pfd = {serialFd, POLLOUT, 0};
+        if (poll(&pfd, 1, NEVM_SERIAL_WRITE_TIMEOUT_MS) <= 0) {
+            return;
+        }
+    }
+}
+
+static bool _serialAvailable(void)
+{
+    if (rxPos < rxLen) {
+        return true;
+    }
+    if (serialFd < 0) {
+        return false;
+    }
+
+    // The device is non-blocking, so this returns right away if there's
+    // nothing to read.
+    ssize_t n = read(serialFd, rxBuf, sizeof(rxBuf));
+    if (n <= 0) {
+        return false;
+    }
+    rxLen = (size_t)n;
+    rxPos = 0;
+
+    return true;
+}
+
+static char _serialReceive(void)
+{
+    if (!_serialAvailable()) {
+        return '\0';
+    }
+
+    return (char)rxBuf[rxPos++];
+}
+
+/**
+ * Open a serial device as a raw 8N1, non-blocking line, without installing
+ * it as note-c's transport.
+ *
+ * @param device Path to the device.
+ * @param baud   The baud rate: 9600, 19200, 38400, 57600, 115200 or 230400.
+ *
+ * @return The file descriptor on success and -1 on failure.
+ */
+int NotecardEnvVarSerial_openDevice(const char *device, uint32_t baud)
+{
+    speed_t speed = _speed(baud);
+    if (device == NULL || speed == B0) {
+        return -1;
+    }
+
+    int fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+        close(fd);
+        return -1;
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+    if (cfsetispeed(&tio, speed) != 0 || cfsetospeed(&tio, speed) != 0 ||
+            tcsetattr(fd, TCSANOW, &tio) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * Open a serial device and install it as note-c's serial transport.
+ *
+ * @param device Path to the device.
+ * @param baud   The baud rate: 9600, 19200, 38400, 57600, 115200 or 230400.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarSerial_open(const char *device, uint32_t baud)
+{
+    if (serialFd >= 0) {
+        return NEVM_FAILURE;
+    }
+
+    int fd = NotecardEnvVarSerial_openDevice(device, baud);
+    if (fd < 0) {
+        return NEVM_FAILURE;
+    }
+
+    serialFd = fd;
+    rxLen = 0;
+    rxPos = 0;
+    NoteSetFnSerial(_serialReset, _serialTransmit, _serialAvailable,
+                    _serialReceive);
+
+    return NEVM_SUCCESS;
+}
+
+static bool _writeAll(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n > 0) {
+            buf += n;
+            len -= (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EINTR) {
+            return false;
+        }
+
+        struct pollfd pfd = {fd, POLLOUT, 0};
+        if (poll(&pfd, 1, NEVM_SERIAL_WRITE_TIMEOUT_MS) <= 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Internal function to read the first non-empty line from the device,
+ * returning it without its line ending, or NULL on a timeout. The device is
+ * read as many bytes at a time as it has, like NotecardEnvVarAsyncSerial does,
+ * and anything after the line is dropped with the rest of the transaction's
+ * leftovers.
+ */
+static char *_readLine(int fd)
+{
+    size_t cap = 1024;
+    size_t len = 0;
+    char *line = (char *)malloc(cap);
+    uint32_t start = NotecardEnvVarSerial_getMs();
+
+    while (line != NULL) {
+        uint32_t elapsed = NotecardEnvVarSerial_getMs() - start;
+        if (elapsed >= NEVM_SERIAL_TRANSACTION_TIMEOUT_MS) {
+            break;
+        }
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, (int)(NEVM_SERIAL_TRANSACTION_TIMEOUT_MS - elapsed))
+                <= 0) {
+            continue;
+        }
+
+        if (cap - len < 256) {
+            char *grown = (char *)realloc(line, cap * 2);
+            if (grown == NULL) {
+                break;
+            }
+            line = grown;
+            cap *= 2;
+        }
+        // Leave room for a terminator.
+        ssize_t n = read(fd, line + len, cap - len - 1);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+
+        size_t lineStart = 0;
+        size_t end = len + (size_t)n;
+        for (size_t i = len; i < end; ++i) {
+            if (line[i] != '\n') {
+                continue;
+            }
+            size_t lineLen = i - lineStart;
+            if (lineLen > 0 && line[lineStart + lineLen - 1] == '\r') {
+                --lineLen;
+            }
+            if (lineLen > 0) {
+                memmove(line, line + lineStart, lineLen);
+                line[lineLen] = '\0';
+                return line;
+            }
+            lineStart = i + 1;
+        }
+        memmove(line, line + lineStart, end - lineStart);
+        len = end - lineStart;
+    }
+
+    free(line);
+
+    return NULL;
+}
+
+/**
+ * A request function for NotecardEnvVarManager_setRequestFn that runs a
+ * blocking transaction over a device opened with
+ * NotecardEnvVarSerial_openDevice. Unlike the note-c transport installed by
+ * NotecardEnvVarSerial_open, it isn't tied to one device per process, so each
+ * manager can talk to its own Notecard.
+ *
+ * @param req The request, which is deleted.
+ * @param ctx Pointer to the device's file descriptor (an int).
+ *
+ * @return The response, to be freed with JDelete, or NULL on failure.
+ */
+J *NotecardEnvVarSerial_requestFn(J *req, void *ctx)
+{
+    char *json = JPrintUnformatted(req);
+    JDelete(req);
+    if (ctx == NULL || json == NULL) {
+        JFree(json);
+        return NULL;
+    }
+    int fd = *(const int *)ctx;
+
+    // Drop anything left over from an earlier transaction that timed out.
+    tcflush(fd, TCIFLUSH);
+
+    size_t len = strlen(json);
+    bool sent = true;
+    for (size_t off = 0; sent && off < len; off += NEVM_SERIAL_SEGMENT_LEN) {
+        if (off > 0) {
+            NotecardEnvVarSerial_delayMs(NEVM_SERIAL_SEGMENT_DELAY_MS);
+        }
+        size_t segLen = len - off < NEVM_SERIAL_SEGMENT_LEN ? len - off :
+                        NEVM_SERIAL_SEGMENT_LEN;
+        sent = _writeAll(fd, json + off, segLen);
+    }
+    JFree(json);
+    if (!sent || !_writeAll(fd, "\n", 1)) {
+        return NULL;
+    }
+
+    char *line = _readLine(fd);
+    if (line == NULL) {
+        return NULL;
+    }
+    J *rsp = JParse(line);
+    free(line);
+
+    return rsp;
+}
+
+/**
+ * Close the serial device opened with NotecardEnvVarSerial_open.
+ */
+void NotecardEnvVarSerial_close(void)
+{
+    if (serialFd >= 0) {
+        close(serialFd);
+        serialFd = -1;
+    }
+}
+
+/**
+ * Sleep for ms milliseconds.
+ *
+ * @param ms The delay in milliseconds.
+ */
+void NotecardEnvVarSerial_delayMs(uint32_t ms)
+{
+    struct timespec ts = {ms / 1000, (long)(ms % 1000) * 1000000L};
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+/**
+ * Get a free-running millisecond count from the monotonic clock.
+ *
+ * @return The count in milliseconds.
+ */
+uint32_t NotecardEnvVarSerial_getMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
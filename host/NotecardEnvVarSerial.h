@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "NotecardEnvVarManager.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// note-c serial transport over a Linux serial device (e.g. /dev/ttyACM0 or a
+// pty), configured as a raw 8N1 line with termios. note-c's serial hooks
+// don't take a context, so there's one open device per process. To talk to
+// several Notecards, open each with NotecardEnvVarSerial_openDevice and give
+// each manager NotecardEnvVarSerial_requestFn with a pointer to its
+// descriptor.
+
+int NotecardEnvVarSerial_open(const char *device, uint32_t baud);
+int NotecardEnvVarSerial_openDevice(const char *device, uint32_t baud);
+J *NotecardEnvVarSerial_requestFn(J *req, void *ctx);
+void NotecardEnvVarSerial_close(void);
+
+// Real-time delay and millis functions to pass to NoteSetFnDefault.
+void NotecardEnvVarSerial_delayMs(uint32_t ms);
+uint32_t NotecardEnvVarSerial_getMs(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,445 @@
+#define _DEFAULT_SOURCE
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "NotecardEnvVarShm.h"
+
+// How many times a reader retries a lookup that raced with the writer before
+// giving up. Publishing takes microseconds, so this is only reached if the
+// writer died in the middle of a publish.
+#define NEVM_SHM_MAX_RETRIES 1000000
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t seq;
+    uint32_t generation;
+    uint32_t numVars;
+} nevmShmHeader;
+
+typedef struct {
+    uint32_t hash;
+    uint32_t nameOff;
+    uint32_t valOff;
+} nevmShmSlot;
+
+typedef struct {
+    uint32_t hash;
+    size_t idx;
+} nevmShmSortItem;
+
+struct NotecardEnvVarShm {
+    uint8_t *base;
+    size_t size;
+};
+
+static uint32_t _hash(const char *str)
+{
+    uint32_t hash = 2166136261u;
+    for (; *str != '\0'; ++str) {
+        hash ^= (uint8_t)*str;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static int _compareItems(const void *a, const void *b)
+{
+    uint32_t ha = ((const nevmShmSortItem *)a)->hash;
+    uint32_t hb = ((const nevmShmSortItem *)b)->hash;
+
+    return ha < hb ? -1 : ha > hb;
+}
+
+static NotecardEnvVarShm *_map(int fd, size_t size, int prot)
+{
+    NotecardEnvVarShm *shm = (NotecardEnvVarShm *)calloc(1, sizeof(*shm));
+    if (shm == NULL) {
+        return NULL;
+    }
+
+    void *base = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        free(shm);
+        return NULL;
+    }
+    shm->base = (uint8_t *)base;
+    shm->size = size;
+
+    return shm;
+}
+
+static void _writeBegin(nevmShmHeader *hdr)
+{
+    uint32_t seq = __atomic_load_n(&hdr->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&hdr->seq, seq | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void _writeEnd(nevmShmHeader *hdr)
+{
+    uint32_t seq = __atomic_load_n(&hdr->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&hdr->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+// Everything in the segment is accessed with relaxed atomics, since readers
+// load it while the writer may be storing to it. The sequence lock's fences
+// order the accesses, as for the event ring in src/NotecardEnvVarEvents.c.
+static void _store32(uint32_t *dst, uint32_t val)
+{
+    __atomic_store_n(dst, val, __ATOMIC_RELAXED);
+}
+
+static uint32_t _load32(const uint32_t *src)
+{
+    return __atomic_load_n(src, __ATOMIC_RELAXED);
+}
+
+static void _storeStr(uint8_t *dst, const char *str, size_t len)
+{
+    for (size_t i = 0; i < len; ++i) {
+        __atomic_store_n(&dst[i], (uint8_t)str[i], __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Check whether the NUL-terminated string at offset off of the segment is
+ * str, of length len.
+ */
+static bool _strEquals(const NotecardEnvVarShm *shm, uint32_t off,
+                       const char *str, size_t len)
+{
+    if (off >= shm->size || shm->size - off <= len) {
+        return false;
+    }
+
+    const uint8_t *src = shm->base + off;
+    for (size_t i = 0; i < len; ++i) {
+        if (__atomic_load_n(&src[i], __ATOMIC_RELAXED) != (uint8_t)str[i]) {
+            return false;
+        }
+    }
+
+    return __atomic_load_n(&src[len], __ATOMIC_RELAXED) == '\0';
+}
+
+/**
+ * Copy the NUL-terminated string at offset off of the segment into buf.
+ *
+ * @return true on success and false if the offset is out of range or the
+ *         string isn't terminated within the segment or buf.
+ */
+static bool _strCopy(const NotecardEnvVarShm *shm, uint32_t off, char *buf,
+                     size_t bufLen)
+{
+    if (off >= shm->size) {
+        return false;
+    }
+
+    const uint8_t *src = shm->base + off;
+    size_t maxLen = shm->size - off;
+    for (size_t i = 0; i < maxLen && i < bufLen; ++i) {
+        buf[i] = (char)__atomic_load_n(&src[i], __ATOMIC_RELAXED);
+        if (buf[i] == '\0') {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Create (or take over) a shared-memory segment for publishing snapshots. An
+ * existing segment is reused, so that readers that already mapped it see the
+ * new snapshots, and it's never shrunk, since readers map the size they saw
+ * when they opened it.
+ *
+ * @param name The segment name, starting with a slash (e.g. "/nevm").
+ * @param size The segment size in bytes, which bounds the size of a snapshot.
+ *
+ * @return A valid pointer on success and NULL on failure.
+ */
+NotecardEnvVarShm *NotecardEnvVarShm_create(const char *name, size_t size)
+{
+    if (name == NULL || size < sizeof(nevmShmHeader) || size > UINT32_MAX) {
+        return NULL;
+    }
+
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+            ((size_t)st.st_size < size && ftruncate(fd, size) != 0)) {
+        close(fd);
+        return NULL;
+    }
+    if ((size_t)st.st_size > size) {
+        size = (size_t)st.st_size;
+    }
+
+    NotecardEnvVarShm *shm = _map(fd, size, PROT_READ | PROT_WRITE);
+    close(fd);
+    if (shm == NULL) {
+        return NULL;
+    }
+
+    // Start with an empty snapshot.
+    nevmShmHeader *hdr = (nevmShmHeader *)shm->base;
+    _writeBegin(hdr);
+    _store32(&hdr->magic, NEVM_SHM_MAGIC);
+    _store32(&hdr->version, NEVM_SHM_VERSION);
+    _store32(&hdr->size, (uint32_t)size);
+    _store32(&hdr->generation, 0);
+    _store32(&hdr->numVars, 0);
+    _writeEnd(hdr);
+
+    return shm;
+}
+
+/**
+ * Replace the segment's snapshot. Readers see either the old or the new
+ * snapshot, never a mix of the two.
+ *
+ * @param shm        Pointer to a segment from NotecardEnvVarShm_create.
+ * @param vars       The variable names.
+ * @param vals       The values, one per variable.
+ * @param numVars    The number of variables.
+ * @param generation The manager's generation for the snapshot.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE if the snapshot doesn't fit
+ *         in the segment or on another failure.
+ */
+int NotecardEnvVarShm_publish(NotecardEnvVarShm *shm, const char **vars,
+                              const char **vals, size_t numVars,
+                              uint32_t generation)
+{
+    if (shm == NULL || ((vars == NULL || vals == NULL) && numVars > 0)) {
+        return NEVM_FAILURE;
+    }
+
+    size_t stringsOff = sizeof(nevmShmHeader) + numVars * sizeof(nevmShmSlot);
+    size_t len = stringsOff;
+    for (size_t i = 0; i < numVars; ++i) {
+        len += strlen(vars[i]) + 1 + strlen(vals[i]) + 1;
+    }
+    if (len > shm->size) {
+        return NEVM_FAILURE;
+    }
+
+    nevmShmSortItem *items = NULL;
+    if (numVars > 0) {
+        items = (nevmShmSortItem *)malloc(numVars * sizeof(*items));
+        if (items == NULL) {
+            return NEVM_FAILURE;
+        }
+    }
+    for (size_t i = 0; i < numVars; ++i) {
+        items[i].hash = _hash(vars[i]);
+        items[i].idx = i;
+    }
+    if (numVars > 1) {
+        qsort(items, numVars, sizeof(*items), _compareItems);
+    }
+
+    nevmShmHeader *hdr = (nevmShmHeader *)shm->base;
+    nevmShmSlot *slots = (nevmShmSlot *)(hdr + 1);
+    size_t off = stringsOff;
+    _writeBegin(hdr);
+    for (size_t i = 0; i < numVars; ++i) {
+        const char *var = vars[items[i].idx];
+        const char *val = vals[items[i].idx];
+        size_t varLen = strlen(var) + 1;
+        size_t valLen = strlen(val) + 1;
+
+        _store32(&slots[i].hash, items[i].hash);
+        _store32(&slots[i].nameOff, (uint32_t)off);
+        _storeStr(shm->base + off, var, varLen);
+        off += varLen;
+        _store32(&slots[i].valOff, (uint32_t)off);
+        _storeStr(shm->base + off, val, valLen);
+        off += valLen;
+    }
+    _store32(&hdr->generation, generation);
+    _store32(&hdr->numVars, (uint32_t)numVars);
+    _writeEnd(hdr);
+
+    free(items);
+
+    return NEVM_SUCCESS;
+}
+
+/**
+ * Remove a segment's name. Processes that have it mapped keep their mapping.
+ *
+ * @param name The segment name.
+ */
+void NotecardEnvVarShm_unlink(const char *name)
+{
+    if (name != NULL) {
+        shm_unlink(name);
+    }
+}
+
+/**
+ * Open a segment for reading. Lookups on the returned segment don't make
+ * system calls.
+ *
+ * @param name The segment name.
+ *
+ * @return A valid pointer on success and NULL on failure, including if the
+ *         segment doesn't exist yet or has an unknown layout.
+ */
+NotecardEnvVarShm *NotecardEnvVarShm_open(const char *name)
+{
+    if (name == NULL) {
+        return NULL;
+    }
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(nevmShmHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    NotecardEnvVarShm *shm = _map(fd, (size_t)st.st_size, PROT_READ);
+    close(fd);
+    if (shm == NULL) {
+        return NULL;
+    }
+
+    const nevmShmHeader *hdr = (const nevmShmHeader *)shm->base;
+    if (_load32(&hdr->magic) != NEVM_SHM_MAGIC ||
+            _load32(&hdr->version) != NEVM_SHM_VERSION) {
+        NotecardEnvVarShm_close(shm);
+        return NULL;
+    }
+
+    return shm;
+}
+
+/**
+ * Look up a variable in the current snapshot.
+ *
+ * @param shm        Pointer to an open segment.
+ * @param var        The variable name.
+ * @param buf        Buffer to copy the NUL-terminated value into.
+ * @param bufLen     Size of buf in bytes.
+ * @param generation If non-NULL, set to the generation of the snapshot the
+ *                   value was read from.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE if the variable isn't in
+ *         the snapshot, the value doesn't fit in buf or the writer died in the
+ *         middle of a publish.
+ */
+int NotecardEnvVarShm_get(const NotecardEnvVarShm *shm, const char *var,
+                          char *buf, size_t bufLen, uint32_t *generation)
+{
+    if (shm == NULL || var == NULL || buf == NULL || bufLen == 0) {
+        return NEVM_FAILURE;
+    }
+
+    const nevmShmHeader *hdr = (const nevmShmHeader *)shm->base;
+    const nevmShmSlot *slots = (const nevmShmSlot *)(hdr + 1);
+    size_t maxSlots = (shm->size - sizeof(*hdr)) / sizeof(*slots);
+    uint32_t hash = _hash(var);
+    size_t varLen = strlen(var);
+
+    for (uint32_t tries = 0; tries < NEVM_SHM_MAX_RETRIES; ++tries) {
+        uint32_t seq = __atomic_load_n(&hdr->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+
+        size_t numVars = _load32(&hdr->numVars);
+        if (numVars > maxSlots) {
+            numVars = maxSlots;
+        }
+        uint32_t gen = _load32(&hdr->generation);
+
+        // Find the first slot with the hash, then check the names of all the
+        // slots that share it.
+        size_t lo = 0;
+        size_t hi = numVars;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (_load32(&slots[mid].hash) < hash) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        int ret = NEVM_FAILURE;
+        for (size_t i = lo; i < numVars && _load32(&slots[i].hash) == hash;
+                ++i) {
+            if (!_strEquals(shm, _load32(&slots[i].nameOff), var, varLen)) {
+                continue;
+            }
+            if (_strCopy(shm, _load32(&slots[i].valOff), buf, bufLen)) {
+                ret = NEVM_SUCCESS;
+            }
+            break;
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&hdr->seq, __ATOMIC_RELAXED) != seq) {
+            continue;
+        }
+        if (ret == NEVM_SUCCESS && generation != NULL) {
+            *generation = gen;
+        }
+
+        return ret;
+    }
+
+    return NEVM_FAILURE;
+}
+
+/**
+ * Get the generation of the current snapshot. It changes whenever the writer
+ * publishes changed values, so readers can poll it to find out when to look
+ * their variables up again.
+ *
+ * @param shm Pointer to an open segment.
+ *
+ * @return The generation, or 0 if shm is NULL.
+ */
+uint32_t NotecardEnvVarShm_getGeneration(const NotecardEnvVarShm *shm)
+{
+    if (shm == NULL) {
+        return 0;
+    }
+
+    const nevmShmHeader *hdr = (const nevmShmHeader *)shm->base;
+
+    return __atomic_load_n(&hdr->generation, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Unmap a segment opened with NotecardEnvVarShm_create or
+ * NotecardEnvVarShm_open. The segment itself stays until it's unlinked.
+ *
+ * @param shm Pointer to the segment.
+ */
+void NotecardEnvVarShm_close(NotecardEnvVarShm *shm)
+{
+    if (shm == NULL) {
+        return;
+    }
+
+    munmap(shm->base, shm->size);
+    free(shm);
+}
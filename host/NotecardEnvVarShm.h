@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "NotecardEnvVarManager.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A snapshot of environment variables in a POSIX shared-memory segment, for
+// sharing one Notecard's configuration between processes on a Linux host.
+// One writer (the daemon) publishes whole snapshots, and any number of
+// readers look values up without locks or system calls once the segment is
+// mapped.
+//
+// Segment layout (native byte order, since it never leaves the host):
+//
+//   Header:  magic "NEVS", layout version, segment size, sequence number,
+//            generation, number of variables (4 bytes each).
+//   Slots:   one per variable, sorted by name hash: FNV-1a hash of the name,
+//            offset of the name and offset of the value (4 bytes each).
+//   Strings: the NUL-terminated names and values the slots point to.
+//
+// The sequence number is a seqlock. The writer makes it odd before changing
+// the segment and even again after, and readers retry if it was odd or
+// changed while they read. Readers check every offset against the segment
+// size, so a torn read can't take them outside the segment.
+
+#define NEVM_SHM_MAGIC   0x5356454EUL
+#define NEVM_SHM_VERSION 1
+
+struct NotecardEnvVarShm;
+typedef struct NotecardEnvVarShm NotecardEnvVarShm;
+
+// Writer.
+NotecardEnvVarShm *NotecardEnvVarShm_create(const char *name, size_t size);
+int NotecardEnvVarShm_publish(NotecardEnvVarShm *shm, const char **vars,
+                              const char **vals, size_t numVars,
+                              uint32_t generation);
+void NotecardEnvVarShm_unlink(const char *name);
+
+// Readers.
+NotecardEnvVarShm *NotecardEnvVarShm_open(const char *name);
+int NotecardEnvVarShm_get(const NotecardEnvVarShm *shm, const char *var,
+                          char *buf, size_t bufLen, uint32_t *generation);
+uint32_t NotecardEnvVarShm_getGeneration(const NotecardEnvVarShm *shm);
+
+void NotecardEnvVarShm_close(NotecardEnvVarShm *shm);
+
+#ifdef __cplusplus
+}
+#endif
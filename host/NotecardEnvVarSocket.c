@@ -0,0 +1,575 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "NotecardEnvVarSocket.h"
+
+// Events handled per epoll_wait.
+#define NEVM_SOCKET_MAX_EVENTS 64
+// Pending connections the kernel queues before they're accepted.
+#define NEVM_SOCKET_BACKLOG 128
+// Room for the " <len>\n" after a name.
+#define NEVM_SOCKET_HEADER_EXTRA 32
+
+typedef struct {
+    uint32_t hash;
+    uint32_t nameOff;
+} nevmSocketSub;
+
+typedef struct nevmSocketClient {
+    int fd;
+
+    // The subscription, if any: numSubs names, or all variables if subAll is
+    // set. subs and the names it points into share one allocation.
+    bool subscribed;
+    bool subAll;
+    size_t numSubs;
+    nevmSocketSub *subs;
+
+    // A partial request line, and replies not yet accepted by the socket.
+    // Both are only allocated while in use, so an idle connection costs no
+    // more than this struct.
+    char *in;
+    size_t inLen;
+    char *out;
+    size_t outLen;
+    size_t outPos;
+    size_t outCap;
+    bool waitingOut;
+
+    struct nevmSocketClient *prev;
+    struct nevmSocketClient *next;
+    struct nevmSocketClient *prevSub;
+    struct nevmSocketClient *nextSub;
+} nevmSocketClient;
+
+struct NotecardEnvVarSocket {
+    const NotecardEnvVarManager *man;
+    char *path;
+    int listenFd;
+    int epollFd;
+
+    nevmSocketClient *clients;
+    nevmSocketClient *subscribers;
+    size_t numClients;
+
+    // Scratch buffers shared by all clients. val fits the longest value the
+    // manager stores.
+    char rx[NEVM_SOCKET_MAX_LINE];
+    char val[UINT16_MAX + 1];
+};
+
+static uint32_t _hash(const char *str, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (uint8_t)str[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static void _drop(NotecardEnvVarSocket *sock, nevmSocketClient *client)
+{
+    epoll_ctl(sock->epollFd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+
+    if (client->prev != NULL) {
+        client->prev->next = client->next;
+    } else {
+        sock->clients = client->next;
+    }
+    if (client->next != NULL) {
+        client->next->prev = client->prev;
+    }
+    if (client->subscribed) {
+        if (client->prevSub != NULL) {
+            client->prevSub->nextSub = client->nextSub;
+        } else {
+            sock->subscribers = client->nextSub;
+        }
+        if (client->nextSub != NULL) {
+            client->nextSub->prevSub = client->prevSub;
+        }
+    }
+    --sock->numClients;
+
+    free(client->subs);
+    free(client->in);
+    free(client->out);
+    free(client);
+}
+
+/**
+ * Internal function to queue bytes for a client. Returns false if the client
+ * fell too far behind or memory ran out, in which case the caller drops it.
+ */
+static bool _append(nevmSocketClient *client, const char *buf, size_t len)
+{
+    // Reclaim the space of bytes already sent.
+    if (client->outPos > 0) {
+        memmove(client->out, client->out + client->outPos,
+                client->outLen - client->outPos);
+        client->outLen -= client->outPos;
+        client->outPos = 0;
+    }
+    if (client->outLen + len > NEVM_SOCKET_MAX_BACKLOG) {
+        return false;
+    }
+    if (client->outLen + len > client->outCap) {
+        size_t cap = client->outCap ? client->outCap : 256;
+        while (cap < client->outLen + len) {
+            cap *= 2;
+        }
+        char *out = (char *)realloc(client->out, cap);
+        if (out == NULL) {
+            return false;
+        }
+        client->out = out;
+        client->outCap = cap;
+    }
+    memcpy(client->out + client->outLen, buf, len);
+    client->outLen += len;
+
+    return true;
+}
+
+/**
+ * Internal function to send as much of a client's queued output as the socket
+ * takes, and wait for it to drain if some is left. Returns false if the client
+ * should be dropped.
+ */
+static bool _flush(NotecardEnvVarSocket *sock, nevmSocketClient *client)
+{
+    while (client->outPos < client->outLen) {
+        ssize_t n = send(client->fd, client->out + client->outPos,
+                         client->outLen - client->outPos, MSG_NOSIGNAL);
+        if (n > 0) {
+            client->outPos += (size_t)n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            return false;
+        }
+    }
+
+    bool waiting = client->outPos < client->outLen;
+    if (!waiting) {
+        free(client->out);
+        client->out = NULL;
+        client->outLen = 0;
+        client->outPos = 0;
+        client->outCap = 0;
+    }
+    if (waiting != client->waitingOut) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN | (waiting ? EPOLLOUT : 0);
+        ev.data.ptr = client;
+        if (epoll_ctl(sock->epollFd, EPOLL_CTL_MOD, client->fd, &ev) != 0) {
+            return false;
+        }
+        client->waitingOut = waiting;
+    }
+
+    return true;
+}
+
+static bool _appendValue(nevmSocketClient *client, const char *tag,
+                         const char *name, const char *val)
+{
+    char header[NEVM_SOCKET_HEADER_EXTRA];
+    size_t nameLen = strlen(name);
+
+    if (val == NULL) {
+        return _append(client, tag, strlen(tag))
+               && _append(client, " ", 1)
+               && _append(client, name, nameLen)
+               && _append(client, "\n", 1);
+    }
+
+    size_t valLen = strlen(val);
+    int headerLen = snprintf(header, sizeof(header), " %u\n",
+                             (unsigned)valLen);
+    return _append(client, tag, strlen(tag))
+           && _append(client, " ", 1)
+           && _append(client, name, nameLen)
+           && _append(client, header, (size_t)headerLen)
+           && _append(client, val, valLen)
+           && _append(client, "\n", 1);
+}
+
+static bool _handleGet(NotecardEnvVarSocket *sock, nevmSocketClient *client,
+                       char *args)
+{
+    char *save = NULL;
+    for (char *name = strtok_r(args, " ", &save); name != NULL;
+            name = strtok_r(NULL, " ", &save)) {
+        bool found = NotecardEnvVarManager_get(sock->man, name, sock->val,
+                                               sizeof(sock->val), NULL)
+                     == NEVM_SUCCESS;
+        if (!_appendValue(client, found ? "VAL" : "NIL", name,
+                          found ? sock->val : NULL)) {
+            return false;
+        }
+    }
+
+    return _append(client, "END\n", 4);
+}
+
+static bool _handleSub(NotecardEnvVarSocket *sock, nevmSocketClient *client,
+                       char *args)
+{
+    if (client->subscribed) {
+        const char *err = "ERR already subscribed\n";
+        return _append(client, err, strlen(err));
+    }
+
+    // Count the names and their total length, then copy them after the
+    // slots.
+    size_t numSubs = 0;
+    size_t namesLen = 0;
+    for (char *p = args; *p != '\0';) {
+        size_t len = strcspn(p, " ");
+        if (len > 0) {
+            ++numSubs;
+            namesLen += len + 1;
+        }
+        p += len;
+        p += strspn(p, " ");
+    }
+    if (numSubs > 0) {
+        client->subs = (nevmSocketSub *)malloc(numSubs * sizeof(nevmSocketSub)
+                                               + namesLen);
+        if (client->subs == NULL) {
+            return false;
+        }
+        char *names = (char *)(client->subs + numSubs);
+        uint32_t off = 0;
+        size_t i = 0;
+        for (char *p = args; *p != '\0';) {
+            size_t len = strcspn(p, " ");
+            if (len > 0) {
+                client->subs[i].hash = _hash(p, len);
+                client->subs[i].nameOff = off;
+                memcpy(names + off, p, len);
+                names[off + len] = '\0';
+                off += (uint32_t)(len + 1);
+                ++i;
+            }
+            p += len;
+            p += strspn(p, " ");
+        }
+    }
+    client->numSubs = numSubs;
+    client->subAll = (numSubs == 0);
+    client->subscribed = true;
+
+    client->prevSub = NULL;
+    client->nextSub = sock->subscribers;
+    if (sock->subscribers != NULL) {
+        sock->subscribers->prevSub = client;
+    }
+    sock->subscribers = client;
+
+    return _append(client, "OK\n", 3);
+}
+
+static bool _handleLine(NotecardEnvVarSocket *sock, nevmSocketClient *client,
+                        char *line, size_t len)
+{
+    if (len > 0 && line[len - 1] == '\r') {
+        --len;
+    }
+    line[len] = '\0';
+
+    char *args = line + strcspn(line, " ");
+    if (*args != '\0') {
+        *args++ = '\0';
+    }
+    if (strcmp(line, "GET") == 0) {
+        return _handleGet(sock, client, args);
+    }
+    if (strcmp(line, "SUB") == 0) {
+        return _handleSub(sock, client, args);
+    }
+
+    const char *err = "ERR unknown request\n";
+    return _append(client, err, strlen(err));
+}
+
+/**
+ * Internal function to read and handle a client's requests. Returns false if
+ * the client closed the connection or should be dropped.
+ */
+static bool _read(NotecardEnvVarSocket *sock, nevmSocketClient *client)
+{
+    // Continue a partial line from the last read.
+    size_t have = client->inLen;
+    if (have > 0) {
+        memcpy(sock->rx, client->in, have);
+        free(client->in);
+        client->in = NULL;
+        client->inLen = 0;
+    }
+
+    ssize_t n;
+    do {
+        n = recv(client->fd, sock->rx + have, sizeof(sock->rx) - have, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        return false;
+    }
+    if (n > 0) {
+        have += (size_t)n;
+    }
+
+    size_t start = 0;
+    for (size_t i = start; i < have; ++i) {
+        if (sock->rx[i] != '\n') {
+            continue;
+        }
+        if (!_handleLine(sock, client, sock->rx + start, i - start)) {
+            return false;
+        }
+        start = i + 1;
+    }
+
+    // Keep what's left of a partial line, unless it can't become a valid
+    // one.
+    size_t left = have - start;
+    if (left >= sizeof(sock->rx)) {
+        return false;
+    }
+    if (left > 0) {
+        client->in = (char *)malloc(left);
+        if (client->in == NULL) {
+            return false;
+        }
+        memcpy(client->in, sock->rx + start, left);
+        client->inLen = left;
+    }
+
+    return _flush(sock, client);
+}
+
+static void _accept(NotecardEnvVarSocket *sock)
+{
+    for (;;) {
+        int fd = accept4(sock->listenFd, NULL, NULL,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+
+        nevmSocketClient *client = (nevmSocketClient *)calloc(1,
+                                   sizeof(*client));
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = client;
+        if (client == NULL ||
+                epoll_ctl(sock->epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            free(client);
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+        client->next = sock->clients;
+        if (sock->clients != NULL) {
+            sock->clients->prev = client;
+        }
+        sock->clients = client;
+        ++sock->numClients;
+    }
+}
+
+/**
+ * Start serving a manager's values on a Unix-domain socket. A stale socket
+ * file at the path is replaced.
+ *
+ * @param path The socket's path.
+ * @param man  The manager to serve, which must outlive the service.
+ *
+ * @return A valid pointer on success and NULL on failure.
+ */
+NotecardEnvVarSocket *NotecardEnvVarSocket_open(const char *path,
+        const NotecardEnvVarManager *man)
+{
+    struct sockaddr_un addr;
+    if (path == NULL || man == NULL || strlen(path) >= sizeof(addr.sun_path)) {
+        return NULL;
+    }
+
+    NotecardEnvVarSocket *sock = (NotecardEnvVarSocket *)calloc(1,
+                                 sizeof(*sock));
+    if (sock == NULL) {
+        return NULL;
+    }
+    sock->man = man;
+    sock->epollFd = -1;
+    sock->path = strdup(path);
+    sock->listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK |
+                            SOCK_CLOEXEC, 0);
+    if (sock->path == NULL || sock->listenFd < 0) {
+        NotecardEnvVarSocket_close(sock);
+        return NULL;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (bind(sock->listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+            listen(sock->listenFd, NEVM_SOCKET_BACKLOG) != 0 ||
+            (sock->epollFd = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+            epoll_ctl(sock->epollFd, EPOLL_CTL_ADD, sock->listenFd, &ev)
+            != 0) {
+        NotecardEnvVarSocket_close(sock);
+        return NULL;
+    }
+
+    return sock;
+}
+
+/**
+ * Get a file descriptor that becomes readable when the service has work, for
+ * waiting on the service together with other descriptors.
+ *
+ * @param sock Pointer to a service.
+ *
+ * @return The descriptor, or -1 if sock is NULL.
+ */
+int NotecardEnvVarSocket_fd(const NotecardEnvVarSocket *sock)
+{
+    return sock != NULL ? sock->epollFd : -1;
+}
+
+/**
+ * Accept connections and answer requests, waiting up to timeoutMs for
+ * something to do. Call it from the thread that owns the manager.
+ *
+ * @param sock      Pointer to a service.
+ * @param timeoutMs How long to wait, 0 to not wait or -1 to wait forever.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarSocket_poll(NotecardEnvVarSocket *sock, int timeoutMs)
+{
+    if (sock == NULL) {
+        return NEVM_FAILURE;
+    }
+
+    struct epoll_event events[NEVM_SOCKET_MAX_EVENTS];
+    int n = epoll_wait(sock->epollFd, events, NEVM_SOCKET_MAX_EVENTS,
+                       timeoutMs);
+    if (n < 0) {
+        return errno == EINTR ? NEVM_SUCCESS : NEVM_FAILURE;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        nevmSocketClient *client = (nevmSocketClient *)events[i].data.ptr;
+        if (client == NULL) {
+            _accept(sock);
+            continue;
+        }
+
+        bool keep = true;
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            keep = _read(sock, client);
+        } else if (events[i].events & EPOLLOUT) {
+            keep = _flush(sock, client);
+        }
+        if (!keep) {
+            _drop(sock, client);
+        }
+    }
+
+    return NEVM_SUCCESS;
+}
+
+/**
+ * Push a change to the clients subscribed to the variable. The manager's
+ * owner calls this for each changed or deleted variable, e.g. from the
+ * manager's callbacks.
+ *
+ * @param sock Pointer to a service.
+ * @param var  The variable name.
+ * @param val  The new value, or NULL if the variable was deleted.
+ */
+void NotecardEnvVarSocket_notify(NotecardEnvVarSocket *sock, const char *var,
+                                 const char *val)
+{
+    if (sock == NULL || var == NULL) {
+        return;
+    }
+
+    uint32_t hash = _hash(var, strlen(var));
+    nevmSocketClient *next = NULL;
+    for (nevmSocketClient *client = sock->subscribers; client != NULL;
+            client = next) {
+        next = client->nextSub;
+
+        bool match = client->subAll;
+        const char *names = (const char *)(client->subs + client->numSubs);
+        for (size_t i = 0; !match && i < client->numSubs; ++i) {
+            match = client->subs[i].hash == hash &&
+                    strcmp(names + client->subs[i].nameOff, var) == 0;
+        }
+        if (match && (!_appendValue(client, val != NULL ? "CHG" : "DEL", var,
+                                    val) || !_flush(sock, client))) {
+            _drop(sock, client);
+        }
+    }
+}
+
+/**
+ * Get the number of connected clients.
+ *
+ * @param sock Pointer to a service.
+ *
+ * @return The number of clients, or 0 if sock is NULL.
+ */
+size_t NotecardEnvVarSocket_numClients(const NotecardEnvVarSocket *sock)
+{
+    return sock != NULL ? sock->numClients : 0;
+}
+
+/**
+ * Stop the service, disconnecting all clients and removing the socket file.
+ *
+ * @param sock Pointer to a service.
+ */
+void NotecardEnvVarSocket_close(NotecardEnvVarSocket *sock)
+{
+    if (sock == NULL) {
+        return;
+    }
+
+    while (sock->clients != NULL) {
+        _drop(sock, sock->clients);
+    }
+    if (sock->epollFd >= 0) {
+        close(sock->epollFd);
+    }
+    if (sock->listenFd >= 0) {
+        close(sock->listenFd);
+        unlink(sock->path);
+    }
+    free(sock->path);
+    free(sock);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "NotecardEnvVarManager.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A local query service on a Unix-domain stream socket, serving a manager's
+// value store to other processes on a Linux host. The service is driven by
+// NotecardEnvVarSocket_poll from the thread that owns the manager, and the
+// owner reports changes with NotecardEnvVarSocket_notify (the gateway daemon
+// does both).
+//
+// The protocol is line-based. Variable names can't contain spaces, and values
+// are sent with their length, so they can contain anything.
+//
+//   GET <name>...    Look up a batch of variables in one round trip. The
+//                    reply has one line per name, in order:
+//                      VAL <name> <len>\n<value>\n   if it has a value
+//                      NIL <name>\n                  if it doesn't
+//                    followed by END\n.
+//   SUB [<name>...]  Subscribe to changes of the named variables, or of all
+//                    variables if none are named. The reply is OK\n, after
+//                    which changes are pushed as they happen:
+//                      CHG <name> <len>\n<value>\n   changed value
+//                      DEL <name>\n                  deleted variable
+//
+// Anything else is answered with ERR <reason>\n. Clients that send overlong
+// lines or don't read their notifications are disconnected.
+
+// The longest request line accepted.
+#define NEVM_SOCKET_MAX_LINE 4096
+// How many bytes of replies and notifications a client can fall behind by
+// before it's disconnected.
+#define NEVM_SOCKET_MAX_BACKLOG (1024 * 1024)
+
+struct NotecardEnvVarSocket;
+typedef struct NotecardEnvVarSocket NotecardEnvVarSocket;
+
+NotecardEnvVarSocket *NotecardEnvVarSocket_open(const char *path,
+        const NotecardEnvVarManager *man);
+int NotecardEnvVarSocket_fd(const NotecardEnvVarSocket *sock);
+int NotecardEnvVarSocket_poll(NotecardEnvVarSocket *sock, int timeoutMs);
+void NotecardEnvVarSocket_notify(NotecardEnvVarSocket *sock, const char *var,
+                                 const char *val);
+size_t NotecardEnvVarSocket_numClients(const NotecardEnvVarSocket *sock);
+void NotecardEnvVarSocket_close(NotecardEnvVarSocket *sock);
+
+#ifdef __cplusplus
+}
+#endif
@@ -17,6 +17,8 @@
 #define HUB_SET_RETRY_SECONDS 5
 // Fetch every 20 seconds.
 #define FETCH_INTERVAL_SECONDS 20
+// Print the current configuration every 5 seconds.
+#define PRINT_INTERVAL_SECONDS 5
 
 // A struct to cache the values of environment variables.
 typedef struct {
@@ -34,10 +36,39 @@ const char *envVars[] = {
     "variable_b",
     "variable_c"
 };
+// Compiled-in defaults, used until the first fetch completes.
+const char *envVarDefaults[] = {
+    "default_a",
+    "default_b",
+    "default_c"
+};
 static const size_t numEnvVars = sizeof(envVars) / sizeof(envVars[0]);
 
 struct k_work envUpdateWorkItem;
 struct k_timer envUpdateTimer;
+// The manager isn't thread-safe, and it's used by both the main thread and
+// the system workqueue. The lock is only held while the manager is used, never
+// across Notecard I/O, so lookups don't wait on a fetch.
+K_MUTEX_DEFINE(envVarManagerLock);
+// Set while an env.get transaction is in flight, for the main loop to report.
+static atomic_t fetchInFlight = ATOMIC_INIT(0);
+static bool hubConfigured = false;
+
+// Issue the hub.set request to set the ProductUID on the Notecard.
+static bool configureHub(void)
+{
+    J *req = NoteNewRequest("hub.set");
+    if (PRODUCT_UID[0]) {
+        JAddStringToObject(req, "product", PRODUCT_UID);
+    }
+    JAddStringToObject(req, "mode", "continuous");
+    JAddBoolToObject(req, "sync", true);
+    JAddStringToObject(req, "sn", "zephyr-env-var-manager");
+    // Send the request with a retry timeout. If the Notecard has just started
+    // up, it may need a moment before it's able to receive and respond to
+    // requests.
+    return NoteRequestWithRetry(req, HUB_SET_RETRY_SECONDS);
+}
 
 // Callback that will be executed when the environment variable update timer
 // expires.
@@ -47,10 +78,41 @@ static void envUpdateTimerCb(struct k_timer *timer)
 }
 
 // Callback that will be executed by the system workqueue when it's time to
-// check for environment variable updates.
+// check for environment variable updates. All Notecard I/O happens here, off
+// the boot path: the application runs with the default values until the
+// first fetch completes.
 static void envUpdateWorkCb(struct k_work *item)
 {
-    NotecardEnvVarManager_fetch(envVarManager, envVars, numEnvVars);
+    if (!hubConfigured) {
+        if (!configureHub()) {
+            printk("hub.set failed, retrying on the next update.\n");
+            return;
+        }
+        hubConfigured = true;
+    }
+
+    // Split the fetch so that the lock is only held to build the request and
+    // to apply the response. The transaction, which waits on the Notecard,
+    // runs unlocked, and the main thread keeps serving the values the manager
+    // already has, flagged as stale until the response is applied.
+    k_mutex_lock(&envVarManagerLock, K_FOREVER);
+    J *req = NotecardEnvVarManager_buildFetchRequest(envVarManager, envVars,
+             numEnvVars);
+    k_mutex_unlock(&envVarManagerLock);
+    if (req == NULL) {
+        printk("Failed to build env.get request.\n");
+        return;
+    }
+
+    atomic_set(&fetchInFlight, 1);
+    J *rsp = NoteRequestResponse(req);
+    atomic_set(&fetchInFlight, 0);
+
+    k_mutex_lock(&envVarManagerLock, K_FOREVER);
+    NotecardEnvVarManager_applyFetchResponse(envVarManager, rsp, envVars,
+            numEnvVars);
+    k_mutex_unlock(&envVarManagerLock);
+    NoteDeleteResponse(rsp);
 }
 
 void envVarManagerCb(const char *var, const char *val, void *userCtx)
@@ -75,6 +137,22 @@ void envVarManagerCb(const char *var, const char *val, void *userCtx)
     printk("- variable_c has value %s\n", envVarCache.valueC);
 }
 
+void envVarRemovedCb(const char *var, void *userCtx)
+{
+    EnvVarCache *cache = (EnvVarCache *)userCtx;
+
+    printk("\nVariable \"%s\" was deleted.\n", var);
+
+    // Clear the cached value of a deleted variable.
+    if (strcmp(var, "variable_a") == 0) {
+        cache->valueA[0] = '\0';
+    } else if (strcmp(var, "variable_b") == 0) {
+        cache->valueB[0] = '\0';
+    } else if (strcmp(var, "variable_c") == 0) {
+        cache->valueC[0] = '\0';
+    }
+}
+
 int main(void)
 {
     // Initialize note-c references.
@@ -83,25 +161,6 @@ int main(void)
     NoteSetFnI2C(NOTE_I2C_ADDR_DEFAULT, NOTE_I2C_MAX_DEFAULT, note_i2c_reset,
                  note_i2c_transmit, note_i2c_receive);
 
-    k_work_init(&envUpdateWorkItem, envUpdateWorkCb);
-    k_timer_init(&envUpdateTimer, envUpdateTimerCb, NULL);
-
-    // Issue the hub.set request to set the ProductUID on the Notecard.
-    J *req = NoteNewRequest("hub.set");
-    if (PRODUCT_UID[0]) {
-        JAddStringToObject(req, "product", PRODUCT_UID);
-    }
-    JAddStringToObject(req, "mode", "continuous");
-    JAddBoolToObject(req, "sync", true);
-    JAddStringToObject(req, "sn", "zephyr-env-var-manager");
-    // Send the request with a retry timeout. If the Notecard has just started
-    // up, it may need a moment before it's able to receive and respond to
-    // requests.
-    if (!NoteRequestWithRetry(req, HUB_SET_RETRY_SECONDS)) {
-        printk("hub.set failed, aborting.\n");
-        return -1;
-    }
-
     // Allocate the environment variable manager.
     envVarManager = NotecardEnvVarManager_alloc();
     if (envVarManager == NULL) {
@@ -109,6 +168,16 @@ int main(void)
         return -1;
     }
 
+    // Seed the manager with the defaults so that lookups succeed right away.
+    // The callback below is only called for fetched values that differ from
+    // these.
+    if (NotecardEnvVarManager_setDefaults(envVarManager, envVars,
+                                          envVarDefaults, numEnvVars)
+            != NEVM_SUCCESS) {
+        printk("Failed to set env var defaults.\n");
+        return -1;
+    }
+
     // Set the callback for the manager, and give it a pointer to our cache
     // so that we can store the values of the environment variables we're
     // fetching.
@@ -118,8 +187,66 @@ int main(void)
         return -1;
     }
 
+    // Clear cached values when their variables are deleted.
+    if (NotecardEnvVarManager_setEnvVarRemovedCb(envVarManager,
+            envVarRemovedCb, &envVarCache) != NEVM_SUCCESS) {
+        printk("Failed to set env var manager removal callback.\n");
+        return -1;
+    }
+
+    // Queue changes for the main thread, so it can react to them without
+    // taking the lock. Values longer than the cache's buffers aren't stored.
+    if (NotecardEnvVarManager_enableEvents(envVarManager, numEnvVars,
+                                           sizeof(envVarCache.valueA) - 1)
+            != NEVM_SUCCESS) {
+        printk("Failed to enable env var events.\n");
+        return -1;
+    }
+
+    // Kick off the first fetch in the background right away.
+    k_work_init(&envUpdateWorkItem, envUpdateWorkCb);
+    k_timer_init(&envUpdateTimer, envUpdateTimerCb, NULL);
     k_timer_start(&envUpdateTimer, K_SECONDS(0),
                   K_SECONDS(FETCH_INTERVAL_SECONDS));
 
+    // The application's main loop. Values are available immediately, flagged
+    // as stale until the Notecard confirms them.
+    char val[16];
+    bool stale;
+    char name[16];
+    NotecardEnvVarEvent event;
+    while (true) {
+        // The event ring is lock-free, so changes can be handled here while
+        // a fetch runs on the work queue.
+        while (NotecardEnvVarManager_pollEvent(envVarManager, &event, name,
+                                               sizeof(name), val, sizeof(val))
+                == 1) {
+            if (event.removed) {
+                printk("%s was deleted\n", name);
+            } else {
+                printk("%s changed to %s in generation %u\n", name, val,
+                       (unsigned)event.generation);
+            }
+        }
+
+        // The lock is never held across the fetch's transaction, so this
+        // doesn't block while one is in flight: it gets the stale values.
+        if (atomic_get(&fetchInFlight)) {
+            printk("Fetch in flight, serving the last known values.\n");
+        }
+        k_mutex_lock(&envVarManagerLock, K_FOREVER);
+        for (size_t i = 0; i < numEnvVars; ++i) {
+            if (NotecardEnvVarManager_get(envVarManager, envVars[i], val,
+                                          sizeof(val), &stale)
+                    == NEVM_SUCCESS) {
+                printk("%s = %s%s\n", envVars[i], val,
+                       stale ? " (stale)" : "");
+            }
+        }
+        k_mutex_unlock(&envVarManagerLock);
+
+        k_sleep(K_SECONDS(PRINT_INTERVAL_SECONDS));
+    }
+
     return 0;
 }
@@ -0,0 +1,130 @@
+#!/bin/bash
+
+#
+# This script compiles the library for a target profile under each feature
+# configuration listed for that profile in footprint_configs.txt and reports
+# the size of the .text, .rodata, .data and .bss sections per configuration.
+# If any section exceeds its threshold, the script exits with a non-zero value.
+#
+# Profiles:
+#   cortex-m4         (default) A Cortex-M4 -Os build. Requires the Arm GNU
+#                     Toolchain (arm-none-eabi-gcc).
+#   x86_64-linux-gnu  An x86-64 Linux -Os build with the host's GCC, for
+#                     checking footprint changes without a cross toolchain.
+#
+# The note-c headers are needed to compile the library; pass the directory
+# containing note-c/ with -I (the CMake footprint target does this for you).
+#
+# If the profile's toolchain isn't installed, the script exits with a non-zero
+# value. Pass -s to skip the check with a zero exit value instead.
+#
+# The profile's toolchain and target flags can be overridden with the
+# CROSS_PREFIX and FOOTPRINT_CFLAGS environment variables.
+#
+
+PROFILE="cortex-m4"
+INCLUDE_DIRS=""
+SKIP_MISSING=0
+
+while [[ "$#" -gt 0 ]]; do
+    case $1 in
+        -p) PROFILE="$2"; shift ;;
+        -I) INCLUDE_DIRS="${INCLUDE_DIRS} -I$2"; shift ;;
+        -s) SKIP_MISSING=1 ;;
+        *) echo "Unknown parameter: $1"; exit 1 ;;
+    esac
+    shift
+done
+
+case $PROFILE in
+    cortex-m4)
+        CROSS_PREFIX=${CROSS_PREFIX-arm-none-eabi-}
+        FOOTPRINT_CFLAGS=${FOOTPRINT_CFLAGS-"-mcpu=cortex-m4 -mthumb -mfloat-abi=soft"}
+        TOOLCHAIN="the Arm GNU Toolchain"
+        ;;
+    x86_64-linux-gnu)
+        CROSS_PREFIX=${CROSS_PREFIX-x86_64-linux-gnu-}
+        FOOTPRINT_CFLAGS=${FOOTPRINT_CFLAGS-""}
+        TOOLCHAIN="GCC for x86-64 Linux"
+        ;;
+    *) echo "Unknown profile: $PROFILE"; exit 1 ;;
+esac
+
+SCRIPT_DIR=$( cd -- "$( dirname -- "${BASH_SOURCE[0]}" )" &> /dev/null && pwd )
+ROOT_SRC_DIR="$SCRIPT_DIR/.."
+CONFIG_FILE="$SCRIPT_DIR/footprint_configs.txt"
+CC="${CROSS_PREFIX}gcc"
+SIZE="${CROSS_PREFIX}size"
+
+if [[ ! $(which $CC) || ! $(which $SIZE) ]]; then
+    echo "$CC or $SIZE not found. Install $TOOLCHAIN to run the $PROFILE" \
+         "footprint check."
+    if [[ $SKIP_MISSING -ne 0 ]]; then
+        echo "Skipping the $PROFILE footprint check."
+        exit 0
+    fi
+    exit 1
+fi
+
+OBJ_DIR=$(mktemp -d)
+trap "rm -rf $OBJ_DIR" EXIT
+
+FAILED=0
+echo "Profile: $PROFILE ($($CC -dumpfullversion -dumpversion 2>/dev/null | head -n 1))"
+printf "%-14s %8s %8s %8s %8s  %s\n" "config" "text" "rodata" "data" "bss" "status"
+
+while read -r LINE_PROFILE NAME MAX_TEXT MAX_RODATA MAX_DATA MAX_BSS FLAGS; do
+    # Skip comments, blank lines and other profiles.
+    if [[ -z "$LINE_PROFILE" || "$LINE_PROFILE" == \#* ||
+          "$LINE_PROFILE" != "$PROFILE" ]]; then
+        continue
+    fi
+
+    DEFINES=""
+    if [[ "$FLAGS" != "-" ]]; then
+        for FLAG in $FLAGS; do
+            DEFINES="${DEFINES} -D${FLAG}"
+        done
+    fi
+
+    rm -f $OBJ_DIR/*.o
+    for SRC in "$ROOT_SRC_DIR"/src/*.c; do
+        OBJ="$OBJ_DIR/$(basename "$SRC" .c).o"
+        if ! $CC $FOOTPRINT_CFLAGS -Os -ffunction-sections -fdata-sections \
+                -Wall -Werror $DEFINES -I"$ROOT_SRC_DIR/src" $INCLUDE_DIRS \
+                -c "$SRC" -o "$OBJ"; then
+            echo "Failed to compile $SRC for configuration $NAME."
+            exit 1
+        fi
+    done
+
+    # Sum the sizes of the sections of each kind across all objects. With
+    # -ffunction-sections and -fdata-sections, every function and object has
+    # a section of its own (e.g. .text.NotecardEnvVarManager_fetch).
+    read -r TEXT RODATA DATA BSS <<< $($SIZE -A $OBJ_DIR/*.o | awk '
+        $1 ~ /^\.text/   { text += $2 }
+        $1 ~ /^\.rodata/ { rodata += $2 }
+        $1 ~ /^\.data/   { data += $2 }
+        $1 ~ /^\.bss/    { bss += $2 }
+        END { print text + 0, rodata + 0, data + 0, bss + 0 }')
+
+    STATUS="ok"
+    for PAIR in "text $TEXT $MAX_TEXT" "rodata $RODATA $MAX_RODATA" \
+                "data $DATA $MAX_DATA" "bss $BSS $MAX_BSS"; do
+        read -r SECTION SIZE_BYTES MAX_BYTES <<< "$PAIR"
+        if [[ $SIZE_BYTES -gt $MAX_BYTES ]]; then
+            STATUS="FAIL (.$SECTION > $MAX_BYTES)"
+            FAILED=1
+            break
+        fi
+    done
+
+    printf "%-14s %8d %8d %8d %8d  %s\n" "$NAME" $TEXT $RODATA $DATA $BSS "$STATUS"
+done < "$CONFIG_FILE"
+
+if [[ $FAILED -ne 0 ]]; then
+    echo "Footprint thresholds exceeded."
+    exit 1
+fi
+
+echo "Footprint within thresholds."
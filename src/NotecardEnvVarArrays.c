@@ -0,0 +1,424 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+#include "NotecardEnvVarManagerInternal.h"
+
+#ifdef NEVM_ENABLE_TYPES
+
+// Array-valued variables hold comma-separated numbers, such as a calibration
+// table "0.5, 1.25, 2". The caller binds a variable to a buffer of its own,
+// and whenever a fetch (or a restore or default) provides a value for the
+// variable, the numbers are parsed straight from the value into the buffer,
+// before the user's callback is called. No intermediate strings are made.
+//
+// A value is parsed in two passes. The first counts the commas, which is a
+// branch-free loop that compilers vectorize, so a value with more elements
+// than the buffer holds is rejected before the buffer is touched. The second
+// runs the number parsers from element to element, each stopping at its
+// delimiter.
+//
+// Blob variables hold base64, such as a certificate, and are bound to a byte
+// buffer that they're decoded into directly. The decoder looks each character
+// up in a table and, between line breaks and padding, decodes whole groups of
+// four characters into three bytes with a single check for special
+// characters.
+//
+// A value that comes back unchanged on every fetch isn't parsed again: the
+// value store already reports whether it changed. Values too long to store
+// can't be compared with the stored value, so for those each binding keeps
+// the FNV-1a hash and length of the last one it parsed instead.
+
+// _base64 entries for characters that aren't digits.
+#define NEVM_BASE64_SPACE   0x40
+#define NEVM_BASE64_PAD     0x41
+#define NEVM_BASE64_INVALID 0xFF
+
+// The value of each base64 digit, in the standard or the URL-safe alphabet,
+// indexed by ASCII character.
+static const uint8_t _base64[128] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x40, 0x40, 0xFF, 0xFF, 0x40, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0x40, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0x3E, 0xFF, 0x3F,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B,
+    0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0x41, 0xFF, 0xFF,
+    0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+    0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+    0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16,
+    0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0x3F,
+    0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20,
+    0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30,
+    0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+static inline const char *_skipSpaces(const char *p, const char *end)
+{
+    while (p < end && *p == ' ') {
+        ++p;
+    }
+
+    return p;
+}
+
+/**
+ * Internal function to parse a comma-separated value into an array's buffer.
+ *
+ * @return The number of elements on success and -1 on failure, in which case
+ *         the buffer may have been partly overwritten.
+ */
+static long _parseArray(const nevmArray *array, const char *val,
+                        size_t valLen)
+{
+    if (valLen == 0) {
+        return 0;
+    }
+
+    size_t count = 1;
+    for (size_t i = 0; i < valLen; ++i) {
+        count += (val[i] == ',');
+    }
+    if (count > array->maxLen) {
+        NOTE_C_LOG_ERROR("Array value has too many elements.\r\n");
+        return -1;
+    }
+
+    const char *end = val + valLen;
+    const char *p = val;
+    for (size_t i = 0; i < count; ++i) {
+        p = _skipSpaces(p, end);
+        NotecardEnvVarParseResult result;
+        if (array->type == NEVM_ARRAY_FLOAT) {
+            result = NotecardEnvVarManager_parseFloat(p, end - p,
+                     (float *)array->buf + i);
+        } else {
+            result = NotecardEnvVarManager_parseInt32(p, end - p,
+                     (int32_t *)array->buf + i);
+        }
+        if (result.ec != NEVM_PARSE_OK) {
+            NOTE_C_LOG_ERROR("Invalid array element.\r\n");
+            return -1;
+        }
+
+        // The element must be followed by its delimiter, or by the end of
+        // the value if it's the last one.
+        p = _skipSpaces(result.ptr, end);
+        if (p < end && *p == ',' && i + 1 < count) {
+            ++p;
+        } else if (p != end || i + 1 < count) {
+            NOTE_C_LOG_ERROR("Invalid array element.\r\n");
+            return -1;
+        }
+    }
+
+    return (long)count;
+}
+
+/**
+ * Internal function to decode a base64 value into a blob's buffer. Whitespace
+ * is ignored, and padding is optional.
+ *
+ * @return The number of bytes on success and -1 on failure, in which case
+ *         the buffer may have been partly overwritten.
+ */
+static long _decodeBase64(const nevmArray *array, const char *val,
+                          size_t valLen)
+{
+    const uint8_t *p = (const uint8_t *)val;
+    const uint8_t *end = p + valLen;
+    uint8_t *out = (uint8_t *)array->buf;
+    size_t n = 0;
+    uint32_t acc = 0;
+    unsigned digits = 0;
+    bool padded = false;
+
+    while (p < end) {
+        // Whole groups, the common case.
+        if (digits == 0) {
+            for (; end - p >= 4 && n + 3 <= array->maxLen; p += 4, n += 3) {
+                if ((p[0] | p[1] | p[2] | p[3]) & 0x80) {
+                    break;
+                }
+                uint32_t a = _base64[p[0]];
+                uint32_t b = _base64[p[1]];
+                uint32_t c = _base64[p[2]];
+                uint32_t d = _base64[p[3]];
+                if ((a | b | c | d) & 0xC0) {
+                    break;
+                }
+                uint32_t group = (a << 18) | (b << 12) | (c << 6) | d;
+                out[n] = (uint8_t)(group >> 16);
+                out[n + 1] = (uint8_t)(group >> 8);
+                out[n + 2] = (uint8_t)group;
+            }
+            if (p == end) {
+                break;
+            }
+        }
+
+        uint8_t c = (*p & 0x80) ? NEVM_BASE64_INVALID : _base64[*p];
+        ++p;
+        if (c == NEVM_BASE64_SPACE) {
+            continue;
+        }
+        if (c == NEVM_BASE64_PAD) {
+            padded = true;
+            break;
+        }
+        if (c == NEVM_BASE64_INVALID) {
+            NOTE_C_LOG_ERROR("Invalid base64 value.\r\n");
+            return -1;
+        }
+        acc = (acc << 6) | c;
+        if (++digits == 4) {
+            if (n + 3 > array->maxLen) {
+                NOTE_C_LOG_ERROR("Blob value too long.\r\n");
+                return -1;
+            }
+            out[n++] = (uint8_t)(acc >> 16);
+            out[n++] = (uint8_t)(acc >> 8);
+            out[n++] = (uint8_t)acc;
+            acc = 0;
+            digits = 0;
+        }
+    }
+
+    // Only padding and whitespace may follow padding, which must end a group
+    // of 2 or 3 digits. A lone digit can't make a byte.
+    for (; padded && p < end; ++p) {
+        if (*p != '=' && ((*p & 0x80) || _base64[*p] != NEVM_BASE64_SPACE)) {
+            break;
+        }
+    }
+    if (p < end || digits == 1 || (padded && digits == 0)) {
+        NOTE_C_LOG_ERROR("Invalid base64 value.\r\n");
+        return -1;
+    }
+    if (n + (digits ? digits - 1 : 0) > array->maxLen) {
+        NOTE_C_LOG_ERROR("Blob value too long.\r\n");
+        return -1;
+    }
+    if (digits == 2) {
+        out[n++] = (uint8_t)(acc >> 4);
+    } else if (digits == 3) {
+        out[n++] = (uint8_t)(acc >> 10);
+        out[n++] = (uint8_t)(acc >> 2);
+    }
+
+    return (long)n;
+}
+
+/**
+ * Internal function to parse a value into an array's buffer, unless it's the
+ * value parsed last time. A value that fails to parse sets the array's length
+ * to 0.
+ *
+ * @param array   The array.
+ * @param val     The value.
+ * @param valLen  The length of val.
+ * @param stored  Whether val is the variable's value in the store.
+ * @param changed Whether the stored value changed. Ignored if val isn't
+ *                stored.
+ */
+static void _apply(nevmArray *array, const char *val, size_t valLen,
+                   bool stored, bool changed)
+{
+    if (stored && !changed && array->parsed && array->stored) {
+        return;
+    }
+    uint32_t valHash = 0;
+    if (!stored) {
+        valHash = _nevmHash(val, valLen);
+        if (array->parsed && !array->stored && array->valHash == valHash &&
+                array->valLen == valLen) {
+            return;
+        }
+    }
+
+    long count = (array->type == NEVM_ARRAY_BLOB) ?
+                 _decodeBase64(array, val, valLen) :
+                 _parseArray(array, val, valLen);
+    *array->len = (count >= 0) ? (size_t)count : 0;
+    array->valHash = valHash;
+    array->valLen = valLen;
+    array->parsed = true;
+    array->stored = stored;
+}
+
+/**
+ * Internal function to parse a variable's value into the buffer bound to it,
+ * if any. See _apply for stored and changed.
+ */
+void _nevmArraysApply(NotecardEnvVarManager *man, const char *var,
+                      size_t varLen, const char *val, size_t valLen,
+                      bool stored, bool changed)
+{
+    uint32_t nameHash = _nevmHash(var, varLen);
+    for (uint16_t i = 0; i < man->numArrays; ++i) {
+        nevmArray *array = &man->arrays[i];
+        if (array->nameHash == nameHash && array->nameLen == varLen &&
+                memcmp(array->name, var, varLen) == 0) {
+            _apply(array, val, valLen, stored, changed);
+            return;
+        }
+    }
+}
+
+/**
+ * Internal function to bind, rebind or unbind an array.
+ */
+static int _bind(NotecardEnvVarManager *man, const char *var, uint8_t type,
+                 void *buf, size_t maxLen, size_t *len)
+{
+    if (man == NULL || var == NULL || (buf != NULL && len == NULL)) {
+        NOTE_C_LOG_ERROR("NULL parameter.\r\n");
+        return NEVM_FAILURE;
+    }
+    size_t nameLen = strlen(var);
+    if (nameLen > NEVM_MAX_STORED_LEN) {
+        NOTE_C_LOG_ERROR("Variable name too long.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    uint32_t nameHash = _nevmHash(var, nameLen);
+    uint16_t i = 0;
+    for (; i < man->numArrays; ++i) {
+        const nevmArray *array = &man->arrays[i];
+        if (array->nameHash == nameHash && array->nameLen == nameLen &&
+                memcmp(array->name, var, nameLen) == 0) {
+            break;
+        }
+    }
+
+    if (buf == NULL) {
+        if (i < man->numArrays) {
+            man->arrays[i] = man->arrays[--man->numArrays];
+        }
+        return NEVM_SUCCESS;
+    }
+
+    if (i == man->numArrays) {
+        if (man->numArrays == man->capArrays) {
+            if (man->capArrays >= NEVM_MAX_ENTRIES) {
+                NOTE_C_LOG_ERROR("Too many arrays.\r\n");
+                return NEVM_FAILURE;
+            }
+            uint16_t capArrays = man->capArrays ? man->capArrays * 2 : 4;
+            nevmArray *arrays = (nevmArray *)NoteMalloc(capArrays *
+                                sizeof(nevmArray));
+            if (arrays == NULL) {
+                NOTE_C_LOG_ERROR("Out of memory.\r\n");
+                return NEVM_FAILURE;
+            }
+            if (man->numArrays > 0) {
+                memcpy(arrays, man->arrays, man->numArrays * sizeof(nevmArray));
+            }
+            NoteFree(man->arrays);
+            man->arrays = arrays;
+            man->capArrays = capArrays;
+        }
+        ++man->numArrays;
+    }
+
+    nevmArray *array = &man->arrays[i];
+    array->name = var;
+    array->buf = buf;
+    array->len = len;
+    array->maxLen = maxLen;
+    array->valLen = 0;
+    array->nameHash = nameHash;
+    array->valHash = 0;
+    array->nameLen = (uint16_t)nameLen;
+    array->type = type;
+    array->parsed = false;
+    array->stored = false;
+    *len = 0;
+
+    // Start from the value the manager already has, such as a default.
+    int idx = _nevmStoreFind(man, var, nameLen);
+    if (idx >= 0 && !(man->entries[idx].flags & NEVM_ENTRY_REMOVED)) {
+        const nevmEntry *entry = &man->entries[idx];
+        _apply(array, _nevmEntryVal(entry), entry->valLen, true, true);
+    }
+
+    return NEVM_SUCCESS;
+}
+
+/**
+ * Bind an array-valued variable, holding comma-separated numbers such as
+ * "0.5, 1.25, 2", to a buffer of floats. Whenever a fetch, restore or default
+ * provides a new value for the variable, it's parsed into buf before the
+ * user's callback is called, and *len is set to the number of elements. If the
+ * value is malformed or has more than maxLen elements, *len is set to 0 and
+ * buf may have been partly overwritten. A removed variable leaves buf alone.
+ * Binding a variable again replaces its buffer.
+ *
+ * @param man    Pointer to a NotecardEnvVarManager object.
+ * @param var    The variable name, which must stay valid while it's bound.
+ * @param buf    The buffer, or NULL to unbind the variable.
+ * @param maxLen The number of elements buf holds.
+ * @param len    Set to the number of elements in buf. It's set to 0 until a
+ *               value is parsed.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarManager_bindFloatArray(NotecardEnvVarManager *man,
+        const char *var, float *buf,
+        size_t maxLen, size_t *len)
+{
+    return _bind(man, var, NEVM_ARRAY_FLOAT, buf, maxLen, len);
+}
+
+/**
+ * Bind an array-valued variable, holding comma-separated integers, to a
+ * buffer of int32_ts. See NotecardEnvVarManager_bindFloatArray.
+ *
+ * @param man    Pointer to a NotecardEnvVarManager object.
+ * @param var    The variable name, which must stay valid while it's bound.
+ * @param buf    The buffer, or NULL to unbind the variable.
+ * @param maxLen The number of elements buf holds.
+ * @param len    Set to the number of elements in buf. It's set to 0 until a
+ *               value is parsed.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarManager_bindInt32Array(NotecardEnvVarManager *man,
+        const char *var, int32_t *buf,
+        size_t maxLen, size_t *len)
+{
+    return _bind(man, var, NEVM_ARRAY_INT32, buf, maxLen, len);
+}
+
+/**
+ * Bind a blob variable, holding base64 such as a certificate, to a byte
+ * buffer. Whenever a fetch, restore or default provides a new value for the
+ * variable, it's decoded directly into buf before the user's callback is
+ * called, and *len is set to the number of bytes. The standard and URL-safe
+ * alphabets are accepted, whitespace such as line breaks is ignored, and
+ * padding is optional. If the value isn't valid base64 or decodes to more
+ * than maxLen bytes, *len is set to 0 and buf may have been partly
+ * overwritten. A removed variable leaves buf alone. Binding a variable again
+ * replaces its buffer.
+ *
+ * @param man    Pointer to a NotecardEnvVarManager object.
+ * @param var    The variable name, which must stay valid while it's bound.
+ * @param buf    The buffer, or NULL to unbind the variable.
+ * @param maxLen The size of buf in bytes.
+ * @param len    Set to the number of bytes in buf. It's set to 0 until a
+ *               value is decoded.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarManager_bindBlob(NotecardEnvVarManager *man,
+                                   const char *var, uint8_t *buf,
+                                   size_t maxLen, size_t *len)
+{
+    return _bind(man, var, NEVM_ARRAY_BLOB, buf, maxLen, len);
+}
+
+#endif // NEVM_ENABLE_TYPES
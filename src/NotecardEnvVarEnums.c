@@ -0,0 +1,216 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+#include "NotecardEnvVarManagerInternal.h"
+
+#ifdef NEVM_ENABLE_TYPES
+
+// Enum variables hold one of a fixed set of strings, such as a power mode
+// "low", "normal" or "turbo". The caller binds a variable to its names and an
+// int, and whenever a fetch (or a restore or default) provides a value for the
+// variable, the value is resolved to its index in the names and stored in the
+// int, before the user's callback is called. Handlers then switch on the int
+// instead of comparing strings on every use.
+//
+// When a variable is bound, a lookup table is generated for its names: an
+// open-addressing hash table with linear probing, like the value store's
+// index, holding at least twice as many slots as names. Resolving a value then
+// costs one hash pass and, on average, less than two slot loads and string
+// comparisons, however many names there are.
+
+/**
+ * Internal function to generate the lookup table for an enum's names.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+static int _buildLookup(nevmEnum *en)
+{
+    uint16_t numSlots = 2;
+    while (numSlots < 2 * en->numNames) {
+        numSlots *= 2;
+    }
+    uint8_t *slots = (uint8_t *)NoteMalloc(numSlots);
+    if (slots == NULL) {
+        NOTE_C_LOG_ERROR("Out of memory.\r\n");
+        return NEVM_FAILURE;
+    }
+    memset(slots, 0, numSlots);
+
+    uint16_t slotMask = numSlots - 1;
+    for (uint16_t i = 0; i < en->numNames; ++i) {
+        const char *name = en->names[i];
+        uint16_t slot = _nevmHash(name, strlen(name)) & slotMask;
+        while (slots[slot] != 0) {
+            if (strcmp(en->names[slots[slot] - 1], name) == 0) {
+                NOTE_C_LOG_ERROR("Duplicate enum name.\r\n");
+                NoteFree(slots);
+                return NEVM_FAILURE;
+            }
+            slot = (slot + 1) & slotMask;
+        }
+        slots[slot] = (uint8_t)(i + 1);
+    }
+    en->slots = slots;
+    en->slotMask = slotMask;
+
+    return NEVM_SUCCESS;
+}
+
+/**
+ * Internal function to resolve a value to the index of its name.
+ */
+static int _resolve(const nevmEnum *en, const char *val, size_t valLen)
+{
+    uint16_t slot = _nevmHash(val, valLen) & en->slotMask;
+    while (en->slots[slot] != 0) {
+        const char *name = en->names[en->slots[slot] - 1];
+        if (strncmp(name, val, valLen) == 0 && name[valLen] == '\0') {
+            return en->slots[slot] - 1;
+        }
+        slot = (slot + 1) & en->slotMask;
+    }
+
+    NOTE_C_LOG_WARN("Invalid enum value.\r\n");
+    return NEVM_ENUM_INVALID;
+}
+
+/**
+ * Internal function to resolve a variable's value into the int bound to it,
+ * if any.
+ */
+void _nevmEnumsApply(NotecardEnvVarManager *man, const char *var,
+                     size_t varLen, const char *val, size_t valLen)
+{
+    uint32_t nameHash = _nevmHash(var, varLen);
+    for (uint16_t i = 0; i < man->numEnums; ++i) {
+        const nevmEnum *en = &man->enums[i];
+        if (en->nameHash == nameHash && en->nameLen == varLen &&
+                memcmp(en->name, var, varLen) == 0) {
+            *en->value = _resolve(en, val, valLen);
+            return;
+        }
+    }
+}
+
+/**
+ * Internal function to free the enum bindings.
+ */
+void _nevmEnumsFree(NotecardEnvVarManager *man)
+{
+    for (uint16_t i = 0; i < man->numEnums; ++i) {
+        NoteFree(man->enums[i].slots);
+    }
+    NoteFree(man->enums);
+}
+
+/**
+ * Bind an enum variable, holding one of a fixed set of names such as "low",
+ * "normal" or "turbo", to an int. Whenever a fetch, restore or default
+ * provides a new value for the variable, *value is set to the value's index
+ * in names before the user's callback is called, or to NEVM_ENUM_INVALID if
+ * the value isn't one of the names, which is also logged. A removed variable
+ * leaves *value alone. Binding a variable again replaces its names and int.
+ * The names must be distinct.
+ *
+ * @param man      Pointer to a NotecardEnvVarManager object.
+ * @param var      The variable name, which must stay valid while it's bound.
+ * @param names    The names, which must stay valid while the variable is
+ *                 bound, or NULL to unbind the variable.
+ * @param numNames The number of names, from 1 to NEVM_MAX_ENUM_NAMES.
+ * @param value    Set to the index of the variable's value in names. It's set
+ *                 to NEVM_ENUM_INVALID until the variable has a value.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarManager_bindEnum(NotecardEnvVarManager *man,
+                                   const char *var,
+                                   const char *const *names,
+                                   size_t numNames, int *value)
+{
+    if (man == NULL || var == NULL || (names != NULL && value == NULL)) {
+        NOTE_C_LOG_ERROR("NULL parameter.\r\n");
+        return NEVM_FAILURE;
+    }
+    if (names != NULL && (numNames == 0 || numNames > NEVM_MAX_ENUM_NAMES)) {
+        NOTE_C_LOG_ERROR("Invalid number of enum names.\r\n");
+        return NEVM_FAILURE;
+    }
+    size_t nameLen = strlen(var);
+    if (nameLen > NEVM_MAX_STORED_LEN) {
+        NOTE_C_LOG_ERROR("Variable name too long.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    uint32_t nameHash = _nevmHash(var, nameLen);
+    uint16_t i = 0;
+    for (; i < man->numEnums; ++i) {
+        const nevmEnum *en = &man->enums[i];
+        if (en->nameHash == nameHash && en->nameLen == nameLen &&
+                memcmp(en->name, var, nameLen) == 0) {
+            break;
+        }
+    }
+
+    if (names == NULL) {
+        if (i < man->numEnums) {
+            NoteFree(man->enums[i].slots);
+            man->enums[i] = man->enums[--man->numEnums];
+        }
+        return NEVM_SUCCESS;
+    }
+
+    nevmEnum en;
+    en.name = var;
+    en.names = names;
+    en.value = value;
+    en.slots = NULL;
+    en.nameHash = nameHash;
+    en.numNames = (uint16_t)numNames;
+    en.nameLen = (uint16_t)nameLen;
+    if (_buildLookup(&en) != NEVM_SUCCESS) {
+        return NEVM_FAILURE;
+    }
+
+    if (i == man->numEnums) {
+        if (man->numEnums == man->capEnums) {
+            if (man->capEnums >= NEVM_MAX_ENTRIES) {
+                NOTE_C_LOG_ERROR("Too many enums.\r\n");
+                NoteFree(en.slots);
+                return NEVM_FAILURE;
+            }
+            uint16_t capEnums = man->capEnums ? man->capEnums * 2 : 4;
+            nevmEnum *enums = (nevmEnum *)NoteMalloc(capEnums *
+                              sizeof(nevmEnum));
+            if (enums == NULL) {
+                NOTE_C_LOG_ERROR("Out of memory.\r\n");
+                NoteFree(en.slots);
+                return NEVM_FAILURE;
+            }
+            if (man->numEnums > 0) {
+                memcpy(enums, man->enums, man->numEnums * sizeof(nevmEnum));
+            }
+            NoteFree(man->enums);
+            man->enums = enums;
+            man->capEnums = capEnums;
+        }
+        ++man->numEnums;
+    } else {
+        NoteFree(man->enums[i].slots);
+    }
+    man->enums[i] = en;
+    *value = NEVM_ENUM_INVALID;
+
+    // Start from the value the manager already has, such as a default.
+    int idx = _nevmStoreFind(man, var, nameLen);
+    if (idx >= 0 && !(man->entries[idx].flags & NEVM_ENTRY_REMOVED)) {
+        const nevmEntry *entry = &man->entries[idx];
+        *value = _resolve(&en, _nevmEntryVal(entry), entry->valLen);
+    }
+
+    return NEVM_SUCCESS;
+}
+
+#endif // NEVM_ENABLE_TYPES
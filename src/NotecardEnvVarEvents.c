@@ -0,0 +1,353 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+#include "NotecardEnvVarManagerInternal.h"
+
+#ifdef NEVM_ENABLE_EVENTS
+
+#ifndef __GNUC__
+#error "NEVM_ENABLE_EVENTS requires the GCC __atomic builtins."
+#endif
+
+// The change-event ring is a single-producer, single-consumer queue of entry
+// indices. The producer is the fetch, which pushes an entry when its value
+// changes or it's removed. The consumer is an application thread calling
+// NotecardEnvVarManager_pollEvent. Neither side takes a lock.
+//
+// Events don't carry copies of the values. The consumer copies the name and
+// value out of the value store when it polls, guarded by a per-entry sequence
+// lock: the producer makes an entry's sequence number odd while it writes the
+// entry, and the consumer retries or gives up if the number changed under it.
+// Everything the consumer reads while the producer may be writing it is
+// accessed atomically: the value's bytes, and a copy of the entry's value
+// length, generation and removed flag that the producer publishes when it
+// finishes writing the entry. The rest of the entry doesn't change once it's
+// been pushed.
+// The store is allocated at full size when events are enabled, so the entries
+// array never moves, and every value block is given room for the longest value
+// the application expects, so that values are always updated in place and a
+// block the consumer is copying from is never freed.
+//
+// Each entry has a queued flag, set by the producer when it pushes the entry
+// and cleared by the consumer when it pops it. A change to an entry that's
+// already queued isn't pushed again, since the consumer reads the latest value
+// anyway. The ring therefore never holds more events than there are entries,
+// and a ring with one slot per entry can't overflow.
+
+// Result of reading an entry that the producer wrote at the same time.
+#define NEVM_READ_TORN 1
+
+/**
+ * Internal function to start writing an entry that the event consumer may be
+ * reading.
+ */
+void _nevmEventWriteBegin(NotecardEnvVarManager *man, uint16_t idx)
+{
+    if (man->eventSeq == NULL) {
+        return;
+    }
+
+    uint32_t seq = __atomic_load_n(&man->eventSeq[idx], __ATOMIC_RELAXED);
+    __atomic_store_n(&man->eventSeq[idx], seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * Internal function to write a value in place, between _nevmEventWriteBegin and
+ * _nevmEventWriteEnd, where the event consumer may be copying it.
+ */
+void _nevmEventWriteVal(NotecardEnvVarManager *man, char *dst, const char *val,
+                        size_t valLen)
+{
+    if (man->eventSeq == NULL) {
+        memcpy(dst, val, valLen);
+        dst[valLen] = '\0';
+        return;
+    }
+
+    for (size_t i = 0; i < valLen; ++i) {
+        __atomic_store_n(&dst[i], val[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&dst[valLen], '\0', __ATOMIC_RELAXED);
+}
+
+/**
+ * Internal function to finish writing an entry started with
+ * _nevmEventWriteBegin, publishing the fields the event consumer reads.
+ */
+void _nevmEventWriteEnd(NotecardEnvVarManager *man, uint16_t idx)
+{
+    if (man->eventSeq == NULL) {
+        return;
+    }
+
+    const nevmEntry *entry = &man->entries[idx];
+    __atomic_store_n(&man->eventValLen[idx], entry->valLen,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&man->eventGeneration[idx], entry->generation,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&man->eventRemoved[idx],
+                     (entry->flags & NEVM_ENTRY_REMOVED) != 0,
+                     __ATOMIC_RELAXED);
+    uint32_t seq = __atomic_load_n(&man->eventSeq[idx], __ATOMIC_RELAXED);
+    __atomic_store_n(&man->eventSeq[idx], seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Internal function to push a change event for an entry, unless one is already
+ * queued.
+ */
+void _nevmEventPush(NotecardEnvVarManager *man, uint16_t idx)
+{
+    if (man->eventRing == NULL ||
+            __atomic_exchange_n(&man->eventQueued[idx], 1, __ATOMIC_SEQ_CST)) {
+        return;
+    }
+
+    uint32_t head = man->eventHead;
+    man->eventRing[head & (man->capEntries - 1)] = idx;
+    __atomic_store_n(&man->eventHead, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Internal function to free the event ring.
+ */
+void _nevmEventsFree(NotecardEnvVarManager *man)
+{
+    NoteFree(man->eventSeq);
+}
+
+/**
+ * Internal function to give the value blocks of the entries already in the
+ * store room for valCap bytes.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+static int _reserveValues(NotecardEnvVarManager *man, uint16_t valCap)
+{
+    for (uint16_t i = 0; i < man->numEntries; ++i) {
+        nevmEntry *entry = &man->entries[i];
+        if (entry->valCap >= valCap) {
+            continue;
+        }
+
+        size_t size = entry->nameLen + 1 + entry->valLen + 1;
+        char *str = (char *)NoteMalloc(entry->nameLen + 1 + valCap);
+        if (str == NULL) {
+            NOTE_C_LOG_ERROR("Out of memory.\r\n");
+            return NEVM_FAILURE;
+        }
+        memcpy(str, entry->str, size);
+        NoteFree(entry->str);
+        entry->str = str;
+        entry->valCap = valCap;
+    }
+
+    return NEVM_SUCCESS;
+}
+
+/**
+ * Internal function to copy an entry out of the value store for the consumer.
+ *
+ * @return NEVM_SUCCESS on success, NEVM_READ_TORN if the producer wrote the
+ *         entry during the copy and NEVM_FAILURE if a buffer is too small.
+ */
+static int _readEntry(const NotecardEnvVarManager *man, uint16_t idx,
+                      NotecardEnvVarEvent *event, char *name, size_t nameLen,
+                      char *val, size_t valLen, uint32_t *seq)
+{
+    *seq = __atomic_load_n(&man->eventSeq[idx], __ATOMIC_ACQUIRE);
+    if (*seq & 1) {
+        return NEVM_READ_TORN;
+    }
+
+    const nevmEntry *entry = &man->entries[idx];
+    uint16_t entryNameLen = entry->nameLen;
+    uint16_t entryValLen = __atomic_load_n(&man->eventValLen[idx],
+                                           __ATOMIC_RELAXED);
+    bool tooSmall = (name != NULL && entryNameLen >= nameLen) ||
+                    (val != NULL && entryValLen >= valLen) ||
+                    entryValLen >= entry->valCap;
+    if (!tooSmall) {
+        if (name != NULL) {
+            memcpy(name, entry->str, entryNameLen);
+            name[entryNameLen] = '\0';
+        }
+        if (val != NULL) {
+            const char *src = entry->str + entryNameLen + 1;
+            for (uint16_t i = 0; i < entryValLen; ++i) {
+                val[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+            }
+            val[entryValLen] = '\0';
+        }
+    }
+    event->id = idx;
+    event->removed = __atomic_load_n(&man->eventRemoved[idx],
+                                     __ATOMIC_RELAXED);
+    event->generation = __atomic_load_n(&man->eventGeneration[idx],
+                                        __ATOMIC_RELAXED);
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&man->eventSeq[idx], __ATOMIC_RELAXED) != *seq) {
+        return NEVM_READ_TORN;
+    }
+    if (tooSmall) {
+        NOTE_C_LOG_ERROR("Buffer too small for event.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    return NEVM_SUCCESS;
+}
+
+/**
+ * Enable the change-event ring, which lets an application thread consume
+ * changes with NotecardEnvVarManager_pollEvent instead of handling them in
+ * callbacks, without a mutex. Each fetch that changes or removes a variable
+ * pushes an event for it. An event that's still queued when the variable
+ * changes again is kept, and the consumer reads the latest value, so the ring
+ * never overflows.
+ *
+ * Enabling events allocates the value store for maxVars variables, with room
+ * for values of maxValLen characters, up front, and the store doesn't grow
+ * after that. Once it's full, each new variable fails to be stored, and "More
+ * variables than reserved by enableEvents." is logged. Likewise, a value
+ * longer than maxValLen fails to be stored, and "Value longer than reserved by
+ * enableEvents." is logged. The variable is still passed to the callbacks,
+ * but NotecardEnvVarManager_get doesn't find it (or keeps returning its
+ * previous value), it isn't persisted and it doesn't produce events, and a
+ * default that doesn't fit makes NotecardEnvVarManager_setDefaults fail. Size
+ * maxVars and maxValLen for every variable the application uses. Enable events
+ * before starting the consumer, and restore from storage before enabling
+ * them, since restores don't produce events.
+ *
+ * @param man       Pointer to a NotecardEnvVarManager object.
+ * @param maxVars   The maximum number of variables the manager will store.
+ * @param maxValLen The maximum length of a value, excluding its terminator.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarManager_enableEvents(NotecardEnvVarManager *man,
+                                       size_t maxVars, size_t maxValLen)
+{
+    if (man == NULL) {
+        NOTE_C_LOG_ERROR("NULL manager.\r\n");
+        return NEVM_FAILURE;
+    }
+    if (man->eventRing != NULL) {
+        NOTE_C_LOG_ERROR("Events already enabled.\r\n");
+        return NEVM_FAILURE;
+    }
+    if (maxVars == 0 || maxVars > NEVM_MAX_ENTRIES) {
+        NOTE_C_LOG_ERROR("Invalid maximum number of variables.\r\n");
+        return NEVM_FAILURE;
+    }
+    if (maxValLen >= NEVM_MAX_STORED_LEN) {
+        NOTE_C_LOG_ERROR("Invalid maximum value length.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    while (man->capEntries < maxVars) {
+        if (_nevmStoreGrow(man) != NEVM_SUCCESS) {
+            return NEVM_FAILURE;
+        }
+    }
+    if (_reserveValues(man, (uint16_t)(maxValLen + 1)) != NEVM_SUCCESS) {
+        return NEVM_FAILURE;
+    }
+
+    uint16_t cap = man->capEntries;
+    size_t size = cap * (2 * sizeof(uint32_t) + 2 * sizeof(uint16_t) +
+                         2 * sizeof(uint8_t));
+    uint32_t *eventSeq = (uint32_t *)NoteMalloc(size);
+    if (eventSeq == NULL) {
+        NOTE_C_LOG_ERROR("Out of memory.\r\n");
+        return NEVM_FAILURE;
+    }
+    memset(eventSeq, 0, size);
+
+    man->eventGeneration = eventSeq + cap;
+    man->eventRing = (uint16_t *)(man->eventGeneration + cap);
+    man->eventValLen = man->eventRing + cap;
+    man->eventQueued = (uint8_t *)(man->eventValLen + cap);
+    man->eventRemoved = man->eventQueued + cap;
+    man->eventSeq = eventSeq;
+    // Publish the entries already in the store, whose events the consumer
+    // reads once they change.
+    for (uint16_t i = 0; i < man->numEntries; ++i) {
+        _nevmEventWriteEnd(man, i);
+    }
+    man->eventHead = 0;
+    man->eventTail = 0;
+    man->eventValCap = (uint16_t)(maxValLen + 1);
+
+    return NEVM_SUCCESS;
+}
+
+/**
+ * Take the next change event off the ring, copying the variable's name and
+ * value. Call this from a single consumer thread. It never blocks and can run
+ * at the same time as a fetch on another thread.
+ *
+ * @param man     Pointer to a NotecardEnvVarManager object.
+ * @param event   Set to the variable's ID, whether it was removed and the
+ *                generation of the change.
+ * @param name    If non-NULL, buffer to copy the NUL-terminated name into.
+ * @param nameLen Size of name in bytes.
+ * @param val     If non-NULL, buffer to copy the NUL-terminated value into.
+ *                The value of a removed variable is its last value.
+ * @param valLen  Size of val in bytes.
+ *
+ * @return 1 if an event was taken, 0 if none is available right now (including
+ *         while a fetch is writing the next variable) and NEVM_FAILURE on
+ *         failure. If a buffer is too small for the next event, it's left on
+ *         the ring.
+ */
+int NotecardEnvVarManager_pollEvent(NotecardEnvVarManager *man,
+                                    NotecardEnvVarEvent *event, char *name,
+                                    size_t nameLen, char *val, size_t valLen)
+{
+    if (man == NULL || event == NULL) {
+        NOTE_C_LOG_ERROR("NULL parameter.\r\n");
+        return NEVM_FAILURE;
+    }
+    if (man->eventRing == NULL) {
+        NOTE_C_LOG_ERROR("Events not enabled.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    uint32_t tail = man->eventTail;
+    if (tail == __atomic_load_n(&man->eventHead, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    uint16_t idx = man->eventRing[tail & (man->capEntries - 1)];
+
+    // Copy the entry before taking the event, so that an entry the producer is
+    // in the middle of writing stays queued.
+    uint32_t seq;
+    int ret = _readEntry(man, idx, event, name, nameLen, val, valLen, &seq);
+    if (ret != NEVM_SUCCESS) {
+        return ret == NEVM_READ_TORN ? 0 : NEVM_FAILURE;
+    }
+
+    // Clearing the queued flag lets the producer push the entry again. If it
+    // wrote the entry after the copy but before the flag was cleared, that
+    // change was coalesced into this event, so copy the entry again.
+    __atomic_store_n(&man->eventTail, tail + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&man->eventQueued[idx], 0, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&man->eventSeq[idx], __ATOMIC_SEQ_CST) == seq) {
+        return 1;
+    }
+    ret = _readEntry(man, idx, event, name, nameLen, val, valLen, &seq);
+    if (ret == NEVM_READ_TORN) {
+        // The producer is writing the entry now, and it will push it again
+        // once it's done.
+        return 0;
+    }
+
+    return ret == NEVM_SUCCESS ? 1 : NEVM_FAILURE;
+}
+
+#endif // NEVM_ENABLE_EVENTS
@@ -0,0 +1,255 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+#include "NotecardEnvVarManagerInternal.h"
+
+#ifdef NEVM_ENABLE_TYPES
+
+// Boolean variables, such as feature toggles, are bound to bits of a single
+// 32-bit word owned by the manager, so that code running in interrupts can
+// check one with a load and a mask, and take a consistent snapshot of all of
+// them by copying the word.
+//
+// Values are applied to a staging word, flagsNext, as the response is
+// iterated over, and the staging word is copied to the published word, flags,
+// with one store once the whole response has been applied. A reader therefore
+// never sees a mix of flags from two fetches. An aligned 32-bit store is
+// single-copy atomic on the 32-bit MCUs this library targets; on narrower
+// ones, readers in interrupts must copy the word with interrupts disabled.
+//
+// A flag's value can also be a rollout rule, a percentage such as "25%" or
+// "2.5%", for staged rollouts. Each device falls in a bucket from 0 to 9999
+// for each flag, from a hash of its device ID and the flag's variable name,
+// and the flag is set if the bucket is below the percentage in hundredths.
+// Buckets are stable, so a device that has a flag at 25% keeps it at 50%, and
+// independent between flags, so the same devices don't get every new feature
+// first. Rules are evaluated into the staging word when they change, so a
+// flag costs nothing more to check than a plain boolean.
+
+// The number of rollout buckets, so that percentages have two decimal places.
+#define NEVM_ROLLOUT_BUCKETS 10000
+
+/**
+ * Internal function to evaluate a flag's value: a boolean or a rollout rule.
+ *
+ * @return 1 if the flag is set, 0 if it's clear and -1 if the value isn't
+ *         valid.
+ */
+static int _evaluate(const NotecardEnvVarManager *man, uint32_t nameHash,
+                     const char *val, size_t valLen)
+{
+    if ((valLen == 4 && memcmp(val, "true", 4) == 0) ||
+            (valLen == 1 && val[0] == '1')) {
+        return 1;
+    }
+    if ((valLen == 5 && memcmp(val, "false", 5) == 0) ||
+            (valLen == 1 && val[0] == '0')) {
+        return 0;
+    }
+
+    int32_t hundredths;
+    if (valLen < 2 || val[valLen - 1] != '%') {
+        return -1;
+    }
+    NotecardEnvVarParseResult result = NotecardEnvVarManager_parseFixed(val,
+                                       valLen - 1, 2, &hundredths);
+    if (result.ec != NEVM_PARSE_OK || result.ptr != val + valLen - 1 ||
+            hundredths < 0 || hundredths > NEVM_ROLLOUT_BUCKETS) {
+        return -1;
+    }
+    if (hundredths == NEVM_ROLLOUT_BUCKETS) {
+        return 1;
+    }
+    if (!man->hasDeviceId) {
+        return 0;
+    }
+
+    // Mix the two hashes (with MurmurHash3's finalizer), so that every bit of
+    // each affects the bucket.
+    uint32_t hash = man->deviceIdHash ^ nameHash;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+
+    return (hash % NEVM_ROLLOUT_BUCKETS) < (uint32_t)hundredths;
+}
+
+/**
+ * Internal function to apply a flag's value to the staging word. Invalid
+ * values are ignored.
+ */
+static void _applyBit(NotecardEnvVarManager *man, unsigned bit,
+                      const char *val, size_t valLen)
+{
+    int value = _evaluate(man, man->flagVars[bit].nameHash, val, valLen);
+    if (value == 1) {
+        man->flagsNext |= NEVM_FLAG(bit);
+    } else if (value == 0) {
+        man->flagsNext &= ~NEVM_FLAG(bit);
+    }
+}
+
+/**
+ * Internal function to apply the value the manager has for a flag's variable,
+ * if any, to the staging word.
+ */
+static void _applyStored(NotecardEnvVarManager *man, unsigned bit)
+{
+    const nevmFlag *flag = &man->flagVars[bit];
+    int idx = _nevmStoreFind(man, flag->name, flag->nameLen);
+    if (idx >= 0 && !(man->entries[idx].flags & NEVM_ENTRY_REMOVED)) {
+        const nevmEntry *entry = &man->entries[idx];
+        _applyBit(man, bit, _nevmEntryVal(entry), entry->valLen);
+    }
+}
+
+/**
+ * Internal function to apply a variable's value to the staging word for each
+ * bit bound to the variable.
+ */
+void _nevmFlagsApply(NotecardEnvVarManager *man, const char *var,
+                     size_t varLen, const char *val, size_t valLen)
+{
+    uint32_t nameHash = _nevmHash(var, varLen);
+    for (unsigned bit = 0; bit < NEVM_MAX_FLAGS; ++bit) {
+        const nevmFlag *flag = &man->flagVars[bit];
+        if ((man->flagsBound & NEVM_FLAG(bit)) &&
+                flag->nameHash == nameHash && flag->nameLen == varLen &&
+                memcmp(flag->name, var, varLen) == 0) {
+            _applyBit(man, bit, val, valLen);
+        }
+    }
+}
+
+/**
+ * Bind a boolean variable, holding "true" or "false" ("1" or "0" are accepted
+ * too) or a rollout rule such as "25%", to a bit of the manager's flag word.
+ * Whenever a fetch, restore or default provides a new value for the variable,
+ * the bit is updated, and the word is published once the whole response has
+ * been applied. Callbacks called during the fetch therefore still see the
+ * previous word, while callbacks deferred by a dispatch budget (see
+ * NotecardEnvVarManager_setDispatchBudget), which run later from
+ * NotecardEnvVarManager_service, see the new one. A rollout rule sets the bit
+ * on that percentage of devices, chosen by their device IDs (see
+ * NotecardEnvVarManager_setDeviceId). A value that isn't valid, or a removed
+ * variable, leaves the bit alone. A bit is clear until its variable has a
+ * value.
+ *
+ * @param man Pointer to a NotecardEnvVarManager object.
+ * @param var The variable name, which must stay valid while it's bound, or
+ *            NULL to unbind the bit and clear it.
+ * @param bit The bit, from 0 to NEVM_MAX_FLAGS - 1. Binding a bit again
+ *            replaces its variable.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarManager_bindFlag(NotecardEnvVarManager *man,
+                                   const char *var, unsigned bit)
+{
+    if (man == NULL) {
+        NOTE_C_LOG_ERROR("NULL manager.\r\n");
+        return NEVM_FAILURE;
+    }
+    if (bit >= NEVM_MAX_FLAGS) {
+        NOTE_C_LOG_ERROR("Flag bit out of range.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    man->flagsBound &= ~NEVM_FLAG(bit);
+    man->flagsNext &= ~NEVM_FLAG(bit);
+    if (var == NULL) {
+        NEVM_FLAGS_PUBLISH(man);
+        return NEVM_SUCCESS;
+    }
+
+    size_t nameLen = strlen(var);
+    if (nameLen > NEVM_MAX_STORED_LEN) {
+        NOTE_C_LOG_ERROR("Variable name too long.\r\n");
+        NEVM_FLAGS_PUBLISH(man);
+        return NEVM_FAILURE;
+    }
+    if (man->flagVars == NULL) {
+        man->flagVars = (nevmFlag *)NoteMalloc(NEVM_MAX_FLAGS *
+                                               sizeof(nevmFlag));
+        if (man->flagVars == NULL) {
+            NOTE_C_LOG_ERROR("Out of memory.\r\n");
+            NEVM_FLAGS_PUBLISH(man);
+            return NEVM_FAILURE;
+        }
+    }
+
+    nevmFlag *flag = &man->flagVars[bit];
+    flag->name = var;
+    flag->nameHash = _nevmHash(var, nameLen);
+    flag->nameLen = (uint16_t)nameLen;
+    man->flagsBound |= NEVM_FLAG(bit);
+
+    // Start from the value the manager already has, such as a default.
+    _applyStored(man, bit);
+    NEVM_FLAGS_PUBLISH(man);
+
+    return NEVM_SUCCESS;
+}
+
+/**
+ * Set the device ID that rollout rules are evaluated with, such as the
+ * Notecard's device UID from card.version, and evaluate the rules of bound
+ * flags again. Until it's set, rollout rules below 100% clear their flags.
+ *
+ * @param man      Pointer to a NotecardEnvVarManager object.
+ * @param deviceId The device ID. Only its hash is kept.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarManager_setDeviceId(NotecardEnvVarManager *man,
+                                      const char *deviceId)
+{
+    if (man == NULL || deviceId == NULL) {
+        NOTE_C_LOG_ERROR("NULL parameter.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    man->deviceIdHash = _nevmHash(deviceId, strlen(deviceId));
+    man->hasDeviceId = true;
+    for (unsigned bit = 0; bit < NEVM_MAX_FLAGS; ++bit) {
+        if (man->flagsBound & NEVM_FLAG(bit)) {
+            _applyStored(man, bit);
+        }
+    }
+    NEVM_FLAGS_PUBLISH(man);
+
+    return NEVM_SUCCESS;
+}
+
+/**
+ * Get the manager's flag word, for checking bound flags without a function
+ * call. Bit n is set if the variable bound to it is true. The word is only
+ * written by the thread calling into the manager, once per fetch, so it can
+ * be read from interrupts and other threads:
+ *
+ *     const volatile uint32_t *flags = NotecardEnvVarManager_getFlags(man);
+ *     ...
+ *     if (*flags & NEVM_FLAG(FLAG_FAST_SAMPLING)) {
+ *
+ * @param man Pointer to a NotecardEnvVarManager object.
+ *
+ * @return Pointer to the flag word, which stays valid until the manager is
+ *         freed, and NULL if man is NULL.
+ */
+const volatile uint32_t *NotecardEnvVarManager_getFlags(
+    NotecardEnvVarManager *man)
+{
+    if (man == NULL) {
+        NOTE_C_LOG_ERROR("NULL manager.\r\n");
+        return NULL;
+    }
+
+    return &man->flags;
+}
+
+#endif // NEVM_ENABLE_TYPES
@@ -0,0 +1,171 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+#include "NotecardEnvVarManagerInternal.h"
+
+#ifdef NEVM_ENABLE_TYPES
+
+// Variables holding JSON, such as per-channel sensor configurations, are read
+// through path accessors. A variable's value is parsed on the first access
+// after it changes, and the tree is kept on its store entry until the value
+// changes again, so parsing follows changes and accesses rather than fetches.
+// A value that isn't valid JSON is remembered as such, and isn't parsed again
+// until it changes either.
+//
+// A path is a sequence of object keys and array indices separated by dots,
+// such as "ch3.gain" or "channels.2.gain". Segments are matched in place,
+// without copying the path.
+
+/**
+ * Internal function to get the child of node named by a path segment.
+ */
+static J *_child(J *node, const char *seg, size_t segLen)
+{
+    if (node->type & JObject) {
+        J *item = NULL;
+        JObjectForEach(item, node) {
+            if (item->string != NULL && strncmp(item->string, seg, segLen) == 0
+                    && item->string[segLen] == '\0') {
+                return item;
+            }
+        }
+    } else if (node->type & JArray) {
+        uint32_t index;
+        NotecardEnvVarParseResult result = NotecardEnvVarManager_parseUint32(
+                                               seg, segLen, &index);
+        if (result.ec == NEVM_PARSE_OK && result.ptr == seg + segLen &&
+                index <= INT32_MAX) {
+            return JGetArrayItem(node, (int)index);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Get a node of a variable's value parsed as JSON, without any Notecard I/O.
+ * The value is parsed on the first access after it changes, and the parsed
+ * tree is reused by later accesses until the value changes again.
+ *
+ * @param man  Pointer to a NotecardEnvVarManager object.
+ * @param var  The variable name.
+ * @param path Dot-separated object keys and array indices, such as
+ *             "ch3.gain" or "channels.2", or "" for the whole value.
+ *
+ * @return The node, which belongs to the manager and stays valid until the
+ *         variable's value changes, and NULL if the variable has no known
+ *         value, its value isn't valid JSON or the path doesn't exist.
+ */
+J *NotecardEnvVarManager_getJson(NotecardEnvVarManager *man, const char *var,
+                                 const char *path)
+{
+    if (man == NULL || var == NULL || path == NULL) {
+        NOTE_C_LOG_ERROR("NULL parameter.\r\n");
+        return NULL;
+    }
+
+    int idx = _nevmStoreFind(man, var, strlen(var));
+    if (idx < 0) {
+        return NULL;
+    }
+    nevmEntry *entry = &man->entries[idx];
+    if (entry->flags & (NEVM_ENTRY_REMOVED | NEVM_ENTRY_JSON_INVALID)) {
+        return NULL;
+    }
+    if (entry->json == NULL) {
+        entry->json = JParse(_nevmEntryVal(entry));
+        if (entry->json == NULL) {
+            NOTE_C_LOG_ERROR("Value isn't valid JSON.\r\n");
+            entry->flags |= NEVM_ENTRY_JSON_INVALID;
+            return NULL;
+        }
+    }
+
+    J *node = entry->json;
+    const char *p = path;
+    while (node != NULL && *p != '\0') {
+        const char *seg = p;
+        while (*p != '\0' && *p != '.') {
+            ++p;
+        }
+        node = _child(node, seg, p - seg);
+        if (*p == '.') {
+            ++p;
+        }
+    }
+
+    return node;
+}
+
+/**
+ * Get a number from a variable's value parsed as JSON. See
+ * NotecardEnvVarManager_getJson.
+ *
+ * @param man   Pointer to a NotecardEnvVarManager object.
+ * @param var   The variable name.
+ * @param path  The path of the number, such as "ch3.gain".
+ * @param value Set to the number.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE if there's no number at
+ *         the path.
+ */
+int NotecardEnvVarManager_getJsonNumber(NotecardEnvVarManager *man,
+                                        const char *var, const char *path,
+                                        JNUMBER *value)
+{
+    if (value == NULL) {
+        NOTE_C_LOG_ERROR("NULL parameter.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    J *node = NotecardEnvVarManager_getJson(man, var, path);
+    if (node == NULL || !(node->type & JNumber)) {
+        return NEVM_FAILURE;
+    }
+    *value = node->valuenumber;
+
+    return NEVM_SUCCESS;
+}
+
+/**
+ * Get a string from a variable's value parsed as JSON. The string is copied
+ * to buf, so it remains valid after the value changes. See
+ * NotecardEnvVarManager_getJson.
+ *
+ * @param man    Pointer to a NotecardEnvVarManager object.
+ * @param var    The variable name.
+ * @param path   The path of the string, such as "ch3.mode".
+ * @param buf    Buffer to copy the NUL-terminated string into.
+ * @param bufLen Size of buf in bytes.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE if there's no string at
+ *         the path or it doesn't fit in buf.
+ */
+int NotecardEnvVarManager_getJsonString(NotecardEnvVarManager *man,
+                                        const char *var, const char *path,
+                                        char *buf, size_t bufLen)
+{
+    if (buf == NULL) {
+        NOTE_C_LOG_ERROR("NULL parameter.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    J *node = NotecardEnvVarManager_getJson(man, var, path);
+    if (node == NULL || !(node->type & JString)) {
+        return NEVM_FAILURE;
+    }
+    const char *str = JGetStringValue(node);
+    size_t len = strlen(str);
+    if (len >= bufLen) {
+        NOTE_C_LOG_ERROR("Buffer too small for value.\r\n");
+        return NEVM_FAILURE;
+    }
+    memcpy(buf, str, len + 1);
+
+    return NEVM_SUCCESS;
+}
+
+#endif // NEVM_ENABLE_TYPES
@@ -7,6 +7,7 @@
 #include "note-c/note.h"
 
 #include "NotecardEnvVarManager.h"
+#include "NotecardEnvVarManagerInternal.h"
 
 #ifdef NEVM_TEST
 #include "test_static.h"
@@ -14,10 +15,251 @@
 #define NEVM_STATIC static
 #endif
 
-struct NotecardEnvVarManager {
-    envVarCb userCb;
-    void *userCtx;
-};
+/**
+ * Internal function to compute the FNV-1a hash of a string of known length.
+ */
+uint32_t _nevmHash(const char *str, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (uint8_t)str[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static void _indexInsert(uint16_t *index, uint16_t indexCap, uint32_t hash,
+                         uint16_t entryIdx)
+{
+    uint16_t mask = indexCap - 1;
+    uint16_t slot = hash & mask;
+    while (index[slot] != NEVM_INDEX_EMPTY) {
+        slot = (slot + 1) & mask;
+    }
+    index[slot] = entryIdx;
+}
+
+static int _find(const NotecardEnvVarManager *man, const char *name,
+                 size_t nameLen, uint32_t hash)
+{
+    if (man->indexCap == 0) {
+        return -1;
+    }
+
+    uint16_t mask = man->indexCap - 1;
+    for (uint16_t slot = hash & mask; man->index[slot] != NEVM_INDEX_EMPTY;
+            slot = (slot + 1) & mask) {
+        const nevmEntry *entry = &man->entries[man->index[slot]];
+        if (entry->hash == hash && entry->nameLen == nameLen &&
+                memcmp(entry->str, name, nameLen) == 0) {
+            return man->index[slot];
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Internal function to double the capacity of the value store. The hash index
+ * is kept at twice the entry capacity, so that probes stay short and always
+ * find an empty slot. The seen, requested and pending bitmaps used for removal
+ * detection and deferred dispatch grow with the store, so fetches never
+ * allocate them.
+ */
+int _nevmStoreGrow(NotecardEnvVarManager *man)
+{
+    if (man->capEntries >= NEVM_MAX_ENTRIES) {
+        NOTE_C_LOG_ERROR("Value store is full.\r\n");
+        return NEVM_FAILURE;
+    }
+#ifdef NEVM_ENABLE_EVENTS
+    // The event consumer reads entries without a lock, so they can't move.
+    if (man->eventRing != NULL) {
+        NOTE_C_LOG_ERROR("More variables than reserved by enableEvents.\r\n");
+        return NEVM_FAILURE;
+    }
+#endif
+
+    uint16_t capEntries = man->capEntries ? man->capEntries * 2 : 8;
+    uint16_t indexCap = capEntries * 2;
+    nevmEntry *entries = (nevmEntry *)NoteMalloc(capEntries *
+                         sizeof(nevmEntry));
+    uint16_t *index = (uint16_t *)NoteMalloc(indexCap * sizeof(uint16_t));
+    uint16_t bitmapWords = NEVM_BITMAP_WORDS(capEntries);
+    uint32_t *seen = (uint32_t *)NoteMalloc(3 * bitmapWords *
+                                            sizeof(uint32_t));
+    if (entries == NULL || index == NULL || seen == NULL) {
+        NOTE_C_LOG_ERROR("Out of memory.\r\n");
+        NoteFree(entries);
+        NoteFree(index);
+        NoteFree(seen);
+        return NEVM_FAILURE;
+    }
+
+    if (man->numEntries > 0) {
+        memcpy(entries, man->entries, man->numEntries * sizeof(nevmEntry));
+    }
+    memset(index, 0xFF, indexCap * sizeof(uint16_t));
+    for (uint16_t i = 0; i < man->numEntries; ++i) {
+        _indexInsert(index, indexCap, entries[i].hash, i);
+    }
+
+    // Carry over the bitmaps, since the store may grow in the middle of a
+    // fetch.
+    memset(seen, 0, 3 * bitmapWords * sizeof(uint32_t));
+    uint16_t oldWords = NEVM_BITMAP_WORDS(man->capEntries);
+    if (oldWords > 0) {
+        memcpy(seen, man->seen, oldWords * sizeof(uint32_t));
+        memcpy(seen + bitmapWords, man->requested, oldWords * sizeof(uint32_t));
+        memcpy(seen + 2 * bitmapWords, man->pending,
+               oldWords * sizeof(uint32_t));
+    }
+
+    NoteFree(man->entries);
+    NoteFree(man->index);
+    NoteFree(man->seen);
+    man->entries = entries;
+    man->capEntries = capEntries;
+    man->index = index;
+    man->indexCap = indexCap;
+    man->seen = seen;
+    man->requested = seen + bitmapWords;
+    man->pending = seen + 2 * bitmapWords;
+
+    return NEVM_SUCCESS;
+}
+
+/**
+ * Internal function to look up a variable in the value store.
+ *
+ * @param man     Pointer to a NotecardEnvVarManager object.
+ * @param name    The variable name. Needn't be NUL-terminated.
+ * @param nameLen The length of name.
+ *
+ * @return The variable's index in the store, or -1 if it's not in the store.
+ */
+int _nevmStoreFind(const NotecardEnvVarManager *man, const char *name,
+                   size_t nameLen)
+{
+    return _find(man, name, nameLen, _nevmHash(name, nameLen));
+}
+
+/**
+ * Internal function to record the value of a variable in the value store,
+ * adding the variable if it's new.
+ *
+ * @param man     Pointer to a NotecardEnvVarManager object.
+ * @param name    The variable name. Needn't be NUL-terminated.
+ * @param nameLen The length of name.
+ * @param val     The value. Needn't be NUL-terminated.
+ * @param valLen  The length of val.
+ * @param changed Set to true if the variable is new or its value changed and
+ *                false otherwise.
+ *
+ * @return The variable's index in the store on success and -1 on failure.
+ */
+int _nevmStoreSet(NotecardEnvVarManager *man, const char *name,
+                  size_t nameLen, const char *val, size_t valLen,
+                  bool *changed)
+{
+    *changed = false;
+    if (nameLen > NEVM_MAX_STORED_LEN || valLen >= NEVM_MAX_STORED_LEN) {
+        NOTE_C_LOG_ERROR("Variable too long to store.\r\n");
+        return -1;
+    }
+
+    uint32_t hash = _nevmHash(name, nameLen);
+    int idx = _find(man, name, nameLen, hash);
+    if (idx >= 0) {
+        nevmEntry *entry = &man->entries[idx];
+        if (!(entry->flags & NEVM_ENTRY_REMOVED) && entry->valLen == valLen &&
+                memcmp(_nevmEntryVal(entry), val, valLen) == 0) {
+            return idx;
+        }
+
+#ifdef NEVM_ENABLE_EVENTS
+        // The event consumer may be copying the value, so its block can't be
+        // replaced.
+        if (man->eventRing != NULL && valLen >= entry->valCap) {
+            NOTE_C_LOG_ERROR("Value longer than reserved by enableEvents.\r\n");
+            return -1;
+        }
+#endif
+        *changed = true;
+        NEVM_ENTRY_DROP_JSON(entry);
+        if (valLen < entry->valCap) {
+            NEVM_EVENT_WRITE_BEGIN(man, (uint16_t)idx);
+            NEVM_EVENT_WRITE_VAL(man, entry->str + entry->nameLen + 1, val,
+                                 valLen);
+            entry->valLen = (uint16_t)valLen;
+            entry->flags &= ~NEVM_ENTRY_REMOVED;
+            NEVM_EVENT_WRITE_END(man, (uint16_t)idx);
+            return idx;
+        }
+    } else {
+#ifdef NEVM_ENABLE_EVENTS
+        if (man->eventRing != NULL && valLen >= man->eventValCap) {
+            NOTE_C_LOG_ERROR("Value longer than reserved by enableEvents.\r\n");
+            return -1;
+        }
+#endif
+        if (man->numEntries == man->capEntries &&
+                _nevmStoreGrow(man) != NEVM_SUCCESS) {
+            return -1;
+        }
+    }
+
+    // Leave some room for the value to grow in place.
+    size_t valCap = (valLen + 1 + 7) & ~(size_t)7;
+    if (valCap > NEVM_MAX_STORED_LEN) {
+        valCap = valLen + 1;
+    }
+#ifdef NEVM_ENABLE_EVENTS
+    if (man->eventRing != NULL && valCap < man->eventValCap) {
+        valCap = man->eventValCap;
+    }
+#endif
+    char *str = (char *)NoteMalloc(nameLen + 1 + valCap);
+    if (str == NULL) {
+        NOTE_C_LOG_ERROR("Out of memory.\r\n");
+        *changed = false;
+        return -1;
+    }
+    memcpy(str, name, nameLen);
+    str[nameLen] = '\0';
+    memcpy(str + nameLen + 1, val, valLen);
+    str[nameLen + 1 + valLen] = '\0';
+
+    nevmEntry *entry;
+    bool existing = (idx >= 0);
+    if (existing) {
+        entry = &man->entries[idx];
+        NEVM_EVENT_WRITE_BEGIN(man, (uint16_t)idx);
+        NoteFree(entry->str);
+    } else {
+        idx = man->numEntries++;
+        entry = &man->entries[idx];
+        entry->hash = hash;
+        entry->nameLen = (uint16_t)nameLen;
+        entry->generation = 0;
+        entry->flags = 0;
+#ifdef NEVM_ENABLE_TYPES
+        entry->json = NULL;
+#endif
+        _indexInsert(man->index, man->indexCap, hash, (uint16_t)idx);
+        *changed = true;
+    }
+    entry->str = str;
+    entry->valLen = (uint16_t)valLen;
+    entry->valCap = (uint16_t)valCap;
+    entry->flags &= ~NEVM_ENTRY_REMOVED;
+    if (existing) {
+        NEVM_EVENT_WRITE_END(man, (uint16_t)idx);
+    }
+
+    return idx;
+}
 
 /**
  * Internal function to create a request for the specified environment variables
@@ -73,9 +315,288 @@ NEVM_STATIC J *_buildEnvGetRequest(const char **vars, size_t numVars)
     return req;
 }
 
+/**
+ * Internal function to mark the entries of the variables requested by name, for
+ * removal detection.
+ */
+static void _markRequested(NotecardEnvVarManager *man, const char **vars,
+                           size_t numVars)
+{
+    for (size_t i = 0; i < numVars; ++i) {
+        int idx = _nevmStoreFind(man, vars[i], strlen(vars[i]));
+        if (idx >= 0) {
+            _nevmBitSet(man->requested, (uint16_t)idx);
+        }
+    }
+}
+
+/**
+ * Internal function to queue an entry for delivery by
+ * NotecardEnvVarManager_service. An entry that's already queued is delivered
+ * once, with its latest state.
+ */
+static void _queue(NotecardEnvVarManager *man, uint16_t idx)
+{
+    if (!_nevmBitTest(man->pending, idx)) {
+        _nevmBitSet(man->pending, idx);
+        ++man->numPending;
+    }
+}
+
+/**
+ * Internal function to call whichever of the user's callbacks is set.
+ */
+void _nevmCallUserCb(const NotecardEnvVarManager *man, const char *var,
+                     size_t varLen, const char *val, size_t valLen)
+{
+    if (man->userLenCb != NULL) {
+        man->userLenCb(var, varLen, val, valLen, man->userCtx);
+    } else if (man->userCb != NULL) {
+        man->userCb(var, val, man->userCtx);
+    }
+}
+
+/**
+ * Internal function to deliver an entry's value to the user's callback, or its
+ * removal to the removal callback.
+ */
+static void _deliver(NotecardEnvVarManager *man, uint16_t idx)
+{
+    const nevmEntry *entry = &man->entries[idx];
+    const char *var = entry->str;
+
+    NEVM_TRACE(man, NEVM_TRACE_CALLBACK, true, var);
+    if (entry->flags & NEVM_ENTRY_REMOVED) {
+        if (man->removedCb != NULL) {
+            man->removedCb(var, man->removedCtx);
+        }
+    } else {
+        _nevmCallUserCb(man, var, entry->nameLen, _nevmEntryVal(entry),
+                        entry->valLen);
+    }
+    NEVM_TRACE(man, NEVM_TRACE_CALLBACK, false, var);
+}
+
+/**
+ * Internal function to apply the body of an env.get response: store each
+ * variable, call the user's callback on new and changed values, and report
+ * requested variables missing from the body as removed. If any value changed,
+ * the manager's generation is advanced and recorded in the changed entries.
+ * With a dispatch budget set, the variables are queued for
+ * NotecardEnvVarManager_service instead of calling the callbacks.
+ *
+ * @param man     Pointer to a NotecardEnvVarManager object.
+ * @param body    The response body.
+ * @param vars    The requested variables, as passed to the fetch.
+ * @param numVars The number of requested variables, or NEVM_ENV_VAR_ALL.
+ */
+static void _applyBody(NotecardEnvVarManager *man, J *body, const char **vars,
+                       size_t numVars)
+{
+    bool storeChanged = false;
+    bool valuesChanged = false;
+    uint32_t generation = man->generation + 1;
+    bool all = (numVars == NEVM_ENV_VAR_ALL);
+    bool deferred = (man->dispatchMaxPairs > 0);
+
+    // Start a new generation of the seen and requested bitmaps.
+    uint16_t bitmapWords = NEVM_BITMAP_WORDS(man->capEntries);
+    if (bitmapWords > 0) {
+        memset(man->seen, 0, 2 * bitmapWords * sizeof(uint32_t));
+    }
+    if (!all) {
+        _markRequested(man, vars, numVars);
+    }
+
+    NEVM_TRACE(man, NEVM_TRACE_BODY, true, NULL);
+    J *item = NULL;
+    JObjectForEach(item, body) {
+        char *var = item->string;
+        char *val = JGetStringValue(item);
+        size_t varLen = strlen(var);
+        size_t valLen = (val != NULL) ? strlen(val) : 0;
+
+        // Keep the latest value of each variable in the store.
+        bool notify = true;
+        int idx = -1;
+        if (val != NULL) {
+            bool changed = false;
+            idx = _nevmStoreSet(man, var, varLen, val, valLen, &changed);
+            if (idx >= 0) {
+                // A stale value confirmed by the Notecard isn't news to the
+                // user.
+                nevmEntry *entry = &man->entries[idx];
+                notify = changed || !(entry->flags & NEVM_ENTRY_STALE);
+                if (changed) {
+                    NEVM_EVENT_WRITE_BEGIN(man, (uint16_t)idx);
+                    entry->generation = generation;
+                    NEVM_EVENT_WRITE_END(man, (uint16_t)idx);
+                    NEVM_EVENT_PUSH(man, (uint16_t)idx);
+                    valuesChanged = true;
+                }
+                if (changed || (entry->flags & NEVM_ENTRY_DEFAULT)) {
+                    entry->flags |= NEVM_ENTRY_DIRTY;
+                    storeChanged = true;
+                }
+                entry->flags &= ~(NEVM_ENTRY_STALE | NEVM_ENTRY_DEFAULT);
+                _nevmBitSet(man->seen, (uint16_t)idx);
+            } else {
+                NOTE_C_LOG_ERROR("Failed to store variable.\r\n");
+                // The variable still exists, even if it keeps its previous
+                // value.
+                int found = _nevmStoreFind(man, var, varLen);
+                if (found >= 0) {
+                    _nevmBitSet(man->seen, (uint16_t)found);
+                }
+            }
+            NEVM_ARRAYS_APPLY(man, var, varLen, val, valLen, idx >= 0,
+                              changed);
+            // A flag's bit and an enum's index only depend on the value, so
+            // they're only resolved again when the value changes. An invalid
+            // enum value is reported once.
+            if (changed || idx < 0) {
+                NEVM_FLAGS_APPLY(man, var, varLen, val, valLen);
+                NEVM_ENUMS_APPLY(man, var, varLen, val, valLen);
+            }
+        } else {
+            int found = _nevmStoreFind(man, var, varLen);
+            if (found >= 0) {
+                _nevmBitSet(man->seen, (uint16_t)found);
+            }
+        }
+
+        // Call the user's callback on each variable:value pair in the
+        // response. Values that aren't in the store can't be queued, so
+        // they're delivered right away.
+        if (notify && deferred && idx >= 0) {
+            _queue(man, (uint16_t)idx);
+        } else if (notify && _nevmHasUserCb(man)) {
+            NEVM_TRACE(man, NEVM_TRACE_CALLBACK, true, var);
+            _nevmCallUserCb(man, var, varLen, val, valLen);
+            NEVM_TRACE(man, NEVM_TRACE_CALLBACK, false, var);
+        }
+    }
+
+    // Requested variables that didn't come back were deleted. Defaults are
+    // left alone, since they were never on the Notecard.
+    for (uint16_t i = 0; i < man->numEntries; ++i) {
+        nevmEntry *entry = &man->entries[i];
+        if ((!all && !_nevmBitTest(man->requested, i))
+                || _nevmBitTest(man->seen, i)
+                || (entry->flags & (NEVM_ENTRY_REMOVED | NEVM_ENTRY_DEFAULT))) {
+            continue;
+        }
+
+        NEVM_ENTRY_DROP_JSON(entry);
+        NEVM_EVENT_WRITE_BEGIN(man, i);
+        entry->flags = (entry->flags & ~NEVM_ENTRY_STALE) | NEVM_ENTRY_REMOVED
+                       | NEVM_ENTRY_DIRTY;
+        entry->generation = generation;
+        NEVM_EVENT_WRITE_END(man, i);
+        NEVM_EVENT_PUSH(man, i);
+        storeChanged = true;
+        valuesChanged = true;
+        if (deferred) {
+            _queue(man, i);
+        } else if (man->removedCb != NULL) {
+            NEVM_TRACE(man, NEVM_TRACE_CALLBACK, true, entry->str);
+            man->removedCb(entry->str, man->removedCtx);
+            NEVM_TRACE(man, NEVM_TRACE_CALLBACK, false, entry->str);
+        }
+    }
+    NEVM_TRACE(man, NEVM_TRACE_BODY, false, NULL);
+    NEVM_FLAGS_PUBLISH(man);
+
+    if (valuesChanged) {
+        man->generation = generation;
+    }
+
+#ifdef NEVM_ENABLE_PERSIST
+    if (storeChanged && man->storage != NULL &&
+            _nevmPersistSave(man) != NEVM_SUCCESS) {
+        NOTE_C_LOG_ERROR("Failed to persist variables.\r\n");
+    }
+#else
+    (void)storeChanged;
+#endif
+}
+
+/**
+ * Build the env.get request for a fetch, for sending over a transport other
+ * than note-c's blocking one. Pass the Notecard's response, with the same
+ * vars and numVars, to NotecardEnvVarManager_applyFetchResponse. The manager
+ * can't be fetched from again until then.
+ *
+ * @param man     Pointer to a NotecardEnvVarManager object.
+ * @param vars    Pointer to an array of C-strings of variables to fetch.
+ * @param numVars The number of variable strings in vars, or NEVM_ENV_VAR_ALL.
+ *
+ * @return The request on success, which the caller must delete, and NULL on
+ *         failure.
+ */
+J *NotecardEnvVarManager_buildFetchRequest(NotecardEnvVarManager *man,
+        const char **vars, size_t numVars)
+{
+    if (man == NULL) {
+        NOTE_C_LOG_ERROR("NULL manager.\r\n");
+        return NULL;
+    }
+
+    NEVM_TRACE(man, NEVM_TRACE_BUILD_REQUEST, true, NULL);
+    J *req = _buildEnvGetRequest(vars, numVars);
+    NEVM_TRACE(man, NEVM_TRACE_BUILD_REQUEST, false, NULL);
+
+    return req;
+}
+
+/**
+ * Apply the Notecard's response to a request built with
+ * NotecardEnvVarManager_buildFetchRequest, calling the callbacks as
+ * NotecardEnvVarManager_fetch does.
+ *
+ * @param man     Pointer to a NotecardEnvVarManager object.
+ * @param rsp     The response, or NULL if the transaction failed. The caller
+ *                keeps ownership.
+ * @param vars    The vars passed to NotecardEnvVarManager_buildFetchRequest.
+ * @param numVars The numVars passed to
+ *                NotecardEnvVarManager_buildFetchRequest.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarManager_applyFetchResponse(NotecardEnvVarManager *man,
+        J *rsp, const char **vars,
+        size_t numVars)
+{
+    if (man == NULL) {
+        NOTE_C_LOG_ERROR("NULL manager.\r\n");
+        return NEVM_FAILURE;
+    }
+    if (rsp == NULL) {
+        NOTE_C_LOG_ERROR("NULL response to env.get request.\r\n");
+        return NEVM_FAILURE;
+    }
+    if (NoteResponseError(rsp)) {
+        NOTE_C_LOG_ERROR("Error in env.get response.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    J *body = JGetObject(rsp, "body");
+    if (body == NULL) {
+        NOTE_C_LOG_ERROR("No \"body\" field in env.get response.\r\n");
+        return NEVM_FAILURE;
+    }
+    _applyBody(man, body, vars, numVars);
+
+    return NEVM_SUCCESS;
+}
+
 /**
  * Fetch environment variables from the Notecard, calling the user-provided
- * callback on each variable:value pair.
+ * callback on each variable:value pair. Variables with a stale value (a
+ * default or a restored value) that the Notecard confirms are marked fresh
+ * without calling the callback. Previously known variables that were
+ * requested but are missing from the response are reported to the removal
+ * callback, if one is set.
  *
  * @param man     Pointer to a NotecardEnvVarManager object.
  * @param vars    Pointer to an array of C-strings of variables to fetch.
@@ -92,42 +613,33 @@ int NotecardEnvVarManager_fetch(NotecardEnvVarManager *man, const char **vars,
         NOTE_C_LOG_ERROR("NULL manager.\r\n");
         return NEVM_FAILURE;
     }
-    if (man->userCb == NULL) {
+    bool consumed = _nevmHasUserCb(man);
+#ifdef NEVM_ENABLE_EVENTS
+    consumed = consumed || man->eventRing != NULL;
+#endif
+#ifdef NEVM_ENABLE_TYPES
+    consumed = consumed || man->numArrays > 0 || man->flagsBound != 0
+               || man->numEnums > 0;
+#endif
+    if (!consumed) {
         NOTE_C_LOG_INFO("No user callback set. No variables will be fetched."
                         "\r\n");
         return NEVM_SUCCESS;
     }
 
-    int ret = NEVM_SUCCESS;
-    J *rsp = NoteRequestResponse(_buildEnvGetRequest(vars, numVars));
-    if (rsp != NULL) {
-        if (!NoteResponseError(rsp)) {
-            J *body = JGetObject(rsp, "body");
-            if (body != NULL) {
-                J *item = NULL;
-                JObjectForEach(item, body) {
-                    char *var = item->string;
-                    char *val = JGetStringValue(item);
-
-                    // Call the user's callback on each variable:value pair
-                    // in the response.
-                    man->userCb(var, val, man->userCtx);
-                }
-            } else {
-                NOTE_C_LOG_ERROR("No \"body\" field in env.get response.\r\n");
-                ret = NEVM_FAILURE;
-            }
-        } else {
-            NOTE_C_LOG_ERROR("Error in env.get response.\r\n");
-            ret = NEVM_FAILURE;
-        }
-    } else {
-        NOTE_C_LOG_ERROR("NULL response to env.get request.\r\n");
-        ret = NEVM_FAILURE;
-    }
+    NEVM_TRACE(man, NEVM_TRACE_FETCH, true, NULL);
 
+    J *req = NotecardEnvVarManager_buildFetchRequest(man, vars, numVars);
+    NEVM_TRACE(man, NEVM_TRACE_TRANSACTION, true, NULL);
+    J *rsp = (man->requestFn != NULL) ? man->requestFn(req, man->requestCtx)
+             : NoteRequestResponse(req);
+    NEVM_TRACE(man, NEVM_TRACE_TRANSACTION, false, NULL);
+    int ret = NotecardEnvVarManager_applyFetchResponse(man, rsp, vars,
+              numVars);
     NoteDeleteResponse(rsp);
 
+    NEVM_TRACE(man, NEVM_TRACE_FETCH, false, NULL);
+
     return ret;
 }
 
@@ -138,6 +650,25 @@ int NotecardEnvVarManager_fetch(NotecardEnvVarManager *man, const char **vars,
  */
 void NotecardEnvVarManager_free(NotecardEnvVarManager *man)
 {
+    if (man == NULL) {
+        return;
+    }
+
+    for (uint16_t i = 0; i < man->numEntries; ++i) {
+        NoteFree(man->entries[i].str);
+        NEVM_ENTRY_DROP_JSON(&man->entries[i]);
+    }
+    NoteFree(man->entries);
+    NoteFree(man->index);
+    NoteFree(man->seen);
+#ifdef NEVM_ENABLE_EVENTS
+    _nevmEventsFree(man);
+#endif
+#ifdef NEVM_ENABLE_TYPES
+    NoteFree(man->arrays);
+    NoteFree(man->flagVars);
+    _nevmEnumsFree(man);
+#endif
     NoteFree(man);
 }
 
@@ -160,6 +691,24 @@ NotecardEnvVarManager *NotecardEnvVarManager_alloc(void)
     return man;
 }
 
+/**
+ * Internal function to set the user's callback, with or without lengths.
+ */
+static int _setUserCb(NotecardEnvVarManager *man, envVarCb userCb,
+                      envVarLenCb userLenCb, void *userCtx)
+{
+    if (man == NULL) {
+        NOTE_C_LOG_ERROR("NULL manager.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    man->userCb = userCb;
+    man->userLenCb = userLenCb;
+    man->userCtx = userCtx;
+
+    return NEVM_SUCCESS;
+}
+
 /**
  * Set the callback that the manager will call on every variable:value pair
  * fetched from the Notecard.
@@ -174,14 +723,380 @@ NotecardEnvVarManager *NotecardEnvVarManager_alloc(void)
  */
 int NotecardEnvVarManager_setEnvVarCb(NotecardEnvVarManager *man,
                                       envVarCb userCb, void *userCtx)
+{
+    return _setUserCb(man, userCb, NULL, userCtx);
+}
+
+/**
+ * Set a callback like the one set by NotecardEnvVarManager_setEnvVarCb, which
+ * also receives the lengths of the variable's name and value. It replaces that
+ * callback, and vice versa.
+ *
+ * @param man       Pointer to a NotecardEnvVarManager object.
+ * @param userLenCb The callback.
+ * @param userCtx   Pointer to a user context, passed to userLenCb whenever
+ *                  it's called.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarManager_setEnvVarLenCb(NotecardEnvVarManager *man,
+        envVarLenCb userLenCb, void *userCtx)
+{
+    return _setUserCb(man, NULL, userLenCb, userCtx);
+}
+
+/**
+ * Set the function the manager sends its requests with, so that each manager
+ * can talk to its own Notecard. The function is called as
+ * NoteRequestResponse would be: it takes ownership of the request (which may
+ * be NULL if building it failed) and returns the response, or NULL on
+ * failure. The manager deletes the response.
+ *
+ * @param man        Pointer to a NotecardEnvVarManager object.
+ * @param requestFn  The request function, or NULL to use note-c's
+ *                   NoteRequestResponse, which is the default.
+ * @param requestCtx Pointer to a user context, passed to requestFn whenever
+ *                   it's called.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarManager_setRequestFn(NotecardEnvVarManager *man,
+                                       nevmRequestFn requestFn,
+                                       void *requestCtx)
 {
     if (man == NULL) {
         NOTE_C_LOG_ERROR("NULL manager.\r\n");
         return NEVM_FAILURE;
     }
 
-    man->userCb = userCb;
-    man->userCtx = userCtx;
+    man->requestFn = requestFn;
+    man->requestCtx = requestCtx;
 
     return NEVM_SUCCESS;
 }
+
+/**
+ * Set the callback that the manager will call when a variable it has seen
+ * before is deleted. A variable counts as deleted when a fetch that requested
+ * it (by name or with NEVM_ENV_VAR_ALL) no longer returns it.
+ *
+ * @param man        Pointer to a NotecardEnvVarManager object.
+ * @param removedCb  The callback.
+ * @param removedCtx Pointer to a user context, passed to removedCb whenever
+ *                   it's called.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarManager_setEnvVarRemovedCb(NotecardEnvVarManager *man,
+        envVarRemovedCb removedCb,
+        void *removedCtx)
+{
+    if (man == NULL) {
+        NOTE_C_LOG_ERROR("NULL manager.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    man->removedCb = removedCb;
+    man->removedCtx = removedCtx;
+
+    return NEVM_SUCCESS;
+}
+
+/**
+ * Set a dispatch budget, so that fetches queue the variable:value pairs and
+ * removals they would report instead of calling the user's callback and the
+ * removal callback, and NotecardEnvVarManager_service delivers them in bounded
+ * slices. This keeps each call short enough for a cooperative main loop, such
+ * as Arduino's loop(). A variable that's still queued when a later fetch
+ * returns it again is delivered once, with the latest value.
+ *
+ * @param man      Pointer to a NotecardEnvVarManager object.
+ * @param maxPairs The maximum number of pairs delivered per service call,
+ *                 capped at 65535. 0 calls the callbacks directly from the
+ *                 fetch, which is the default.
+ * @param maxUs    If non-zero, a service call stops delivering once this many
+ *                 microseconds have passed. At least one pair is delivered per
+ *                 call, so a slow callback can overrun the budget.
+ * @param microsFn Returns the current time in microseconds. Required if maxUs
+ *                 is non-zero.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarManager_setDispatchBudget(NotecardEnvVarManager *man,
+        size_t maxPairs, uint32_t maxUs,
+        nevmMicrosFn microsFn)
+{
+    if (man == NULL) {
+        NOTE_C_LOG_ERROR("NULL manager.\r\n");
+        return NEVM_FAILURE;
+    }
+    if (maxUs > 0 && microsFn == NULL) {
+        NOTE_C_LOG_ERROR("A time budget requires microsFn.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    man->dispatchMaxPairs = maxPairs > UINT16_MAX ? UINT16_MAX :
+                            (uint16_t)maxPairs;
+    man->dispatchMaxUs = maxUs;
+    man->microsFn = microsFn;
+
+    return NEVM_SUCCESS;
+}
+
+/**
+ * Deliver queued pairs and removals to the callbacks, within the budget set
+ * with NotecardEnvVarManager_setDispatchBudget. Delivery resumes where the
+ * previous call stopped. Call this from the main loop. If the budget has been
+ * removed since they were queued, all of them are delivered.
+ *
+ * @param man Pointer to a NotecardEnvVarManager object.
+ *
+ * @return The number of variables still queued on success and NEVM_FAILURE on
+ *         failure.
+ */
+int NotecardEnvVarManager_service(NotecardEnvVarManager *man)
+{
+    if (man == NULL) {
+        NOTE_C_LOG_ERROR("NULL manager.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    uint16_t maxPairs = man->dispatchMaxPairs ? man->dispatchMaxPairs :
+                        UINT16_MAX;
+    bool timed = (man->dispatchMaxUs > 0 && man->microsFn != NULL);
+    uint32_t startUs = timed ? man->microsFn() : 0;
+    uint16_t delivered = 0;
+    while (man->numPending > 0 && delivered < maxPairs) {
+        uint16_t i = man->dispatchCursor;
+        if (i >= man->numEntries) {
+            man->dispatchCursor = 0;
+            continue;
+        }
+        uint32_t word = man->pending[i / 32] >> (i % 32);
+        if (word == 0) {
+            // Nothing left in this word.
+            man->dispatchCursor = (uint16_t)((i / 32 + 1) * 32);
+            continue;
+        }
+        man->dispatchCursor = i + 1;
+        if (!(word & 1)) {
+            continue;
+        }
+
+        _nevmBitClear(man->pending, i);
+        --man->numPending;
+        _deliver(man, i);
+        ++delivered;
+        if (timed && man->microsFn() - startUs >= man->dispatchMaxUs) {
+            break;
+        }
+    }
+
+    return man->numPending;
+}
+
+/**
+ * Get the manager's generation, which starts at 0 and is incremented by each
+ * fetch that changes at least one value (including removing a variable).
+ * Fetches that only confirm known values, defaults and restored values don't
+ * advance it. Consumers can poll the generation and only re-read their
+ * variables when it differs from the last one they saw.
+ *
+ * @param man Pointer to a NotecardEnvVarManager object.
+ *
+ * @return The generation, or 0 if man is NULL.
+ */
+uint32_t NotecardEnvVarManager_getGeneration(const NotecardEnvVarManager *man)
+{
+    if (man == NULL) {
+        NOTE_C_LOG_ERROR("NULL manager.\r\n");
+        return 0;
+    }
+
+    return man->generation;
+}
+
+/**
+ * Get the generation in which a fetch last changed or removed a variable.
+ *
+ * @param man        Pointer to a NotecardEnvVarManager object.
+ * @param var        The variable name.
+ * @param generation Set to the generation of the variable's last change, or 0
+ *                   if no fetch has changed it (e.g. it still has its default
+ *                   or restored value).
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE if the manager doesn't
+ *         know the variable.
+ */
+int NotecardEnvVarManager_getVarGeneration(const NotecardEnvVarManager *man,
+        const char *var,
+        uint32_t *generation)
+{
+    if (man == NULL || var == NULL || generation == NULL) {
+        NOTE_C_LOG_ERROR("NULL parameter.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    int idx = _nevmStoreFind(man, var, strlen(var));
+    if (idx < 0) {
+        return NEVM_FAILURE;
+    }
+    *generation = man->entries[idx].generation;
+
+    return NEVM_SUCCESS;
+}
+
+/**
+ * Get the last known value of a variable without any Notecard I/O. The value
+ * is copied to buf, so it remains valid after later fetches.
+ *
+ * @param man    Pointer to a NotecardEnvVarManager object.
+ * @param var    The variable name.
+ * @param buf    Buffer to copy the NUL-terminated value into.
+ * @param bufLen Size of buf in bytes.
+ * @param stale  If non-NULL, set to true if the value is a default or was
+ *               restored from storage and hasn't been confirmed by a fetch
+ *               yet, and false otherwise.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE if the variable has no
+ *         known value (including if it was removed) or the value doesn't fit
+ *         in buf.
+ */
+int NotecardEnvVarManager_get(const NotecardEnvVarManager *man,
+                              const char *var, char *buf, size_t bufLen,
+                              bool *stale)
+{
+    if (man == NULL || var == NULL || buf == NULL) {
+        NOTE_C_LOG_ERROR("NULL parameter.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    int idx = _nevmStoreFind(man, var, strlen(var));
+    if (idx < 0) {
+        return NEVM_FAILURE;
+    }
+    const nevmEntry *entry = &man->entries[idx];
+    if (entry->flags & NEVM_ENTRY_REMOVED) {
+        return NEVM_FAILURE;
+    }
+    if (entry->valLen >= bufLen) {
+        NOTE_C_LOG_ERROR("Buffer too small for value.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    memcpy(buf, _nevmEntryVal(entry), entry->valLen + 1);
+    if (stale != NULL) {
+        *stale = (entry->flags & NEVM_ENTRY_STALE) != 0;
+    }
+
+    return NEVM_SUCCESS;
+}
+
+/**
+ * Call a callback on each variable the manager has a value for, including
+ * defaults and restored values, without any Notecard I/O. Removed variables
+ * are skipped. This is for taking a snapshot of the whole configuration, such
+ * as after a restore.
+ *
+ * @param man Pointer to a NotecardEnvVarManager object.
+ * @param cb  Called with each variable's name and value, which are
+ *            NUL-terminated and stay valid until the manager next changes a
+ *            value. It mustn't call back into the manager.
+ * @param ctx Passed to cb.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarManager_forEach(const NotecardEnvVarManager *man,
+                                  envVarLenCb cb, void *ctx)
+{
+    if (man == NULL || cb == NULL) {
+        NOTE_C_LOG_ERROR("NULL parameter.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    for (uint16_t i = 0; i < man->numEntries; ++i) {
+        const nevmEntry *entry = &man->entries[i];
+        if (!(entry->flags & NEVM_ENTRY_REMOVED)) {
+            cb(entry->str, entry->nameLen, _nevmEntryVal(entry),
+               entry->valLen, ctx);
+        }
+    }
+
+    return NEVM_SUCCESS;
+}
+
+/**
+ * Set compiled-in default values, which NotecardEnvVarManager_get returns
+ * (flagged as stale) until a fetch or restore provides the real values. A
+ * default is ignored for any variable that already has a value. The user's
+ * callback isn't called for defaults, and a later fetch only calls it for
+ * values that differ from the default.
+ *
+ * @param man     Pointer to a NotecardEnvVarManager object.
+ * @param vars    Pointer to an array of C-strings of variable names.
+ * @param vals    Pointer to an array of C-strings of the default values, one
+ *                per variable.
+ * @param numVars The number of variables.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarManager_setDefaults(NotecardEnvVarManager *man,
+                                      const char **vars, const char **vals,
+                                      size_t numVars)
+{
+    if (man == NULL || ((vars == NULL || vals == NULL) && numVars > 0)) {
+        NOTE_C_LOG_ERROR("NULL parameter.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    for (size_t i = 0; i < numVars; ++i) {
+        size_t nameLen = strlen(vars[i]);
+        if (_nevmStoreFind(man, vars[i], nameLen) >= 0) {
+            continue;
+        }
+
+        bool changed = false;
+        size_t valLen = strlen(vals[i]);
+        int idx = _nevmStoreSet(man, vars[i], nameLen, vals[i], valLen,
+                                &changed);
+        if (idx < 0) {
+            NEVM_FLAGS_PUBLISH(man);
+            return NEVM_FAILURE;
+        }
+        man->entries[idx].flags |= NEVM_ENTRY_STALE | NEVM_ENTRY_DEFAULT;
+        NEVM_ARRAYS_APPLY(man, vars[i], nameLen, vals[i], valLen, true, true);
+        NEVM_FLAGS_APPLY(man, vars[i], nameLen, vals[i], valLen);
+        NEVM_ENUMS_APPLY(man, vars[i], nameLen, vals[i], valLen);
+    }
+    NEVM_FLAGS_PUBLISH(man);
+
+    return NEVM_SUCCESS;
+}
+
+#ifdef NEVM_ENABLE_TRACE
+/**
+ * Set the callback that the manager will call at the beginning and end of each
+ * phase of NotecardEnvVarManager_fetch: building the request, the Notecard
+ * transaction, iterating over the response body and each call of the user's
+ * variable callback. Set traceCb to NULL to stop tracing.
+ *
+ * @param man      Pointer to a NotecardEnvVarManager object.
+ * @param traceCb  The callback.
+ * @param traceCtx Pointer to a user context passed to traceCb.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarManager_setTraceCb(NotecardEnvVarManager *man,
+                                     nevmTraceCb traceCb, void *traceCtx)
+{
+    if (man == NULL) {
+        NOTE_C_LOG_ERROR("NULL manager.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    man->traceCb = traceCb;
+    man->traceCtx = traceCtx;
+
+    return NEVM_SUCCESS;
+}
+#endif
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#include "note-c/note.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -17,13 +21,179 @@ struct NotecardEnvVarManager;
 typedef struct NotecardEnvVarManager NotecardEnvVarManager;
 
 typedef void (*envVarCb)(const char *var, const char *val, void *ctx);
+// Like envVarCb, with the lengths of var and val, which the manager already
+// knows, so that the callback doesn't need to measure them.
+typedef void (*envVarLenCb)(const char *var, size_t varLen, const char *val,
+                            size_t valLen, void *ctx);
+typedef void (*envVarRemovedCb)(const char *var, void *ctx);
+// Returns a free-running microsecond count, such as Arduino's micros().
+typedef uint32_t (*nevmMicrosFn)(void);
+// Sends a request to the manager's Notecard and returns the response, like
+// note-c's NoteRequestResponse, which it replaces for one manager.
+typedef J *(*nevmRequestFn)(J *req, void *ctx);
+
+#ifdef NEVM_ENABLE_TRACE
+// Phases of NotecardEnvVarManager_fetch reported to the trace callback.
+enum {
+    NEVM_TRACE_FETCH = 0,
+    NEVM_TRACE_BUILD_REQUEST,
+    NEVM_TRACE_TRANSACTION,
+    NEVM_TRACE_BODY,
+    NEVM_TRACE_CALLBACK
+};
+
+// Called at the beginning (begin == true) and end of each phase. detail is the
+// variable name for NEVM_TRACE_CALLBACK and NULL otherwise.
+typedef void (*nevmTraceCb)(int phase, bool begin, const char *detail,
+                            void *ctx);
+#endif
+
+#ifdef NEVM_ENABLE_EVENTS
+// A change event taken from the manager's event ring.
+typedef struct {
+    // The variable's ID, which stays the same for the manager's lifetime.
+    uint16_t id;
+    // True if the variable was removed.
+    bool removed;
+    // The manager's generation when the variable last changed.
+    uint32_t generation;
+} NotecardEnvVarEvent;
+#endif
+
+#ifdef NEVM_ENABLE_TYPES
+// Outcomes of the number parsers.
+enum {
+    NEVM_PARSE_OK = 0,
+    // The input doesn't start with a number.
+    NEVM_PARSE_INVALID,
+    // The number doesn't fit in the type.
+    NEVM_PARSE_RANGE
+};
+
+// Result of a number parser, like C++'s std::from_chars_result. ptr points
+// past the characters that made up the number.
+typedef struct {
+    const char *ptr;
+    int ec;
+} NotecardEnvVarParseResult;
+
+// The number of bits in the manager's flag word.
+#define NEVM_MAX_FLAGS 32
+// The mask of a bit of the manager's flag word.
+#define NEVM_FLAG(bit) ((uint32_t)1 << (bit))
+
+// The maximum number of names of an enum variable.
+#define NEVM_MAX_ENUM_NAMES 255
+// The value of an enum variable that isn't one of its names.
+#define NEVM_ENUM_INVALID (-1)
+#endif
+
+#ifdef NEVM_ENABLE_PERSIST
+// A storage backend for persisting the manager's values across reboots, such
+// as a region of internal flash. Offsets are relative to the start of the
+// region, which is size bytes long. Like NOR flash, erased bytes must read
+// back as 0xFF, and bytes are only written after being erased. The region is
+// erased in sectors of sectorSize bytes, and the manager uses the first two
+// sectors. Each function returns NEVM_SUCCESS on success and NEVM_FAILURE on
+// failure.
+typedef struct {
+    int (*read)(void *ctx, uint32_t offset, void *buf, size_t len);
+    int (*write)(void *ctx, uint32_t offset, const void *buf, size_t len);
+    int (*erase)(void *ctx, uint32_t offset, size_t len);
+    uint32_t size;
+    uint32_t sectorSize;
+    void *ctx;
+} NotecardEnvVarStorage;
+#endif
 
 NotecardEnvVarManager *NotecardEnvVarManager_alloc(void);
+int NotecardEnvVarManager_applyFetchResponse(NotecardEnvVarManager *man,
+        J *rsp, const char **vars,
+        size_t numVars);
+J *NotecardEnvVarManager_buildFetchRequest(NotecardEnvVarManager *man,
+        const char **vars, size_t numVars);
 int NotecardEnvVarManager_fetch(NotecardEnvVarManager *man, const char **vars,
                                 size_t numVars);
+int NotecardEnvVarManager_forEach(const NotecardEnvVarManager *man,
+                                  envVarLenCb cb, void *ctx);
 void NotecardEnvVarManager_free(NotecardEnvVarManager *man);
+int NotecardEnvVarManager_get(const NotecardEnvVarManager *man,
+                              const char *var, char *buf, size_t bufLen,
+                              bool *stale);
+uint32_t NotecardEnvVarManager_getGeneration(const NotecardEnvVarManager *man);
+int NotecardEnvVarManager_getVarGeneration(const NotecardEnvVarManager *man,
+        const char *var,
+        uint32_t *generation);
+int NotecardEnvVarManager_service(NotecardEnvVarManager *man);
+int NotecardEnvVarManager_setDefaults(NotecardEnvVarManager *man,
+                                      const char **vars, const char **vals,
+                                      size_t numVars);
+int NotecardEnvVarManager_setDispatchBudget(NotecardEnvVarManager *man,
+        size_t maxPairs, uint32_t maxUs,
+        nevmMicrosFn microsFn);
 int NotecardEnvVarManager_setEnvVarCb(NotecardEnvVarManager *man,
                                       envVarCb userCb, void *userCtx);
+int NotecardEnvVarManager_setEnvVarLenCb(NotecardEnvVarManager *man,
+        envVarLenCb userLenCb, void *userCtx);
+int NotecardEnvVarManager_setRequestFn(NotecardEnvVarManager *man,
+                                       nevmRequestFn requestFn,
+                                       void *requestCtx);
+int NotecardEnvVarManager_setEnvVarRemovedCb(NotecardEnvVarManager *man,
+        envVarRemovedCb removedCb,
+        void *removedCtx);
+#ifdef NEVM_ENABLE_EVENTS
+int NotecardEnvVarManager_enableEvents(NotecardEnvVarManager *man,
+                                       size_t maxVars, size_t maxValLen);
+int NotecardEnvVarManager_pollEvent(NotecardEnvVarManager *man,
+                                    NotecardEnvVarEvent *event, char *name,
+                                    size_t nameLen, char *val, size_t valLen);
+#endif
+#ifdef NEVM_ENABLE_TYPES
+int NotecardEnvVarManager_bindBlob(NotecardEnvVarManager *man,
+                                   const char *var, uint8_t *buf,
+                                   size_t maxLen, size_t *len);
+int NotecardEnvVarManager_bindEnum(NotecardEnvVarManager *man,
+                                   const char *var,
+                                   const char *const *names,
+                                   size_t numNames, int *value);
+int NotecardEnvVarManager_bindFlag(NotecardEnvVarManager *man,
+                                   const char *var, unsigned bit);
+int NotecardEnvVarManager_bindFloatArray(NotecardEnvVarManager *man,
+        const char *var, float *buf,
+        size_t maxLen, size_t *len);
+int NotecardEnvVarManager_bindInt32Array(NotecardEnvVarManager *man,
+        const char *var, int32_t *buf,
+        size_t maxLen, size_t *len);
+const volatile uint32_t *NotecardEnvVarManager_getFlags(
+    NotecardEnvVarManager *man);
+J *NotecardEnvVarManager_getJson(NotecardEnvVarManager *man, const char *var,
+                                 const char *path);
+int NotecardEnvVarManager_getJsonNumber(NotecardEnvVarManager *man,
+                                        const char *var, const char *path,
+                                        JNUMBER *value);
+int NotecardEnvVarManager_getJsonString(NotecardEnvVarManager *man,
+                                        const char *var, const char *path,
+                                        char *buf, size_t bufLen);
+NotecardEnvVarParseResult NotecardEnvVarManager_parseFixed(const char *str,
+        size_t len, unsigned scale, int32_t *value);
+NotecardEnvVarParseResult NotecardEnvVarManager_parseFloat(const char *str,
+        size_t len, float *value);
+NotecardEnvVarParseResult NotecardEnvVarManager_parseInt32(const char *str,
+        size_t len, int32_t *value);
+NotecardEnvVarParseResult NotecardEnvVarManager_parseUint32(const char *str,
+        size_t len, uint32_t *value);
+int NotecardEnvVarManager_setDeviceId(NotecardEnvVarManager *man,
+                                      const char *deviceId);
+#endif
+#ifdef NEVM_ENABLE_PERSIST
+int NotecardEnvVarManager_restore(NotecardEnvVarManager *man);
+int NotecardEnvVarManager_setStorage(NotecardEnvVarManager *man,
+                                     const NotecardEnvVarStorage *storage);
+#endif
+#ifdef NEVM_ENABLE_TRACE
+int NotecardEnvVarManager_setTraceCb(NotecardEnvVarManager *man,
+                                     nevmTraceCb traceCb, void *traceCtx);
+#endif
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,163 @@
+#pragma once
+
+// Header-only C++17 layer over the C API. nevm::Manager owns a
+// NotecardEnvVarManager and frees it when it goes out of scope. Callbacks are
+// any callables, called through a trampoline instantiated for their type, so
+// there's no std::function and no allocation, and names and values arrive as
+// std::string_view without being measured again. Every member is an inline
+// call of the C function of the same name.
+
+#if __cplusplus < 201703L
+#error "NotecardEnvVarManager.hpp requires C++17."
+#endif
+
+#include <string_view>
+#include <utility>
+
+#include "NotecardEnvVarManager.h"
+
+namespace nevm
+{
+
+class Manager
+{
+public:
+    Manager() noexcept : man_(NotecardEnvVarManager_alloc()) {}
+
+    // Takes ownership of man.
+    explicit Manager(NotecardEnvVarManager *man) noexcept : man_(man) {}
+
+    ~Manager()
+    {
+        NotecardEnvVarManager_free(man_);
+    }
+
+    Manager(const Manager &) = delete;
+    Manager &operator=(const Manager &) = delete;
+
+    Manager(Manager &&other) noexcept : man_(std::exchange(other.man_,
+                nullptr)) {}
+
+    Manager &operator=(Manager &&other) noexcept
+    {
+        if (this != &other) {
+            NotecardEnvVarManager_free(man_);
+            man_ = std::exchange(other.man_, nullptr);
+        }
+        return *this;
+    }
+
+    // False if allocation failed or the manager was moved from.
+    explicit operator bool() const noexcept
+    {
+        return man_ != nullptr;
+    }
+
+    NotecardEnvVarManager *get() const noexcept
+    {
+        return man_;
+    }
+
+    // Gives up ownership of the manager.
+    NotecardEnvVarManager *release() noexcept
+    {
+        return std::exchange(man_, nullptr);
+    }
+
+    // The callbacks are called as cb(name, value) and cb(name). The manager
+    // keeps a pointer to them, so they must outlive it or be replaced first,
+    // which is why temporaries aren't accepted.
+    template <typename F>
+    int setEnvVarCb(F &cb) noexcept
+    {
+        return NotecardEnvVarManager_setEnvVarLenCb(man_, envVarTrampoline<F>,
+                &cb);
+    }
+    template <typename F>
+    int setEnvVarCb(const F &&cb) = delete;
+
+    template <typename F>
+    int setEnvVarRemovedCb(F &cb) noexcept
+    {
+        return NotecardEnvVarManager_setEnvVarRemovedCb(man_,
+                removedTrampoline<F>, &cb);
+    }
+    template <typename F>
+    int setEnvVarRemovedCb(const F &&cb) = delete;
+
+    // Called as fn(req), returning the response (see
+    // NotecardEnvVarManager_setRequestFn).
+    template <typename F>
+    int setRequestFn(F &fn) noexcept
+    {
+        return NotecardEnvVarManager_setRequestFn(man_, requestTrampoline<F>,
+                &fn);
+    }
+    template <typename F>
+    int setRequestFn(const F &&fn) = delete;
+
+    int fetch(const char **vars = nullptr,
+              size_t numVars = NEVM_ENV_VAR_ALL) noexcept
+    {
+        return NotecardEnvVarManager_fetch(man_, vars, numVars);
+    }
+
+    int get(const char *var, char *buf, size_t bufLen,
+            bool *stale = nullptr) const noexcept
+    {
+        return NotecardEnvVarManager_get(man_, var, buf, bufLen, stale);
+    }
+
+    uint32_t getGeneration() const noexcept
+    {
+        return NotecardEnvVarManager_getGeneration(man_);
+    }
+
+    int getVarGeneration(const char *var, uint32_t *generation) const noexcept
+    {
+        return NotecardEnvVarManager_getVarGeneration(man_, var, generation);
+    }
+
+    int service() noexcept
+    {
+        return NotecardEnvVarManager_service(man_);
+    }
+
+    int setDefaults(const char **vars, const char **vals,
+                    size_t numVars) noexcept
+    {
+        return NotecardEnvVarManager_setDefaults(man_, vars, vals, numVars);
+    }
+
+    int setDispatchBudget(size_t maxPairs, uint32_t maxUs,
+                          nevmMicrosFn microsFn) noexcept
+    {
+        return NotecardEnvVarManager_setDispatchBudget(man_, maxPairs, maxUs,
+                microsFn);
+    }
+
+private:
+    template <typename F>
+    static void envVarTrampoline(const char *var, size_t varLen,
+                                 const char *val, size_t valLen, void *ctx)
+    {
+        (*static_cast<F *>(ctx))(std::string_view(var, varLen),
+                                 std::string_view(val, valLen));
+    }
+
+    template <typename F>
+    static void removedTrampoline(const char *var, void *ctx)
+    {
+        (*static_cast<F *>(ctx))(std::string_view(var));
+    }
+
+    template <typename F>
+    static J *requestTrampoline(J *req, void *ctx)
+    {
+        return (*static_cast<F *>(ctx))(req);
+    }
+
+    NotecardEnvVarManager *man_;
+};
+
+}
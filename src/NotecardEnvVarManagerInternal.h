@@ -0,0 +1,337 @@
+#pragma once
+
+// Definitions shared by the library's source files. Not part of the public
+// API.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "NotecardEnvVarManager.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Values longer than this are delivered to the user's callback but not kept
+// in the manager's value store.
+#define NEVM_MAX_STORED_LEN UINT16_MAX
+
+// Marker for an empty slot in the value store's hash index.
+#define NEVM_INDEX_EMPTY UINT16_MAX
+
+// The maximum number of variables in the value store.
+#define NEVM_MAX_ENTRIES 16384
+
+// nevmEntry flags.
+// The value is a default or was restored from storage, and hasn't been
+// confirmed by a fetch yet.
+#define NEVM_ENTRY_STALE    0x01
+// The value is a compiled-in default, which isn't persisted.
+#define NEVM_ENTRY_DEFAULT  0x02
+// The value changed since it was last persisted.
+#define NEVM_ENTRY_DIRTY    0x04
+// The value was just restored from storage (used during restore only).
+#define NEVM_ENTRY_RESTORED 0x08
+// The variable was deleted. The entry is kept as a tombstone so that the
+// removal can be persisted and the variable can come back.
+#define NEVM_ENTRY_REMOVED  0x10
+// The value isn't valid JSON, so it isn't parsed again until it changes.
+#define NEVM_ENTRY_JSON_INVALID 0x20
+
+// Number of 32-bit words in a bitmap of n bits.
+#define NEVM_BITMAP_WORDS(n) (((n) + 31) / 32)
+
+// A variable in the manager's value store. The name and value are kept in a
+// single block, str, as two consecutive C-strings. The value is updated in
+// place as long as it fits in valCap bytes (including its terminator).
+// Entries are never moved or removed once added, so an entry's index in the
+// store identifies its variable for the lifetime of the manager.
+typedef struct {
+    char *str;
+#ifdef NEVM_ENABLE_TYPES
+    // The value parsed as JSON on first access, until the value changes.
+    J *json;
+#endif
+    uint32_t hash;
+    // The manager's generation when a fetch last changed the value, or 0 if
+    // no fetch has changed it.
+    uint32_t generation;
+    uint16_t nameLen;
+    uint16_t valLen;
+    uint16_t valCap;
+    uint8_t flags;
+} nevmEntry;
+
+#ifdef NEVM_ENABLE_TYPES
+// nevmArray element types.
+#define NEVM_ARRAY_FLOAT 0
+#define NEVM_ARRAY_INT32 1
+#define NEVM_ARRAY_BLOB  2
+
+// A caller's buffer bound to an array-valued or blob variable (see
+// NotecardEnvVarArrays.c). parsed is set once a value has been parsed into
+// it, and stored if that was the variable's value in the store. Otherwise,
+// valHash and valLen identify the value, which was too long to store.
+typedef struct {
+    const char *name;
+    void *buf;
+    size_t *len;
+    size_t maxLen;
+    size_t valLen;
+    uint32_t nameHash;
+    uint32_t valHash;
+    uint16_t nameLen;
+    uint8_t type;
+    bool parsed;
+    bool stored;
+} nevmArray;
+
+// A variable bound to a bit of the manager's flag word (see
+// NotecardEnvVarFlags.c).
+typedef struct {
+    const char *name;
+    uint32_t nameHash;
+    uint16_t nameLen;
+} nevmFlag;
+
+// A caller's int bound to an enum variable (see NotecardEnvVarEnums.c). slots
+// is an open-addressing hash table of slotMask + 1 slots, holding the index of
+// each name plus 1, or 0 for an empty slot.
+typedef struct {
+    const char *name;
+    const char *const *names;
+    int *value;
+    uint8_t *slots;
+    uint32_t nameHash;
+    uint16_t numNames;
+    uint16_t nameLen;
+    uint16_t slotMask;
+} nevmEnum;
+#endif
+
+struct NotecardEnvVarManager {
+    // At most one of userCb and userLenCb is set. Both take userCtx.
+    envVarCb userCb;
+    envVarLenCb userLenCb;
+    void *userCtx;
+
+    // The Notecard's transport. NULL uses note-c's NoteRequestResponse.
+    nevmRequestFn requestFn;
+    void *requestCtx;
+
+    // Value store. index is an open-addressing hash table of entry indices
+    // with indexCap (a power of 2) slots. It isn't behind a feature macro,
+    // since lookups, defaults, removal detection and deferred dispatch all
+    // use it.
+    nevmEntry *entries;
+    uint16_t numEntries;
+    uint16_t capEntries;
+    uint16_t *index;
+    uint16_t indexCap;
+
+    // Incremented by each fetch that changes at least one value.
+    uint32_t generation;
+
+    // Removal detection. Bit i of seen is set if entry i appeared in the
+    // current fetch's response, and bit i of requested if the fetch asked for
+    // it by name. Both have capEntries bits and share one allocation with
+    // pending.
+    uint32_t *seen;
+    uint32_t *requested;
+    envVarRemovedCb removedCb;
+    void *removedCtx;
+
+    // Deferred dispatch. Bit i of pending is set if entry i is queued for
+    // delivery to a callback. NotecardEnvVarManager_service resumes
+    // scanning pending at dispatchCursor. dispatchMaxPairs is 0 when
+    // callbacks are called directly from the fetch.
+    uint32_t *pending;
+    uint16_t numPending;
+    uint16_t dispatchCursor;
+    uint16_t dispatchMaxPairs;
+    uint32_t dispatchMaxUs;
+    nevmMicrosFn microsFn;
+
+#ifdef NEVM_ENABLE_EVENTS
+    // Change-event ring (see NotecardEnvVarEvents.c). eventSeq, eventRing,
+    // eventQueued and the copies of each entry's fields published for the
+    // consumer have capEntries elements each and share one allocation.
+    // eventHead is only written by the producer and eventTail by the
+    // consumer. Every entry's value block holds at least eventValCap bytes,
+    // since blocks can't be replaced while the consumer may be reading them.
+    uint32_t *eventSeq;
+    uint32_t *eventGeneration;
+    uint16_t *eventRing;
+    uint16_t *eventValLen;
+    uint8_t *eventQueued;
+    uint8_t *eventRemoved;
+    uint32_t eventHead;
+    uint32_t eventTail;
+    uint16_t eventValCap;
+#endif
+#ifdef NEVM_ENABLE_PERSIST
+    // Journal state. The journal occupies the first two sectors of storage,
+    // and records are appended to journalSector at journalOff. A journalOff
+    // of 0 means the append position is unknown, so the next save compacts
+    // into the other sector. journalLoaded is set once every persisted value
+    // is held in memory, so that compacting doesn't drop any.
+    const NotecardEnvVarStorage *storage;
+    uint32_t journalSeq;
+    uint32_t journalOff;
+    uint8_t journalSector;
+    bool journalLoaded;
+#endif
+#ifdef NEVM_ENABLE_TYPES
+    // Array bindings, in no particular order.
+    nevmArray *arrays;
+    uint16_t numArrays;
+    uint16_t capArrays;
+
+    // Enum bindings, in no particular order.
+    nevmEnum *enums;
+    uint16_t numEnums;
+    uint16_t capEnums;
+
+    // Flag bindings, indexed by bit and allocated on the first binding. Bit n
+    // of flagsBound is set if bit n is bound. Values are applied to
+    // flagsNext, which is copied to flags once the values have all been
+    // applied. Rollout rules are evaluated with the device ID's hash.
+    nevmFlag *flagVars;
+    uint32_t flagsBound;
+    uint32_t flagsNext;
+    volatile uint32_t flags;
+    uint32_t deviceIdHash;
+    bool hasDeviceId;
+#endif
+#ifdef NEVM_ENABLE_TRACE
+    nevmTraceCb traceCb;
+    void *traceCtx;
+#endif
+};
+
+#ifdef NEVM_ENABLE_TRACE
+#define NEVM_TRACE(man, phase, begin, detail)                                 \
+    do {                                                                      \
+        if ((man)->traceCb != NULL) {                                         \
+            (man)->traceCb((phase), (begin), (detail), (man)->traceCtx);      \
+        }                                                                     \
+    } while (0)
+#else
+#define NEVM_TRACE(man, phase, begin, detail)
+#endif
+
+static inline void _nevmBitSet(uint32_t *bitmap, uint16_t bit)
+{
+    bitmap[bit / 32] |= (uint32_t)1 << (bit % 32);
+}
+
+static inline void _nevmBitClear(uint32_t *bitmap, uint16_t bit)
+{
+    bitmap[bit / 32] &= ~((uint32_t)1 << (bit % 32));
+}
+
+static inline bool _nevmBitTest(const uint32_t *bitmap, uint16_t bit)
+{
+    return (bitmap[bit / 32] >> (bit % 32)) & 1;
+}
+
+static inline const char *_nevmEntryVal(const nevmEntry *entry)
+{
+    return entry->str + entry->nameLen + 1;
+}
+
+#ifdef NEVM_ENABLE_TYPES
+// Forget an entry's parsed JSON, whose value is changing.
+static inline void _nevmEntryDropJson(nevmEntry *entry)
+{
+    JDelete(entry->json);
+    entry->json = NULL;
+    entry->flags &= ~NEVM_ENTRY_JSON_INVALID;
+}
+#define NEVM_ENTRY_DROP_JSON(entry) _nevmEntryDropJson(entry)
+#else
+#define NEVM_ENTRY_DROP_JSON(entry)
+#endif
+
+static inline bool _nevmHasUserCb(const NotecardEnvVarManager *man)
+{
+    return man->userCb != NULL || man->userLenCb != NULL;
+}
+
+void _nevmCallUserCb(const NotecardEnvVarManager *man, const char *var,
+                     size_t varLen, const char *val, size_t valLen);
+uint32_t _nevmHash(const char *str, size_t len);
+int _nevmStoreGrow(NotecardEnvVarManager *man);
+int _nevmStoreFind(const NotecardEnvVarManager *man, const char *name,
+                   size_t nameLen);
+int _nevmStoreSet(NotecardEnvVarManager *man, const char *name,
+                  size_t nameLen, const char *val, size_t valLen,
+                  bool *changed);
+
+#ifdef NEVM_ENABLE_PERSIST
+int _nevmPersistSave(NotecardEnvVarManager *man);
+#endif
+
+#ifdef NEVM_ENABLE_EVENTS
+void _nevmEventWriteBegin(NotecardEnvVarManager *man, uint16_t idx);
+void _nevmEventWriteVal(NotecardEnvVarManager *man, char *dst, const char *val,
+                        size_t valLen);
+void _nevmEventWriteEnd(NotecardEnvVarManager *man, uint16_t idx);
+void _nevmEventPush(NotecardEnvVarManager *man, uint16_t idx);
+void _nevmEventsFree(NotecardEnvVarManager *man);
+#define NEVM_EVENT_WRITE_BEGIN(man, idx) _nevmEventWriteBegin((man), (idx))
+#define NEVM_EVENT_WRITE_END(man, idx) _nevmEventWriteEnd((man), (idx))
+#define NEVM_EVENT_PUSH(man, idx) _nevmEventPush((man), (idx))
+#define NEVM_EVENT_WRITE_VAL(man, dst, val, valLen)                           \
+    _nevmEventWriteVal((man), (dst), (val), (valLen))
+#else
+#define NEVM_EVENT_WRITE_BEGIN(man, idx)
+#define NEVM_EVENT_WRITE_END(man, idx)
+#define NEVM_EVENT_PUSH(man, idx)
+#define NEVM_EVENT_WRITE_VAL(man, dst, val, valLen)                           \
+    do {                                                                      \
+        memcpy((dst), (val), (valLen));                                       \
+        (dst)[(valLen)] = '\0';                                               \
+    } while (0)
+#endif
+
+#ifdef NEVM_ENABLE_TYPES
+void _nevmArraysApply(NotecardEnvVarManager *man, const char *var,
+                      size_t varLen, const char *val, size_t valLen,
+                      bool stored, bool changed);
+#define NEVM_ARRAYS_APPLY(man, var, varLen, val, valLen, stored, changed)     \
+    do {                                                                      \
+        if ((man)->numArrays > 0) {                                           \
+            _nevmArraysApply((man), (var), (varLen), (val), (valLen),         \
+                             (stored), (changed));                            \
+        }                                                                     \
+    } while (0)
+void _nevmFlagsApply(NotecardEnvVarManager *man, const char *var,
+                     size_t varLen, const char *val, size_t valLen);
+#define NEVM_FLAGS_APPLY(man, var, varLen, val, valLen)                       \
+    do {                                                                      \
+        if ((man)->flagsBound != 0) {                                         \
+            _nevmFlagsApply((man), (var), (varLen), (val), (valLen));         \
+        }                                                                     \
+    } while (0)
+#define NEVM_FLAGS_PUBLISH(man) ((man)->flags = (man)->flagsNext)
+void _nevmEnumsApply(NotecardEnvVarManager *man, const char *var,
+                     size_t varLen, const char *val, size_t valLen);
+void _nevmEnumsFree(NotecardEnvVarManager *man);
+#define NEVM_ENUMS_APPLY(man, var, varLen, val, valLen)                       \
+    do {                                                                      \
+        if ((man)->numEnums > 0) {                                            \
+            _nevmEnumsApply((man), (var), (varLen), (val), (valLen));         \
+        }                                                                     \
+    } while (0)
+#else
+#define NEVM_ARRAYS_APPLY(man, var, varLen, val, valLen, stored, changed)
+#define NEVM_FLAGS_APPLY(man, var, varLen, val, valLen)
+#define NEVM_FLAGS_PUBLISH(man)
+#define NEVM_ENUMS_APPLY(man, var, varLen, val, valLen)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
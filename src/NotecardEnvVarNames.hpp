@@ -0,0 +1,242 @@
+#pragma once
+
+// Compile-time table of variable names for C++17 firmware. A constexpr
+// nevm::NameTable finds a collision-free hash for its names while compiling,
+// so mapping a fetched name to its index costs one pass of FNV-1a over the
+// name, two multiplies and a single comparison, with no strcmp over the
+// table. index() is constexpr too, so handlers can be dispatched with a
+// switch:
+//
+//   constexpr nevm::NameTable names("interval", "threshold", "mode");
+//
+//   void onChange(std::string_view var, std::string_view val)
+//   {
+//       switch (names.find(var)) {
+//       case names.index("interval"):
+//           ...
+//       }
+//   }
+//
+//   manager.fetch(names.vars(), names.size());
+//
+// or with dispatch(), which takes one handler per name, in the table's order,
+// and generates the switch:
+//
+//   names.dispatch(var, val,
+//       [](std::string_view val) { ... },   // interval
+//       [](std::string_view val) { ... },   // threshold
+//       [](std::string_view val) { ... });  // mode
+//
+// The table is constant-initialized, so it lives in read-only memory with no
+// static initializer. Duplicate names, or a name passed to index() that isn't
+// in the table, fail to compile.
+//
+// The hash is CHD ("compress, hash and displace"): each name falls in one of
+// N buckets by its hash, and each bucket has a displacement, chosen while
+// compiling, that sends its names to free slots of a table of the next power
+// of two at or above N.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+#include <utility>
+
+namespace nevm
+{
+
+namespace detail
+{
+
+// Not constexpr: reaching a call while evaluating a constant expression makes
+// it fail to compile. At run time, they do nothing.
+inline void nameTableDuplicate() {}
+inline void nameTableNoHash() {}
+inline void nameTableUnknown() {}
+
+constexpr uint32_t nameHash(std::string_view name) noexcept
+{
+    uint32_t h = 2166136261u;
+    for (char c : name) {
+        h = (h ^ (uint8_t)c) * 16777619u;
+    }
+    return h;
+}
+
+// Murmur3's finalizer, over the hash displaced by d.
+constexpr uint32_t nameSlotHash(uint32_t h, uint32_t d) noexcept
+{
+    h += d * 0x9E3779B9u;
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+constexpr size_t nameTableCapacity(size_t n) noexcept
+{
+    size_t cap = 1;
+    while (cap < n) {
+        cap *= 2;
+    }
+    return cap;
+}
+
+}
+
+template <size_t N>
+class NameTable
+{
+    static_assert(N > 0 && N < UINT16_MAX, "Unsupported number of names.");
+
+public:
+    template <typename... Names>
+    constexpr NameTable(const Names &...names) noexcept
+        : vars_{names...}, keys_{names...}
+    {
+        for (size_t i = 0; i < N; ++i) {
+            for (size_t j = i + 1; j < N; ++j) {
+                if (keys_[i] == keys_[j]) {
+                    detail::nameTableDuplicate();
+                }
+            }
+        }
+
+        uint32_t hashes[N] = {};
+        uint16_t bucketSizes[N] = {};
+        for (size_t i = 0; i < N; ++i) {
+            hashes[i] = detail::nameHash(keys_[i]);
+            ++bucketSizes[hashes[i] % N];
+        }
+        for (size_t s = 0; s < capacity; ++s) {
+            slots_[s] = N;
+        }
+
+        // Place the largest buckets first, while the table is emptiest.
+        bool placed[N] = {};
+        for (size_t n = 0; n < N; ++n) {
+            size_t b = N;
+            for (size_t i = 0; i < N; ++i) {
+                if (!placed[i] && (b == N || bucketSizes[i] > bucketSizes[b])) {
+                    b = i;
+                }
+            }
+            placed[b] = true;
+            if (bucketSizes[b] > 0) {
+                place(hashes, b);
+            }
+        }
+    }
+
+    static constexpr size_t size() noexcept
+    {
+        return N;
+    }
+
+    // The index of name, or -1 if it isn't in the table.
+    constexpr int find(std::string_view name) const noexcept
+    {
+        uint32_t h = detail::nameHash(name);
+        uint16_t idx = slots_[detail::nameSlotHash(h, disp_[h % N]) &
+                              (capacity - 1)];
+        return (idx < N && keys_[idx] == name) ? (int)idx : -1;
+    }
+
+    // The index of a name that must be in the table, for case labels. At run
+    // time, it's the same as find().
+    constexpr int index(std::string_view name) const noexcept
+    {
+        int idx = find(name);
+        if (idx < 0) {
+            detail::nameTableUnknown();
+        }
+        return idx;
+    }
+
+    constexpr std::string_view name(size_t idx) const noexcept
+    {
+        return keys_[idx];
+    }
+
+    // Call the handler for name with val, and return whether name is in the
+    // table. The handlers are in the table's order, one per name.
+    template <typename... Handlers>
+    constexpr bool dispatch(std::string_view name, std::string_view val,
+                            Handlers &&...handlers) const
+    {
+        static_assert(sizeof...(Handlers) == N,
+                      "dispatch() takes one handler per name.");
+        return dispatchAt(find(name), val,
+                          std::index_sequence_for<Handlers...> {}, handlers...);
+    }
+
+    // The names, in declaration order, for NotecardEnvVarManager_fetch. The
+    // C API takes a const char ** for historical reasons, but never writes
+    // through it. The cast only drops the constness of the pointer array,
+    // which a constexpr table keeps in read-only memory, so nothing else may
+    // write through the result either.
+    const char **vars() const noexcept
+    {
+        return const_cast<const char **>(vars_);
+    }
+
+private:
+    static constexpr size_t capacity = detail::nameTableCapacity(N);
+
+    // Compares idx with each constant index in turn, which compilers turn
+    // into a switch.
+    template <size_t... I, typename... Handlers>
+    static constexpr bool dispatchAt(int idx, std::string_view val,
+                                     std::index_sequence<I...>,
+                                     Handlers &...handlers)
+    {
+        return ((idx == (int)I && (handlers(val), true)) || ...);
+    }
+
+    // Find a displacement for bucket b that puts each of its names in a free
+    // slot, and take the slots.
+    constexpr void place(const uint32_t (&hashes)[N], size_t b) noexcept
+    {
+        for (uint32_t d = 0; d <= UINT16_MAX; ++d) {
+            size_t taken[N] = {};
+            size_t numTaken = 0;
+            bool fits = true;
+            for (size_t i = 0; i < N && fits; ++i) {
+                if (hashes[i] % N != b) {
+                    continue;
+                }
+                size_t s = detail::nameSlotHash(hashes[i], d) & (capacity - 1);
+                fits = (slots_[s] == N);
+                for (size_t t = 0; t < numTaken && fits; ++t) {
+                    fits = (taken[t] != s);
+                }
+                taken[numTaken++] = s;
+            }
+            if (!fits) {
+                continue;
+            }
+
+            for (size_t i = 0; i < N; ++i) {
+                if (hashes[i] % N == b) {
+                    size_t s = detail::nameSlotHash(hashes[i], d) &
+                               (capacity - 1);
+                    slots_[s] = (uint16_t)i;
+                }
+            }
+            disp_[b] = (uint16_t)d;
+            return;
+        }
+        detail::nameTableNoHash();
+    }
+
+    const char *vars_[N] = {};
+    std::string_view keys_[N] = {};
+    uint16_t disp_[N] = {};
+    uint16_t slots_[capacity] = {};
+};
+
+template <typename... Names>
+NameTable(const Names &...) -> NameTable<sizeof...(Names)>;
+
+}
@@ -0,0 +1,349 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "NotecardEnvVarManager.h"
+
+#ifdef NEVM_ENABLE_TYPES
+
+// Number parsers for typed variables. Like C++'s std::from_chars, they take a
+// length rather than a C-string, don't skip whitespace, don't accept a leading
+// '+', don't depend on the locale and don't allocate. They're also much
+// smaller than strtod, which pulls newlib's whole locale-aware conversion
+// machinery into flash.
+//
+// Each parser returns where it stopped and whether it succeeded. On
+// NEVM_PARSE_INVALID, ptr is the start of the input and the value is left
+// alone. On NEVM_PARSE_RANGE, ptr is past the number, which was well-formed
+// but doesn't fit, and the value is left alone.
+
+// The most significant decimal digits of a float's input that are kept. More
+// than 9 are never needed to tell two floats apart, and 19 fit in a uint64_t.
+#define NEVM_PARSE_MAX_DIGITS 19
+
+// Clamp for the exponent, to keep its arithmetic from overflowing. Anything
+// beyond it is already out of float's range.
+#define NEVM_PARSE_MAX_EXPONENT 100000
+
+// The powers of 10 that are exactly representable as doubles.
+static const double _pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13,
+    1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+#define NEVM_PARSE_MAX_EXACT_POW10 22
+
+static inline bool _isDigit(char c)
+{
+    return (unsigned)(c - '0') < 10;
+}
+
+static inline char _lower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+}
+
+/**
+ * Internal function to parse the digits at p into a value no greater than max,
+ * consuming all of them even if the value overflows.
+ *
+ * @return One past the last digit, which is p if there are none.
+ */
+static const char *_parseDigits(const char *p, const char *end, uint32_t max,
+                                uint32_t *value, bool *overflow)
+{
+    uint32_t u = 0;
+
+    for (; p < end && _isDigit(*p); ++p) {
+        uint32_t d = (uint32_t)(*p - '0');
+        if (u > (max - d) / 10) {
+            *overflow = true;
+        } else {
+            u = u * 10 + d;
+        }
+    }
+    *value = u;
+
+    return p;
+}
+
+/**
+ * Internal function to check for a case-insensitive word at p.
+ */
+static bool _matchWord(const char *p, const char *end, const char *word)
+{
+    for (; *word != '\0'; ++p, ++word) {
+        if (p == end || _lower(*p) != *word) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Parse a decimal signed 32-bit integer, with an optional leading '-'.
+ *
+ * @param str   The characters to parse.
+ * @param len   The number of characters in str.
+ * @param value Where to store the value.
+ *
+ * @return Where parsing stopped, and NEVM_PARSE_OK, NEVM_PARSE_INVALID or
+ *         NEVM_PARSE_RANGE.
+ */
+NotecardEnvVarParseResult NotecardEnvVarManager_parseInt32(const char *str,
+        size_t len, int32_t *value)
+{
+    NotecardEnvVarParseResult result = {str, NEVM_PARSE_INVALID};
+    const char *end = str + len;
+    const char *p = str;
+    bool neg = (p < end && *p == '-');
+    p += neg;
+
+    uint32_t u;
+    bool overflow = false;
+    const char *digitsEnd = _parseDigits(p, end,
+                                         neg ? (uint32_t)INT32_MAX + 1 :
+                                         (uint32_t)INT32_MAX, &u, &overflow);
+    if (digitsEnd == p) {
+        return result;
+    }
+
+    result.ptr = digitsEnd;
+    if (overflow) {
+        result.ec = NEVM_PARSE_RANGE;
+    } else {
+        *value = neg ? (int32_t)(0 - u) : (int32_t)u;
+        result.ec = NEVM_PARSE_OK;
+    }
+
+    return result;
+}
+
+/**
+ * Parse a decimal unsigned 32-bit integer.
+ *
+ * @param str   The characters to parse.
+ * @param len   The number of characters in str.
+ * @param value Where to store the value.
+ *
+ * @return Where parsing stopped, and NEVM_PARSE_OK, NEVM_PARSE_INVALID or
+ *         NEVM_PARSE_RANGE.
+ */
+NotecardEnvVarParseResult NotecardEnvVarManager_parseUint32(const char *str,
+        size_t len, uint32_t *value)
+{
+    NotecardEnvVarParseResult result = {str, NEVM_PARSE_INVALID};
+    uint32_t u;
+    bool overflow = false;
+    const char *digitsEnd = _parseDigits(str, str + len, UINT32_MAX, &u,
+                                         &overflow);
+    if (digitsEnd == str) {
+        return result;
+    }
+
+    result.ptr = digitsEnd;
+    if (overflow) {
+        result.ec = NEVM_PARSE_RANGE;
+    } else {
+        *value = u;
+        result.ec = NEVM_PARSE_OK;
+    }
+
+    return result;
+}
+
+/**
+ * Parse a decimal number, such as "-12.5", into a signed 32-bit fixed-point
+ * value with scale decimal places: "-12.5" with scale 2 is -1250. Digits past
+ * the scale are rounded to nearest, with ties away from zero. Exponents aren't
+ * accepted.
+ *
+ * @param str   The characters to parse.
+ * @param len   The number of characters in str.
+ * @param scale The number of decimal places, up to 9.
+ * @param value Where to store the value.
+ *
+ * @return Where parsing stopped, and NEVM_PARSE_OK, NEVM_PARSE_INVALID or
+ *         NEVM_PARSE_RANGE.
+ */
+NotecardEnvVarParseResult NotecardEnvVarManager_parseFixed(const char *str,
+        size_t len, unsigned scale, int32_t *value)
+{
+    NotecardEnvVarParseResult result = {str, NEVM_PARSE_INVALID};
+    const char *end = str + len;
+    const char *p = str;
+    bool neg = (p < end && *p == '-');
+    p += neg;
+    if (scale > 9) {
+        return result;
+    }
+
+    // The integer part saturates just past the range, so that scaling it
+    // can't overflow.
+    const uint64_t saturated = (uint64_t)INT32_MAX + 2;
+    uint64_t u = 0;
+    bool any = false;
+    for (; p < end && _isDigit(*p); ++p) {
+        any = true;
+        u = u * 10 + (uint64_t)(*p - '0');
+        if (u > saturated) {
+            u = saturated;
+        }
+    }
+
+    unsigned places = 0;
+    bool roundUp = false;
+    if (p < end && *p == '.') {
+        const char *frac = p + 1;
+        for (p = frac; p < end && _isDigit(*p); ++p) {
+            if (places < scale) {
+                u = u * 10 + (uint64_t)(*p - '0');
+                ++places;
+            } else if (p == frac + scale) {
+                roundUp = (*p >= '5');
+            }
+        }
+        any = any || (p > frac);
+    }
+    if (!any) {
+        return result;
+    }
+
+    for (; places < scale; ++places) {
+        u *= 10;
+    }
+    u += roundUp;
+
+    result.ptr = p;
+    if (u > (neg ? (uint64_t)INT32_MAX + 1 : (uint64_t)INT32_MAX)) {
+        result.ec = NEVM_PARSE_RANGE;
+    } else {
+        *value = neg ? (int32_t)(0 - (uint32_t)u) : (int32_t)u;
+        result.ec = NEVM_PARSE_OK;
+    }
+
+    return result;
+}
+
+/**
+ * Parse a decimal floating-point number, such as "-1.5e-3", "inf" or "nan",
+ * as strtof would in the C locale. Values printed with 9 significant digits
+ * (e.g. with "%.9g") parse back to the same float. The value is computed in
+ * double precision and rounded once to float, which is correctly rounded
+ * except for inputs within about 1e-16 of the midpoint between two floats.
+ *
+ * @param str   The characters to parse.
+ * @param len   The number of characters in str.
+ * @param value Where to store the value.
+ *
+ * @return Where parsing stopped, and NEVM_PARSE_OK, NEVM_PARSE_INVALID or
+ *         NEVM_PARSE_RANGE if the value's magnitude is too large for a float.
+ */
+NotecardEnvVarParseResult NotecardEnvVarManager_parseFloat(const char *str,
+        size_t len, float *value)
+{
+    NotecardEnvVarParseResult result = {str, NEVM_PARSE_INVALID};
+    const char *end = str + len;
+    const char *p = str;
+    bool neg = (p < end && *p == '-');
+    p += neg;
+
+    if (_matchWord(p, end, "inf")) {
+        result.ptr = p + (_matchWord(p, end, "infinity") ? 8 : 3);
+        result.ec = NEVM_PARSE_OK;
+        *value = neg ? -INFINITY : INFINITY;
+        return result;
+    }
+    if (_matchWord(p, end, "nan")) {
+        result.ptr = p + 3;
+        result.ec = NEVM_PARSE_OK;
+        *value = neg ? -NAN : NAN;
+        return result;
+    }
+
+    // Keep the leading significant digits in w, with the value being
+    // w * 10^exp10.
+    uint64_t w = 0;
+    int digits = 0;
+    int32_t exp10 = 0;
+    bool any = false;
+    for (; p < end && _isDigit(*p); ++p) {
+        any = true;
+        if (digits < NEVM_PARSE_MAX_DIGITS) {
+            w = w * 10 + (uint64_t)(*p - '0');
+            digits += (w != 0);
+        } else {
+            ++exp10;
+        }
+    }
+    if (p < end && *p == '.') {
+        const char *frac = p + 1;
+        for (p = frac; p < end && _isDigit(*p); ++p) {
+            if (digits < NEVM_PARSE_MAX_DIGITS) {
+                w = w * 10 + (uint64_t)(*p - '0');
+                digits += (w != 0);
+                --exp10;
+            }
+        }
+        any = any || (p > frac);
+    }
+    if (!any) {
+        return result;
+    }
+
+    // The exponent only counts if it has digits.
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *e = p + 1;
+        bool expNeg = (e < end && *e == '-');
+        e += (e < end && (*e == '-' || *e == '+'));
+        if (e < end && _isDigit(*e)) {
+            int32_t exp = 0;
+            for (; e < end && _isDigit(*e); ++e) {
+                if (exp < NEVM_PARSE_MAX_EXPONENT) {
+                    exp = exp * 10 + (*e - '0');
+                }
+            }
+            exp10 += expNeg ? -exp : exp;
+            p = e;
+        }
+    }
+    result.ptr = p;
+
+    double d = 0;
+    if (w != 0) {
+        // The value is at least 10^(digits - 1 + exp10) and less than
+        // 10^(digits + exp10). FLT_MAX is about 3.4e38, and anything below
+        // half the smallest subnormal, about 7e-46, rounds to 0.
+        if (digits + exp10 > 39) {
+            result.ec = NEVM_PARSE_RANGE;
+            return result;
+        }
+        if (digits + exp10 >= -45) {
+            // With w exact and |exp10| <= 22, this is a single correctly
+            // rounded operation.
+            d = (double)w;
+            for (; exp10 > NEVM_PARSE_MAX_EXACT_POW10;
+                    exp10 -= NEVM_PARSE_MAX_EXACT_POW10) {
+                d *= _pow10[NEVM_PARSE_MAX_EXACT_POW10];
+            }
+            for (; exp10 < -NEVM_PARSE_MAX_EXACT_POW10;
+                    exp10 += NEVM_PARSE_MAX_EXACT_POW10) {
+                d /= _pow10[NEVM_PARSE_MAX_EXACT_POW10];
+            }
+            d = (exp10 >= 0) ? d * _pow10[exp10] : d / _pow10[-exp10];
+        }
+    }
+
+    float f = (float)d;
+    if (isinf(f)) {
+        result.ec = NEVM_PARSE_RANGE;
+        return result;
+    }
+    *value = neg ? -f : f;
+    result.ec = NEVM_PARSE_OK;
+
+    return result;
+}
+
+#endif // NEVM_ENABLE_TYPES
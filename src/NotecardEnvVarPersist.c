@@ -0,0 +1,481 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+#include "NotecardEnvVarManagerInternal.h"
+
+#ifdef NEVM_ENABLE_PERSIST
+
+// Values are persisted in an append-only journal spread over the first two
+// sectors of storage. Only one sector is active at a time. All integers are
+// little-endian.
+//
+//   Sector header (8 bytes): magic "NEVJ", sequence number (4 bytes).
+//   Records:                 name length (2 bytes), value length (2 bytes),
+//                            CRC-32 of the lengths, name and value (4 bytes),
+//                            then the name and value without terminators,
+//                            padded to a multiple of 4 bytes. A value length
+//                            of NEVM_TOMBSTONE_LEN marks a removed variable,
+//                            and the record has no value bytes.
+//
+// A save appends a record for each changed variable. When the active sector
+// is full, the live values are compacted into the other sector, whose header
+// is written last with the next sequence number. At boot, the valid sector
+// with the highest sequence number is replayed, later records overriding
+// earlier ones. Replay stops at the first erased or corrupt record, so a
+// record torn by a reset is simply dropped.
+#define NEVM_JOURNAL_MAGIC      0x4A56454EUL
+#define NEVM_SECTOR_HDR_LEN     8
+#define NEVM_RECORD_HDR_LEN     8
+#define NEVM_RECORD_ALIGN       4
+#define NEVM_MIN_SECTOR_SIZE    64
+#define NEVM_TOMBSTONE_LEN      UINT16_MAX
+
+static void _put16(uint8_t *buf, uint16_t val)
+{
+    buf[0] = (uint8_t)val;
+    buf[1] = (uint8_t)(val >> 8);
+}
+
+static void _put32(uint8_t *buf, uint32_t val)
+{
+    _put16(buf, (uint16_t)val);
+    _put16(buf + 2, (uint16_t)(val >> 16));
+}
+
+static uint16_t _get16(const uint8_t *buf)
+{
+    return (uint16_t)(buf[0] | (buf[1] << 8));
+}
+
+static uint32_t _get32(const uint8_t *buf)
+{
+    return _get16(buf) | ((uint32_t)_get16(buf + 2) << 16);
+}
+
+/**
+ * Internal function to continue a CRC-32 (IEEE 802.3) over len more bytes.
+ * Uses a 16-entry table to keep the flash cost down.
+ *
+ * @param crc  The CRC of the preceding bytes, or 0 to start a new CRC.
+ * @param data The bytes.
+ * @param len  The number of bytes.
+ *
+ * @return The updated CRC.
+ */
+static uint32_t _crc32(uint32_t crc, const void *data, size_t len)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+        0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    const uint8_t *bytes = (const uint8_t *)data;
+
+    crc = ~crc;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= bytes[i];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+
+    return ~crc;
+}
+
+static uint32_t _recordLen(uint16_t nameLen, uint16_t valLen)
+{
+    if (valLen == NEVM_TOMBSTONE_LEN) {
+        valLen = 0;
+    }
+    uint32_t len = NEVM_RECORD_HDR_LEN + (uint32_t)nameLen + valLen;
+
+    return (len + NEVM_RECORD_ALIGN - 1) & ~(uint32_t)(NEVM_RECORD_ALIGN - 1);
+}
+
+/**
+ * Internal function to append a record for an entry at *offset in the given
+ * sector, advancing *offset past the record.
+ */
+static int _appendRecord(const NotecardEnvVarStorage *storage, uint8_t sector,
+                         uint32_t *offset, const nevmEntry *entry)
+{
+    bool removed = (entry->flags & NEVM_ENTRY_REMOVED) != 0;
+    uint16_t valLen = removed ? 0 : entry->valLen;
+    uint8_t hdr[NEVM_RECORD_HDR_LEN];
+    _put16(hdr, entry->nameLen);
+    _put16(hdr + 2, removed ? NEVM_TOMBSTONE_LEN : valLen);
+    uint32_t crc = _crc32(0, hdr, 4);
+    crc = _crc32(crc, entry->str, entry->nameLen);
+    crc = _crc32(crc, _nevmEntryVal(entry), valLen);
+    _put32(hdr + 4, crc);
+
+    uint32_t base = sector * storage->sectorSize + *offset;
+    if (storage->write(storage->ctx, base, hdr, sizeof(hdr)) != NEVM_SUCCESS
+            || storage->write(storage->ctx, base + sizeof(hdr), entry->str,
+                              entry->nameLen) != NEVM_SUCCESS
+            || (valLen > 0
+                && storage->write(storage->ctx,
+                                  base + sizeof(hdr) + entry->nameLen,
+                                  _nevmEntryVal(entry), valLen)
+                != NEVM_SUCCESS)) {
+        NOTE_C_LOG_ERROR("Failed to write to storage.\r\n");
+        return NEVM_FAILURE;
+    }
+    *offset += _recordLen(entry->nameLen, valLen);
+
+    return NEVM_SUCCESS;
+}
+
+static bool _persisted(const nevmEntry *entry)
+{
+    return !(entry->flags & NEVM_ENTRY_DEFAULT);
+}
+
+static uint32_t _entryRecordLen(const nevmEntry *entry)
+{
+    return _recordLen(entry->nameLen, (entry->flags & NEVM_ENTRY_REMOVED) ?
+                      NEVM_TOMBSTONE_LEN : entry->valLen);
+}
+
+/**
+ * Internal function to write every persisted value to the inactive sector and
+ * make it the active sector.
+ */
+static int _compact(NotecardEnvVarManager *man)
+{
+    const NotecardEnvVarStorage *storage = man->storage;
+    uint8_t sector = man->journalSector ^ 1;
+
+    // Removed variables are simply left out of the compacted sector.
+    uint32_t len = NEVM_SECTOR_HDR_LEN;
+    for (uint16_t i = 0; i < man->numEntries; ++i) {
+        const nevmEntry *entry = &man->entries[i];
+        if (_persisted(entry) && !(entry->flags & NEVM_ENTRY_REMOVED)) {
+            len += _recordLen(entry->nameLen, entry->valLen);
+        }
+    }
+    if (len > storage->sectorSize) {
+        NOTE_C_LOG_ERROR("Values don't fit in a storage sector.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    if (storage->erase(storage->ctx, sector * storage->sectorSize,
+                       storage->sectorSize) != NEVM_SUCCESS) {
+        NOTE_C_LOG_ERROR("Failed to erase storage.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    uint32_t offset = NEVM_SECTOR_HDR_LEN;
+    for (uint16_t i = 0; i < man->numEntries; ++i) {
+        const nevmEntry *entry = &man->entries[i];
+        if (_persisted(entry) && !(entry->flags & NEVM_ENTRY_REMOVED)
+                && _appendRecord(storage, sector, &offset, entry)
+                != NEVM_SUCCESS) {
+            return NEVM_FAILURE;
+        }
+    }
+
+    // Writing the header switches the active sector.
+    uint8_t hdr[NEVM_SECTOR_HDR_LEN];
+    _put32(hdr, NEVM_JOURNAL_MAGIC);
+    _put32(hdr + 4, man->journalSeq + 1);
+    if (storage->write(storage->ctx, sector * storage->sectorSize, hdr,
+                       sizeof(hdr)) != NEVM_SUCCESS) {
+        NOTE_C_LOG_ERROR("Failed to write to storage.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    man->journalSector = sector;
+    man->journalSeq += 1;
+    man->journalOff = offset;
+    for (uint16_t i = 0; i < man->numEntries; ++i) {
+        man->entries[i].flags &= ~NEVM_ENTRY_DIRTY;
+    }
+
+    return NEVM_SUCCESS;
+}
+
+/**
+ * Internal function to walk the records in the active sector, setting
+ * journalOff to the end of the journal. With load set, the records are also
+ * replayed into the store, later records overriding earlier ones, and every
+ * variable loaded is flagged NEVM_ENTRY_RESTORED. Variables fetched since
+ * boot are left alone.
+ *
+ * @param man  Pointer to a NotecardEnvVarManager object with a journal.
+ * @param load Whether to load the records into the store.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+static int _replay(NotecardEnvVarManager *man, bool load)
+{
+    int ret = NEVM_SUCCESS;
+    char *buf = NULL;
+    size_t bufLen = 0;
+    const NotecardEnvVarStorage *storage = man->storage;
+    uint32_t base = man->journalSector * storage->sectorSize;
+    uint32_t offset = NEVM_SECTOR_HDR_LEN;
+    man->journalOff = 0;
+    while (offset + NEVM_RECORD_HDR_LEN <= storage->sectorSize) {
+        uint8_t hdr[NEVM_RECORD_HDR_LEN];
+        if (storage->read(storage->ctx, base + offset, hdr, sizeof(hdr))
+                != NEVM_SUCCESS) {
+            NOTE_C_LOG_ERROR("Failed to read from storage.\r\n");
+            ret = NEVM_FAILURE;
+            break;
+        }
+        uint16_t nameLen = _get16(hdr);
+        uint16_t valLen = _get16(hdr + 2);
+        if (nameLen == UINT16_MAX && valLen == UINT16_MAX
+                && _get32(hdr + 4) == UINT32_MAX) {
+            // Erased: the end of the journal.
+            man->journalOff = offset;
+            break;
+        }
+        bool tombstone = (valLen == NEVM_TOMBSTONE_LEN);
+        size_t len = (size_t)nameLen + (tombstone ? 0 : valLen);
+        if (len > storage->sectorSize - offset - NEVM_RECORD_HDR_LEN) {
+            NOTE_C_LOG_WARN("Journal truncated.\r\n");
+            break;
+        }
+
+        if (len > bufLen) {
+            NoteFree(buf);
+            buf = (char *)NoteMalloc(len);
+            if (buf == NULL) {
+                NOTE_C_LOG_ERROR("Out of memory.\r\n");
+                ret = NEVM_FAILURE;
+                break;
+            }
+            bufLen = len;
+        }
+        if (len > 0 && storage->read(storage->ctx,
+                                     base + offset + NEVM_RECORD_HDR_LEN, buf,
+                                     len) != NEVM_SUCCESS) {
+            NOTE_C_LOG_ERROR("Failed to read from storage.\r\n");
+            ret = NEVM_FAILURE;
+            break;
+        }
+        uint32_t crc = _crc32(_crc32(0, hdr, 4), buf, len);
+        if (crc != _get32(hdr + 4)) {
+            NOTE_C_LOG_WARN("Journal truncated.\r\n");
+            break;
+        }
+
+        offset += _recordLen(nameLen, valLen);
+        if (!load) {
+            continue;
+        }
+        int idx = _nevmStoreFind(man, buf, nameLen);
+        if (idx >= 0 && !(man->entries[idx].flags
+                          & (NEVM_ENTRY_DEFAULT | NEVM_ENTRY_RESTORED))) {
+            // Fetched since boot, so the value in memory is newer.
+            continue;
+        }
+        if (tombstone) {
+            // Only a variable restored from an earlier record can be removed.
+            // It stays flagged restored, so a later record can set it again.
+            nevmEntry *entry = idx >= 0 ? &man->entries[idx] : NULL;
+            if (entry != NULL && (entry->flags & NEVM_ENTRY_RESTORED)) {
+                entry->flags = (entry->flags & ~NEVM_ENTRY_STALE)
+                               | NEVM_ENTRY_REMOVED;
+            }
+            continue;
+        }
+
+        bool changed = false;
+        idx = _nevmStoreSet(man, buf, nameLen, buf + nameLen, valLen,
+                            &changed);
+        if (idx < 0) {
+            ret = NEVM_FAILURE;
+            break;
+        }
+        nevmEntry *entry = &man->entries[idx];
+        entry->flags = (entry->flags & ~NEVM_ENTRY_DEFAULT) | NEVM_ENTRY_STALE
+                       | NEVM_ENTRY_RESTORED;
+    }
+    NoteFree(buf);
+
+    return ret;
+}
+
+/**
+ * Internal function to persist the values that changed since the last save,
+ * appending them to the journal and compacting it if the active sector is
+ * full.
+ *
+ * @param man Pointer to a NotecardEnvVarManager object with storage set.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int _nevmPersistSave(NotecardEnvVarManager *man)
+{
+    const NotecardEnvVarStorage *storage = man->storage;
+
+    if (man->journalOff != 0) {
+        uint32_t len = 0;
+        for (uint16_t i = 0; i < man->numEntries; ++i) {
+            const nevmEntry *entry = &man->entries[i];
+            if ((entry->flags & NEVM_ENTRY_DIRTY) && _persisted(entry)) {
+                len += _entryRecordLen(entry);
+            }
+        }
+
+        if (len <= storage->sectorSize - man->journalOff) {
+            for (uint16_t i = 0; i < man->numEntries; ++i) {
+                nevmEntry *entry = &man->entries[i];
+                if (!(entry->flags & NEVM_ENTRY_DIRTY) || !_persisted(entry)) {
+                    continue;
+                }
+                if (_appendRecord(storage, man->journalSector,
+                                  &man->journalOff, entry) != NEVM_SUCCESS) {
+                    // The sector may now hold a torn record, so don't append
+                    // after it.
+                    man->journalOff = 0;
+                    return NEVM_FAILURE;
+                }
+                entry->flags &= ~NEVM_ENTRY_DIRTY;
+            }
+
+            return NEVM_SUCCESS;
+        }
+    }
+
+    // The other sector is written from memory, so first load the persisted
+    // values that haven't been restored.
+    if (!man->journalLoaded) {
+        if (_replay(man, true) != NEVM_SUCCESS) {
+            return NEVM_FAILURE;
+        }
+        for (uint16_t i = 0; i < man->numEntries; ++i) {
+            man->entries[i].flags &= ~NEVM_ENTRY_RESTORED;
+        }
+        man->journalLoaded = true;
+    }
+
+    return _compact(man);
+}
+
+/**
+ * Set the storage backend used to persist fetched values across reboots. With
+ * storage set, every fetch that changes a value appends the change to a
+ * journal in the first two sectors of storage. Set storage to NULL to stop
+ * persisting.
+ *
+ * @param man     Pointer to a NotecardEnvVarManager object.
+ * @param storage Pointer to the storage backend. The manager doesn't copy the
+ *                backend, so it must remain valid while in use.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEnvVarManager_setStorage(NotecardEnvVarManager *man,
+                                     const NotecardEnvVarStorage *storage)
+{
+    if (man == NULL) {
+        NOTE_C_LOG_ERROR("NULL manager.\r\n");
+        return NEVM_FAILURE;
+    }
+    if (storage != NULL && (storage->read == NULL || storage->write == NULL
+                            || storage->erase == NULL
+                            || storage->sectorSize < NEVM_MIN_SECTOR_SIZE
+                            || storage->size / 2 < storage->sectorSize)) {
+        NOTE_C_LOG_ERROR("Invalid storage backend.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    man->storage = storage;
+    man->journalSeq = 0;
+    man->journalOff = 0;
+    man->journalLoaded = true;
+    // With no valid sector, the first save compacts into sector 0.
+    man->journalSector = 1;
+    if (storage == NULL) {
+        return NEVM_SUCCESS;
+    }
+
+    // Find the active sector and the end of its journal, so that saves made
+    // without a restore append to the existing journal.
+    for (uint8_t sector = 0; sector < 2; ++sector) {
+        uint8_t hdr[NEVM_SECTOR_HDR_LEN];
+        if (storage->read(storage->ctx, sector * storage->sectorSize, hdr,
+                          sizeof(hdr)) != NEVM_SUCCESS) {
+            NOTE_C_LOG_ERROR("Failed to read from storage.\r\n");
+            return NEVM_FAILURE;
+        }
+        uint32_t seq = _get32(hdr + 4);
+        if (_get32(hdr) == NEVM_JOURNAL_MAGIC && seq >= man->journalSeq) {
+            man->journalSector = sector;
+            man->journalSeq = seq;
+        }
+    }
+    if (man->journalSeq == 0) {
+        return NEVM_SUCCESS;
+    }
+    man->journalLoaded = false;
+
+    return _replay(man, false);
+}
+
+/**
+ * Load the values persisted by a previous boot by replaying the journal, then
+ * call the user-provided callback on each variable:value pair. Call this at
+ * startup, before the first fetch, so the application can run with its last
+ * known configuration without waiting on the Notecard. Restored values are
+ * stale until a fetch confirms them.
+ *
+ * @param man Pointer to a NotecardEnvVarManager object with storage set.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE if there's no journal in
+ *         storage or the values couldn't be loaded.
+ */
+int NotecardEnvVarManager_restore(NotecardEnvVarManager *man)
+{
+    if (man == NULL) {
+        NOTE_C_LOG_ERROR("NULL manager.\r\n");
+        return NEVM_FAILURE;
+    }
+    const NotecardEnvVarStorage *storage = man->storage;
+    if (storage == NULL) {
+        NOTE_C_LOG_ERROR("No storage backend set.\r\n");
+        return NEVM_FAILURE;
+    }
+    if (man->journalSeq == 0) {
+        NOTE_C_LOG_INFO("No journal in storage.\r\n");
+        return NEVM_FAILURE;
+    }
+
+    int ret = _replay(man, true);
+    man->journalLoaded = (ret == NEVM_SUCCESS);
+
+    // Report each restored variable once, with its latest value.
+    for (uint16_t i = 0; i < man->numEntries; ++i) {
+        nevmEntry *entry = &man->entries[i];
+        if (!(entry->flags & NEVM_ENTRY_RESTORED)) {
+            continue;
+        }
+        entry->flags &= ~NEVM_ENTRY_RESTORED;
+        if (entry->flags & NEVM_ENTRY_REMOVED) {
+            continue;
+        }
+        NEVM_ARRAYS_APPLY(man, entry->str, entry->nameLen,
+                          _nevmEntryVal(entry), entry->valLen, true, true);
+        NEVM_FLAGS_APPLY(man, entry->str, entry->nameLen,
+                         _nevmEntryVal(entry), entry->valLen);
+        NEVM_ENUMS_APPLY(man, entry->str, entry->nameLen,
+                         _nevmEntryVal(entry), entry->valLen);
+        _nevmCallUserCb(man, entry->str, entry->nameLen, _nevmEntryVal(entry),
+                        entry->valLen);
+    }
+    NEVM_FLAGS_PUBLISH(man);
+
+    if (ret != NEVM_SUCCESS) {
+        NOTE_C_LOG_ERROR("Failed to restore journal.\r\n");
+    }
+
+    return ret;
+}
+
+#endif // NEVM_ENABLE_PERSIST
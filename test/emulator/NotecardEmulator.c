@@ -0,0 +1,641 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "NotecardEmulator.h"
+#include "NotecardEnvVarManager.h"
+
+// Layers of an emulated variable, in order of increasing precedence.
+enum {
+    EMU_LAYER_DEFAULT = 0,
+    EMU_LAYER_HUB,
+    EMU_LAYER_LOCAL,
+    EMU_NUM_LAYERS
+};
+
+typedef struct {
+    char *name;
+    char *layers[EMU_NUM_LAYERS];
+    uint32_t modifiedSec;
+} EmuVar;
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} EmuBuf;
+
+struct NotecardEmulator {
+    EmuVar *vars;
+    size_t numVars;
+    size_t capVars;
+
+    const NotecardEmulatorEvent *timeline;
+    size_t numEvents;
+    size_t nextEvent;
+
+    uint32_t nowMs;
+    uint32_t modifiedSec;
+    size_t maxValueLen;
+    size_t maxResponseLen;
+
+    // Serial transport buffers. rx holds bytes from the host until a full line
+    // arrives, tx holds response bytes waiting to be read by the host.
+    EmuBuf rx;
+    EmuBuf tx;
+    size_t txPos;
+
+    NotecardEmulatorStats stats;
+};
+
+static NotecardEmulator *attached = NULL;
+
+static int _bufAppend(EmuBuf *buf, const char *data, size_t len)
+{
+    if (buf->len + len + 1 > buf->cap) {
+        size_t cap = buf->cap ? buf->cap : 256;
+        while (cap < buf->len + len + 1) {
+            cap *= 2;
+        }
+        char *grown = (char *)realloc(buf->data, cap);
+        if (grown == NULL) {
+            return NEVM_FAILURE;
+        }
+        buf->data = grown;
+        buf->cap = cap;
+    }
+
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+
+    return NEVM_SUCCESS;
+}
+
+static char *_strdup(const char *str)
+{
+    size_t len = strlen(str) + 1;
+    char *dup = (char *)malloc(len);
+    if (dup != NULL) {
+        memcpy(dup, str, len);
+    }
+
+    return dup;
+}
+
+static uint32_t _nowSec(const NotecardEmulator *emu)
+{
+    return NOTECARD_EMULATOR_EPOCH_BASE + emu->nowMs / 1000;
+}
+
+static const char *_effectiveValue(const EmuVar *var)
+{
+    for (int layer = EMU_NUM_LAYERS - 1; layer >= 0; --layer) {
+        if (var->layers[layer] != NULL) {
+            return var->layers[layer];
+        }
+    }
+
+    return NULL;
+}
+
+static EmuVar *_findVar(NotecardEmulator *emu, const char *name)
+{
+    for (size_t i = 0; i < emu->numVars; ++i) {
+        if (strcmp(emu->vars[i].name, name) == 0) {
+            return &emu->vars[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void _freeVar(EmuVar *var)
+{
+    free(var->name);
+    for (int layer = 0; layer < EMU_NUM_LAYERS; ++layer) {
+        free(var->layers[layer]);
+    }
+}
+
+/**
+ * Set one layer of a variable, creating the variable if needed and removing it
+ * once no layer holds a value. Updates the modification times if the value
+ * visible to env.get changed.
+ */
+static int _setLayer(NotecardEmulator *emu, const char *name, int layer,
+                     const char *value)
+{
+    EmuVar *var = _findVar(emu, name);
+    if (var == NULL) {
+        if (value == NULL) {
+            return NEVM_SUCCESS;
+        }
+        if (emu->numVars == emu->capVars) {
+            size_t cap = emu->capVars ? emu->capVars * 2 : 16;
+            EmuVar *vars = (EmuVar *)realloc(emu->vars, cap * sizeof(EmuVar));
+            if (vars == NULL) {
+                return NEVM_FAILURE;
+            }
+            emu->vars = vars;
+            emu->capVars = cap;
+        }
+        var = &emu->vars[emu->numVars];
+        memset(var, 0, sizeof(*var));
+        var->name = _strdup(name);
+        if (var->name == NULL) {
+            return NEVM_FAILURE;
+        }
+        ++emu->numVars;
+    }
+
+    const char *before = _effectiveValue(var);
+    char *copy = NULL;
+    if (value != NULL) {
+        copy = _strdup(value);
+        if (copy == NULL) {
+            return NEVM_FAILURE;
+        }
+    }
+    // Keep the old value alive until it has been compared.
+    char *old = var->layers[layer];
+    var->layers[layer] = copy;
+    const char *after = _effectiveValue(var);
+
+    bool changed = (before == NULL) != (after == NULL) ||
+                   (before != NULL && strcmp(before, after) != 0);
+    free(old);
+    if (changed) {
+        var->modifiedSec = _nowSec(emu);
+        emu->modifiedSec = var->modifiedSec;
+    }
+
+    if (after == NULL) {
+        _freeVar(var);
+        *var = emu->vars[--emu->numVars];
+    }
+
+    return NEVM_SUCCESS;
+}
+
+static void _applyTimeline(NotecardEmulator *emu)
+{
+    while (emu->nextEvent < emu->numEvents &&
+            emu->timeline[emu->nextEvent].atMs <= emu->nowMs) {
+        const NotecardEmulatorEvent *event = &emu->timeline[emu->nextEvent++];
+        _setLayer(emu, event->name, EMU_LAYER_HUB, event->value);
+    }
+}
+
+static J *_errRsp(J *rsp, const char *err)
+{
+    JAddStringToObject(rsp, "err", err);
+    return rsp;
+}
+
+static bool _notModifiedSince(const NotecardEmulator *emu, J *req)
+{
+    return JIsPresent(req, "time") &&
+           emu->modifiedSec <= (uint32_t)JGetInt(req, "time");
+}
+
+static J *_envGet(NotecardEmulator *emu, J *req, J *rsp)
+{
+    if (_notModifiedSince(emu, req)) {
+        ++emu->stats.envNotModified;
+        return _errRsp(rsp, "environment hasn't been modified "
+                       "{env-not-modified}");
+    }
+
+    const char *name = JGetString(req, "name");
+    if (name[0] != '\0') {
+        EmuVar *var = _findVar(emu, name);
+        if (var != NULL) {
+            JAddStringToObject(rsp, "text", _effectiveValue(var));
+        }
+    } else {
+        J *body = JAddObjectToObject(rsp, "body");
+        if (body == NULL) {
+            return _errRsp(rsp, "insufficient memory {mem}");
+        }
+
+        J *names = JGetArray(req, "names");
+        if (names != NULL) {
+            J *item = NULL;
+            JArrayForEach(item, names) {
+                const char *wanted = JGetStringValue(item);
+                EmuVar *var = wanted ? _findVar(emu, wanted) : NULL;
+                if (var != NULL) {
+                    JAddStringToObject(body, var->name, _effectiveValue(var));
+                }
+            }
+        } else {
+            for (size_t i = 0; i < emu->numVars; ++i) {
+                JAddStringToObject(body, emu->vars[i].name,
+                                   _effectiveValue(&emu->vars[i]));
+            }
+        }
+    }
+
+    if (emu->modifiedSec != 0) {
+        JAddNumberToObject(rsp, "time", emu->modifiedSec);
+    }
+    ++emu->stats.envGets;
+
+    return rsp;
+}
+
+static J *_envModified(NotecardEmulator *emu, J *req, J *rsp)
+{
+    if (_notModifiedSince(emu, req)) {
+        return _errRsp(rsp, "environment hasn't been modified "
+                       "{env-not-modified}");
+    }
+
+    JAddNumberToObject(rsp, "time", emu->modifiedSec);
+
+    return rsp;
+}
+
+static J *_envSetLayer(NotecardEmulator *emu, J *req, J *rsp, int layer)
+{
+    const char *name = JGetString(req, "name");
+    if (name[0] == '\0') {
+        return _errRsp(rsp, "no environment variable name specified");
+    }
+
+    const char *text = JIsPresent(req, "text") ? JGetString(req, "text") :
+                       NULL;
+    if (text != NULL && text[0] == '\0') {
+        // An empty string clears the variable, just like an absent one.
+        text = NULL;
+    }
+    if (text != NULL && emu->maxValueLen != 0 &&
+            strlen(text) > emu->maxValueLen) {
+        return _errRsp(rsp, "environment variable value is too long");
+    }
+
+    if (_setLayer(emu, name, layer, text) != NEVM_SUCCESS) {
+        return _errRsp(rsp, "insufficient memory {mem}");
+    }
+
+    return rsp;
+}
+
+/**
+ * Process a single request and return the Notecard's response. The request is
+ * not freed. Requests sent as commands ("cmd") are processed but produce no
+ * response, so NULL is returned.
+ *
+ * @param emu Pointer to a NotecardEmulator.
+ * @param req The request.
+ *
+ * @return The response, to be freed with JDelete, or NULL for commands and on
+ *         allocation failure.
+ */
+J *NotecardEmulator_request(NotecardEmulator *emu, J *req)
+{
+    if (emu == NULL || req == NULL) {
+        return NULL;
+    }
+
+    ++emu->stats.requests;
+    _applyTimeline(emu);
+
+    bool isCmd = JIsPresent(req, "cmd");
+    const char *type = JGetString(req, isCmd ? "cmd" : "req");
+    J *rsp = JCreateObject();
+    if (rsp == NULL) {
+        return NULL;
+    }
+
+    if (strcmp(type, "env.get") == 0) {
+        _envGet(emu, req, rsp);
+    } else if (strcmp(type, "env.modified") == 0) {
+        _envModified(emu, req, rsp);
+    } else if (strcmp(type, "env.set") == 0) {
+        _envSetLayer(emu, req, rsp, EMU_LAYER_LOCAL);
+    } else if (strcmp(type, "env.default") == 0) {
+        _envSetLayer(emu, req, rsp, EMU_LAYER_DEFAULT);
+    } else {
+        _errRsp(rsp, "unrecognized request");
+    }
+
+    if (emu->maxResponseLen != 0) {
+        char *json = JPrintUnformatted(rsp);
+        size_t len = json ? strlen(json) : 0;
+        JFree(json);
+        if (len > emu->maxResponseLen) {
+            JDelete(rsp);
+            rsp = JCreateObject();
+            if (rsp != NULL) {
+                _errRsp(rsp, "response exceeds maximum length {too-big}");
+            }
+        }
+    }
+
+    if (rsp != NULL && JIsPresent(req, "id")) {
+        JAddNumberToObject(rsp, "id", JGetNumber(req, "id"));
+    }
+    if (isCmd) {
+        JDelete(rsp);
+        rsp = NULL;
+    }
+
+    return rsp;
+}
+
+/**
+ * A request function for NotecardEnvVarManager_setRequestFn, so that each
+ * manager can talk to its own emulator. Requests and responses go through
+ * JSON text, as they would over the wire, and count towards the serial byte
+ * statistics.
+ *
+ * @param req The request, which is deleted.
+ * @param ctx Pointer to the emulator.
+ *
+ * @return The response, to be freed with JDelete, or NULL on failure.
+ */
+J *NotecardEmulator_requestFn(J *req, void *ctx)
+{
+    NotecardEmulator *emu = (NotecardEmulator *)ctx;
+    char *json = JPrintUnformatted(req);
+    JDelete(req);
+    if (emu == NULL || json == NULL) {
+        JFree(json);
+        return NULL;
+    }
+    emu->stats.bytesIn += (uint32_t)strlen(json) + 1;
+    J *wireReq = JParse(json);
+    JFree(json);
+
+    J *rsp = NotecardEmulator_request(emu, wireReq);
+    JDelete(wireReq);
+    json = JPrintUnformatted(rsp);
+    JDelete(rsp);
+    if (json == NULL) {
+        return NULL;
+    }
+    emu->stats.bytesOut += (uint32_t)strlen(json) + 2;
+    J *wireRsp = JParse(json);
+    JFree(json);
+
+    return wireRsp;
+}
+
+/**
+ * Feed one line received over the serial transport to the emulator, queueing
+ * the response for the host to read.
+ */
+static void _serialLine(NotecardEmulator *emu, char *line)
+{
+    while (*line == ' ' || *line == '\r' || *line == '\t') {
+        ++line;
+    }
+
+    if (*line == '\0') {
+        // The Notecard answers a bare newline with one, which is how note-c
+        // resynchronizes the serial link.
+        _bufAppend(&emu->tx, "\r\n", 2);
+        return;
+    }
+
+    J *req = JParse(line);
+    J *rsp = NULL;
+    if (req != NULL) {
+        rsp = NotecardEmulator_request(emu, req);
+        JDelete(req);
+    } else {
+        ++emu->stats.requests;
+        rsp = JCreateObject();
+        if (rsp != NULL) {
+            _errRsp(rsp, "unrecognized request {io}");
+        }
+    }
+
+    if (rsp != NULL) {
+        char *json = JPrintUnformatted(rsp);
+        if (json != NULL) {
+            _bufAppend(&emu->tx, json, strlen(json));
+            _bufAppend(&emu->tx, "\r\n", 2);
+            JFree(json);
+        }
+        JDelete(rsp);
+    }
+}
+
+static bool _serialReset(void)
+{
+    if (attached != NULL) {
+        attached->rx.len = 0;
+        attached->tx.len = 0;
+        attached->txPos = 0;
+    }
+
+    return true;
+}
+
+static void _serialTransmit(uint8_t *txBuf, size_t txBufLen, bool flush)
+{
+    (void)flush;
+
+    NotecardEmulator *emu = attached;
+    if (emu == NULL) {
+        return;
+    }
+
+    emu->stats.bytesIn += txBufLen;
+    for (size_t i = 0; i < txBufLen; ++i) {
+        if (txBuf[i] != '\n') {
+            _bufAppend(&emu->rx, (const char *)&txBuf[i], 1);
+            continue;
+        }
+
+        // Process the line from a copy, so that the rx buffer is free to grow
+        // while the request is being handled.
+        char *line = _strdup(emu->rx.data ? emu->rx.data : "");
+        emu->rx.len = 0;
+        if (line != NULL) {
+            _serialLine(emu, line);
+            free(line);
+        }
+    }
+}
+
+static bool _serialAvailable(void)
+{
+    return attached != NULL && attached->txPos < attached->tx.len;
+}
+
+static char _serialReceive(void)
+{
+    NotecardEmulator *emu = attached;
+    if (emu == NULL || emu->txPos >= emu->tx.len) {
+        return '\0';
+    }
+
+    char ch = emu->tx.data[emu->txPos++];
+    ++emu->stats.bytesOut;
+    if (emu->txPos == emu->tx.len) {
+        emu->tx.len = 0;
+        emu->txPos = 0;
+    }
+
+    return ch;
+}
+
+/**
+ * Create a new NotecardEmulator with an empty environment and its clock at 0.
+ *
+ * @return A valid pointer to a NotecardEmulator on success and NULL on
+ *         failure.
+ */
+NotecardEmulator *NotecardEmulator_alloc(void)
+{
+    NotecardEmulator *emu = (NotecardEmulator *)calloc(1, sizeof(*emu));
+
+    return emu;
+}
+
+/**
+ * Free a NotecardEmulator, detaching it from note-c if it's attached.
+ *
+ * @param emu Pointer to a NotecardEmulator.
+ */
+void NotecardEmulator_free(NotecardEmulator *emu)
+{
+    if (emu == NULL) {
+        return;
+    }
+
+    if (attached == emu) {
+        NotecardEmulator_detach();
+    }
+    for (size_t i = 0; i < emu->numVars; ++i) {
+        _freeVar(&emu->vars[i]);
+    }
+    free(emu->vars);
+    free(emu->rx.data);
+    free(emu->tx.data);
+    free(emu);
+}
+
+/**
+ * Script Notehub-side changes. Events must be sorted by atMs and, along with
+ * their strings, must outlive the emulator. Events due at the current time are
+ * applied immediately.
+ *
+ * @param emu       Pointer to a NotecardEmulator.
+ * @param events    Array of events.
+ * @param numEvents The number of events in the array.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEmulator_setTimeline(NotecardEmulator *emu,
+                                 const NotecardEmulatorEvent *events,
+                                 size_t numEvents)
+{
+    if (emu == NULL || (events == NULL && numEvents != 0)) {
+        return NEVM_FAILURE;
+    }
+
+    emu->timeline = events;
+    emu->numEvents = numEvents;
+    emu->nextEvent = 0;
+    _applyTimeline(emu);
+
+    return NEVM_SUCCESS;
+}
+
+/**
+ * Immediately apply a Notehub-side change, as if it had just synced.
+ *
+ * @param emu   Pointer to a NotecardEmulator.
+ * @param name  The variable name.
+ * @param value The new value, or NULL to delete the variable on Notehub.
+ *
+ * @return NEVM_SUCCESS on success and NEVM_FAILURE on failure.
+ */
+int NotecardEmulator_setHubVar(NotecardEmulator *emu, const char *name,
+                               const char *value)
+{
+    if (emu == NULL || name == NULL) {
+        return NEVM_FAILURE;
+    }
+
+    return _setLayer(emu, name, EMU_LAYER_HUB, value);
+}
+
+/**
+ * Limit the length of values accepted by env.set and env.default. 0 (the
+ * default) means no limit.
+ */
+void NotecardEmulator_setMaxValueLen(NotecardEmulator *emu, size_t maxLen)
+{
+    if (emu != NULL) {
+        emu->maxValueLen = maxLen;
+    }
+}
+
+/**
+ * Limit the length of serialized responses, beyond which the emulator answers
+ * with a {too-big} error. 0 (the default) means no limit.
+ */
+void NotecardEmulator_setMaxResponseLen(NotecardEmulator *emu, size_t maxLen)
+{
+    if (emu != NULL) {
+        emu->maxResponseLen = maxLen;
+    }
+}
+
+/**
+ * Advance the emulator's clock, applying any timeline events that fall due.
+ */
+void NotecardEmulator_advance(NotecardEmulator *emu, uint32_t ms)
+{
+    if (emu == NULL) {
+        return;
+    }
+
+    emu->nowMs += ms;
+    _applyTimeline(emu);
+}
+
+uint32_t NotecardEmulator_now(const NotecardEmulator *emu)
+{
+    return emu ? emu->nowMs : 0;
+}
+
+void NotecardEmulator_getStats(const NotecardEmulator *emu,
+                               NotecardEmulatorStats *stats)
+{
+    if (emu != NULL && stats != NULL) {
+        *stats = emu->stats;
+    }
+}
+
+/**
+ * Make emu the Notecard that note-c talks to over its serial hooks.
+ *
+ * @param emu Pointer to a NotecardEmulator.
+ */
+void NotecardEmulator_attach(NotecardEmulator *emu)
+{
+    attached = emu;
+    NoteSetFnSerial(_serialReset, _serialTransmit, _serialAvailable,
+                    _serialReceive);
+}
+
+void NotecardEmulator_detach(void)
+{
+    attached = NULL;
+}
+
+void NotecardEmulator_delayMs(uint32_t ms)
+{
+    NotecardEmulator_advance(attached, ms);
+}
+
+uint32_t NotecardEmulator_getMs(void)
+{
+    return NotecardEmulator_now(attached);
+}
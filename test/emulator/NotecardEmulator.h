@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "note-c/note.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// An in-process emulation of the Notecard's environment variable requests
+// (env.get, env.set, env.modified and env.default) for host tests and
+// benchmarks. Variables live in an in-memory store with three layers, matching
+// the Notecard's precedence rules: values set on the device with env.set win
+// over values synced from Notehub, which win over defaults set with
+// env.default. Notehub-side changes are driven by a scripted timeline against
+// the emulator's virtual clock.
+
+struct NotecardEmulator;
+typedef struct NotecardEmulator NotecardEmulator;
+
+// A Notehub-side change to an environment variable. The change takes effect
+// once the emulator's clock reaches atMs. A NULL value deletes the variable.
+typedef struct {
+    uint32_t atMs;
+    const char *name;
+    const char *value;
+} NotecardEmulatorEvent;
+
+typedef struct {
+    // Every request the emulator has processed, including those that failed.
+    uint32_t requests;
+    // Successful env.get requests that returned a body.
+    uint32_t envGets;
+    // env.get requests answered with {env-not-modified}.
+    uint32_t envNotModified;
+    // Bytes received from and sent to the host over the serial transport.
+    uint32_t bytesIn;
+    uint32_t bytesOut;
+} NotecardEmulatorStats;
+
+// The epoch time reported by the emulator when its clock reads 0 ms.
+#define NOTECARD_EMULATOR_EPOCH_BASE 1700000000
+
+NotecardEmulator *NotecardEmulator_alloc(void);
+void NotecardEmulator_free(NotecardEmulator *emu);
+
+int NotecardEmulator_setTimeline(NotecardEmulator *emu,
+                                 const NotecardEmulatorEvent *events,
+                                 size_t numEvents);
+int NotecardEmulator_setHubVar(NotecardEmulator *emu, const char *name,
+                               const char *value);
+void NotecardEmulator_setMaxValueLen(NotecardEmulator *emu, size_t maxLen);
+void NotecardEmulator_setMaxResponseLen(NotecardEmulator *emu, size_t maxLen);
+
+void NotecardEmulator_advance(NotecardEmulator *emu, uint32_t ms);
+uint32_t NotecardEmulator_now(const NotecardEmulator *emu);
+void NotecardEmulator_getStats(const NotecardEmulator *emu,
+                               NotecardEmulatorStats *stats);
+
+J *NotecardEmulator_request(NotecardEmulator *emu, J *req);
+J *NotecardEmulator_requestFn(J *req, void *ctx);
+
+// Serial transport. NotecardEmulator_attach installs the emulator's serial
+// hooks with note-c. The delay and millis functions run the attached
+// emulator's virtual clock and are meant to be passed to NoteSetFnDefault, so
+// that note-c's timeouts elapse instantly and timeline events fire as note-c
+// polls the transport.
+void NotecardEmulator_attach(NotecardEmulator *emu);
+void NotecardEmulator_detach(void);
+void NotecardEmulator_delayMs(uint32_t ms);
+uint32_t NotecardEmulator_getMs(void);
+
+#ifdef __cplusplus
+}
+#endif
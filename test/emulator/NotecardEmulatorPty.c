@@ -0,0 +1,202 @@
+#define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "NotecardEmulatorPty.h"
+
+// How often the server thread checks whether it should stop.
+#define NOTECARD_EMULATOR_PTY_POLL_MS 20
+
+struct NotecardEmulatorPty {
+    NotecardEmulator *emu;
+    int master;
+    int slave;
+    char path[64];
+    pthread_t thread;
+    bool running;
+    int stop;
+
+    char *line;
+    size_t lineLen;
+    size_t lineCap;
+};
+
+static void _writeAll(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0) {
+            return;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+static void _handleLine(NotecardEmulatorPty *pty)
+{
+    char *line = pty->line;
+    line[pty->lineLen] = '\0';
+    pty->lineLen = 0;
+    while (*line == ' ' || *line == '\r' || *line == '\t') {
+        ++line;
+    }
+
+    // The Notecard answers a bare newline with one.
+    if (*line == '\0') {
+        _writeAll(pty->master, "\r\n", 2);
+        return;
+    }
+
+    J *req = JParse(line);
+    J *rsp = NULL;
+    if (req != NULL) {
+        rsp = NotecardEmulator_request(pty->emu, req);
+        JDelete(req);
+    }
+    char *json = rsp != NULL ? JPrintUnformatted(rsp) : NULL;
+    if (json != NULL) {
+        _writeAll(pty->master, json, strlen(json));
+        JFree(json);
+    } else {
+        const char *err = "{\"err\":\"unrecognized request {io}\"}";
+        _writeAll(pty->master, err, strlen(err));
+    }
+    _writeAll(pty->master, "\r\n", 2);
+    JDelete(rsp);
+}
+
+static void *_serve(void *arg)
+{
+    NotecardEmulatorPty *pty = (NotecardEmulatorPty *)arg;
+    char buf[256];
+
+    while (!__atomic_load_n(&pty->stop, __ATOMIC_ACQUIRE)) {
+        struct pollfd pfd = {pty->master, POLLIN, 0};
+        if (poll(&pfd, 1, NOTECARD_EMULATOR_PTY_POLL_MS) <= 0) {
+            continue;
+        }
+        ssize_t n = read(pty->master, buf, sizeof(buf));
+        if (n <= 0) {
+            continue;
+        }
+
+        for (ssize_t i = 0; i < n; ++i) {
+            if (pty->lineLen + 1 >= pty->lineCap) {
+                size_t cap = pty->lineCap ? pty->lineCap * 2 : 256;
+                char *line = (char *)realloc(pty->line, cap);
+                if (line == NULL) {
+                    pty->lineLen = 0;
+                    continue;
+                }
+                pty->line = line;
+                pty->lineCap = cap;
+            }
+            if (buf[i] == '\n') {
+                _handleLine(pty);
+            } else {
+                pty->line[pty->lineLen++] = buf[i];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Start serving an emulator over a new pseudo-terminal.
+ *
+ * @param emu The emulator, which must outlive the server.
+ *
+ * @return A valid pointer on success and NULL on failure.
+ */
+NotecardEmulatorPty *NotecardEmulatorPty_start(NotecardEmulator *emu)
+{
+    if (emu == NULL) {
+        return NULL;
+    }
+
+    NotecardEmulatorPty *pty = (NotecardEmulatorPty *)calloc(1,
+                               sizeof(*pty));
+    if (pty == NULL) {
+        return NULL;
+    }
+    pty->emu = emu;
+    pty->slave = -1;
+
+    pty->master = posix_openpt(O_RDWR | O_NOCTTY);
+    const char *path = NULL;
+    if (pty->master >= 0 && grantpt(pty->master) == 0 &&
+            unlockpt(pty->master) == 0) {
+        path = ptsname(pty->master);
+    }
+    if (path == NULL || strlen(path) >= sizeof(pty->path)) {
+        NotecardEmulatorPty_stop(pty);
+        return NULL;
+    }
+    strcpy(pty->path, path);
+
+    // Keep the slave open in raw mode, so that the line doesn't echo before
+    // the client configures it and the master doesn't see a hangup when the
+    // client closes it.
+    struct termios tio;
+    pty->slave = open(pty->path, O_RDWR | O_NOCTTY);
+    if (pty->slave < 0 || tcgetattr(pty->slave, &tio) != 0) {
+        NotecardEmulatorPty_stop(pty);
+        return NULL;
+    }
+    cfmakeraw(&tio);
+    if (tcsetattr(pty->slave, TCSANOW, &tio) != 0 ||
+            pthread_create(&pty->thread, NULL, _serve, pty) != 0) {
+        NotecardEmulatorPty_stop(pty);
+        return NULL;
+    }
+    pty->running = true;
+
+    return pty;
+}
+
+/**
+ * Get the path of the pseudo-terminal's client side.
+ *
+ * @param pty Pointer to a running server.
+ *
+ * @return The path, valid until the server is stopped.
+ */
+const char *NotecardEmulatorPty_path(const NotecardEmulatorPty *pty)
+{
+    return pty != NULL ? pty->path : NULL;
+}
+
+/**
+ * Stop serving and close the pseudo-terminal.
+ *
+ * @param pty Pointer to a server.
+ */
+void NotecardEmulatorPty_stop(NotecardEmulatorPty *pty)
+{
+    if (pty == NULL) {
+        return;
+    }
+
+    if (pty->running) {
+        __atomic_store_n(&pty->stop, 1, __ATOMIC_RELEASE);
+        pthread_join(pty->thread, NULL);
+    }
+    if (pty->slave >= 0) {
+        close(pty->slave);
+    }
+    if (pty->master >= 0) {
+        close(pty->master);
+    }
+    free(pty->line);
+    free(pty);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "NotecardEmulator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Serves an emulator over a pseudo-terminal from a background thread, so that
+// code that opens a real serial device (like the gateway daemon) can be tested
+// against it. Open the path from NotecardEmulatorPty_path as the Notecard's
+// serial device. The emulator's clock only moves when the test advances it,
+// and the test mustn't change the emulator while a request is in flight.
+
+struct NotecardEmulatorPty;
+typedef struct NotecardEmulatorPty NotecardEmulatorPty;
+
+NotecardEmulatorPty *NotecardEmulatorPty_start(NotecardEmulator *emu);
+const char *NotecardEmulatorPty_path(const NotecardEmulatorPty *pty);
+void NotecardEmulatorPty_stop(NotecardEmulatorPty *pty);
+
+#ifdef __cplusplus
+}
+#endif
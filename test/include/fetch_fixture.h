@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdlib.h>
+
+#include <functional>
+#include <string>
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+
+// A fake Notecard for the tests that bind variables, fetch them and check what
+// the manager made of their values. Include it after declaring the
+// NoteRequestResponse fake and call fetchFixtureReset() at the start of each
+// test case.
+//
+// The fake responds to every request with responseBody, to which responseVar
+// is added with the value responseVal if it's set. That value is added after
+// parsing, so that it needn't be escaped as JSON.
+
+namespace
+{
+
+std::string responseBody;
+std::string responseVar;
+std::string responseVal;
+
+// Called by userCb with the name of the variable that changed, so that a test
+// can take a snapshot of its bound value as the user's callback sees it.
+std::function<void(const char *var)> onUserCb;
+
+J *NoteRequestResponse_respond(J *req)
+{
+    JDelete(req);
+    J *rsp = JParse(("{\"body\":" + responseBody + "}").c_str());
+    if (rsp != NULL && !responseVar.empty()) {
+        JAddStringToObject(JGetObject(rsp, "body"), responseVar.c_str(),
+                           responseVal.c_str());
+    }
+    return rsp;
+}
+
+void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)val;
+    (void)ctx;
+
+    if (onUserCb) {
+        onUserCb(var);
+    }
+}
+
+void fetchFixtureReset(void)
+{
+    RESET_FAKE(NoteRequestResponse);
+    NoteSetFnDefault(malloc, free, NULL, NULL);
+    NoteRequestResponse_fake.custom_fake = NoteRequestResponse_respond;
+    responseBody = "{}";
+    responseVar.clear();
+    responseVal.clear();
+    onUserCb = nullptr;
+}
+
+// Fetches all variables, with body, a JSON object, as the response's body.
+int fetch(NotecardEnvVarManager *man, const std::string &body)
+{
+    responseBody = body;
+    responseVar.clear();
+    return NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL);
+}
+
+// Fetches all variables, with var set to the string val and nothing else in
+// the response's body.
+int fetchVar(NotecardEnvVarManager *man, const std::string &var,
+             const std::string &val)
+{
+    responseBody = "{}";
+    responseVar = var;
+    responseVal = val;
+    return NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL);
+}
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// A tracking allocator for the memory budget tests. Install it with
+// NoteSetFnDefault(memTrackerMalloc, memTrackerFree, ...) before anything else
+// in the test executable allocates through note-c. Each block is prefixed with
+// a small header holding the requested size, so that frees can be accounted
+// for without help from the C library.
+
+struct MemStats {
+    size_t allocs;      // Successful allocations since the last mark.
+    size_t liveBlocks;  // Blocks currently allocated.
+    size_t liveBytes;   // Bytes currently allocated (requested sizes).
+    size_t peakBytes;   // High-water mark of liveBytes since the last mark.
+};
+
+namespace
+{
+
+MemStats memStats;
+
+union MemHeader {
+    size_t size;
+    // Keep the user pointer aligned for any type.
+    max_align_t align;
+};
+
+void *memTrackerMalloc(size_t size)
+{
+    MemHeader *hdr = (MemHeader *)malloc(sizeof(MemHeader) + size);
+    if (hdr == NULL) {
+        return NULL;
+    }
+
+    hdr->size = size;
+    ++memStats.allocs;
+    ++memStats.liveBlocks;
+    memStats.liveBytes += size;
+    if (memStats.liveBytes > memStats.peakBytes) {
+        memStats.peakBytes = memStats.liveBytes;
+    }
+
+    return hdr + 1;
+}
+
+void memTrackerFree(void *p)
+{
+    if (p == NULL) {
+        return;
+    }
+
+    MemHeader *hdr = (MemHeader *)p - 1;
+    --memStats.liveBlocks;
+    memStats.liveBytes -= hdr->size;
+    free(hdr);
+}
+
+// Start a new measurement window. Live blocks and bytes carry over, while the
+// allocation count and peak are reset relative to the current state.
+MemStats memTrackerMark(void)
+{
+    memStats.allocs = 0;
+    memStats.peakBytes = memStats.liveBytes;
+
+    return memStats;
+}
+
+}
@@ -0,0 +1,223 @@
+/*!
+ * @file NotecardEmulator_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <map>
+#include <string.h>
+#include <string>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "note-c/note.h"
+
+#include "NotecardEmulator.h"
+#include "NotecardEnvVarManager.h"
+
+namespace
+{
+
+std::map<std::string, std::string> fetched;
+
+void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)ctx;
+
+    fetched[var] = val;
+}
+
+J *envGet(NotecardEmulator *emu, const char *name, long long time)
+{
+    J *req = NoteNewRequest("env.get");
+    REQUIRE(req != NULL);
+    if (name != NULL) {
+        JAddStringToObject(req, "name", name);
+    }
+    if (time != 0) {
+        JAddNumberToObject(req, "time", (JNUMBER)time);
+    }
+    J *rsp = NotecardEmulator_request(emu, req);
+    JDelete(req);
+    REQUIRE(rsp != NULL);
+
+    return rsp;
+}
+
+J *envSet(NotecardEmulator *emu, const char *type, const char *name,
+          const char *text)
+{
+    J *req = NoteNewRequest(type);
+    REQUIRE(req != NULL);
+    JAddStringToObject(req, "name", name);
+    if (text != NULL) {
+        JAddStringToObject(req, "text", text);
+    }
+    J *rsp = NotecardEmulator_request(emu, req);
+    JDelete(req);
+    REQUIRE(rsp != NULL);
+
+    return rsp;
+}
+
+const NotecardEmulatorEvent timeline[] = {
+    {0, "var_a", "1"},
+    {0, "var_b", "2"},
+    {5000, "var_a", "10"},
+    {9000, "var_b", NULL},
+};
+
+TEST_CASE("NotecardEmulator")
+{
+    NoteSetFnDefault(malloc, free, NotecardEmulator_delayMs,
+                     NotecardEmulator_getMs);
+
+    NotecardEmulator *emu = NotecardEmulator_alloc();
+    REQUIRE(emu != NULL);
+    REQUIRE(NotecardEmulator_setTimeline(emu, timeline,
+                                         sizeof(timeline) / sizeof(*timeline))
+            == NEVM_SUCCESS);
+
+    SECTION("env.get follows the timeline") {
+        J *rsp = envGet(emu, NULL, 0);
+        J *body = JGetObject(rsp, "body");
+        REQUIRE(body != NULL);
+        CHECK(strcmp(JGetString(body, "var_a"), "1") == 0);
+        CHECK(strcmp(JGetString(body, "var_b"), "2") == 0);
+        JDelete(rsp);
+
+        NotecardEmulator_advance(emu, 9000);
+        rsp = envGet(emu, NULL, 0);
+        body = JGetObject(rsp, "body");
+        REQUIRE(body != NULL);
+        CHECK(strcmp(JGetString(body, "var_a"), "10") == 0);
+        // Deleted on Notehub.
+        CHECK(!JIsPresent(body, "var_b"));
+        JDelete(rsp);
+    }
+
+    SECTION("time watermark") {
+        J *rsp = envGet(emu, NULL, 0);
+        long long time = JGetInt(rsp, "time");
+        CHECK(time == NOTECARD_EMULATOR_EPOCH_BASE);
+        JDelete(rsp);
+
+        // Nothing changed yet.
+        NotecardEmulator_advance(emu, 2000);
+        rsp = envGet(emu, NULL, time);
+        CHECK(NoteResponseError(rsp));
+        CHECK(NoteErrorContains(JGetString(rsp, "err"), "{env-not-modified}"));
+        JDelete(rsp);
+
+        J *req = NoteNewRequest("env.modified");
+        REQUIRE(req != NULL);
+        rsp = NotecardEmulator_request(emu, req);
+        JDelete(req);
+        REQUIRE(rsp != NULL);
+        CHECK(JGetInt(rsp, "time") == time);
+        JDelete(rsp);
+
+        // var_a changes at 5 s.
+        NotecardEmulator_advance(emu, 3000);
+        rsp = envGet(emu, NULL, time);
+        CHECK(!NoteResponseError(rsp));
+        CHECK(JGetInt(rsp, "time") == NOTECARD_EMULATOR_EPOCH_BASE + 5);
+        JDelete(rsp);
+
+        NotecardEmulatorStats stats;
+        NotecardEmulator_getStats(emu, &stats);
+        CHECK(stats.envGets == 2);
+        CHECK(stats.envNotModified == 1);
+    }
+
+    SECTION("env.set and env.default precedence") {
+        J *rsp = envSet(emu, "env.default", "var_c", "default");
+        CHECK(!NoteResponseError(rsp));
+        JDelete(rsp);
+        rsp = envGet(emu, "var_c", 0);
+        CHECK(strcmp(JGetString(rsp, "text"), "default") == 0);
+        JDelete(rsp);
+
+        // A device-side override wins over Notehub.
+        rsp = envSet(emu, "env.set", "var_a", "local");
+        JDelete(rsp);
+        NotecardEmulator_advance(emu, 5000);
+        rsp = envGet(emu, "var_a", 0);
+        CHECK(strcmp(JGetString(rsp, "text"), "local") == 0);
+        JDelete(rsp);
+
+        // Clearing the override reveals the Notehub value again.
+        rsp = envSet(emu, "env.set", "var_a", NULL);
+        JDelete(rsp);
+        rsp = envGet(emu, "var_a", 0);
+        CHECK(strcmp(JGetString(rsp, "text"), "10") == 0);
+        JDelete(rsp);
+
+        // Notehub wins over the default, which shows once Notehub deletes it.
+        rsp = envSet(emu, "env.default", "var_b", "fallback");
+        JDelete(rsp);
+        rsp = envGet(emu, "var_b", 0);
+        CHECK(strcmp(JGetString(rsp, "text"), "2") == 0);
+        JDelete(rsp);
+        NotecardEmulator_advance(emu, 4000);
+        rsp = envGet(emu, "var_b", 0);
+        CHECK(strcmp(JGetString(rsp, "text"), "fallback") == 0);
+        JDelete(rsp);
+    }
+
+    SECTION("Size limits") {
+        NotecardEmulator_setMaxValueLen(emu, 4);
+        J *rsp = envSet(emu, "env.set", "var_a", "too long");
+        CHECK(NoteResponseError(rsp));
+        JDelete(rsp);
+
+        NotecardEmulator_setMaxResponseLen(emu, 16);
+        rsp = envGet(emu, NULL, 0);
+        CHECK(NoteErrorContains(JGetString(rsp, "err"), "{too-big}"));
+        JDelete(rsp);
+    }
+
+    SECTION("NotecardEnvVarManager_fetch over the serial transport") {
+        NotecardEmulator_attach(emu);
+        fetched.clear();
+
+        NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+        REQUIRE(man != NULL);
+        REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+                NEVM_SUCCESS);
+
+        const char *vars[] = {"var_a", "var_b", "var_missing"};
+        CHECK(NotecardEnvVarManager_fetch(man, vars, 3) == NEVM_SUCCESS);
+        CHECK(fetched.size() == 2);
+        CHECK(fetched["var_a"] == "1");
+        CHECK(fetched["var_b"] == "2");
+
+        NotecardEmulator_advance(emu, 5000);
+        CHECK(NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL) ==
+              NEVM_SUCCESS);
+        CHECK(fetched["var_a"] == "10");
+
+        NotecardEmulatorStats stats;
+        NotecardEmulator_getStats(emu, &stats);
+        CHECK(stats.envGets == 2);
+        CHECK(stats.bytesIn > 0);
+        CHECK(stats.bytesOut > 0);
+
+        NotecardEnvVarManager_free(man);
+    }
+
+    NotecardEmulator_free(emu);
+}
+
+}
+
+#endif // NEVM_TEST
@@ -0,0 +1,194 @@
+/*!
+ * @file NotecardEnvVarAsyncSerial_hpp_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <memory>
+#include <stdlib.h>
+#include <string.h>
+#include <string_view>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "note-c/note.h"
+
+#include "NotecardEmulator.h"
+#include "NotecardEmulatorPty.h"
+#include "NotecardEnvVarAsyncSerial.hpp"
+#include "NotecardEnvVarSerial.h"
+
+namespace
+{
+
+struct Consumer {
+    nevm::Manager man;
+    size_t calls = 0;
+    std::vector<int> results;
+    bool finished = false;
+
+    void operator()(std::string_view var, std::string_view val)
+    {
+        (void)var;
+        (void)val;
+
+        ++calls;
+    }
+};
+
+nevm::Task consume(nevm::AsyncSerial &serial, Consumer &consumer)
+{
+    consumer.results.push_back(co_await serial.fetch(consumer.man));
+
+    // Named variables are kept in the coroutine's frame while it waits.
+    const char *vars[] = {"var_b"};
+    consumer.results.push_back(co_await serial.fetch(consumer.man, vars, 1));
+    consumer.finished = true;
+}
+
+// Fetches again after a failure, then destroys the transport.
+nevm::Task retryThenDestroy(std::unique_ptr<nevm::AsyncSerial> &serial,
+                            Consumer &consumer)
+{
+    // unique_ptr::reset clears the pointer before destroying the transport.
+    nevm::AsyncSerial *transport = serial.get();
+    int ret = co_await transport->fetch(consumer.man);
+    consumer.results.push_back(ret);
+    if (ret != NEVM_SUCCESS) {
+        consumer.results.push_back(co_await transport->fetch(consumer.man));
+    }
+    serial.reset();
+    consumer.finished = true;
+}
+
+TEST_CASE("nevm::AsyncSerial")
+{
+    NoteSetFnDefault(malloc, free, NotecardEnvVarSerial_delayMs,
+                     NotecardEnvVarSerial_getMs);
+
+    SECTION("A fetch that can't be queued doesn't suspend") {
+        nevm::AsyncSerial serial(-1, 1000);
+        CHECK(!serial);
+        Consumer consumer;
+        consume(serial, consumer);
+        CHECK(consumer.finished);
+        CHECK(consumer.results == std::vector<int> {NEVM_FAILURE,
+                                                     NEVM_FAILURE
+                                                    });
+    }
+
+    SECTION("Teardown") {
+        int fds[2];
+        REQUIRE(pipe(fds) == 0);
+        auto serial = std::make_unique<nevm::AsyncSerial>(fds[0], 100);
+        REQUIRE(*serial);
+        Consumer consumer;
+        retryThenDestroy(serial, consumer);
+        CHECK(!consumer.finished);
+
+        SECTION("A coroutine resumed by handle can destroy the transport") {
+            // The first fetch times out, and the retry is queued from the
+            // resumed coroutine.
+            serial->handle(0, 0);
+            serial->handle(0, 100);
+            CHECK(!consumer.finished);
+            REQUIRE(serial->pending() == 1);
+            serial->handle(0, 100);
+            serial->handle(0, 200);
+            CHECK(consumer.finished);
+            CHECK(serial == nullptr);
+            CHECK(consumer.results == std::vector<int> {NEVM_FAILURE,
+                                                         NEVM_FAILURE
+                                                        });
+        }
+
+        SECTION("Fetches awaited during teardown fail right away") {
+            serial.reset();
+            CHECK(consumer.finished);
+            CHECK(consumer.results == std::vector<int> {NEVM_FAILURE,
+                                                         NEVM_FAILURE
+                                                        });
+        }
+
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    SECTION("Coroutines share one event loop") {
+        NotecardEmulator *emu = NotecardEmulator_alloc();
+        REQUIRE(emu != NULL);
+        NotecardEmulator_setHubVar(emu, "var_a", "1");
+        NotecardEmulator_setHubVar(emu, "var_b", "2");
+        NotecardEmulatorPty *pty = NotecardEmulatorPty_start(emu);
+        REQUIRE(pty != NULL);
+        int fd = NotecardEnvVarSerial_openDevice(NotecardEmulatorPty_path(pty),
+                 115200);
+        REQUIRE(fd >= 0);
+
+        {
+            nevm::AsyncSerial serial(fd, 1000);
+            REQUIRE(serial);
+
+            const size_t numConsumers = 20;
+            std::vector<Consumer> consumers(numConsumers);
+            for (Consumer &consumer : consumers) {
+                REQUIRE(consumer.man.setEnvVarCb(consumer) == NEVM_SUCCESS);
+                consume(serial, consumer);
+                CHECK(!consumer.finished);
+            }
+            CHECK(serial.pending() == numConsumers);
+
+            int epollFd = epoll_create1(0);
+            REQUIRE(epollFd >= 0);
+            struct epoll_event ev;
+            ev.events = serial.events();
+            ev.data.ptr = NULL;
+            REQUIRE(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) == 0);
+            uint32_t start = NotecardEnvVarSerial_getMs();
+            while (serial.pending() > 0 &&
+                    NotecardEnvVarSerial_getMs() - start < 5000) {
+                struct epoll_event events[1];
+                int n = epoll_wait(epollFd, events, 1,
+                                   serial.timeout(NotecardEnvVarSerial_getMs()));
+                serial.handle(n > 0 ? events[0].events : 0,
+                              NotecardEnvVarSerial_getMs());
+                ev.events = serial.events();
+                REQUIRE(epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) == 0);
+            }
+            close(epollFd);
+
+            for (Consumer &consumer : consumers) {
+                CHECK(consumer.finished);
+                CHECK(consumer.results == std::vector<int> {NEVM_SUCCESS,
+                                                             NEVM_SUCCESS
+                                                            });
+                // Both variables, then var_b again.
+                CHECK(consumer.calls == 3);
+                char buf[8];
+                CHECK(consumer.man.get("var_a", buf, sizeof(buf)) ==
+                      NEVM_SUCCESS);
+                CHECK(strcmp(buf, "1") == 0);
+            }
+        }
+
+        close(fd);
+        NotecardEmulatorPty_stop(pty);
+        NotecardEmulator_free(emu);
+    }
+}
+
+}
+
+#endif // NEVM_TEST
@@ -0,0 +1,357 @@
+/*!
+ * @file NotecardEnvVarAsyncSerial_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <fcntl.h>
+#include <map>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "note-c/note.h"
+
+#include "NotecardEmulator.h"
+#include "NotecardEmulatorPty.h"
+#include "NotecardEnvVarAsyncSerial.h"
+#include "NotecardEnvVarSerial.h"
+
+namespace
+{
+
+std::map<std::string, std::string> fetched;
+int doneCalls;
+int lastResult;
+
+void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)ctx;
+
+    fetched[var] = val;
+}
+
+void doneCb(NotecardEnvVarManager *man, int result, void *ctx)
+{
+    (void)man;
+    (void)ctx;
+
+    ++doneCalls;
+    lastResult = result;
+}
+
+int refetchResult;
+
+// Tries to queue another fetch on the transport passed as ctx.
+void refetchCb(NotecardEnvVarManager *man, int result, void *ctx)
+{
+    doneCb(man, result, ctx);
+    refetchResult = NotecardEnvVarAsyncSerial_fetch(
+                        (NotecardEnvVarAsyncSerial *)ctx, man, NULL,
+                        NEVM_ENV_VAR_ALL, doneCb, NULL);
+}
+
+// Frees the transport pointed to by ctx.
+void freeCb(NotecardEnvVarManager *man, int result, void *ctx)
+{
+    doneCb(man, result, ctx);
+    NotecardEnvVarAsyncSerial **serial = (NotecardEnvVarAsyncSerial **)ctx;
+    NotecardEnvVarAsyncSerial_free(*serial);
+    *serial = NULL;
+}
+
+// Read one request line from the scripted Notecard's side of the pty.
+std::string readRequest(int master)
+{
+    std::string line;
+    char c;
+    struct pollfd pfd = {master, POLLIN, 0};
+    while (poll(&pfd, 1, 1000) > 0 && read(master, &c, 1) == 1) {
+        if (c == '\n') {
+            break;
+        }
+        line += c;
+    }
+
+    return line;
+}
+
+void respond(int master, const char *rsp)
+{
+    REQUIRE(write(master, rsp, strlen(rsp)) == (ssize_t)strlen(rsp));
+}
+
+long long requestId(const std::string &line)
+{
+    J *req = JParse(line.c_str());
+    REQUIRE(req != NULL);
+    CHECK(strcmp(JGetString(req, "req"), "env.get") == 0);
+    long long id = JGetInt(req, "id");
+    JDelete(req);
+
+    return id;
+}
+
+TEST_CASE("NotecardEnvVarAsyncSerial")
+{
+    NoteSetFnDefault(malloc, free, NotecardEnvVarSerial_delayMs,
+                     NotecardEnvVarSerial_getMs);
+    fetched.clear();
+    doneCalls = 0;
+    lastResult = 0;
+    refetchResult = 0;
+
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+    REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+            NEVM_SUCCESS);
+
+    SECTION("Invalid parameters") {
+        CHECK(NotecardEnvVarAsyncSerial_alloc(-1, 1000) == NULL);
+        CHECK(NotecardEnvVarAsyncSerial_fd(NULL) == -1);
+        CHECK(NotecardEnvVarAsyncSerial_timeout(NULL, 0) == -1);
+        CHECK(NotecardEnvVarAsyncSerial_fetch(NULL, man, NULL,
+                                              NEVM_ENV_VAR_ALL, doneCb, NULL)
+              == NEVM_FAILURE);
+    }
+
+    SECTION("Scripted Notecard") {
+        // The test plays the Notecard on the pty's master side.
+        int master = posix_openpt(O_RDWR | O_NOCTTY);
+        REQUIRE(master >= 0);
+        REQUIRE(grantpt(master) == 0);
+        REQUIRE(unlockpt(master) == 0);
+        int fd = NotecardEnvVarSerial_openDevice(ptsname(master), 115200);
+        REQUIRE(fd >= 0);
+        NotecardEnvVarAsyncSerial *serial = NotecardEnvVarAsyncSerial_alloc(fd,
+                                            100);
+        REQUIRE(serial != NULL);
+
+        // Nothing to do yet.
+        CHECK(NotecardEnvVarAsyncSerial_events(serial) == EPOLLIN);
+        CHECK(NotecardEnvVarAsyncSerial_timeout(serial, 0) == -1);
+
+        REQUIRE(NotecardEnvVarAsyncSerial_fetch(serial, man, NULL,
+                                                NEVM_ENV_VAR_ALL, doneCb, NULL)
+                == NEVM_SUCCESS);
+        CHECK(NotecardEnvVarAsyncSerial_pending(serial) == 1);
+        CHECK(NotecardEnvVarAsyncSerial_events(serial) ==
+              (EPOLLIN | EPOLLOUT));
+        CHECK(NotecardEnvVarAsyncSerial_timeout(serial, 0) == 0);
+
+        SECTION("Response") {
+            NotecardEnvVarAsyncSerial_handle(serial, EPOLLOUT, 0);
+            CHECK(NotecardEnvVarAsyncSerial_events(serial) == EPOLLIN);
+            CHECK(NotecardEnvVarAsyncSerial_timeout(serial, 40) == 60);
+            long long id = requestId(readRequest(master));
+
+            // A stale response is ignored, and the response may arrive in
+            // pieces.
+            std::string stale = "{\"id\":" + std::to_string(id + 100) +
+                                ",\"body\":{\"var_x\":\"x\"}}\r\n";
+            respond(master, stale.c_str());
+            std::string rsp = "{\"id\":" + std::to_string(id) +
+                              ",\"body\":{\"var_a\":\"1\"}}";
+            respond(master, rsp.c_str());
+            usleep(10000);
+            NotecardEnvVarAsyncSerial_handle(serial, EPOLLIN, 10);
+            CHECK(doneCalls == 0);
+
+            respond(master, "\r\n");
+            usleep(10000);
+            NotecardEnvVarAsyncSerial_handle(serial, EPOLLIN, 20);
+            CHECK(doneCalls == 1);
+            CHECK(lastResult == NEVM_SUCCESS);
+            CHECK(fetched.size() == 1);
+            CHECK(fetched["var_a"] == "1");
+            CHECK(NotecardEnvVarAsyncSerial_pending(serial) == 0);
+        }
+
+        SECTION("Timeout") {
+            NotecardEnvVarAsyncSerial_handle(serial, EPOLLOUT, 0);
+            readRequest(master);
+            NotecardEnvVarAsyncSerial_handle(serial, 0, 99);
+            CHECK(doneCalls == 0);
+            NotecardEnvVarAsyncSerial_handle(serial, 0, 100);
+            CHECK(doneCalls == 1);
+            CHECK(lastResult == NEVM_FAILURE);
+            CHECK(NotecardEnvVarAsyncSerial_pending(serial) == 0);
+        }
+
+        SECTION("Queued fetches run in order") {
+            NotecardEnvVarManager *other = NotecardEnvVarManager_alloc();
+            REQUIRE(other != NULL);
+            REQUIRE(NotecardEnvVarManager_setEnvVarCb(other, userCb, NULL) ==
+                    NEVM_SUCCESS);
+            const char *vars[] = {"var_b"};
+            REQUIRE(NotecardEnvVarAsyncSerial_fetch(serial, other, vars, 1,
+                                                    doneCb, NULL)
+                    == NEVM_SUCCESS);
+            CHECK(NotecardEnvVarAsyncSerial_pending(serial) == 2);
+
+            NotecardEnvVarAsyncSerial_handle(serial, EPOLLOUT, 0);
+            long long first = requestId(readRequest(master));
+            respond(master, ("{\"id\":" + std::to_string(first) +
+                             ",\"body\":{\"var_a\":\"1\"}}\r\n").c_str());
+            usleep(10000);
+
+            // Completing the first sends the second.
+            NotecardEnvVarAsyncSerial_handle(serial, EPOLLIN, 10);
+            CHECK(doneCalls == 1);
+            std::string line = readRequest(master);
+            CHECK(line.find("var_b") != std::string::npos);
+            long long second = requestId(line);
+            CHECK(second != first);
+            respond(master, ("{\"id\":" + std::to_string(second) +
+                             ",\"body\":{\"var_b\":\"2\"}}\r\n").c_str());
+            usleep(10000);
+            NotecardEnvVarAsyncSerial_handle(serial, EPOLLIN, 20);
+            CHECK(doneCalls == 2);
+            CHECK(fetched["var_b"] == "2");
+
+            NotecardEnvVarManager_free(other);
+        }
+
+        SECTION("Freeing fails queued fetches") {
+            NotecardEnvVarAsyncSerial_free(serial);
+            serial = NULL;
+            CHECK(doneCalls == 1);
+            CHECK(lastResult == NEVM_FAILURE);
+        }
+
+        SECTION("Freeing rejects fetches from done callbacks") {
+            NotecardEnvVarManager *other = NotecardEnvVarManager_alloc();
+            REQUIRE(other != NULL);
+            REQUIRE(NotecardEnvVarAsyncSerial_fetch(serial, other, NULL,
+                                                    NEVM_ENV_VAR_ALL,
+                                                    refetchCb, serial)
+                    == NEVM_SUCCESS);
+
+            NotecardEnvVarAsyncSerial_free(serial);
+            serial = NULL;
+            CHECK(doneCalls == 2);
+            CHECK(refetchResult == NEVM_FAILURE);
+
+            NotecardEnvVarManager_free(other);
+        }
+
+        SECTION("Done callbacks can free the transport") {
+            NotecardEnvVarManager *other = NotecardEnvVarManager_alloc();
+            REQUIRE(other != NULL);
+            REQUIRE(NotecardEnvVarAsyncSerial_fetch(serial, other, NULL,
+                                                    NEVM_ENV_VAR_ALL, freeCb,
+                                                    &serial) == NEVM_SUCCESS);
+
+            NotecardEnvVarAsyncSerial_handle(serial, EPOLLOUT, 0);
+            long long id = requestId(readRequest(master));
+            respond(master, ("{\"id\":" + std::to_string(id) +
+                             ",\"body\":{\"var_a\":\"1\"}}\r\n").c_str());
+            usleep(10000);
+            NotecardEnvVarAsyncSerial_handle(serial, EPOLLIN, 10);
+            CHECK(doneCalls == 1);
+            CHECK(lastResult == NEVM_SUCCESS);
+            CHECK(fetched["var_a"] == "1");
+
+            // The second fetch's callback frees the transport, and it's only
+            // called once the read, which has another line after the
+            // response, is over.
+            id = requestId(readRequest(master));
+            respond(master, ("{\"id\":" + std::to_string(id) +
+                             ",\"body\":{}}\r\n{\"id\":" +
+                             std::to_string(id + 1) + "}\r\n").c_str());
+            usleep(10000);
+            NotecardEnvVarAsyncSerial_handle(serial, EPOLLIN, 20);
+            CHECK(doneCalls == 2);
+            CHECK(serial == NULL);
+
+            NotecardEnvVarManager_free(other);
+        }
+
+        NotecardEnvVarAsyncSerial_free(serial);
+        close(fd);
+        close(master);
+    }
+
+    SECTION("Event loop against the emulator") {
+        NotecardEmulator *emu = NotecardEmulator_alloc();
+        REQUIRE(emu != NULL);
+        NotecardEmulator_setHubVar(emu, "var_a", "1");
+        NotecardEmulator_setHubVar(emu, "var_b", "2");
+        NotecardEmulatorPty *pty = NotecardEmulatorPty_start(emu);
+        REQUIRE(pty != NULL);
+        int fd = NotecardEnvVarSerial_openDevice(NotecardEmulatorPty_path(pty),
+                 115200);
+        REQUIRE(fd >= 0);
+        NotecardEnvVarAsyncSerial *serial = NotecardEnvVarAsyncSerial_alloc(fd,
+                                            1000);
+        REQUIRE(serial != NULL);
+
+        // One thread runs fetches for several managers.
+        NotecardEnvVarManager *mans[3];
+        for (size_t i = 0; i < 3; ++i) {
+            mans[i] = NotecardEnvVarManager_alloc();
+            REQUIRE(mans[i] != NULL);
+            REQUIRE(NotecardEnvVarManager_setEnvVarCb(mans[i], userCb, NULL)
+                    == NEVM_SUCCESS);
+            REQUIRE(NotecardEnvVarAsyncSerial_fetch(serial, mans[i], NULL,
+                                                    NEVM_ENV_VAR_ALL, doneCb,
+                                                    NULL) == NEVM_SUCCESS);
+        }
+
+        int epollFd = epoll_create1(0);
+        REQUIRE(epollFd >= 0);
+        struct epoll_event ev;
+        ev.events = NotecardEnvVarAsyncSerial_events(serial);
+        ev.data.ptr = serial;
+        REQUIRE(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) == 0);
+        uint32_t start = NotecardEnvVarSerial_getMs();
+        while (NotecardEnvVarAsyncSerial_pending(serial) > 0 &&
+                NotecardEnvVarSerial_getMs() - start < 5000) {
+            struct epoll_event events[4];
+            uint32_t now = NotecardEnvVarSerial_getMs();
+            int n = epoll_wait(epollFd, events, 4,
+                               NotecardEnvVarAsyncSerial_timeout(serial, now));
+            uint32_t revents = n > 0 ? events[0].events : 0;
+            NotecardEnvVarAsyncSerial_handle(serial, revents,
+                                             NotecardEnvVarSerial_getMs());
+            ev.events = NotecardEnvVarAsyncSerial_events(serial);
+            REQUIRE(epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) == 0);
+        }
+
+        CHECK(doneCalls == 3);
+        CHECK(lastResult == NEVM_SUCCESS);
+        char buf[8];
+        for (size_t i = 0; i < 3; ++i) {
+            CHECK(NotecardEnvVarManager_get(mans[i], "var_b", buf, sizeof(buf),
+                                            NULL) == NEVM_SUCCESS);
+            CHECK(strcmp(buf, "2") == 0);
+            NotecardEnvVarManager_free(mans[i]);
+        }
+
+        close(epollFd);
+        NotecardEnvVarAsyncSerial_free(serial);
+        close(fd);
+        NotecardEmulatorPty_stop(pty);
+        NotecardEmulator_free(emu);
+    }
+
+    NotecardEnvVarManager_free(man);
+}
+
+}
+
+#endif // NEVM_TEST
@@ -0,0 +1,80 @@
+/*!
+ * @file NotecardEnvVarChromeTrace_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <fstream>
+#include <sstream>
+#include <string.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarChromeTrace.h"
+
+namespace
+{
+
+const char *tracePath = "NotecardEnvVarChromeTrace_test.json";
+
+TEST_CASE("NotecardEnvVarChromeTrace")
+{
+    NoteSetFnDefault(malloc, free, NULL, NULL);
+
+    SECTION("Invalid path") {
+        CHECK(NotecardEnvVarChromeTrace_open("/nonexistent/dir/trace.json")
+              == NULL);
+    }
+
+    SECTION("Writes trace_event JSON") {
+        NotecardEnvVarChromeTrace *trace = NotecardEnvVarChromeTrace_open(
+                                               tracePath);
+        REQUIRE(trace != NULL);
+
+        NotecardEnvVarChromeTrace_cb(NEVM_TRACE_FETCH, true, NULL, trace);
+        NotecardEnvVarChromeTrace_cb(NEVM_TRACE_CALLBACK, true, "a\"b", trace);
+        NotecardEnvVarChromeTrace_cb(NEVM_TRACE_CALLBACK, false, "a\"b",
+                                     trace);
+        NotecardEnvVarChromeTrace_cb(NEVM_TRACE_FETCH, false, NULL, trace);
+        REQUIRE(NotecardEnvVarChromeTrace_close(trace) == NEVM_SUCCESS);
+
+        std::ifstream file(tracePath);
+        std::stringstream contents;
+        contents << file.rdbuf();
+        J *json = JParse(contents.str().c_str());
+        REQUIRE(json != NULL);
+
+        J *events = JGetArray(json, "traceEvents");
+        REQUIRE(events != NULL);
+        REQUIRE(JGetArraySize(events) == 4);
+
+        J *first = JGetArrayItem(events, 0);
+        CHECK(strcmp(JGetString(first, "name"), "fetch") == 0);
+        CHECK(strcmp(JGetString(first, "ph"), "B") == 0);
+        J *callback = JGetArrayItem(events, 1);
+        CHECK(strcmp(JGetString(callback, "name"), "callback") == 0);
+        CHECK(strcmp(JGetString(JGetObject(callback, "args"), "var"),
+                     "a\"b") == 0);
+        J *last = JGetArrayItem(events, 3);
+        CHECK(strcmp(JGetString(last, "ph"), "E") == 0);
+        CHECK(JGetNumber(last, "ts") >= JGetNumber(first, "ts"));
+
+        JDelete(json);
+        remove(tracePath);
+    }
+}
+
+}
+
+#endif // NEVM_TEST
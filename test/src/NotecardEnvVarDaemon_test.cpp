@@ -0,0 +1,222 @@
+/*!
+ * @file NotecardEnvVarDaemon_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "NotecardEmulator.h"
+#include "NotecardEmulatorPty.h"
+#include "NotecardEnvVarDaemon.h"
+#include "NotecardEnvVarShm.h"
+#include "NotecardEnvVarSocket.h"
+
+namespace
+{
+
+const char *shmName = "/nevm_daemon_test";
+const char *socketPath = "nevm_daemon_test.sock";
+
+// Read from a subscriber until nothing more arrives.
+std::string drain(int fd)
+{
+    std::string rsp;
+    char buf[256];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+        rsp.append(buf, (size_t)n);
+    }
+
+    return rsp;
+}
+
+const NotecardEmulatorEvent timeline[] = {
+    {0, "var_a", "1"},
+    {0, "var_b", "2"},
+    {5000, "var_a", "10"},
+    {9000, "var_b", NULL},
+};
+
+TEST_CASE("NotecardEnvVarDaemon")
+{
+    NotecardEnvVarShm_unlink(shmName);
+
+    NotecardEmulator *emu = NotecardEmulator_alloc();
+    REQUIRE(emu != NULL);
+    REQUIRE(NotecardEmulator_setTimeline(emu, timeline,
+                                         sizeof(timeline) / sizeof(*timeline))
+            == NEVM_SUCCESS);
+    NotecardEmulatorPty *pty = NotecardEmulatorPty_start(emu);
+    REQUIRE(pty != NULL);
+
+    NotecardEnvVarDaemonConfig config = {};
+    config.device = NotecardEmulatorPty_path(pty);
+    config.baud = 115200;
+    config.shmName = shmName;
+    config.shmSize = 4096;
+    config.intervalMs = 1000;
+    config.numVars = NEVM_ENV_VAR_ALL;
+
+    SECTION("Invalid parameters") {
+        CHECK(NotecardEnvVarDaemon_alloc(NULL) == NULL);
+        config.device = "/dev/nonexistent";
+        CHECK(NotecardEnvVarDaemon_alloc(&config) == NULL);
+        CHECK(NotecardEnvVarDaemon_step(NULL) == NEVM_FAILURE);
+    }
+
+    SECTION("Fetches over serial and publishes changes") {
+        NotecardEnvVarDaemon *daemon = NotecardEnvVarDaemon_alloc(&config);
+        REQUIRE(daemon != NULL);
+        NotecardEnvVarShm *reader = NotecardEnvVarShm_open(shmName);
+        REQUIRE(reader != NULL);
+
+        char buf[16];
+        REQUIRE(NotecardEnvVarDaemon_step(daemon) == NEVM_SUCCESS);
+        uint32_t generation = NotecardEnvVarShm_getGeneration(reader);
+        CHECK(generation != 0);
+        CHECK(NotecardEnvVarShm_get(reader, "var_a", buf, sizeof(buf), NULL)
+              == NEVM_SUCCESS);
+        CHECK(strcmp(buf, "1") == 0);
+        CHECK(NotecardEnvVarShm_get(reader, "var_b", buf, sizeof(buf), NULL)
+              == NEVM_SUCCESS);
+        CHECK(strcmp(buf, "2") == 0);
+
+        // Nothing changed, so the snapshot isn't republished.
+        REQUIRE(NotecardEnvVarDaemon_step(daemon) == NEVM_SUCCESS);
+        CHECK(NotecardEnvVarShm_getGeneration(reader) == generation);
+
+        NotecardEmulator_advance(emu, 5000);
+        REQUIRE(NotecardEnvVarDaemon_step(daemon) == NEVM_SUCCESS);
+        CHECK(NotecardEnvVarShm_getGeneration(reader) > generation);
+        CHECK(NotecardEnvVarShm_get(reader, "var_a", buf, sizeof(buf), NULL)
+              == NEVM_SUCCESS);
+        CHECK(strcmp(buf, "10") == 0);
+
+        // Deleted on Notehub.
+        NotecardEmulator_advance(emu, 4000);
+        REQUIRE(NotecardEnvVarDaemon_step(daemon) == NEVM_SUCCESS);
+        CHECK(NotecardEnvVarShm_get(reader, "var_b", buf, sizeof(buf), NULL)
+              == NEVM_FAILURE);
+        CHECK(NotecardEnvVarShm_get(reader, "var_a", buf, sizeof(buf), NULL)
+              == NEVM_SUCCESS);
+
+        NotecardEnvVarShm_close(reader);
+        NotecardEnvVarDaemon_free(daemon);
+    }
+
+    SECTION("Publishes defaults before the first fetch") {
+        const char *defaultVars[] = {"var_a", "var_c"};
+        const char *defaultVals[] = {"default_a", "default_c"};
+        config.defaultVars = defaultVars;
+        config.defaultVals = defaultVals;
+        config.numDefaults = 2;
+        NotecardEnvVarDaemon *daemon = NotecardEnvVarDaemon_alloc(&config);
+        REQUIRE(daemon != NULL);
+        NotecardEnvVarShm *reader = NotecardEnvVarShm_open(shmName);
+        REQUIRE(reader != NULL);
+
+        char buf[16];
+        CHECK(NotecardEnvVarShm_get(reader, "var_a", buf, sizeof(buf), NULL)
+              == NEVM_SUCCESS);
+        CHECK(strcmp(buf, "default_a") == 0);
+
+        // Fetched values replace the defaults, and the defaults of variables
+        // the Notecard doesn't have stay published.
+        REQUIRE(NotecardEnvVarDaemon_step(daemon) == NEVM_SUCCESS);
+        CHECK(NotecardEnvVarShm_get(reader, "var_a", buf, sizeof(buf), NULL)
+              == NEVM_SUCCESS);
+        CHECK(strcmp(buf, "1") == 0);
+        CHECK(NotecardEnvVarShm_get(reader, "var_c", buf, sizeof(buf), NULL)
+              == NEVM_SUCCESS);
+        CHECK(strcmp(buf, "default_c") == 0);
+
+        NotecardEnvVarShm_close(reader);
+        NotecardEnvVarDaemon_free(daemon);
+    }
+
+    SECTION("Publishes the values persisted by the last run") {
+        char path[] = "nevm_daemon_test.bin";
+        remove(path);
+        config.storagePath = path;
+        NotecardEnvVarDaemon *daemon = NotecardEnvVarDaemon_alloc(&config);
+        REQUIRE(daemon != NULL);
+        REQUIRE(NotecardEnvVarDaemon_step(daemon) == NEVM_SUCCESS);
+        NotecardEnvVarDaemon_free(daemon);
+        NotecardEnvVarShm_unlink(shmName);
+
+        daemon = NotecardEnvVarDaemon_alloc(&config);
+        REQUIRE(daemon != NULL);
+        NotecardEnvVarShm *reader = NotecardEnvVarShm_open(shmName);
+        REQUIRE(reader != NULL);
+
+        char buf[16];
+        CHECK(NotecardEnvVarShm_get(reader, "var_a", buf, sizeof(buf), NULL)
+              == NEVM_SUCCESS);
+        CHECK(strcmp(buf, "1") == 0);
+        CHECK(NotecardEnvVarShm_get(reader, "var_b", buf, sizeof(buf), NULL)
+              == NEVM_SUCCESS);
+        CHECK(strcmp(buf, "2") == 0);
+
+        NotecardEnvVarShm_close(reader);
+        NotecardEnvVarDaemon_free(daemon);
+        remove(path);
+    }
+
+    SECTION("Pushes changes to socket subscribers") {
+        config.socketPath = socketPath;
+        NotecardEnvVarDaemon *daemon = NotecardEnvVarDaemon_alloc(&config);
+        REQUIRE(daemon != NULL);
+        REQUIRE(NotecardEnvVarDaemon_step(daemon) == NEVM_SUCCESS);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        REQUIRE(fd >= 0);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, socketPath);
+        REQUIRE(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+        REQUIRE(send(fd, "SUB\n", 4, 0) == 4);
+        NotecardEnvVarDaemon_poll(daemon, 10);
+        NotecardEnvVarDaemon_poll(daemon, 10);
+        CHECK(drain(fd) == "OK\n");
+
+        // Only changes are pushed.
+        NotecardEmulator_advance(emu, 5000);
+        REQUIRE(NotecardEnvVarDaemon_step(daemon) == NEVM_SUCCESS);
+        CHECK(drain(fd) == "CHG var_a 2\n10\n");
+        REQUIRE(NotecardEnvVarDaemon_step(daemon) == NEVM_SUCCESS);
+        CHECK(drain(fd).empty());
+
+        NotecardEmulator_advance(emu, 4000);
+        REQUIRE(NotecardEnvVarDaemon_step(daemon) == NEVM_SUCCESS);
+        CHECK(drain(fd) == "DEL var_b\n");
+
+        NotecardEnvVarDaemon_free(daemon);
+        close(fd);
+    }
+
+    NotecardEmulatorPty_stop(pty);
+    NotecardEmulator_free(emu);
+    NotecardEnvVarShm_unlink(shmName);
+}
+
+}
+
+#endif // NEVM_TEST
@@ -0,0 +1,106 @@
+/*!
+ * @file NotecardEnvVarFileStorage_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <stdio.h>
+#include <string.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "NotecardEnvVarFileStorage.h"
+
+namespace
+{
+
+const char *path = "nevm_file_storage_test.bin";
+
+TEST_CASE("NotecardEnvVarFileStorage")
+{
+    remove(path);
+
+    SECTION("Invalid geometry") {
+        CHECK(NotecardEnvVarFileStorage_open(path, 1000, 256) == NULL);
+        CHECK(NotecardEnvVarFileStorage_open(path, 1024, 0) == NULL);
+    }
+
+    SECTION("NOR flash semantics") {
+        NotecardEnvVarFileStorage *fs = NotecardEnvVarFileStorage_open(path,
+                                        1024, 256);
+        REQUIRE(fs != NULL);
+        const NotecardEnvVarStorage *storage =
+            NotecardEnvVarFileStorage_storage(fs);
+        REQUIRE(storage != NULL);
+        CHECK(storage->size == 1024);
+        CHECK(storage->sectorSize == 256);
+
+        // A new region reads as erased.
+        uint8_t buf[4];
+        REQUIRE(storage->read(storage->ctx, 1020, buf, sizeof(buf)) ==
+                NEVM_SUCCESS);
+        CHECK(buf[0] == 0xFF);
+        CHECK(buf[3] == 0xFF);
+
+        // Writes can only clear bits.
+        const uint8_t first[] = {0xF0};
+        const uint8_t second[] = {0x0F};
+        REQUIRE(storage->write(storage->ctx, 300, first, 1) == NEVM_SUCCESS);
+        REQUIRE(storage->write(storage->ctx, 300, second, 1) == NEVM_SUCCESS);
+        REQUIRE(storage->read(storage->ctx, 300, buf, 1) == NEVM_SUCCESS);
+        CHECK(buf[0] == 0x00);
+
+        // Erases are whole sectors.
+        CHECK(storage->erase(storage->ctx, 300, 256) == NEVM_FAILURE);
+        CHECK(storage->erase(storage->ctx, 256, 100) == NEVM_FAILURE);
+        REQUIRE(storage->erase(storage->ctx, 256, 256) == NEVM_SUCCESS);
+        REQUIRE(storage->read(storage->ctx, 300, buf, 1) == NEVM_SUCCESS);
+        CHECK(buf[0] == 0xFF);
+
+        // Out of range.
+        CHECK(storage->read(storage->ctx, 1022, buf, 4) == NEVM_FAILURE);
+        CHECK(storage->write(storage->ctx, 1022, buf, 4) == NEVM_FAILURE);
+
+        NotecardEnvVarFileStorageStats stats;
+        NotecardEnvVarFileStorage_getStats(fs, &stats);
+        CHECK(stats.erases == 1);
+        CHECK(stats.maxSectorErases == 1);
+        CHECK(stats.bytesWritten == 2);
+        CHECK(stats.writes == 2);
+
+        CHECK(NotecardEnvVarFileStorage_close(fs) == NEVM_SUCCESS);
+    }
+
+    SECTION("Contents survive reopening") {
+        NotecardEnvVarFileStorage *fs = NotecardEnvVarFileStorage_open(path,
+                                        512, 256);
+        REQUIRE(fs != NULL);
+        const NotecardEnvVarStorage *storage =
+            NotecardEnvVarFileStorage_storage(fs);
+        REQUIRE(storage->write(storage->ctx, 10, "abc", 3) == NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarFileStorage_close(fs) == NEVM_SUCCESS);
+
+        fs = NotecardEnvVarFileStorage_open(path, 512, 256);
+        REQUIRE(fs != NULL);
+        storage = NotecardEnvVarFileStorage_storage(fs);
+        char buf[3];
+        REQUIRE(storage->read(storage->ctx, 10, buf, 3) == NEVM_SUCCESS);
+        CHECK(memcmp(buf, "abc", 3) == 0);
+        CHECK(NotecardEnvVarFileStorage_close(fs) == NEVM_SUCCESS);
+    }
+
+    remove(path);
+}
+
+}
+
+#endif // NEVM_TEST
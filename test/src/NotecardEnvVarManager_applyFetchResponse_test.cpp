@@ -0,0 +1,125 @@
+/*!
+ * @file NotecardEnvVarManager_applyFetchResponse_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <map>
+#include <string.h>
+#include <string>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+
+namespace
+{
+
+std::map<std::string, std::string> fetched;
+std::map<std::string, bool> removed;
+
+void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)ctx;
+
+    fetched[var] = val;
+}
+
+void removedCb(const char *var, void *ctx)
+{
+    (void)ctx;
+
+    removed[var] = true;
+}
+
+TEST_CASE("NotecardEnvVarManager_buildFetchRequest and "
+          "NotecardEnvVarManager_applyFetchResponse")
+{
+    NoteSetFnDefault(malloc, free, NULL, NULL);
+    fetched.clear();
+    removed.clear();
+
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+    REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+            NEVM_SUCCESS);
+    REQUIRE(NotecardEnvVarManager_setEnvVarRemovedCb(man, removedCb, NULL) ==
+            NEVM_SUCCESS);
+    const char *vars[] = {"var_a", "var_b"};
+
+    SECTION("NULL parameters") {
+        CHECK(NotecardEnvVarManager_buildFetchRequest(NULL, vars, 2) == NULL);
+        J *rsp = JParse("{\"body\":{}}");
+        CHECK(NotecardEnvVarManager_applyFetchResponse(NULL, rsp, vars, 2) ==
+              NEVM_FAILURE);
+        JDelete(rsp);
+    }
+
+    SECTION("Builds the same request as a fetch") {
+        J *req = NotecardEnvVarManager_buildFetchRequest(man, vars, 2);
+        REQUIRE(req != NULL);
+        CHECK(strcmp(JGetString(req, "req"), "env.get") == 0);
+        J *names = JGetArray(req, "names");
+        REQUIRE(names != NULL);
+        CHECK(JGetArraySize(names) == 2);
+        JDelete(req);
+
+        // Invalid variable lists fail as they do for a fetch.
+        CHECK(NotecardEnvVarManager_buildFetchRequest(man, NULL, 2) == NULL);
+    }
+
+    SECTION("Applies responses as a fetch does") {
+        J *rsp = JParse("{\"body\":{\"var_a\":\"1\",\"var_b\":\"2\"}}");
+        REQUIRE(rsp != NULL);
+        CHECK(NotecardEnvVarManager_applyFetchResponse(man, rsp, vars, 2) ==
+              NEVM_SUCCESS);
+        JDelete(rsp);
+        CHECK(fetched["var_a"] == "1");
+        CHECK(fetched["var_b"] == "2");
+        CHECK(NotecardEnvVarManager_getGeneration(man) == 1);
+
+        rsp = JParse("{\"body\":{\"var_a\":\"1\"}}");
+        REQUIRE(rsp != NULL);
+        CHECK(NotecardEnvVarManager_applyFetchResponse(man, rsp, vars, 2) ==
+              NEVM_SUCCESS);
+        JDelete(rsp);
+        CHECK(removed["var_b"]);
+    }
+
+    SECTION("Failed transactions") {
+        CHECK(NotecardEnvVarManager_applyFetchResponse(man, NULL, vars, 2) ==
+              NEVM_FAILURE);
+
+        J *rsp = JParse("{\"err\":\"timeout {io}\"}");
+        REQUIRE(rsp != NULL);
+        CHECK(NotecardEnvVarManager_applyFetchResponse(man, rsp, vars, 2) ==
+              NEVM_FAILURE);
+        JDelete(rsp);
+
+        rsp = JParse("{}");
+        REQUIRE(rsp != NULL);
+        CHECK(NotecardEnvVarManager_applyFetchResponse(man, rsp, vars, 2) ==
+              NEVM_FAILURE);
+        JDelete(rsp);
+
+        CHECK(fetched.empty());
+        CHECK(NotecardEnvVarManager_getGeneration(man) == 0);
+    }
+
+    NotecardEnvVarManager_free(man);
+}
+
+}
+
+#endif // NEVM_TEST
@@ -0,0 +1,248 @@
+/*!
+ * @file NotecardEnvVarManager_bindArray_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <string>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fff.h"
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+
+DEFINE_FFF_GLOBALS
+FAKE_VALUE_FUNC(J *, NoteRequestResponse, J *)
+
+#include "fetch_fixture.h"
+
+namespace
+{
+
+float curve[4];
+size_t curveLen;
+int32_t steps[3];
+size_t stepsLen;
+size_t curveLenInCb;
+
+TEST_CASE("NotecardEnvVarManager_bindArray")
+{
+    fetchFixtureReset();
+    onUserCb = [](const char *var) {
+        if (std::string(var) == "cal_curve") {
+            curveLenInCb = curveLen;
+        }
+    };
+    for (float &val : curve) {
+        val = -1;
+    }
+    for (int32_t &val : steps) {
+        val = -1;
+    }
+    curveLen = 99;
+    stepsLen = 99;
+    curveLenInCb = 99;
+
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+
+    SECTION("NULL parameters") {
+        CHECK(NotecardEnvVarManager_bindFloatArray(NULL, "cal_curve", curve, 4,
+                &curveLen) == NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_bindFloatArray(man, NULL, curve, 4,
+                &curveLen) == NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_bindInt32Array(man, "steps", steps, 3,
+                NULL) == NEVM_FAILURE);
+    }
+
+    SECTION("Binding sets the length to 0") {
+        REQUIRE(NotecardEnvVarManager_bindFloatArray(man, "cal_curve", curve,
+                4, &curveLen) == NEVM_SUCCESS);
+        CHECK(curveLen == 0);
+    }
+
+    SECTION("Values are parsed before the callback is called") {
+        REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_bindFloatArray(man, "cal_curve", curve,
+                4, &curveLen) == NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_bindInt32Array(man, "steps", steps, 3,
+                &stepsLen) == NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{\"cal_curve\":\"0.5, 1.25,-2e3\","
+                      "\"steps\":\"10,-20,30\",\"other\":\"1,2\"}") ==
+                NEVM_SUCCESS);
+
+        CHECK(curveLenInCb == 3);
+        CHECK(curveLen == 3);
+        CHECK(curve[0] == 0.5f);
+        CHECK(curve[1] == 1.25f);
+        CHECK(curve[2] == -2000.0f);
+        CHECK(curve[3] == -1);
+        CHECK(stepsLen == 3);
+        CHECK(steps[0] == 10);
+        CHECK(steps[1] == -20);
+        CHECK(steps[2] == 30);
+    }
+
+    SECTION("A bound array is fetched without a user callback") {
+        REQUIRE(NotecardEnvVarManager_bindInt32Array(man, "steps", steps, 3,
+                &stepsLen) == NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{\"steps\":\"7\"}") == NEVM_SUCCESS);
+
+        CHECK(NoteRequestResponse_fake.call_count == 1);
+        CHECK(stepsLen == 1);
+        CHECK(steps[0] == 7);
+    }
+
+    SECTION("An empty value has no elements") {
+        REQUIRE(NotecardEnvVarManager_bindInt32Array(man, "steps", steps, 3,
+                &stepsLen) == NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{\"steps\":\"\"}") == NEVM_SUCCESS);
+
+        CHECK(stepsLen == 0);
+        CHECK(steps[0] == -1);
+    }
+
+    SECTION("Too many elements") {
+        REQUIRE(NotecardEnvVarManager_bindInt32Array(man, "steps", steps, 3,
+                &stepsLen) == NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{\"steps\":\"1,2,3,4\"}") == NEVM_SUCCESS);
+
+        THEN("The length is 0 and the buffer is untouched") {
+            CHECK(stepsLen == 0);
+            CHECK(steps[0] == -1);
+        }
+    }
+
+    SECTION("Malformed values") {
+        REQUIRE(NotecardEnvVarManager_bindInt32Array(man, "steps", steps, 3,
+                &stepsLen) == NEVM_SUCCESS);
+        const char *bodies[] = {
+            "{\"steps\":\"1,,2\"}",
+            "{\"steps\":\"1,2,\"}",
+            "{\"steps\":\"1;2\"}",
+            "{\"steps\":\"1.5\"}",
+            "{\"steps\":\"99999999999\"}",
+        };
+        for (const char *body : bodies) {
+            stepsLen = 99;
+            REQUIRE(fetch(man, body) == NEVM_SUCCESS);
+            CHECK(stepsLen == 0);
+        }
+    }
+
+    SECTION("Unchanged values aren't parsed again") {
+        REQUIRE(NotecardEnvVarManager_bindFloatArray(man, "cal_curve", curve,
+                4, &curveLen) == NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{\"cal_curve\":\"1,2\"}") == NEVM_SUCCESS);
+        REQUIRE(curveLen == 2);
+
+        curve[0] = 42;
+        REQUIRE(fetch(man, "{\"cal_curve\":\"1,2\"}") == NEVM_SUCCESS);
+        CHECK(curve[0] == 42);
+
+        REQUIRE(fetch(man, "{\"cal_curve\":\"1,3\"}") == NEVM_SUCCESS);
+        CHECK(curve[0] == 1);
+        CHECK(curve[1] == 3);
+    }
+
+    SECTION("Values with the same hash are both parsed") {
+        // "220,848" and "638,124" have the same FNV-1a hash.
+        REQUIRE(NotecardEnvVarManager_bindInt32Array(man, "steps", steps, 3,
+                &stepsLen) == NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{\"steps\":\"220,848\"}") == NEVM_SUCCESS);
+        REQUIRE(steps[0] == 220);
+
+        REQUIRE(fetch(man, "{\"steps\":\"638,124\"}") == NEVM_SUCCESS);
+        CHECK(stepsLen == 2);
+        CHECK(steps[0] == 638);
+        CHECK(steps[1] == 124);
+    }
+
+    SECTION("Values that can't be stored are parsed once") {
+        // With events enabled, values longer than 4 characters aren't stored.
+        REQUIRE(NotecardEnvVarManager_enableEvents(man, 4, 4) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_bindInt32Array(man, "steps", steps, 3,
+                &stepsLen) == NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{\"steps\":\"1,2,3\"}") == NEVM_SUCCESS);
+        REQUIRE(stepsLen == 3);
+
+        steps[0] = 42;
+        REQUIRE(fetch(man, "{\"steps\":\"1,2,3\"}") == NEVM_SUCCESS);
+        CHECK(steps[0] == 42);
+
+        REQUIRE(fetch(man, "{\"steps\":\"4,5\"}") == NEVM_SUCCESS);
+        CHECK(stepsLen == 2);
+        CHECK(steps[0] == 4);
+    }
+
+    SECTION("Defaults are parsed") {
+        const char *vars[] = {"cal_curve", "steps"};
+        const char *vals[] = {"4,3,2,1", "5"};
+        REQUIRE(NotecardEnvVarManager_bindFloatArray(man, "cal_curve", curve,
+                4, &curveLen) == NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_setDefaults(man, vars, vals, 2) ==
+                NEVM_SUCCESS);
+        CHECK(curveLen == 4);
+        CHECK(curve[3] == 1);
+
+        AND_WHEN("An array is bound after its default is set") {
+            REQUIRE(NotecardEnvVarManager_bindInt32Array(man, "steps", steps,
+                    3, &stepsLen) == NEVM_SUCCESS);
+
+            THEN("The default is parsed when it's bound") {
+                CHECK(stepsLen == 1);
+                CHECK(steps[0] == 5);
+            }
+        }
+    }
+
+    SECTION("Rebinding and unbinding") {
+        float other[2] = {-1, -1};
+        size_t otherLen = 99;
+        REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_bindFloatArray(man, "cal_curve", curve,
+                4, &curveLen) == NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{\"cal_curve\":\"1,2\"}") == NEVM_SUCCESS);
+
+        REQUIRE(NotecardEnvVarManager_bindFloatArray(man, "cal_curve", other,
+                2, &otherLen) == NEVM_SUCCESS);
+        CHECK(otherLen == 2);
+        CHECK(other[1] == 2);
+
+        REQUIRE(NotecardEnvVarManager_bindFloatArray(man, "cal_curve", NULL,
+                0, NULL) == NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{\"cal_curve\":\"5,6\"}") == NEVM_SUCCESS);
+        CHECK(otherLen == 2);
+        CHECK(other[0] == 1);
+    }
+
+    SECTION("A removed variable leaves the buffer alone") {
+        REQUIRE(NotecardEnvVarManager_bindInt32Array(man, "steps", steps, 3,
+                &stepsLen) == NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{\"steps\":\"1,2\"}") == NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{}") == NEVM_SUCCESS);
+
+        CHECK(stepsLen == 2);
+        CHECK(steps[1] == 2);
+    }
+
+    NotecardEnvVarManager_free(man);
+}
+
+}
+
+#endif // NEVM_TEST
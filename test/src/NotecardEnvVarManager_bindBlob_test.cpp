@@ -0,0 +1,180 @@
+/*!
+ * @file NotecardEnvVarManager_bindBlob_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fff.h"
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+
+DEFINE_FFF_GLOBALS
+FAKE_VALUE_FUNC(J *, NoteRequestResponse, J *)
+
+#include "fetch_fixture.h"
+
+namespace
+{
+
+uint8_t blob[64];
+size_t blobLen;
+size_t blobLenInCb;
+
+std::string encode(const std::vector<uint8_t> &data, bool urlSafe, bool pad)
+{
+    const char *alphabet = urlSafe ?
+                           "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_" :
+                           "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < data.size(); i += 3) {
+        uint32_t group = data[i] << 16;
+        size_t n = data.size() - i;
+        if (n > 1) {
+            group |= data[i + 1] << 8;
+        }
+        if (n > 2) {
+            group |= data[i + 2];
+        }
+        out += alphabet[(group >> 18) & 63];
+        out += alphabet[(group >> 12) & 63];
+        if (n > 1) {
+            out += alphabet[(group >> 6) & 63];
+        } else if (pad) {
+            out += '=';
+        }
+        if (n > 2) {
+            out += alphabet[group & 63];
+        } else if (pad) {
+            out += '=';
+        }
+    }
+
+    return out;
+}
+
+TEST_CASE("NotecardEnvVarManager_bindBlob")
+{
+    fetchFixtureReset();
+    onUserCb = [](const char *) {
+        blobLenInCb = blobLen;
+    };
+    memset(blob, 0xAA, sizeof(blob));
+    blobLen = 99;
+    blobLenInCb = 99;
+
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+
+    SECTION("NULL parameters") {
+        CHECK(NotecardEnvVarManager_bindBlob(NULL, "cert", blob, sizeof(blob),
+                                             &blobLen) == NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_bindBlob(man, "cert", blob, sizeof(blob),
+                                             NULL) == NEVM_FAILURE);
+    }
+
+    SECTION("Values are decoded before the callback is called") {
+        REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_bindBlob(man, "cert", blob, sizeof(blob),
+                                               &blobLen) == NEVM_SUCCESS);
+        REQUIRE(fetchVar(man, "cert", "aGVsbG8=") == NEVM_SUCCESS);
+
+        CHECK(blobLenInCb == 5);
+        CHECK(blobLen == 5);
+        CHECK(memcmp(blob, "hello", 5) == 0);
+        CHECK(blob[5] == 0xAA);
+    }
+
+    SECTION("Random data in every form") {
+        REQUIRE(NotecardEnvVarManager_bindBlob(man, "cert", blob, sizeof(blob),
+                                               &blobLen) == NEVM_SUCCESS);
+        uint32_t seed = 1;
+        for (size_t size = 0; size <= sizeof(blob); ++size) {
+            std::vector<uint8_t> data(size);
+            for (uint8_t &byte : data) {
+                seed = seed * 1103515245 + 12345;
+                byte = (uint8_t)(seed >> 16);
+            }
+            for (int form = 0; form < 4; ++form) {
+                std::string val = encode(data, form & 1, form & 2);
+                if (form == 3) {
+                    // PEM-style line breaks.
+                    for (size_t i = 16; i < val.size(); i += 17) {
+                        val.insert(i, "\n");
+                    }
+                    val += "\r\n";
+                }
+                REQUIRE(fetchVar(man, "cert", val) == NEVM_SUCCESS);
+                REQUIRE(blobLen == size);
+                REQUIRE(memcmp(blob, data.data(), size) == 0);
+            }
+        }
+    }
+
+    SECTION("Invalid values") {
+        REQUIRE(NotecardEnvVarManager_bindBlob(man, "cert", blob, sizeof(blob),
+                                               &blobLen) == NEVM_SUCCESS);
+        const char *vals[] = {
+            "a",
+            "aGVsb*8=",
+            "aGVsbG8=a",
+            "====",
+            "aGVsbG8\xc3\xa9",
+        };
+        for (const char *val : vals) {
+            blobLen = 99;
+            REQUIRE(fetchVar(man, "cert", val) == NEVM_SUCCESS);
+            CHECK(blobLen == 0);
+        }
+    }
+
+    SECTION("A value too long for the buffer") {
+        uint8_t small[4];
+        size_t smallLen = 99;
+        REQUIRE(NotecardEnvVarManager_bindBlob(man, "cert", small,
+                                               sizeof(small), &smallLen) ==
+                NEVM_SUCCESS);
+        REQUIRE(fetchVar(man, "cert", encode({1, 2, 3, 4}, false, true)) ==
+                NEVM_SUCCESS);
+        CHECK(smallLen == 4);
+
+        REQUIRE(fetchVar(man, "cert", encode({1, 2, 3, 4, 5}, false, true)) ==
+                NEVM_SUCCESS);
+        CHECK(smallLen == 0);
+        REQUIRE(fetchVar(man, "cert",
+                         encode({1, 2, 3, 4, 5, 6, 7}, false, false)) ==
+                NEVM_SUCCESS);
+        CHECK(smallLen == 0);
+    }
+
+    SECTION("Unchanged values aren't decoded again") {
+        REQUIRE(NotecardEnvVarManager_bindBlob(man, "cert", blob, sizeof(blob),
+                                               &blobLen) == NEVM_SUCCESS);
+        REQUIRE(fetchVar(man, "cert", "aGVsbG8=") == NEVM_SUCCESS);
+        blob[0] = 0;
+        REQUIRE(fetchVar(man, "cert", "aGVsbG8=") == NEVM_SUCCESS);
+        CHECK(blob[0] == 0);
+    }
+
+    NotecardEnvVarManager_free(man);
+}
+
+}
+
+#endif // NEVM_TEST
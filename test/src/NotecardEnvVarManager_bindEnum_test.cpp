@@ -0,0 +1,200 @@
+/*!
+ * @file NotecardEnvVarManager_bindEnum_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <string>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fff.h"
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+
+DEFINE_FFF_GLOBALS
+FAKE_VALUE_FUNC(J *, NoteRequestResponse, J *)
+
+#include "fetch_fixture.h"
+
+namespace
+{
+
+const char *powerModes[] = {"low", "normal", "turbo"};
+
+int powerMode;
+int powerModeInCb;
+
+TEST_CASE("NotecardEnvVarManager_bindEnum")
+{
+    fetchFixtureReset();
+    onUserCb = [](const char *) {
+        powerModeInCb = powerMode;
+    };
+    powerMode = 99;
+    powerModeInCb = 99;
+
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+
+    SECTION("Invalid parameters") {
+        CHECK(NotecardEnvVarManager_bindEnum(NULL, "power_mode", powerModes,
+                                             3, &powerMode) == NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_bindEnum(man, NULL, powerModes, 3,
+                                             &powerMode) == NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_bindEnum(man, "power_mode", powerModes, 3,
+                                             NULL) == NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_bindEnum(man, "power_mode", powerModes, 0,
+                                             &powerMode) == NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_bindEnum(man, "power_mode", powerModes,
+                                             NEVM_MAX_ENUM_NAMES + 1,
+                                             &powerMode) == NEVM_FAILURE);
+
+        const char *duplicates[] = {"low", "high", "low"};
+        CHECK(NotecardEnvVarManager_bindEnum(man, "power_mode", duplicates, 3,
+                                             &powerMode) == NEVM_FAILURE);
+        CHECK(powerMode == 99);
+    }
+
+    SECTION("Binding sets the value to invalid") {
+        REQUIRE(NotecardEnvVarManager_bindEnum(man, "power_mode", powerModes,
+                                               3, &powerMode) == NEVM_SUCCESS);
+        CHECK(powerMode == NEVM_ENUM_INVALID);
+    }
+
+    SECTION("Values are resolved before the callback is called") {
+        REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_bindEnum(man, "power_mode", powerModes,
+                                               3, &powerMode) == NEVM_SUCCESS);
+        for (int i = 0; i < 3; ++i) {
+            REQUIRE(fetch(man, std::string("{\"power_mode\":\"") +
+                          powerModes[i] + "\"}") == NEVM_SUCCESS);
+            CHECK(powerModeInCb == i);
+            CHECK(powerMode == i);
+        }
+    }
+
+    SECTION("A bound enum is fetched without a user callback") {
+        REQUIRE(NotecardEnvVarManager_bindEnum(man, "power_mode", powerModes,
+                                               3, &powerMode) == NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{\"power_mode\":\"turbo\"}") == NEVM_SUCCESS);
+
+        CHECK(NoteRequestResponse_fake.call_count == 1);
+        CHECK(powerMode == 2);
+    }
+
+    SECTION("Invalid values") {
+        REQUIRE(NotecardEnvVarManager_bindEnum(man, "power_mode", powerModes,
+                                               3, &powerMode) == NEVM_SUCCESS);
+        const char *vals[] = {"", "norm", "normalx", "LOW", " low"};
+        for (const char *val : vals) {
+            REQUIRE(fetch(man, "{\"power_mode\":\"normal\"}") ==
+                    NEVM_SUCCESS);
+            REQUIRE(powerMode == 1);
+            REQUIRE(fetch(man, std::string("{\"power_mode\":\"") + val +
+                          "\"}") == NEVM_SUCCESS);
+            CHECK(powerMode == NEVM_ENUM_INVALID);
+        }
+    }
+
+    SECTION("Unchanged values aren't resolved again") {
+        REQUIRE(NotecardEnvVarManager_bindEnum(man, "power_mode", powerModes,
+                                               3, &powerMode) == NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{\"power_mode\":\"low\"}") == NEVM_SUCCESS);
+        REQUIRE(powerMode == 0);
+
+        powerMode = 42;
+        REQUIRE(fetch(man, "{\"power_mode\":\"low\"}") == NEVM_SUCCESS);
+        CHECK(powerMode == 42);
+
+        // An invalid value is only resolved, and warned about, once.
+        REQUIRE(fetch(man, "{\"power_mode\":\"bogus\"}") == NEVM_SUCCESS);
+        REQUIRE(powerMode == NEVM_ENUM_INVALID);
+        powerMode = 42;
+        REQUIRE(fetch(man, "{\"power_mode\":\"bogus\"}") == NEVM_SUCCESS);
+        CHECK(powerMode == 42);
+    }
+
+    SECTION("Many names") {
+        std::vector<std::string> strs;
+        for (int i = 0; i < NEVM_MAX_ENUM_NAMES; ++i) {
+            strs.push_back("mode" + std::to_string(i));
+        }
+        std::vector<const char *> names;
+        for (const std::string &str : strs) {
+            names.push_back(str.c_str());
+        }
+        REQUIRE(NotecardEnvVarManager_bindEnum(man, "power_mode", names.data(),
+                                               names.size(), &powerMode) ==
+                NEVM_SUCCESS);
+
+        for (size_t i = 0; i < strs.size(); ++i) {
+            REQUIRE(fetch(man, "{\"power_mode\":\"" + strs[i] + "\"}") ==
+                    NEVM_SUCCESS);
+            CHECK(powerMode == (int)i);
+        }
+    }
+
+    SECTION("A removed variable leaves the value alone") {
+        REQUIRE(NotecardEnvVarManager_bindEnum(man, "power_mode", powerModes,
+                                               3, &powerMode) == NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{\"power_mode\":\"low\"}") == NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{}") == NEVM_SUCCESS);
+
+        CHECK(powerMode == 0);
+    }
+
+    SECTION("Defaults are resolved") {
+        const char *vars[] = {"power_mode"};
+        const char *vals[] = {"normal"};
+        REQUIRE(NotecardEnvVarManager_setDefaults(man, vars, vals, 1) ==
+                NEVM_SUCCESS);
+
+        AND_WHEN("An enum is bound after its default is set") {
+            REQUIRE(NotecardEnvVarManager_bindEnum(man, "power_mode",
+                                                   powerModes, 3,
+                                                   &powerMode) ==
+                    NEVM_SUCCESS);
+
+            THEN("The default is resolved when it's bound") {
+                CHECK(powerMode == 1);
+            }
+        }
+    }
+
+    SECTION("Rebinding and unbinding") {
+        const char *levels[] = {"turbo", "low"};
+        int level = 99;
+        REQUIRE(NotecardEnvVarManager_bindEnum(man, "power_mode", powerModes,
+                                               3, &powerMode) == NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{\"power_mode\":\"low\"}") == NEVM_SUCCESS);
+
+        REQUIRE(NotecardEnvVarManager_bindEnum(man, "power_mode", levels, 2,
+                                               &level) == NEVM_SUCCESS);
+        CHECK(level == 1);
+
+        REQUIRE(NotecardEnvVarManager_bindEnum(man, "power_mode", NULL, 0,
+                                               NULL) == NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{\"power_mode\":\"turbo\"}") == NEVM_SUCCESS);
+        CHECK(level == 1);
+        CHECK(powerMode == 0);
+    }
+
+    NotecardEnvVarManager_free(man);
+}
+
+}
+
+#endif // NEVM_TEST
@@ -0,0 +1,261 @@
+/*!
+ * @file NotecardEnvVarManager_bindFlag_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <string>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fff.h"
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+
+DEFINE_FFF_GLOBALS
+FAKE_VALUE_FUNC(J *, NoteRequestResponse, J *)
+
+#include "fetch_fixture.h"
+
+namespace
+{
+
+enum {
+    FLAG_FAST_SAMPLING = 0,
+    FLAG_GPS = 5,
+    FLAG_DEBUG = 31
+};
+
+const volatile uint32_t *flags;
+uint32_t flagsInCb;
+
+TEST_CASE("NotecardEnvVarManager_bindFlag")
+{
+    fetchFixtureReset();
+    onUserCb = [](const char *) {
+        flagsInCb = *flags;
+    };
+    flagsInCb = 0xFFFFFFFF;
+
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+    flags = NotecardEnvVarManager_getFlags(man);
+    REQUIRE(flags != NULL);
+    CHECK(*flags == 0);
+
+    SECTION("Invalid parameters") {
+        CHECK(NotecardEnvVarManager_getFlags(NULL) == NULL);
+        CHECK(NotecardEnvVarManager_bindFlag(NULL, "gps", FLAG_GPS) ==
+              NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_bindFlag(man, "gps", NEVM_MAX_FLAGS) ==
+              NEVM_FAILURE);
+    }
+
+    SECTION("Bound flags are fetched without a user callback") {
+        REQUIRE(NotecardEnvVarManager_bindFlag(man, "fast_sampling",
+                                               FLAG_FAST_SAMPLING) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_bindFlag(man, "gps", FLAG_GPS) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_bindFlag(man, "debug", FLAG_DEBUG) ==
+                NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{\"fast_sampling\":\"true\",\"gps\":\"0\","
+                      "\"debug\":\"1\",\"other\":\"true\"}") == NEVM_SUCCESS);
+
+        CHECK(NoteRequestResponse_fake.call_count == 1);
+        CHECK(*flags == (NEVM_FLAG(FLAG_FAST_SAMPLING) |
+                         NEVM_FLAG(FLAG_DEBUG)));
+
+        REQUIRE(fetch(man, "{\"fast_sampling\":\"false\",\"gps\":\"true\","
+                      "\"debug\":\"1\"}") == NEVM_SUCCESS);
+        CHECK(*flags == (NEVM_FLAG(FLAG_GPS) | NEVM_FLAG(FLAG_DEBUG)));
+    }
+
+    SECTION("The flags are published once the response is applied") {
+        REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_bindFlag(man, "gps", FLAG_GPS) ==
+                NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{\"gps\":\"true\"}") == NEVM_SUCCESS);
+
+        CHECK(flagsInCb == 0);
+        CHECK(*flags == NEVM_FLAG(FLAG_GPS));
+
+        AND_WHEN("Callbacks are deferred") {
+            REQUIRE(NotecardEnvVarManager_setDispatchBudget(man, 2, 0, NULL) ==
+                    NEVM_SUCCESS);
+            REQUIRE(NotecardEnvVarManager_bindFlag(man, "debug", FLAG_DEBUG) ==
+                    NEVM_SUCCESS);
+            REQUIRE(fetch(man, "{\"gps\":\"true\",\"debug\":\"true\"}") ==
+                    NEVM_SUCCESS);
+            CHECK(*flags == (NEVM_FLAG(FLAG_GPS) | NEVM_FLAG(FLAG_DEBUG)));
+
+            THEN("They see the flags of the whole response") {
+                flagsInCb = 0;
+                REQUIRE(NotecardEnvVarManager_service(man) == 0);
+                CHECK(flagsInCb == (NEVM_FLAG(FLAG_GPS) |
+                                    NEVM_FLAG(FLAG_DEBUG)));
+            }
+        }
+    }
+
+    SECTION("Values that aren't booleans leave the bit alone") {
+        REQUIRE(NotecardEnvVarManager_bindFlag(man, "gps", FLAG_GPS) ==
+                NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{\"gps\":\"true\"}") == NEVM_SUCCESS);
+        const char *bodies[] = {
+            "{\"gps\":\"\"}",
+            "{\"gps\":\"TRUE\"}",
+            "{\"gps\":\"no\"}",
+            "{\"gps\":\"10\"}",
+            "{\"gps\":\"false \"}",
+        };
+        for (const char *body : bodies) {
+            REQUIRE(fetch(man, body) == NEVM_SUCCESS);
+            CHECK(*flags == NEVM_FLAG(FLAG_GPS));
+        }
+    }
+
+    SECTION("A removed variable leaves the bit alone") {
+        REQUIRE(NotecardEnvVarManager_bindFlag(man, "gps", FLAG_GPS) ==
+                NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{\"gps\":\"true\"}") == NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{}") == NEVM_SUCCESS);
+
+        CHECK(*flags == NEVM_FLAG(FLAG_GPS));
+    }
+
+    SECTION("Defaults are applied") {
+        const char *vars[] = {"gps", "debug"};
+        const char *vals[] = {"true", "true"};
+        REQUIRE(NotecardEnvVarManager_bindFlag(man, "gps", FLAG_GPS) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_setDefaults(man, vars, vals, 2) ==
+                NEVM_SUCCESS);
+        CHECK(*flags == NEVM_FLAG(FLAG_GPS));
+
+        AND_WHEN("A flag is bound after its default is set") {
+            REQUIRE(NotecardEnvVarManager_bindFlag(man, "debug", FLAG_DEBUG) ==
+                    NEVM_SUCCESS);
+
+            THEN("The default is applied when it's bound") {
+                CHECK(*flags == (NEVM_FLAG(FLAG_GPS) | NEVM_FLAG(FLAG_DEBUG)));
+            }
+        }
+    }
+
+    SECTION("Rollout rules") {
+        REQUIRE(NotecardEnvVarManager_setDeviceId(man, "dev:000000000000001")
+                == NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_bindFlag(man, "flag.new_modem",
+                                               FLAG_GPS) == NEVM_SUCCESS);
+
+        REQUIRE(fetch(man, "{\"flag.new_modem\":\"100%\"}") == NEVM_SUCCESS);
+        CHECK(*flags == NEVM_FLAG(FLAG_GPS));
+        REQUIRE(fetch(man, "{\"flag.new_modem\":\"0%\"}") == NEVM_SUCCESS);
+        CHECK(*flags == 0);
+
+        AND_WHEN("A rule isn't valid") {
+            REQUIRE(fetch(man, "{\"flag.new_modem\":\"100.00%\"}") ==
+                    NEVM_SUCCESS);
+            const char *bodies[] = {
+                "{\"flag.new_modem\":\"%\"}",
+                "{\"flag.new_modem\":\"25\"}",
+                "{\"flag.new_modem\":\"-1%\"}",
+                "{\"flag.new_modem\":\"100.01%\"}",
+                "{\"flag.new_modem\":\"25 %\"}",
+                "{\"flag.new_modem\":\"25%%\"}",
+            };
+            for (const char *body : bodies) {
+                REQUIRE(fetch(man, body) == NEVM_SUCCESS);
+                CHECK(*flags == NEVM_FLAG(FLAG_GPS));
+            }
+        }
+    }
+
+    SECTION("Rollouts are stable, proportionate and independent per flag") {
+        const int numDevices = 2000;
+        std::vector<bool> hasFlag(numDevices);
+        REQUIRE(NotecardEnvVarManager_bindFlag(man, "flag.a", 0) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_bindFlag(man, "flag.b", 1) ==
+                NEVM_SUCCESS);
+
+        REQUIRE(fetch(man, "{\"flag.a\":\"25%\",\"flag.b\":\"50%\"}") ==
+                NEVM_SUCCESS);
+        int numA = 0;
+        int numB = 0;
+        int numBoth = 0;
+        for (int i = 0; i < numDevices; ++i) {
+            std::string id = "dev:" + std::to_string(860000000000000 + i);
+            REQUIRE(NotecardEnvVarManager_setDeviceId(man, id.c_str()) ==
+                    NEVM_SUCCESS);
+            hasFlag[i] = *flags & NEVM_FLAG(0);
+            numA += hasFlag[i];
+            numB += (*flags & NEVM_FLAG(1)) != 0;
+            numBoth += *flags == (NEVM_FLAG(0) | NEVM_FLAG(1));
+        }
+        CHECK(numA > numDevices * 22 / 100);
+        CHECK(numA < numDevices * 28 / 100);
+        CHECK(numB > numDevices * 46 / 100);
+        CHECK(numB < numDevices * 54 / 100);
+        CHECK(numBoth > numDevices * 10 / 100);
+        CHECK(numBoth < numDevices * 15 / 100);
+
+        REQUIRE(fetch(man, "{\"flag.a\":\"50%\",\"flag.b\":\"50%\"}") ==
+                NEVM_SUCCESS);
+        int numWidened = 0;
+        for (int i = 0; i < numDevices; ++i) {
+            std::string id = "dev:" + std::to_string(860000000000000 + i);
+            REQUIRE(NotecardEnvVarManager_setDeviceId(man, id.c_str()) ==
+                    NEVM_SUCCESS);
+            bool has = *flags & NEVM_FLAG(0);
+            if (hasFlag[i]) {
+                REQUIRE(has);
+            }
+            numWidened += has;
+        }
+        CHECK(numWidened > numDevices * 46 / 100);
+        CHECK(numWidened < numDevices * 54 / 100);
+    }
+
+    SECTION("Rebinding and unbinding") {
+        REQUIRE(NotecardEnvVarManager_bindFlag(man, "gps", FLAG_GPS) ==
+                NEVM_SUCCESS);
+        REQUIRE(fetch(man, "{\"gps\":\"true\",\"debug\":\"false\"}") ==
+                NEVM_SUCCESS);
+        REQUIRE(*flags == NEVM_FLAG(FLAG_GPS));
+
+        REQUIRE(NotecardEnvVarManager_bindFlag(man, "debug", FLAG_GPS) ==
+                NEVM_SUCCESS);
+        CHECK(*flags == 0);
+
+        REQUIRE(NotecardEnvVarManager_bindFlag(man, "gps", FLAG_DEBUG) ==
+                NEVM_SUCCESS);
+        CHECK(*flags == NEVM_FLAG(FLAG_DEBUG));
+
+        REQUIRE(NotecardEnvVarManager_bindFlag(man, NULL, FLAG_DEBUG) ==
+                NEVM_SUCCESS);
+        CHECK(*flags == 0);
+        REQUIRE(fetch(man, "{\"gps\":\"true\",\"debug\":\"true\"}") ==
+                NEVM_SUCCESS);
+        CHECK(*flags == NEVM_FLAG(FLAG_GPS));
+    }
+
+    NotecardEnvVarManager_free(man);
+}
+
+}
+
+#endif // NEVM_TEST
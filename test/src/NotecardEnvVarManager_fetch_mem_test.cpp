@@ -0,0 +1,281 @@
+/*!
+ * @file NotecardEnvVarManager_fetch_mem_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <string>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fff.h"
+#include "mem_tracker.h"
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+
+DEFINE_FFF_GLOBALS
+FAKE_VALUE_FUNC(J *, NoteRequestResponse, J *)
+
+namespace
+{
+
+// Memory budgets for a single NotecardEnvVarManager_fetch call with numVars
+// variables in the response. These are the fetch path's measured figures plus
+// a margin of about 64 bytes and a few allocations, so that a change which
+// grows the manager's memory per fetch fails here. If a change legitimately
+// needs more memory, raise the budget in the same commit and explain why in
+// the commit message.
+//
+// Allocation counts are independent of pointer size. Peak bytes are expressed
+// in J nodes and pointers plus string bytes so that the budgets hold on 32-
+// and 64-bit hosts alike. On a 64-bit host, a fetch of 3 named variables
+// measured 23 allocations and 846 peak bytes, and a fetch of 32 variables
+// with NEVM_ENV_VAR_ALL measured 105 allocations and 3484 peak bytes.
+//
+// The budgets apply to a steady-state fetch, once the manager's value store
+// holds every variable and the values haven't outgrown their slots. The first
+// fetch additionally pays for populating the store (see storeAllocBudget,
+// storeBytesBudget and firstPeakBudget), which the manager keeps until it's
+// freed.
+size_t allocBudget(size_t numVars, bool fetchAll)
+{
+    return fetchAll ? 12 + 3 * numVars : 16 + 4 * numVars;
+}
+
+// The request, the response's J nodes and each variable's name and value in
+// the receive buffer and the response. A named fetch also builds a J node per
+// variable for the request's names.
+size_t peakBudget(size_t numVars, bool fetchAll)
+{
+    size_t nodes = 3 + (fetchAll ? 1 : 2) * numVars;
+
+    return nodes * sizeof(J) + 36 * numVars + (fetchAll ? 160 : 224);
+}
+
+size_t storeCap(size_t numVars)
+{
+    size_t cap = 8;
+    while (cap < numVars) {
+        cap *= 2;
+    }
+
+    return cap;
+}
+
+// The entry array, the hash index at twice the capacity and the three
+// bitmaps, for a store with room for cap variables.
+size_t storeArrayBytes(size_t cap)
+{
+    return cap * (2 * sizeof(void *) + 16 + 2 * sizeof(uint16_t)) +
+           3 * sizeof(uint32_t) * ((cap + 31) / 32);
+}
+
+// One block per variable, plus the entry array, hash index and removal
+// bitmaps, which are reallocated each time the store doubles.
+size_t storeAllocBudget(size_t numVars)
+{
+    size_t grows = 0;
+    for (size_t cap = 0; cap < numVars; cap = (cap == 0) ? 8 : cap * 2) {
+        ++grows;
+    }
+
+    return numVars + 3 * grows;
+}
+
+// The store's arrays, plus each variable's name and value, which fit in 16
+// bytes for the names and values built by buildScenario.
+size_t storeBytesBudget(size_t numVars)
+{
+    return storeArrayBytes(storeCap(numVars)) + 16 * numVars;
+}
+
+// The first fetch peaks either building the request, as in a steady-state
+// fetch, or while the parsed response is applied to the store. The last time
+// the store doubles, the old and new arrays are held at once.
+size_t firstPeakBudget(size_t numVars, bool fetchAll)
+{
+    size_t cap = storeCap(numVars);
+    size_t grow = cap > 8 ? storeArrayBytes(cap / 2) : 0;
+    size_t apply = (2 + numVars) * sizeof(J) + 16 * numVars + 64 +
+                   storeBytesBudget(numVars) + grow;
+    size_t steady = peakBudget(numVars, fetchAll);
+
+    return apply > steady ? apply : steady;
+}
+
+// Blocks the manager may still hold after a steady-state fetch returns.
+const size_t retainedBlocksBudget = 0;
+
+// Blocks the manager may still hold after the first fetch: the store's
+// variables, entry array, hash index and removal bitmaps.
+size_t storeBlocksBudget(size_t numVars)
+{
+    return numVars + 3;
+}
+
+std::string rawRsp;
+size_t userCbCount;
+
+void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)var;
+    (void)val;
+    (void)ctx;
+
+    ++userCbCount;
+}
+
+// Stand-in for the note-c transaction that allocates what note-c allocates on
+// the way: the serialized request, the receive buffer and the parsed response.
+J *NoteRequestResponse_emulated(J *req)
+{
+    char *reqStr = JPrintUnformatted(req);
+    REQUIRE(reqStr != NULL);
+    JFree(reqStr);
+
+    char *rxBuf = (char *)NoteMalloc(rawRsp.size() + 1);
+    REQUIRE(rxBuf != NULL);
+    memcpy(rxBuf, rawRsp.c_str(), rawRsp.size() + 1);
+    J *rsp = JParse(rxBuf);
+    NoteFree(rxBuf);
+
+    JDelete(req);
+
+    return rsp;
+}
+
+struct Scenario {
+    std::vector<std::string> names;
+    std::vector<const char *> vars;
+};
+
+void buildScenario(Scenario &scenario, size_t numVars)
+{
+    char buf[16];
+
+    rawRsp = "{\"body\":{";
+    for (size_t i = 0; i < numVars; ++i) {
+        snprintf(buf, sizeof(buf), "var_%03u", (unsigned)i);
+        scenario.names.push_back(buf);
+        rawRsp += (i == 0 ? "\"" : ",\"");
+        rawRsp += buf;
+        snprintf(buf, sizeof(buf), "val_%03u", (unsigned)i);
+        rawRsp += "\":\"";
+        rawRsp += buf;
+        rawRsp += "\"";
+    }
+    rawRsp += "}}";
+
+    for (size_t i = 0; i < numVars; ++i) {
+        scenario.vars.push_back(scenario.names[i].c_str());
+    }
+}
+
+void fetch(NotecardEnvVarManager *man, Scenario &scenario, size_t numVars,
+           bool fetchAll)
+{
+    userCbCount = 0;
+    if (fetchAll) {
+        REQUIRE(NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL) ==
+                NEVM_SUCCESS);
+    } else {
+        REQUIRE(NotecardEnvVarManager_fetch(man, scenario.vars.data(),
+                                            numVars) == NEVM_SUCCESS);
+    }
+    REQUIRE(userCbCount == numVars);
+}
+
+void checkFetchBudget(size_t numVars, bool fetchAll)
+{
+    RESET_FAKE(NoteRequestResponse);
+    NoteRequestResponse_fake.custom_fake = NoteRequestResponse_emulated;
+
+    NoteSetFnDefault(memTrackerMalloc, memTrackerFree, NULL, NULL);
+
+    Scenario scenario;
+    buildScenario(scenario, numVars);
+
+    const MemStats before = memTrackerMark();
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+    REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+            NEVM_SUCCESS);
+
+    // First fetch: populates the value store.
+    MemStats start = memTrackerMark();
+    fetch(man, scenario, numVars, fetchAll);
+    size_t peak = memStats.peakBytes - start.liveBytes;
+    size_t alloc = allocBudget(numVars, fetchAll) + storeAllocBudget(numVars);
+    size_t bytes = firstPeakBudget(numVars, fetchAll);
+    INFO("first fetch allocations: " << memStats.allocs << " (budget "
+         << alloc << ")");
+    INFO("first fetch peak bytes: " << peak << " (budget " << bytes << ")");
+    CHECK(memStats.allocs <= alloc);
+    CHECK(peak <= bytes);
+    CHECK(memStats.liveBlocks - start.liveBlocks <=
+          storeBlocksBudget(numVars));
+    CHECK(memStats.liveBytes - start.liveBytes <= storeBytesBudget(numVars));
+
+    // Steady state: the same values again.
+    start = memTrackerMark();
+    fetch(man, scenario, numVars, fetchAll);
+    peak = memStats.peakBytes - start.liveBytes;
+    INFO("allocations: " << memStats.allocs << " (budget "
+         << allocBudget(numVars, fetchAll) << ")");
+    INFO("peak bytes: " << peak << " (budget "
+         << peakBudget(numVars, fetchAll) << ")");
+    CHECK(memStats.allocs <= allocBudget(numVars, fetchAll));
+    CHECK(peak <= peakBudget(numVars, fetchAll));
+    CHECK(memStats.liveBlocks - start.liveBlocks <= retainedBlocksBudget);
+
+    NotecardEnvVarManager_free(man);
+
+    // Everything the manager allocated must be released by _free.
+    CHECK(memStats.liveBlocks == before.liveBlocks);
+    CHECK(memStats.liveBytes == before.liveBytes);
+}
+
+TEST_CASE("NotecardEnvVarManager_alloc memory budget")
+{
+    NoteSetFnDefault(memTrackerMalloc, memTrackerFree, NULL, NULL);
+
+    const MemStats start = memTrackerMark();
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+
+    CHECK(memStats.allocs == 1);
+    CHECK(memStats.liveBlocks - start.liveBlocks == 1);
+
+    NotecardEnvVarManager_free(man);
+    CHECK(memStats.liveBlocks == start.liveBlocks);
+}
+
+TEST_CASE("NotecardEnvVarManager_fetch memory budget: 3 named variables")
+{
+    checkFetchBudget(3, false);
+}
+
+TEST_CASE("NotecardEnvVarManager_fetch memory budget: 64 named variables")
+{
+    checkFetchBudget(64, false);
+}
+
+TEST_CASE("NotecardEnvVarManager_fetch memory budget: all variables")
+{
+    checkFetchBudget(32, true);
+}
+
+}
+
+#endif // NEVM_TEST
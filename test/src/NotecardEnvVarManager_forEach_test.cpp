@@ -0,0 +1,122 @@
+/*!
+ * @file NotecardEnvVarManager_forEach_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <map>
+#include <string>
+#include <string.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fff.h"
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+
+DEFINE_FFF_GLOBALS
+FAKE_VALUE_FUNC(J *, NoteRequestResponse, J *)
+
+namespace
+{
+
+std::string rspStr;
+std::map<std::string, std::string> visited;
+
+void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)var;
+    (void)val;
+    (void)ctx;
+}
+
+void visitCb(const char *var, size_t varLen, const char *val, size_t valLen,
+             void *ctx)
+{
+    CHECK(ctx == &visited);
+    CHECK(strlen(var) == varLen);
+    CHECK(strlen(val) == valLen);
+
+    visited[var] = val;
+}
+
+J *NoteRequestResponse_respond(J *req)
+{
+    JDelete(req);
+    return JParse(rspStr.c_str());
+}
+
+TEST_CASE("NotecardEnvVarManager_forEach")
+{
+    RESET_FAKE(NoteRequestResponse);
+    NoteSetFnDefault(malloc, free, NULL, NULL);
+    NoteRequestResponse_fake.custom_fake = NoteRequestResponse_respond;
+    rspStr = "{\"body\":{\"var_a\":\"1\",\"var_b\":\"hello\"}}";
+    visited.clear();
+
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+    REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+            NEVM_SUCCESS);
+
+    SECTION("NULL parameters") {
+        CHECK(NotecardEnvVarManager_forEach(NULL, visitCb, &visited) ==
+              NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_forEach(man, NULL, &visited) ==
+              NEVM_FAILURE);
+    }
+
+    SECTION("Empty store") {
+        CHECK(NotecardEnvVarManager_forEach(man, visitCb, &visited) ==
+              NEVM_SUCCESS);
+        CHECK(visited.empty());
+    }
+
+    SECTION("Defaults and fetched values") {
+        const char *defaultVars[] = {"var_c"};
+        const char *defaultVals[] = {"default_c"};
+        REQUIRE(NotecardEnvVarManager_setDefaults(man, defaultVars,
+                defaultVals, 1) == NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL) ==
+                NEVM_SUCCESS);
+
+        CHECK(NotecardEnvVarManager_forEach(man, visitCb, &visited) ==
+              NEVM_SUCCESS);
+        const std::map<std::string, std::string> expected = {
+            {"var_a", "1"},
+            {"var_b", "hello"},
+            {"var_c", "default_c"},
+        };
+        CHECK(visited == expected);
+
+        AND_WHEN("A variable is removed") {
+            rspStr = "{\"body\":{\"var_a\":\"1\"}}";
+            REQUIRE(NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL)
+                    == NEVM_SUCCESS);
+            visited.clear();
+
+            THEN("It's skipped") {
+                CHECK(NotecardEnvVarManager_forEach(man, visitCb, &visited) ==
+                      NEVM_SUCCESS);
+                CHECK(visited.size() == 2);
+                CHECK(visited.count("var_b") == 0);
+            }
+        }
+    }
+
+    NotecardEnvVarManager_free(man);
+}
+
+}
+
+#endif // NEVM_TEST
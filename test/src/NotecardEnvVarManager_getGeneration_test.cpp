@@ -0,0 +1,142 @@
+/*!
+ * @file NotecardEnvVarManager_getGeneration_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <catch2/catch_test_macros.hpp>
+#include "fff.h"
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+
+DEFINE_FFF_GLOBALS
+FAKE_VALUE_FUNC(J *, NoteRequestResponse, J *)
+
+namespace
+{
+
+const char *vars[] = {"var_a", "var_b"};
+const size_t numVars = sizeof(vars) / sizeof(vars[0]);
+
+const char *response = NULL;
+
+void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)var;
+    (void)val;
+    (void)ctx;
+}
+
+J *NoteRequestResponse_respond(J *req)
+{
+    JDelete(req);
+    return JParse(response);
+}
+
+TEST_CASE("NotecardEnvVarManager_getGeneration")
+{
+    RESET_FAKE(NoteRequestResponse);
+    NoteSetFnDefault(malloc, free, NULL, NULL);
+    NoteRequestResponse_fake.custom_fake = NoteRequestResponse_respond;
+
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+    REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+            NEVM_SUCCESS);
+
+    uint32_t gen = 99;
+
+    SECTION("NULL parameters") {
+        CHECK(NotecardEnvVarManager_getGeneration(NULL) == 0);
+        CHECK(NotecardEnvVarManager_getVarGeneration(NULL, "var_a", &gen) ==
+              NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_getVarGeneration(man, NULL, &gen) ==
+              NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_getVarGeneration(man, "var_a", NULL) ==
+              NEVM_FAILURE);
+    }
+
+    SECTION("Unknown variable") {
+        CHECK(NotecardEnvVarManager_getGeneration(man) == 0);
+        CHECK(NotecardEnvVarManager_getVarGeneration(man, "var_a", &gen) ==
+              NEVM_FAILURE);
+    }
+
+    SECTION("Only fetches that change a value advance the generation") {
+        response = "{\"body\":{\"var_a\":\"1\",\"var_b\":\"2\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(NotecardEnvVarManager_getGeneration(man) == 1);
+
+        // Nothing changed.
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(NotecardEnvVarManager_getGeneration(man) == 1);
+
+        response = "{\"body\":{\"var_a\":\"1\",\"var_b\":\"3\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(NotecardEnvVarManager_getGeneration(man) == 2);
+        CHECK(NotecardEnvVarManager_getVarGeneration(man, "var_a", &gen) ==
+              NEVM_SUCCESS);
+        CHECK(gen == 1);
+        CHECK(NotecardEnvVarManager_getVarGeneration(man, "var_b", &gen) ==
+              NEVM_SUCCESS);
+        CHECK(gen == 2);
+
+        // A removal is a change too.
+        response = "{\"body\":{\"var_b\":\"3\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(NotecardEnvVarManager_getGeneration(man) == 3);
+        CHECK(NotecardEnvVarManager_getVarGeneration(man, "var_a", &gen) ==
+              NEVM_SUCCESS);
+        CHECK(gen == 3);
+    }
+
+    SECTION("Defaults") {
+        const char *vals[] = {"1", "2"};
+        REQUIRE(NotecardEnvVarManager_setDefaults(man, vars, vals, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(NotecardEnvVarManager_getGeneration(man) == 0);
+        CHECK(NotecardEnvVarManager_getVarGeneration(man, "var_a", &gen) ==
+              NEVM_SUCCESS);
+        CHECK(gen == 0);
+
+        // Confirming a default isn't a change, but overriding one is.
+        response = "{\"body\":{\"var_a\":\"1\",\"var_b\":\"20\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(NotecardEnvVarManager_getGeneration(man) == 1);
+        CHECK(NotecardEnvVarManager_getVarGeneration(man, "var_a", &gen) ==
+              NEVM_SUCCESS);
+        CHECK(gen == 0);
+        CHECK(NotecardEnvVarManager_getVarGeneration(man, "var_b", &gen) ==
+              NEVM_SUCCESS);
+        CHECK(gen == 1);
+    }
+
+    SECTION("Failed fetch") {
+        response = "{\"err\":\"error\"}";
+        CHECK(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+              NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_getGeneration(man) == 0);
+    }
+
+    NotecardEnvVarManager_free(man);
+}
+
+}
+
+#endif // NEVM_TEST
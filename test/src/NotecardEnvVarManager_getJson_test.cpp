@@ -0,0 +1,164 @@
+/*!
+ * @file NotecardEnvVarManager_getJson_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <string.h>
+#include <string>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fff.h"
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+
+DEFINE_FFF_GLOBALS
+FAKE_VALUE_FUNC(J *, NoteRequestResponse, J *)
+
+#include "fetch_fixture.h"
+
+namespace
+{
+
+const char *cfg = "{\"ch3\":{\"gain\":2.5,\"mode\":\"diff\"},"
+                  "\"channels\":[{\"gain\":1},{\"gain\":4}]}";
+
+TEST_CASE("NotecardEnvVarManager_getJson")
+{
+    fetchFixtureReset();
+    JNUMBER number = -1;
+    char str[8];
+
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+    REQUIRE(NotecardEnvVarManager_setEnvVarCb(man,
+            [](const char *, const char *, void *) {}, NULL) == NEVM_SUCCESS);
+
+    SECTION("NULL parameters") {
+        CHECK(NotecardEnvVarManager_getJson(NULL, "sensor_cfg", "") == NULL);
+        CHECK(NotecardEnvVarManager_getJson(man, NULL, "") == NULL);
+        CHECK(NotecardEnvVarManager_getJson(man, "sensor_cfg", NULL) == NULL);
+        CHECK(NotecardEnvVarManager_getJsonNumber(man, "sensor_cfg", "",
+                NULL) == NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_getJsonString(man, "sensor_cfg", "", NULL,
+                0) == NEVM_FAILURE);
+    }
+
+    SECTION("An unknown variable") {
+        CHECK(NotecardEnvVarManager_getJson(man, "sensor_cfg", "") == NULL);
+    }
+
+    SECTION("Paths") {
+        REQUIRE(fetchVar(man, "sensor_cfg", cfg) == NEVM_SUCCESS);
+
+        J *root = NotecardEnvVarManager_getJson(man, "sensor_cfg", "");
+        REQUIRE(root != NULL);
+        CHECK(root->type & JObject);
+
+        CHECK(NotecardEnvVarManager_getJsonNumber(man, "sensor_cfg",
+                "ch3.gain", &number) == NEVM_SUCCESS);
+        CHECK(number == 2.5);
+        CHECK(NotecardEnvVarManager_getJsonNumber(man, "sensor_cfg",
+                "channels.1.gain", &number) == NEVM_SUCCESS);
+        CHECK(number == 4);
+        CHECK(NotecardEnvVarManager_getJsonString(man, "sensor_cfg",
+                "ch3.mode", str, sizeof(str)) == NEVM_SUCCESS);
+        CHECK(std::string(str) == "diff");
+
+        AND_WHEN("A path doesn't exist") {
+            const char *paths[] = {
+                "ch",
+                "ch3.gain.x",
+                "channels.2",
+                "channels.x",
+                "channels.-1",
+                "channels.01x",
+            };
+            for (const char *path : paths) {
+                CHECK(NotecardEnvVarManager_getJson(man, "sensor_cfg", path) ==
+                      NULL);
+            }
+        }
+
+        AND_WHEN("A node has the wrong type") {
+            CHECK(NotecardEnvVarManager_getJsonNumber(man, "sensor_cfg",
+                    "ch3.mode", &number) == NEVM_FAILURE);
+            CHECK(NotecardEnvVarManager_getJsonString(man, "sensor_cfg",
+                    "ch3.gain", str, sizeof(str)) == NEVM_FAILURE);
+        }
+
+        AND_WHEN("A string doesn't fit") {
+            CHECK(NotecardEnvVarManager_getJsonString(man, "sensor_cfg",
+                    "ch3.mode", str, 4) == NEVM_FAILURE);
+        }
+    }
+
+    SECTION("The tree is kept until the value changes") {
+        REQUIRE(fetchVar(man, "sensor_cfg", cfg) == NEVM_SUCCESS);
+        J *first = NotecardEnvVarManager_getJson(man, "sensor_cfg", "ch3");
+        REQUIRE(first != NULL);
+        CHECK(NotecardEnvVarManager_getJson(man, "sensor_cfg", "ch3") ==
+              first);
+
+        REQUIRE(fetchVar(man, "sensor_cfg", cfg) == NEVM_SUCCESS);
+        CHECK(NotecardEnvVarManager_getJson(man, "sensor_cfg", "ch3") ==
+              first);
+
+        REQUIRE(fetchVar(man, "sensor_cfg", "{\"ch3\":{\"gain\":3}}") ==
+                NEVM_SUCCESS);
+        CHECK(NotecardEnvVarManager_getJsonNumber(man, "sensor_cfg",
+                "ch3.gain", &number) == NEVM_SUCCESS);
+        CHECK(number == 3);
+    }
+
+    SECTION("Invalid JSON") {
+        REQUIRE(fetchVar(man, "sensor_cfg", "{\"ch3\":") == NEVM_SUCCESS);
+        CHECK(NotecardEnvVarManager_getJson(man, "sensor_cfg", "") == NULL);
+        CHECK(NotecardEnvVarManager_getJson(man, "sensor_cfg", "") == NULL);
+
+        AND_WHEN("The value changes to valid JSON") {
+            REQUIRE(fetchVar(man, "sensor_cfg", cfg) == NEVM_SUCCESS);
+
+            THEN("It's parsed") {
+                CHECK(NotecardEnvVarManager_getJson(man, "sensor_cfg", "ch3")
+                      != NULL);
+            }
+        }
+    }
+
+    SECTION("A removed variable") {
+        REQUIRE(fetchVar(man, "sensor_cfg", cfg) == NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_getJson(man, "sensor_cfg", "") != NULL);
+
+        REQUIRE(fetch(man, "{}") == NEVM_SUCCESS);
+        CHECK(NotecardEnvVarManager_getJson(man, "sensor_cfg", "") == NULL);
+    }
+
+    SECTION("A default") {
+        const char *vars[] = {"sensor_cfg"};
+        const char *vals[] = {cfg};
+        REQUIRE(NotecardEnvVarManager_setDefaults(man, vars, vals, 1) ==
+                NEVM_SUCCESS);
+
+        CHECK(NotecardEnvVarManager_getJsonNumber(man, "sensor_cfg",
+                "channels.0.gain", &number) == NEVM_SUCCESS);
+        CHECK(number == 1);
+    }
+
+    NotecardEnvVarManager_free(man);
+}
+
+}
+
+#endif // NEVM_TEST
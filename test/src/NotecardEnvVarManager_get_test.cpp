@@ -0,0 +1,105 @@
+/*!
+ * @file NotecardEnvVarManager_get_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <string.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fff.h"
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+
+DEFINE_FFF_GLOBALS
+FAKE_VALUE_FUNC(J *, NoteRequestResponse, J *)
+
+namespace
+{
+
+const char *vars[] = {"var_a", "var_b"};
+const size_t numVars = sizeof(vars) / sizeof(vars[0]);
+
+void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)var;
+    (void)val;
+    (void)ctx;
+}
+
+J *NoteRequestResponse_respond(J *req)
+{
+    JDelete(req);
+    return JParse("{\"body\":{\"var_a\":\"1\",\"var_b\":\"hello\"}}");
+}
+
+TEST_CASE("NotecardEnvVarManager_get")
+{
+    RESET_FAKE(NoteRequestResponse);
+    NoteSetFnDefault(malloc, free, NULL, NULL);
+    NoteRequestResponse_fake.custom_fake = NoteRequestResponse_respond;
+
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+    REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+            NEVM_SUCCESS);
+
+    char buf[16];
+    bool stale = true;
+
+    SECTION("NULL parameters") {
+        CHECK(NotecardEnvVarManager_get(NULL, "var_a", buf, sizeof(buf),
+                                        &stale) == NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_get(man, NULL, buf, sizeof(buf),
+                                        &stale) == NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_get(man, "var_a", NULL, sizeof(buf),
+                                        &stale) == NEVM_FAILURE);
+    }
+
+    SECTION("Unknown variable") {
+        CHECK(NotecardEnvVarManager_get(man, "var_a", buf, sizeof(buf),
+                                        &stale) == NEVM_FAILURE);
+    }
+
+    SECTION("Fetched values are fresh") {
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+
+        CHECK(NotecardEnvVarManager_get(man, "var_b", buf, sizeof(buf),
+                                        &stale) == NEVM_SUCCESS);
+        CHECK(strcmp(buf, "hello") == 0);
+        CHECK(!stale);
+
+        // The stale flag is optional.
+        CHECK(NotecardEnvVarManager_get(man, "var_a", buf, sizeof(buf),
+                                        NULL) == NEVM_SUCCESS);
+        CHECK(strcmp(buf, "1") == 0);
+    }
+
+    SECTION("Buffer too small") {
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+
+        CHECK(NotecardEnvVarManager_get(man, "var_b", buf, 5, &stale) ==
+              NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_get(man, "var_b", buf, 6, &stale) ==
+              NEVM_SUCCESS);
+    }
+
+    NotecardEnvVarManager_free(man);
+}
+
+}
+
+#endif // NEVM_TEST
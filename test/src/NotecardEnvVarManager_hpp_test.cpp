@@ -0,0 +1,104 @@
+/*!
+ * @file NotecardEnvVarManager_hpp_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "note-c/note.h"
+
+#include "NotecardEmulator.h"
+#include "NotecardEnvVarManager.hpp"
+
+namespace
+{
+
+static_assert(!std::is_copy_constructible_v<nevm::Manager>);
+static_assert(!std::is_copy_assignable_v<nevm::Manager>);
+static_assert(std::is_nothrow_move_constructible_v<nevm::Manager>);
+static_assert(std::is_nothrow_move_assignable_v<nevm::Manager>);
+
+TEST_CASE("nevm::Manager")
+{
+    NoteSetFnDefault(malloc, free, NotecardEmulator_delayMs,
+                     NotecardEmulator_getMs);
+
+    NotecardEmulator *emu = NotecardEmulator_alloc();
+    REQUIRE(emu != NULL);
+    NotecardEmulator_setHubVar(emu, "var_a", "1");
+    NotecardEmulator_setHubVar(emu, "var_b", "two");
+
+    nevm::Manager man;
+    REQUIRE(man);
+    auto requestFn = [emu](J *req) {
+        return NotecardEmulator_requestFn(req, emu);
+    };
+    REQUIRE(man.setRequestFn(requestFn) == NEVM_SUCCESS);
+
+    SECTION("Callables receive string views") {
+        std::map<std::string, std::string> fetched;
+        auto cb = [&fetched](std::string_view var, std::string_view val) {
+            fetched.emplace(var, val);
+        };
+        REQUIRE(man.setEnvVarCb(cb) == NEVM_SUCCESS);
+        REQUIRE(man.fetch() == NEVM_SUCCESS);
+
+        CHECK(fetched.size() == 2);
+        CHECK(fetched["var_a"] == "1");
+        CHECK(fetched["var_b"] == "two");
+        CHECK(man.getGeneration() == 1);
+        char buf[8];
+        CHECK(man.get("var_b", buf, sizeof(buf)) == NEVM_SUCCESS);
+        CHECK(std::string(buf) == "two");
+
+        SECTION("Removals") {
+            std::vector<std::string> removed;
+            auto removedCb = [&removed](std::string_view var) {
+                removed.emplace_back(var);
+            };
+            REQUIRE(man.setEnvVarRemovedCb(removedCb) == NEVM_SUCCESS);
+            NotecardEmulator_setHubVar(emu, "var_a", NULL);
+            REQUIRE(man.fetch() == NEVM_SUCCESS);
+            CHECK(removed == std::vector<std::string> {"var_a"});
+        }
+    }
+
+    SECTION("Moves transfer ownership") {
+        NotecardEnvVarManager *raw = man.get();
+        nevm::Manager moved(std::move(man));
+        CHECK(!man);
+        CHECK(moved.get() == raw);
+
+        nevm::Manager assigned;
+        assigned = std::move(moved);
+        CHECK(!moved);
+        CHECK(assigned.get() == raw);
+
+        NotecardEnvVarManager *released = assigned.release();
+        CHECK(released == raw);
+        CHECK(!assigned);
+        NotecardEnvVarManager_free(released);
+    }
+
+    NotecardEmulator_free(emu);
+}
+
+}
+
+#endif // NEVM_TEST
@@ -0,0 +1,371 @@
+/*!
+ * @file NotecardEnvVarManager_parse_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "NotecardEnvVarManager.h"
+
+namespace
+{
+
+uint64_t rngState = 88172645463325252ull;
+
+uint64_t rng(void)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 7;
+    rngState ^= rngState << 17;
+    return rngState;
+}
+
+NotecardEnvVarParseResult parseInt32(const char *str, int32_t *value)
+{
+    return NotecardEnvVarManager_parseInt32(str, strlen(str), value);
+}
+
+NotecardEnvVarParseResult parseUint32(const char *str, uint32_t *value)
+{
+    return NotecardEnvVarManager_parseUint32(str, strlen(str), value);
+}
+
+NotecardEnvVarParseResult parseFixed(const char *str, unsigned scale,
+                                     int32_t *value)
+{
+    return NotecardEnvVarManager_parseFixed(str, strlen(str), scale, value);
+}
+
+NotecardEnvVarParseResult parseFloat(const char *str, float *value)
+{
+    return NotecardEnvVarManager_parseFloat(str, strlen(str), value);
+}
+
+bool sameBits(float a, float b)
+{
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+SCENARIO("NotecardEnvVarManager_parseInt32")
+{
+    int32_t value = 7;
+
+    GIVEN("The limits of int32_t") {
+        THEN("They're parsed exactly") {
+            const char *str = "-2147483648";
+            NotecardEnvVarParseResult result = parseInt32(str, &value);
+            CHECK(result.ec == NEVM_PARSE_OK);
+            CHECK(result.ptr == str + strlen(str));
+            CHECK(value == INT32_MIN);
+
+            CHECK(parseInt32("2147483647", &value).ec == NEVM_PARSE_OK);
+            CHECK(value == INT32_MAX);
+            CHECK(parseInt32("-0", &value).ec == NEVM_PARSE_OK);
+            CHECK(value == 0);
+        }
+    }
+
+    GIVEN("Values just past the limits") {
+        THEN("NEVM_PARSE_RANGE is returned past all of the digits and the "
+             "value is left alone") {
+            const char *str = "2147483648,";
+            NotecardEnvVarParseResult result = parseInt32(str, &value);
+            CHECK(result.ec == NEVM_PARSE_RANGE);
+            CHECK(result.ptr == str + 10);
+            CHECK(value == 7);
+
+            CHECK(parseInt32("-2147483649", &value).ec == NEVM_PARSE_RANGE);
+            CHECK(parseInt32("99999999999999999999999", &value).ec ==
+                  NEVM_PARSE_RANGE);
+            CHECK(value == 7);
+        }
+    }
+
+    GIVEN("Input that doesn't start with a number") {
+        THEN("NEVM_PARSE_INVALID is returned at the start of the input") {
+            const char *strs[] = {"", "-", "+1", " 1", "x1", "--1"};
+            for (const char *str : strs) {
+                NotecardEnvVarParseResult result = parseInt32(str, &value);
+                CHECK(result.ec == NEVM_PARSE_INVALID);
+                CHECK(result.ptr == str);
+            }
+            CHECK(value == 7);
+        }
+    }
+
+    GIVEN("A number followed by other characters") {
+        THEN("Parsing stops after the number") {
+            const char *str = "-42abc";
+            NotecardEnvVarParseResult result = parseInt32(str, &value);
+            CHECK(result.ec == NEVM_PARSE_OK);
+            CHECK(result.ptr == str + 3);
+            CHECK(value == -42);
+        }
+    }
+
+    GIVEN("A length shorter than the string") {
+        THEN("Only that many characters are parsed") {
+            const char *str = "12345";
+            NotecardEnvVarParseResult result =
+                NotecardEnvVarManager_parseInt32(str, 3, &value);
+            CHECK(result.ec == NEVM_PARSE_OK);
+            CHECK(result.ptr == str + 3);
+            CHECK(value == 123);
+        }
+    }
+
+    GIVEN("Random values") {
+        THEN("They match strtol") {
+            char buf[16];
+            for (int i = 0; i < 100000; ++i) {
+                int32_t expected = (int32_t)(uint32_t)rng();
+                snprintf(buf, sizeof(buf), "%ld", (long)expected);
+                REQUIRE(parseInt32(buf, &value).ec == NEVM_PARSE_OK);
+                REQUIRE(value == expected);
+            }
+        }
+    }
+}
+
+SCENARIO("NotecardEnvVarManager_parseUint32")
+{
+    uint32_t value = 7;
+
+    GIVEN("The limits of uint32_t") {
+        THEN("They're parsed exactly") {
+            CHECK(parseUint32("4294967295", &value).ec == NEVM_PARSE_OK);
+            CHECK(value == UINT32_MAX);
+            CHECK(parseUint32("0000000000000000000001", &value).ec ==
+                  NEVM_PARSE_OK);
+            CHECK(value == 1);
+        }
+    }
+
+    GIVEN("A value just past the limit") {
+        THEN("NEVM_PARSE_RANGE is returned") {
+            const char *str = "4294967296";
+            NotecardEnvVarParseResult result = parseUint32(str, &value);
+            CHECK(result.ec == NEVM_PARSE_RANGE);
+            CHECK(result.ptr == str + strlen(str));
+            CHECK(value == 7);
+        }
+    }
+
+    GIVEN("A negative number") {
+        THEN("NEVM_PARSE_INVALID is returned") {
+            CHECK(parseUint32("-1", &value).ec == NEVM_PARSE_INVALID);
+            CHECK(value == 7);
+        }
+    }
+}
+
+SCENARIO("NotecardEnvVarManager_parseFixed")
+{
+    int32_t value = 7;
+
+    GIVEN("Numbers with fewer decimal places than the scale") {
+        THEN("They're scaled exactly") {
+            CHECK(parseFixed("-12.5", 2, &value).ec == NEVM_PARSE_OK);
+            CHECK(value == -1250);
+            CHECK(parseFixed("3", 3, &value).ec == NEVM_PARSE_OK);
+            CHECK(value == 3000);
+            CHECK(parseFixed(".5", 1, &value).ec == NEVM_PARSE_OK);
+            CHECK(value == 5);
+            CHECK(parseFixed("5.", 1, &value).ec == NEVM_PARSE_OK);
+            CHECK(value == 50);
+            CHECK(parseFixed("21474.83647", 5, &value).ec == NEVM_PARSE_OK);
+            CHECK(value == INT32_MAX);
+            CHECK(parseFixed("-2.147483648", 9, &value).ec == NEVM_PARSE_OK);
+            CHECK(value == INT32_MIN);
+        }
+    }
+
+    GIVEN("Numbers with more decimal places than the scale") {
+        THEN("They're rounded to nearest, with ties away from zero") {
+            CHECK(parseFixed("1.234", 2, &value).ec == NEVM_PARSE_OK);
+            CHECK(value == 123);
+            CHECK(parseFixed("1.235", 2, &value).ec == NEVM_PARSE_OK);
+            CHECK(value == 124);
+            CHECK(parseFixed("-1.235", 2, &value).ec == NEVM_PARSE_OK);
+            CHECK(value == -124);
+            CHECK(parseFixed("0.4999999", 0, &value).ec == NEVM_PARSE_OK);
+            CHECK(value == 0);
+        }
+    }
+
+    GIVEN("Numbers out of range once scaled") {
+        THEN("NEVM_PARSE_RANGE is returned") {
+            value = 7;
+            const char *str = "21474.83648";
+            NotecardEnvVarParseResult result = parseFixed(str, 5, &value);
+            CHECK(result.ec == NEVM_PARSE_RANGE);
+            CHECK(result.ptr == str + strlen(str));
+            CHECK(parseFixed("2147483647.5", 0, &value).ec ==
+                  NEVM_PARSE_RANGE);
+            CHECK(parseFixed("99999999999999999999", 9, &value).ec ==
+                  NEVM_PARSE_RANGE);
+            CHECK(value == 7);
+        }
+    }
+
+    GIVEN("Input with no digits, or a scale over 9") {
+        THEN("NEVM_PARSE_INVALID is returned") {
+            CHECK(parseFixed(".", 2, &value).ec == NEVM_PARSE_INVALID);
+            CHECK(parseFixed("-.", 2, &value).ec == NEVM_PARSE_INVALID);
+            CHECK(parseFixed("1", 10, &value).ec == NEVM_PARSE_INVALID);
+        }
+    }
+
+    GIVEN("A number with an exponent") {
+        THEN("Parsing stops at the exponent") {
+            const char *str = "1.5e3";
+            NotecardEnvVarParseResult result = parseFixed(str, 1, &value);
+            CHECK(result.ec == NEVM_PARSE_OK);
+            CHECK(result.ptr == str + 3);
+            CHECK(value == 15);
+        }
+    }
+}
+
+SCENARIO("NotecardEnvVarManager_parseFloat")
+{
+    float value = 7;
+
+    GIVEN("Simple decimals") {
+        THEN("They're parsed to the nearest float") {
+            CHECK(parseFloat("0.1", &value).ec == NEVM_PARSE_OK);
+            CHECK(value == 0.1f);
+            CHECK(parseFloat("-1.5e-3", &value).ec == NEVM_PARSE_OK);
+            CHECK(value == -1.5e-3f);
+            CHECK(parseFloat("1E+10", &value).ec == NEVM_PARSE_OK);
+            CHECK(value == 1e10f);
+            CHECK(parseFloat("-0", &value).ec == NEVM_PARSE_OK);
+            CHECK(sameBits(value, -0.0f));
+        }
+    }
+
+    GIVEN("The limits of float") {
+        THEN("They're parsed exactly, and beyond them the value overflows "
+             "or underflows") {
+            CHECK(parseFloat("3.40282347e38", &value).ec == NEVM_PARSE_OK);
+            CHECK(value == 3.40282347e38f);
+            CHECK(parseFloat("1.40129846e-45", &value).ec == NEVM_PARSE_OK);
+            CHECK(value == 1.40129846e-45f);
+            CHECK(parseFloat("1e-50", &value).ec == NEVM_PARSE_OK);
+            CHECK(value == 0);
+
+            value = 7;
+            const char *str = "3.5e38";
+            NotecardEnvVarParseResult result = parseFloat(str, &value);
+            CHECK(result.ec == NEVM_PARSE_RANGE);
+            CHECK(result.ptr == str + strlen(str));
+            CHECK(parseFloat("1e100000000000", &value).ec == NEVM_PARSE_RANGE);
+            CHECK(value == 7);
+        }
+    }
+
+    GIVEN("Infinities and NaNs") {
+        THEN("They're accepted in any case") {
+            const char *str = "-Infinity";
+            NotecardEnvVarParseResult result = parseFloat(str, &value);
+            CHECK(result.ec == NEVM_PARSE_OK);
+            CHECK(result.ptr == str + strlen(str));
+            CHECK(value == -INFINITY);
+
+            str = "infinite";
+            result = parseFloat(str, &value);
+            CHECK(result.ec == NEVM_PARSE_OK);
+            CHECK(result.ptr == str + 3);
+            CHECK(value == INFINITY);
+
+            CHECK(parseFloat("NaN", &value).ec == NEVM_PARSE_OK);
+            CHECK(isnan(value));
+        }
+    }
+
+    GIVEN("An exponent with no digits") {
+        THEN("Parsing stops before it") {
+            const char *str = "2e+";
+            NotecardEnvVarParseResult result = parseFloat(str, &value);
+            CHECK(result.ec == NEVM_PARSE_OK);
+            CHECK(result.ptr == str + 1);
+            CHECK(value == 2);
+        }
+    }
+
+    GIVEN("Input that doesn't start with a number") {
+        THEN("NEVM_PARSE_INVALID is returned at the start of the input") {
+            value = 7;
+            const char *strs[] = {"", ".", "-", "+1", "e5", "in"};
+            for (const char *str : strs) {
+                NotecardEnvVarParseResult result = parseFloat(str, &value);
+                CHECK(result.ec == NEVM_PARSE_INVALID);
+                CHECK(result.ptr == str);
+            }
+            CHECK(value == 7);
+        }
+    }
+
+    GIVEN("Random finite floats printed with 9 significant digits") {
+        THEN("They round-trip exactly") {
+            char buf[32];
+            for (int i = 0; i < 1000000; ++i) {
+                uint32_t bits = (uint32_t)rng();
+                float expected;
+                memcpy(&expected, &bits, sizeof(expected));
+                if (!isfinite(expected)) {
+                    continue;
+                }
+                int len = snprintf(buf, sizeof(buf), "%.9g", expected);
+                NotecardEnvVarParseResult result =
+                    NotecardEnvVarManager_parseFloat(buf, len, &value);
+                REQUIRE(result.ec == NEVM_PARSE_OK);
+                REQUIRE(result.ptr == buf + len);
+                REQUIRE(sameBits(value, expected));
+            }
+        }
+    }
+
+    GIVEN("Random decimals of up to 20 digits") {
+        THEN("They match strtof") {
+            char buf[48];
+            for (int i = 0; i < 1000000; ++i) {
+                int len = 0;
+                int digits = 1 + (int)(rng() % 20);
+                for (int d = 0; d < digits; ++d) {
+                    buf[len++] = (char)('0' + rng() % 10);
+                }
+                len += snprintf(buf + len, sizeof(buf) - len, "e%d",
+                                (int)(rng() % 100) - 60);
+                float expected = strtof(buf, NULL);
+                NotecardEnvVarParseResult result =
+                    NotecardEnvVarManager_parseFloat(buf, len, &value);
+                if (isinf(expected)) {
+                    REQUIRE(result.ec == NEVM_PARSE_RANGE);
+                } else {
+                    REQUIRE(result.ec == NEVM_PARSE_OK);
+                    REQUIRE(sameBits(value, expected));
+                }
+            }
+        }
+    }
+}
+
+}
+
+#endif // NEVM_TEST
@@ -0,0 +1,304 @@
+/*!
+ * @file NotecardEnvVarManager_pollEvent_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <atomic>
+#include <map>
+#include <string.h>
+#include <string>
+#include <thread>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fff.h"
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+
+DEFINE_FFF_GLOBALS
+FAKE_VALUE_FUNC(J *, NoteRequestResponse, J *)
+
+namespace
+{
+
+const char *vars[] = {"var_a", "var_b", "var_c"};
+const size_t numVars = sizeof(vars) / sizeof(vars[0]);
+std::string rspStr;
+size_t callbacks;
+
+void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)var;
+    (void)val;
+    (void)ctx;
+
+    ++callbacks;
+}
+
+J *NoteRequestResponse_respond(J *req)
+{
+    JDelete(req);
+    return JParse(rspStr.c_str());
+}
+
+TEST_CASE("NotecardEnvVarManager_pollEvent")
+{
+    RESET_FAKE(NoteRequestResponse);
+    NoteSetFnDefault(malloc, free, NULL, NULL);
+    NoteRequestResponse_fake.custom_fake = NoteRequestResponse_respond;
+    rspStr = "{\"body\":{\"var_a\":\"1\",\"var_b\":\"2\",\"var_c\":\"3\"}}";
+    callbacks = 0;
+
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+
+    NotecardEnvVarEvent event;
+    char name[16];
+    char val[16];
+
+    SECTION("Invalid parameters") {
+        CHECK(NotecardEnvVarManager_enableEvents(NULL, 8, 15) == NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_enableEvents(man, 0, 15) == NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_enableEvents(man, 100000, 15) ==
+              NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_enableEvents(man, 8, 100000) ==
+              NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_pollEvent(NULL, &event, name,
+                                              sizeof(name), val,
+                                              sizeof(val)) == NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_pollEvent(man, NULL, name, sizeof(name),
+                                              val, sizeof(val)) ==
+              NEVM_FAILURE);
+        // Events aren't enabled.
+        CHECK(NotecardEnvVarManager_pollEvent(man, &event, name,
+                                              sizeof(name), val,
+                                              sizeof(val)) == NEVM_FAILURE);
+
+        REQUIRE(NotecardEnvVarManager_enableEvents(man, 8, 15) == NEVM_SUCCESS);
+        CHECK(NotecardEnvVarManager_enableEvents(man, 8, 15) == NEVM_FAILURE);
+    }
+
+    SECTION("Events without a callback") {
+        REQUIRE(NotecardEnvVarManager_enableEvents(man, 8, 15) == NEVM_SUCCESS);
+        CHECK(NotecardEnvVarManager_pollEvent(man, &event, name,
+                                              sizeof(name), val,
+                                              sizeof(val)) == 0);
+
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        for (size_t i = 0; i < numVars; ++i) {
+            REQUIRE(NotecardEnvVarManager_pollEvent(man, &event, name,
+                    sizeof(name), val, sizeof(val)) == 1);
+            CHECK(event.id == i);
+            CHECK(!event.removed);
+            CHECK(event.generation == 1);
+            CHECK(strcmp(name, vars[i]) == 0);
+        }
+        CHECK(strcmp(val, "3") == 0);
+        CHECK(NotecardEnvVarManager_pollEvent(man, &event, name,
+                                              sizeof(name), val,
+                                              sizeof(val)) == 0);
+
+        // Unchanged values don't produce events.
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(NotecardEnvVarManager_pollEvent(man, &event, name,
+                                              sizeof(name), val,
+                                              sizeof(val)) == 0);
+    }
+
+    SECTION("Duplicate changes are coalesced") {
+        REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_enableEvents(man, 4, 15) == NEVM_SUCCESS);
+        for (int i = 0; i < 20; ++i) {
+            rspStr = "{\"body\":{\"var_a\":\"" + std::to_string(i) +
+                     "\",\"var_b\":\"" + std::to_string(i) + "\"}}";
+            REQUIRE(NotecardEnvVarManager_fetch(man, vars, 2) ==
+                    NEVM_SUCCESS);
+        }
+        CHECK(callbacks == 40);
+
+        // One event per variable, with the latest value.
+        for (size_t i = 0; i < 2; ++i) {
+            REQUIRE(NotecardEnvVarManager_pollEvent(man, &event, name,
+                    sizeof(name), val, sizeof(val)) == 1);
+            CHECK(strcmp(name, vars[i]) == 0);
+            CHECK(strcmp(val, "19") == 0);
+            CHECK(event.generation == 20);
+        }
+        CHECK(NotecardEnvVarManager_pollEvent(man, &event, name,
+                                              sizeof(name), val,
+                                              sizeof(val)) == 0);
+    }
+
+    SECTION("Removals") {
+        REQUIRE(NotecardEnvVarManager_enableEvents(man, 8, 15) == NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        while (NotecardEnvVarManager_pollEvent(man, &event, NULL, 0, NULL,
+                                               0) == 1) {
+        }
+
+        rspStr = "{\"body\":{\"var_a\":\"1\",\"var_c\":\"3\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_pollEvent(man, &event, name,
+                                                sizeof(name), val,
+                                                sizeof(val)) == 1);
+        CHECK(event.removed);
+        CHECK(event.id == 1);
+        CHECK(strcmp(name, "var_b") == 0);
+        CHECK(strcmp(val, "2") == 0);
+    }
+
+    SECTION("Buffer too small") {
+        REQUIRE(NotecardEnvVarManager_enableEvents(man, 8, 15) == NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, 1) == NEVM_SUCCESS);
+
+        // The event stays on the ring.
+        CHECK(NotecardEnvVarManager_pollEvent(man, &event, name, 5, val,
+                                              sizeof(val)) == NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_pollEvent(man, &event, name, 6, val,
+                                              sizeof(val)) == 1);
+    }
+
+    SECTION("The store doesn't grow past the reserved size") {
+        REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_enableEvents(man, 8, 15) == NEVM_SUCCESS);
+        rspStr = "{\"body\":{";
+        for (int i = 0; i < 10; ++i) {
+            rspStr += (i == 0 ? "\"v" : ",\"v") + std::to_string(i) +
+                      "\":\"x\"";
+        }
+        rspStr += "}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL) ==
+                NEVM_SUCCESS);
+
+        // All variables reach the callback, but only 8 are stored.
+        CHECK(callbacks == 10);
+        int events = 0;
+        while (NotecardEnvVarManager_pollEvent(man, &event, NULL, 0, NULL,
+                                               0) == 1) {
+            ++events;
+        }
+        CHECK(events == 8);
+
+        // Variables that didn't fit can't be read or given defaults.
+        CHECK(NotecardEnvVarManager_get(man, "v9", val, sizeof(val), NULL) ==
+              NEVM_FAILURE);
+        const char *defaultVars[] = {"w"};
+        const char *defaultVals[] = {"1"};
+        CHECK(NotecardEnvVarManager_setDefaults(man, defaultVars, defaultVals,
+                                                1) == NEVM_FAILURE);
+    }
+
+    SECTION("Values longer than reserved aren't stored") {
+        rspStr = "{\"body\":{\"var_a\":\"1\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, 1) == NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_enableEvents(man, 8, 7) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_pollEvent(man, &event, name,
+                                                sizeof(name), val,
+                                                sizeof(val)) == 0);
+
+        // A value stored before events were enabled can grow to the
+        // reserved length in place.
+        rspStr = "{\"body\":{\"var_a\":\"1234567\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, 1) == NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_pollEvent(man, &event, name,
+                                                sizeof(name), val,
+                                                sizeof(val)) == 1);
+        CHECK(strcmp(val, "1234567") == 0);
+
+        // Longer values of stored and new variables are refused, and the
+        // previous value is kept.
+        rspStr = "{\"body\":{\"var_a\":\"12345678\","
+                 "\"var_b\":\"12345678\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, 2) == NEVM_SUCCESS);
+        CHECK(NotecardEnvVarManager_pollEvent(man, &event, name, sizeof(name),
+                                              val, sizeof(val)) == 0);
+        CHECK(NotecardEnvVarManager_get(man, "var_a", val, sizeof(val),
+                                        NULL) == NEVM_SUCCESS);
+        CHECK(strcmp(val, "1234567") == 0);
+        CHECK(NotecardEnvVarManager_get(man, "var_b", val, sizeof(val),
+                                        NULL) == NEVM_FAILURE);
+    }
+
+    SECTION("Concurrent producer and consumer") {
+        const int numFetches = 2000;
+        REQUIRE(NotecardEnvVarManager_enableEvents(man, 4, 63) ==
+                NEVM_SUCCESS);
+
+        // Catch's assertions aren't thread-safe, so the consumer records what
+        // it saw and the checks are made once it's joined.
+        std::atomic<bool> done(false);
+        std::map<std::string, int> last;
+        int pollFailures = 0;
+        int outOfOrder = 0;
+        std::thread consumer([&]() {
+            NotecardEnvVarEvent ev;
+            char n[16];
+            // Values grow and shrink while the consumer reads them.
+            char v[64];
+            for (;;) {
+                bool finished = done.load();
+                int ret = NotecardEnvVarManager_pollEvent(man, &ev, n,
+                          sizeof(n), v, sizeof(v));
+                if (ret < 0) {
+                    ++pollFailures;
+                    break;
+                }
+                if (ret == 1) {
+                    // Values only increase, and every copy is consistent.
+                    int num = atoi(v + strspn(v, "x"));
+                    if (num < last[n]) {
+                        ++outOfOrder;
+                    }
+                    last[n] = num;
+                } else if (finished) {
+                    break;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+
+        int fetchFailures = 0;
+        for (int i = 1; i <= numFetches; ++i) {
+            std::string pad(i % 40, 'x');
+            rspStr = "{\"body\":{\"var_a\":\"" + pad + std::to_string(i) +
+                     "\",\"var_b\":\"" + std::to_string(i) + "\"}}";
+            fetchFailures += NotecardEnvVarManager_fetch(man, vars, 2) !=
+                             NEVM_SUCCESS;
+        }
+        done.store(true);
+        consumer.join();
+
+        CHECK(fetchFailures == 0);
+        CHECK(pollFailures == 0);
+        CHECK(outOfOrder == 0);
+
+        // The consumer always ends up with the final values.
+        CHECK(last["var_a"] == numFetches);
+        CHECK(last["var_b"] == numFetches);
+    }
+
+    NotecardEnvVarManager_free(man);
+}
+
+}
+
+#endif // NEVM_TEST
@@ -0,0 +1,447 @@
+/*!
+ * @file NotecardEnvVarManager_restore_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <map>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fff.h"
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarFileStorage.h"
+#include "NotecardEnvVarManager.h"
+
+DEFINE_FFF_GLOBALS
+FAKE_VALUE_FUNC(J *, NoteRequestResponse, J *)
+
+namespace
+{
+
+// RAM-backed storage with NOR flash semantics: two 256-byte sectors.
+const uint32_t sectorSize = 256;
+
+struct RamFlash {
+    uint8_t data[2 * sectorSize];
+    unsigned erases;
+    unsigned writes;
+    bool failWrites;
+};
+
+int ramRead(void *ctx, uint32_t offset, void *buf, size_t len)
+{
+    RamFlash *flash = (RamFlash *)ctx;
+    REQUIRE(offset + len <= sizeof(flash->data));
+    memcpy(buf, flash->data + offset, len);
+
+    return NEVM_SUCCESS;
+}
+
+int ramWrite(void *ctx, uint32_t offset, const void *buf, size_t len)
+{
+    RamFlash *flash = (RamFlash *)ctx;
+    REQUIRE(offset + len <= sizeof(flash->data));
+    if (flash->failWrites) {
+        return NEVM_FAILURE;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        flash->data[offset + i] &= ((const uint8_t *)buf)[i];
+    }
+    ++flash->writes;
+
+    return NEVM_SUCCESS;
+}
+
+int ramErase(void *ctx, uint32_t offset, size_t len)
+{
+    RamFlash *flash = (RamFlash *)ctx;
+    REQUIRE(offset + len <= sizeof(flash->data));
+    memset(flash->data + offset, 0xFF, len);
+    ++flash->erases;
+
+    return NEVM_SUCCESS;
+}
+
+const char *vars[] = {"var_a", "var_b"};
+const size_t numVars = sizeof(vars) / sizeof(vars[0]);
+const char *rspStr = "{\"body\":{\"var_a\":\"1\",\"var_b\":\"two\"}}";
+std::map<std::string, std::string> fetched;
+
+void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)ctx;
+
+    fetched[var] = val != NULL ? val : "(null)";
+}
+
+J *NoteRequestResponse_respond(J *req)
+{
+    JDelete(req);
+    return JParse(rspStr);
+}
+
+NotecardEnvVarManager *newManager(const NotecardEnvVarStorage *storage)
+{
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+    REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+            NEVM_SUCCESS);
+    REQUIRE(NotecardEnvVarManager_setStorage(man, storage) == NEVM_SUCCESS);
+
+    return man;
+}
+
+TEST_CASE("NotecardEnvVarManager_restore")
+{
+    RESET_FAKE(NoteRequestResponse);
+    NoteSetFnDefault(malloc, free, NULL, NULL);
+    NoteRequestResponse_fake.custom_fake = NoteRequestResponse_respond;
+    rspStr = "{\"body\":{\"var_a\":\"1\",\"var_b\":\"two\"}}";
+    fetched.clear();
+
+    RamFlash flash;
+    memset(flash.data, 0xFF, sizeof(flash.data));
+    flash.erases = 0;
+    flash.writes = 0;
+    flash.failWrites = false;
+    const NotecardEnvVarStorage storage = {
+        ramRead, ramWrite, ramErase, sizeof(flash.data), sectorSize, &flash
+    };
+
+    SECTION("NULL manager") {
+        CHECK(NotecardEnvVarManager_restore(NULL) == NEVM_FAILURE);
+    }
+
+    SECTION("No storage") {
+        NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+        REQUIRE(man != NULL);
+
+        CHECK(NotecardEnvVarManager_restore(man) == NEVM_FAILURE);
+
+        NotecardEnvVarManager_free(man);
+    }
+
+    SECTION("Erased storage") {
+        NotecardEnvVarManager *man = newManager(&storage);
+
+        CHECK(NotecardEnvVarManager_restore(man) == NEVM_FAILURE);
+        CHECK(fetched.empty());
+
+        NotecardEnvVarManager_free(man);
+    }
+
+    SECTION("Values fetched before a reboot are restored") {
+        NotecardEnvVarManager *man = newManager(&storage);
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        NotecardEnvVarManager_free(man);
+        CHECK(flash.erases == 1);
+
+        fetched.clear();
+        man = newManager(&storage);
+        CHECK(NotecardEnvVarManager_restore(man) == NEVM_SUCCESS);
+        CHECK(fetched.size() == 2);
+        CHECK(fetched["var_a"] == "1");
+        CHECK(fetched["var_b"] == "two");
+        CHECK(NoteRequestResponse_fake.call_count == 1);
+
+        NotecardEnvVarManager_free(man);
+    }
+
+    SECTION("Restored values are stale until a fetch confirms them") {
+        NotecardEnvVarManager *man = newManager(&storage);
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        NotecardEnvVarManager_free(man);
+
+        man = newManager(&storage);
+        REQUIRE(NotecardEnvVarManager_restore(man) == NEVM_SUCCESS);
+        char buf[8];
+        bool stale = false;
+        CHECK(NotecardEnvVarManager_get(man, "var_a", buf, sizeof(buf),
+                                        &stale) == NEVM_SUCCESS);
+        CHECK(stale);
+
+        // Nothing changed, so the callback isn't called again.
+        fetched.clear();
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(fetched.empty());
+        CHECK(NotecardEnvVarManager_get(man, "var_a", buf, sizeof(buf),
+                                        &stale) == NEVM_SUCCESS);
+        CHECK(!stale);
+
+        NotecardEnvVarManager_free(man);
+    }
+
+    SECTION("Only changed values are appended") {
+        NotecardEnvVarManager *man = newManager(&storage);
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        const unsigned writes = flash.writes;
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(flash.writes == writes);
+
+        rspStr = "{\"body\":{\"var_a\":\"1\","
+                 "\"var_b\":\"a much longer value\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(flash.erases == 1);
+        CHECK(flash.writes > writes);
+        NotecardEnvVarManager_free(man);
+
+        fetched.clear();
+        man = newManager(&storage);
+        CHECK(NotecardEnvVarManager_restore(man) == NEVM_SUCCESS);
+        CHECK(fetched.size() == 2);
+        CHECK(fetched["var_a"] == "1");
+        CHECK(fetched["var_b"] == "a much longer value");
+
+        NotecardEnvVarManager_free(man);
+    }
+
+    SECTION("A full sector is compacted into the other sector") {
+        NotecardEnvVarManager *man = newManager(&storage);
+        std::string rsp;
+        for (int i = 0; i < 40; ++i) {
+            rsp = "{\"body\":{\"var_a\":\"" + std::to_string(i) +
+                  "\",\"var_b\":\"two\"}}";
+            rspStr = rsp.c_str();
+            REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                    NEVM_SUCCESS);
+        }
+        CHECK(flash.erases > 1);
+        CHECK(flash.erases < 10);
+        NotecardEnvVarManager_free(man);
+
+        fetched.clear();
+        man = newManager(&storage);
+        CHECK(NotecardEnvVarManager_restore(man) == NEVM_SUCCESS);
+        CHECK(fetched.size() == 2);
+        CHECK(fetched["var_a"] == "39");
+        CHECK(fetched["var_b"] == "two");
+
+        NotecardEnvVarManager_free(man);
+    }
+
+    SECTION("Corrupt record") {
+        NotecardEnvVarManager *man = newManager(&storage);
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        NotecardEnvVarManager_free(man);
+
+        // Flip a bit in the name of the second record (var_b). The first
+        // record (var_a) starts after the 8-byte sector header and takes 16
+        // bytes.
+        flash.data[8 + 16 + 8] ^= 0x01;
+
+        fetched.clear();
+        man = newManager(&storage);
+        CHECK(NotecardEnvVarManager_restore(man) == NEVM_SUCCESS);
+        CHECK(fetched.size() == 1);
+        CHECK(fetched["var_a"] == "1");
+
+        // The next save compacts rather than appending after the bad record.
+        rspStr = "{\"body\":{\"var_a\":\"1\",\"var_b\":\"three\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(flash.erases == 2);
+        NotecardEnvVarManager_free(man);
+
+        fetched.clear();
+        man = newManager(&storage);
+        CHECK(NotecardEnvVarManager_restore(man) == NEVM_SUCCESS);
+        CHECK(fetched["var_b"] == "three");
+
+        NotecardEnvVarManager_free(man);
+    }
+
+    SECTION("Interrupted save") {
+        NotecardEnvVarManager *man = newManager(&storage);
+        flash.failWrites = true;
+
+        // A failed save doesn't fail the fetch.
+        CHECK(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+              NEVM_SUCCESS);
+        CHECK(fetched.size() == 2);
+        NotecardEnvVarManager_free(man);
+
+        fetched.clear();
+        man = newManager(&storage);
+        CHECK(NotecardEnvVarManager_restore(man) == NEVM_FAILURE);
+        CHECK(fetched.empty());
+
+        NotecardEnvVarManager_free(man);
+    }
+
+    SECTION("Removals are persisted") {
+        NotecardEnvVarManager *man = newManager(&storage);
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        rspStr = "{\"body\":{\"var_b\":\"two\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        NotecardEnvVarManager_free(man);
+
+        fetched.clear();
+        man = newManager(&storage);
+        CHECK(NotecardEnvVarManager_restore(man) == NEVM_SUCCESS);
+        CHECK(fetched.size() == 1);
+        CHECK(fetched["var_b"] == "two");
+        char buf[8];
+        CHECK(NotecardEnvVarManager_get(man, "var_a", buf, sizeof(buf), NULL)
+              == NEVM_FAILURE);
+
+        NotecardEnvVarManager_free(man);
+    }
+
+    SECTION("A removed variable can be set again") {
+        NotecardEnvVarManager *man = newManager(&storage);
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        rspStr = "{\"body\":{\"var_b\":\"two\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        rspStr = "{\"body\":{\"var_a\":\"3\",\"var_b\":\"two\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        NotecardEnvVarManager_free(man);
+
+        fetched.clear();
+        man = newManager(&storage);
+        CHECK(NotecardEnvVarManager_restore(man) == NEVM_SUCCESS);
+        CHECK(fetched.size() == 2);
+        CHECK(fetched["var_a"] == "3");
+        CHECK(fetched["var_b"] == "two");
+
+        NotecardEnvVarManager_free(man);
+    }
+
+    SECTION("Saves before a restore append to the journal") {
+        NotecardEnvVarManager *man = newManager(&storage);
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        NotecardEnvVarManager_free(man);
+
+        man = newManager(&storage);
+        rspStr = "{\"body\":{\"var_a\":\"5\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, 1) == NEVM_SUCCESS);
+        CHECK(flash.erases == 1);
+        NotecardEnvVarManager_free(man);
+
+        fetched.clear();
+        man = newManager(&storage);
+        CHECK(NotecardEnvVarManager_restore(man) == NEVM_SUCCESS);
+        CHECK(fetched.size() == 2);
+        CHECK(fetched["var_a"] == "5");
+        CHECK(fetched["var_b"] == "two");
+
+        NotecardEnvVarManager_free(man);
+    }
+
+    SECTION("Compacting before a restore keeps the persisted values") {
+        NotecardEnvVarManager *man = newManager(&storage);
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        NotecardEnvVarManager_free(man);
+
+        // Fill the sector with var_a without restoring var_b.
+        man = newManager(&storage);
+        std::string rsp;
+        for (int i = 0; i < 20; ++i) {
+            rsp = "{\"body\":{\"var_a\":\"" + std::to_string(i) + "\"}}";
+            rspStr = rsp.c_str();
+            REQUIRE(NotecardEnvVarManager_fetch(man, vars, 1) ==
+                    NEVM_SUCCESS);
+        }
+        CHECK(flash.erases > 1);
+        NotecardEnvVarManager_free(man);
+
+        fetched.clear();
+        man = newManager(&storage);
+        CHECK(NotecardEnvVarManager_restore(man) == NEVM_SUCCESS);
+        CHECK(fetched.size() == 2);
+        CHECK(fetched["var_a"] == "19");
+        CHECK(fetched["var_b"] == "two");
+
+        NotecardEnvVarManager_free(man);
+    }
+
+    SECTION("Defaults aren't persisted") {
+        const char *defaults[] = {"1", "2"};
+        NotecardEnvVarManager *man = newManager(&storage);
+        REQUIRE(NotecardEnvVarManager_setDefaults(man, vars, defaults,
+                numVars) == NEVM_SUCCESS);
+        rspStr = "{\"body\":{\"var_b\":\"two\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        NotecardEnvVarManager_free(man);
+
+        fetched.clear();
+        man = newManager(&storage);
+        CHECK(NotecardEnvVarManager_restore(man) == NEVM_SUCCESS);
+        CHECK(fetched.size() == 1);
+        CHECK(fetched["var_b"] == "two");
+
+        NotecardEnvVarManager_free(man);
+    }
+
+    SECTION("Values too big for a sector") {
+        std::string big = "{\"body\":{\"var_a\":\"" + std::string(600, 'x') +
+                          "\"}}";
+        rspStr = big.c_str();
+        NotecardEnvVarManager *man = newManager(&storage);
+
+        CHECK(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+              NEVM_SUCCESS);
+        CHECK(flash.erases == 0);
+
+        NotecardEnvVarManager_free(man);
+    }
+
+    SECTION("File-backed storage") {
+        char path[] = "nevm_restore_test.bin";
+        remove(path);
+
+        NotecardEnvVarFileStorage *fs = NotecardEnvVarFileStorage_open(path,
+                                        1024, 512);
+        REQUIRE(fs != NULL);
+        NotecardEnvVarManager *man = newManager(
+                                         NotecardEnvVarFileStorage_storage(fs));
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        NotecardEnvVarManager_free(man);
+        REQUIRE(NotecardEnvVarFileStorage_close(fs) == NEVM_SUCCESS);
+
+        fetched.clear();
+        fs = NotecardEnvVarFileStorage_open(path, 1024, 512);
+        REQUIRE(fs != NULL);
+        man = newManager(NotecardEnvVarFileStorage_storage(fs));
+        CHECK(NotecardEnvVarManager_restore(man) == NEVM_SUCCESS);
+        CHECK(fetched["var_a"] == "1");
+        CHECK(fetched["var_b"] == "two");
+        NotecardEnvVarManager_free(man);
+        CHECK(NotecardEnvVarFileStorage_close(fs) == NEVM_SUCCESS);
+
+        remove(path);
+    }
+}
+
+}
+
+#endif // NEVM_TEST
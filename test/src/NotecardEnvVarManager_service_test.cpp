@@ -0,0 +1,213 @@
+/*!
+ * @file NotecardEnvVarManager_service_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fff.h"
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+
+DEFINE_FFF_GLOBALS
+FAKE_VALUE_FUNC(J *, NoteRequestResponse, J *)
+
+namespace
+{
+
+const char *vars[] = {"var_a", "var_b", "var_c"};
+const size_t numVars = sizeof(vars) / sizeof(vars[0]);
+std::string rspStr;
+std::map<std::string, std::string> fetched;
+size_t callbacks;
+std::vector<std::string> removed;
+uint32_t nowUs;
+
+void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)ctx;
+
+    fetched[var] = val;
+    ++callbacks;
+    // Each callback takes 10 us.
+    nowUs += 10;
+}
+
+void removedCb(const char *var, void *ctx)
+{
+    (void)ctx;
+
+    removed.push_back(var);
+}
+
+uint32_t microsFn(void)
+{
+    return nowUs;
+}
+
+J *NoteRequestResponse_respond(J *req)
+{
+    JDelete(req);
+    return JParse(rspStr.c_str());
+}
+
+std::string manyVars(int num, const char *val)
+{
+    std::string rsp = "{\"body\":{";
+    for (int i = 0; i < num; ++i) {
+        rsp += (i == 0 ? "\"v" : ",\"v") + std::to_string(i) + "\":\"" + val +
+               "\"";
+    }
+    rsp += "}}";
+
+    return rsp;
+}
+
+TEST_CASE("NotecardEnvVarManager_service")
+{
+    RESET_FAKE(NoteRequestResponse);
+    NoteSetFnDefault(malloc, free, NULL, NULL);
+    NoteRequestResponse_fake.custom_fake = NoteRequestResponse_respond;
+    rspStr = "{\"body\":{\"var_a\":\"1\",\"var_b\":\"2\",\"var_c\":\"3\"}}";
+    fetched.clear();
+    callbacks = 0;
+    removed.clear();
+    nowUs = 1000;
+
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+    REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+            NEVM_SUCCESS);
+    REQUIRE(NotecardEnvVarManager_setEnvVarRemovedCb(man, removedCb, NULL) ==
+            NEVM_SUCCESS);
+
+    SECTION("Invalid parameters") {
+        CHECK(NotecardEnvVarManager_service(NULL) == NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_setDispatchBudget(NULL, 1, 0, NULL) ==
+              NEVM_FAILURE);
+        // A time budget needs a clock.
+        CHECK(NotecardEnvVarManager_setDispatchBudget(man, 1, 100, NULL) ==
+              NEVM_FAILURE);
+    }
+
+    SECTION("Nothing queued without a budget") {
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(callbacks == 3);
+        CHECK(NotecardEnvVarManager_service(man) == 0);
+        CHECK(callbacks == 3);
+    }
+
+    SECTION("Changes are delivered in slices") {
+        REQUIRE(NotecardEnvVarManager_setDispatchBudget(man, 2, 0, NULL) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(callbacks == 0);
+
+        CHECK(NotecardEnvVarManager_service(man) == 1);
+        CHECK(callbacks == 2);
+        CHECK(NotecardEnvVarManager_service(man) == 0);
+        CHECK(callbacks == 3);
+        CHECK(fetched["var_a"] == "1");
+        CHECK(fetched["var_b"] == "2");
+        CHECK(fetched["var_c"] == "3");
+
+        CHECK(NotecardEnvVarManager_service(man) == 0);
+        CHECK(callbacks == 3);
+    }
+
+    SECTION("Queued changes are coalesced") {
+        REQUIRE(NotecardEnvVarManager_setDispatchBudget(man, 2, 0, NULL) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(NotecardEnvVarManager_service(man) == 1);
+
+        // var_c changes while still queued, so it's delivered once.
+        rspStr = "{\"body\":{\"var_a\":\"10\",\"var_b\":\"2\",\"var_c\":\"30\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(NotecardEnvVarManager_service(man) == 1);
+        CHECK(NotecardEnvVarManager_service(man) == 0);
+        CHECK(callbacks == 5);
+        CHECK(fetched["var_a"] == "10");
+        CHECK(fetched["var_c"] == "30");
+    }
+
+    SECTION("Removals are queued") {
+        REQUIRE(NotecardEnvVarManager_setDispatchBudget(man, 8, 0, NULL) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(NotecardEnvVarManager_service(man) == 0);
+
+        rspStr = "{\"body\":{\"var_a\":\"1\",\"var_c\":\"3\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(removed.empty());
+        CHECK(NotecardEnvVarManager_service(man) == 0);
+        CHECK(removed == std::vector<std::string>({"var_b"}));
+        CHECK(callbacks == 5);
+    }
+
+    SECTION("Time budget") {
+        REQUIRE(NotecardEnvVarManager_setDispatchBudget(man, 100, 25,
+                microsFn) == NEVM_SUCCESS);
+        rspStr = manyVars(10, "x");
+        REQUIRE(NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL) ==
+                NEVM_SUCCESS);
+
+        // Three 10 us callbacks exceed the 25 us budget.
+        CHECK(NotecardEnvVarManager_service(man) == 7);
+        CHECK(callbacks == 3);
+
+        // Removing the budget delivers everything.
+        REQUIRE(NotecardEnvVarManager_setDispatchBudget(man, 0, 0, NULL) ==
+                NEVM_SUCCESS);
+        CHECK(NotecardEnvVarManager_service(man) == 0);
+        CHECK(callbacks == 10);
+    }
+
+    SECTION("Queue survives store growth") {
+        REQUIRE(NotecardEnvVarManager_setDispatchBudget(man, 16, 0, NULL) ==
+                NEVM_SUCCESS);
+        rspStr = manyVars(5, "x");
+        REQUIRE(NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL) ==
+                NEVM_SUCCESS);
+
+        // The store grows past 64 entries with the first 5 still queued.
+        rspStr = manyVars(70, "x");
+        REQUIRE(NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL) ==
+                NEVM_SUCCESS);
+        int remaining = 70;
+        while (remaining > 0) {
+            int next = NotecardEnvVarManager_service(man);
+            CHECK(next == (remaining > 16 ? remaining - 16 : 0));
+            remaining = next;
+        }
+        CHECK(callbacks == 70);
+        CHECK(fetched.size() == 70);
+    }
+
+    NotecardEnvVarManager_free(man);
+}
+
+}
+
+#endif // NEVM_TEST
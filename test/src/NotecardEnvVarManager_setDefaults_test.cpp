@@ -0,0 +1,136 @@
+/*!
+ * @file NotecardEnvVarManager_setDefaults_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <map>
+#include <string.h>
+#include <string>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fff.h"
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+
+DEFINE_FFF_GLOBALS
+FAKE_VALUE_FUNC(J *, NoteRequestResponse, J *)
+
+namespace
+{
+
+const char *vars[] = {"var_a", "var_b", "var_c"};
+const char *defaults[] = {"1", "2", "3"};
+const size_t numVars = sizeof(vars) / sizeof(vars[0]);
+std::map<std::string, std::string> fetched;
+
+void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)ctx;
+
+    fetched[var] = val;
+}
+
+J *NoteRequestResponse_respond(J *req)
+{
+    JDelete(req);
+    return JParse("{\"body\":{\"var_a\":\"1\",\"var_b\":\"20\"}}");
+}
+
+TEST_CASE("NotecardEnvVarManager_setDefaults")
+{
+    RESET_FAKE(NoteRequestResponse);
+    NoteSetFnDefault(malloc, free, NULL, NULL);
+    NoteRequestResponse_fake.custom_fake = NoteRequestResponse_respond;
+    fetched.clear();
+
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+    REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+            NEVM_SUCCESS);
+
+    char buf[16];
+    bool stale = false;
+
+    SECTION("NULL parameters") {
+        CHECK(NotecardEnvVarManager_setDefaults(NULL, vars, defaults,
+                                                numVars) == NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_setDefaults(man, NULL, defaults,
+                                                numVars) == NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_setDefaults(man, vars, NULL, numVars) ==
+              NEVM_FAILURE);
+    }
+
+    SECTION("Defaults are served stale before the first fetch") {
+        REQUIRE(NotecardEnvVarManager_setDefaults(man, vars, defaults,
+                numVars) == NEVM_SUCCESS);
+
+        CHECK(NotecardEnvVarManager_get(man, "var_b", buf, sizeof(buf),
+                                        &stale) == NEVM_SUCCESS);
+        CHECK(strcmp(buf, "2") == 0);
+        CHECK(stale);
+        CHECK(fetched.empty());
+        CHECK(NoteRequestResponse_fake.call_count == 0);
+    }
+
+    SECTION("Fetch only reports values that differ from the defaults") {
+        REQUIRE(NotecardEnvVarManager_setDefaults(man, vars, defaults,
+                numVars) == NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+
+        CHECK(fetched.size() == 1);
+        CHECK(fetched["var_b"] == "20");
+
+        // Confirmed and changed values are fresh.
+        CHECK(NotecardEnvVarManager_get(man, "var_a", buf, sizeof(buf),
+                                        &stale) == NEVM_SUCCESS);
+        CHECK(strcmp(buf, "1") == 0);
+        CHECK(!stale);
+        CHECK(NotecardEnvVarManager_get(man, "var_b", buf, sizeof(buf),
+                                        &stale) == NEVM_SUCCESS);
+        CHECK(strcmp(buf, "20") == 0);
+        CHECK(!stale);
+
+        // Not on the Notecard, so still the default.
+        CHECK(NotecardEnvVarManager_get(man, "var_c", buf, sizeof(buf),
+                                        &stale) == NEVM_SUCCESS);
+        CHECK(strcmp(buf, "3") == 0);
+        CHECK(stale);
+
+        // Once fresh, every fetched value is reported as before.
+        fetched.clear();
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(fetched.size() == 2);
+    }
+
+    SECTION("Defaults don't replace known values") {
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_setDefaults(man, vars, defaults,
+                numVars) == NEVM_SUCCESS);
+
+        CHECK(NotecardEnvVarManager_get(man, "var_b", buf, sizeof(buf),
+                                        &stale) == NEVM_SUCCESS);
+        CHECK(strcmp(buf, "20") == 0);
+        CHECK(!stale);
+    }
+
+    NotecardEnvVarManager_free(man);
+}
+
+}
+
+#endif // NEVM_TEST
@@ -0,0 +1,71 @@
+/*!
+ * @file NotecardEnvVarManager_setDeviceId_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <string>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "NotecardEnvVarManager.h"
+
+namespace
+{
+
+TEST_CASE("NotecardEnvVarManager_setDeviceId")
+{
+    NoteSetFnDefault(malloc, free, NULL, NULL);
+
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+    const volatile uint32_t *flags = NotecardEnvVarManager_getFlags(man);
+    REQUIRE(flags != NULL);
+
+    SECTION("NULL parameters") {
+        CHECK(NotecardEnvVarManager_setDeviceId(NULL, "dev:1") ==
+              NEVM_FAILURE);
+        CHECK(NotecardEnvVarManager_setDeviceId(man, NULL) == NEVM_FAILURE);
+    }
+
+    SECTION("Rollout rules are evaluated again") {
+        const char *vars[] = {"flag.new_modem", "flag.everyone"};
+        const char *vals[] = {"99.99%", "100%"};
+        REQUIRE(NotecardEnvVarManager_bindFlag(man, "flag.new_modem", 0) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_bindFlag(man, "flag.everyone", 1) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_setDefaults(man, vars, vals, 2) ==
+                NEVM_SUCCESS);
+
+        THEN("Only 100% sets a flag until the device ID is set") {
+            CHECK(*flags == NEVM_FLAG(1));
+        }
+
+        // With 99.99%, 1 in 10,000 devices doesn't get the flag.
+        int numSet = 0;
+        for (int i = 0; i < 10; ++i) {
+            std::string id = "dev:" + std::to_string(i);
+            REQUIRE(NotecardEnvVarManager_setDeviceId(man, id.c_str()) ==
+                    NEVM_SUCCESS);
+            numSet += (*flags & NEVM_FLAG(0)) != 0;
+            CHECK(*flags & NEVM_FLAG(1));
+        }
+        CHECK(numSet >= 9);
+    }
+
+    NotecardEnvVarManager_free(man);
+}
+
+}
+
+#endif // NEVM_TEST
@@ -0,0 +1,123 @@
+/*!
+ * @file NotecardEnvVarManager_setEnvVarLenCb_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <map>
+#include <string>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fff.h"
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+
+DEFINE_FFF_GLOBALS
+FAKE_VALUE_FUNC(J *, NoteRequestResponse, J *)
+
+namespace
+{
+
+std::map<std::string, std::string> lenFetched;
+int userCbCalls;
+uint32_t userCtx = 42;
+
+void userLenCb(const char *var, size_t varLen, const char *val, size_t valLen,
+               void *ctx)
+{
+    CHECK(ctx == &userCtx);
+    CHECK(strlen(var) == varLen);
+    CHECK(strlen(val) == valLen);
+
+    lenFetched[std::string(var, varLen)] = std::string(val, valLen);
+}
+
+void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)var;
+    (void)val;
+    (void)ctx;
+
+    ++userCbCalls;
+}
+
+J *NoteRequestResponse_respond(J *req)
+{
+    JDelete(req);
+    return JParse("{\"body\":{\"var_a\":\"1\",\"var_long\":\"twelve chars\"}}");
+}
+
+TEST_CASE("NotecardEnvVarManager_setEnvVarLenCb")
+{
+    RESET_FAKE(NoteRequestResponse);
+    NoteSetFnDefault(malloc, free, NULL, NULL);
+    NoteRequestResponse_fake.custom_fake = NoteRequestResponse_respond;
+    lenFetched.clear();
+    userCbCalls = 0;
+
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+
+    SECTION("NULL manager") {
+        CHECK(NotecardEnvVarManager_setEnvVarLenCb(NULL, userLenCb, &userCtx)
+              == NEVM_FAILURE);
+    }
+
+    SECTION("Replaces the callback without lengths") {
+        REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_setEnvVarLenCb(man, userLenCb,
+                &userCtx) == NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL) ==
+                NEVM_SUCCESS);
+
+        CHECK(userCbCalls == 0);
+        CHECK(lenFetched.size() == 2);
+        CHECK(lenFetched["var_a"] == "1");
+        CHECK(lenFetched["var_long"] == "twelve chars");
+    }
+
+    SECTION("Deferred dispatch") {
+        REQUIRE(NotecardEnvVarManager_setEnvVarLenCb(man, userLenCb,
+                &userCtx) == NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_setDispatchBudget(man, 1, 0, NULL) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL) ==
+                NEVM_SUCCESS);
+        CHECK(lenFetched.empty());
+
+        while (NotecardEnvVarManager_service(man) > 0) {
+        }
+        CHECK(lenFetched.size() == 2);
+        CHECK(lenFetched["var_long"] == "twelve chars");
+    }
+
+    SECTION("Setting the callback without lengths replaces it") {
+        REQUIRE(NotecardEnvVarManager_setEnvVarLenCb(man, userLenCb,
+                &userCtx) == NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL) ==
+                NEVM_SUCCESS);
+
+        CHECK(userCbCalls == 2);
+        CHECK(lenFetched.empty());
+    }
+
+    NotecardEnvVarManager_free(man);
+}
+
+}
+
+#endif // NEVM_TEST
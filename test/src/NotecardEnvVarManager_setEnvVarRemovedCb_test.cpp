@@ -0,0 +1,166 @@
+/*!
+ * @file NotecardEnvVarManager_setEnvVarRemovedCb_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fff.h"
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+
+DEFINE_FFF_GLOBALS
+FAKE_VALUE_FUNC(J *, NoteRequestResponse, J *)
+
+namespace
+{
+
+const char *vars[] = {"var_a", "var_b", "var_c"};
+const size_t numVars = sizeof(vars) / sizeof(vars[0]);
+const char *rspStr;
+std::map<std::string, std::string> fetched;
+std::vector<std::string> removed;
+uint32_t removedCtx = 42;
+
+void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)ctx;
+
+    fetched[var] = val;
+}
+
+void removedCb(const char *var, void *ctx)
+{
+    CHECK(ctx == &removedCtx);
+
+    removed.push_back(var);
+}
+
+J *NoteRequestResponse_respond(J *req)
+{
+    JDelete(req);
+    return JParse(rspStr);
+}
+
+TEST_CASE("NotecardEnvVarManager_setEnvVarRemovedCb")
+{
+    RESET_FAKE(NoteRequestResponse);
+    NoteSetFnDefault(malloc, free, NULL, NULL);
+    NoteRequestResponse_fake.custom_fake = NoteRequestResponse_respond;
+    rspStr = "{\"body\":{\"var_a\":\"1\",\"var_b\":\"2\",\"var_c\":\"3\"}}";
+    fetched.clear();
+    removed.clear();
+
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+    REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+            NEVM_SUCCESS);
+
+    SECTION("NULL manager") {
+        CHECK(NotecardEnvVarManager_setEnvVarRemovedCb(NULL, removedCb,
+                &removedCtx) == NEVM_FAILURE);
+    }
+
+    SECTION("Requested variables missing from the response are removed") {
+        REQUIRE(NotecardEnvVarManager_setEnvVarRemovedCb(man, removedCb,
+                &removedCtx) == NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(removed.empty());
+
+        rspStr = "{\"body\":{\"var_a\":\"1\",\"var_c\":\"3\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        REQUIRE(removed.size() == 1);
+        CHECK(removed[0] == "var_b");
+        char buf[8];
+        CHECK(NotecardEnvVarManager_get(man, "var_b", buf, sizeof(buf),
+                                        NULL) == NEVM_FAILURE);
+
+        // Reported once, not on every fetch.
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(removed.size() == 1);
+
+        // A removed variable can come back, even with its old value.
+        fetched.clear();
+        rspStr = "{\"body\":{\"var_a\":\"1\",\"var_b\":\"2\",\"var_c\":\"3\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(fetched["var_b"] == "2");
+        CHECK(NotecardEnvVarManager_get(man, "var_b", buf, sizeof(buf),
+                                        NULL) == NEVM_SUCCESS);
+    }
+
+    SECTION("Variables that weren't requested aren't removed") {
+        REQUIRE(NotecardEnvVarManager_setEnvVarRemovedCb(man, removedCb,
+                &removedCtx) == NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+
+        rspStr = "{\"body\":{\"var_a\":\"1\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, 1) == NEVM_SUCCESS);
+        CHECK(removed.empty());
+    }
+
+    SECTION("Fetching all variables detects any removal") {
+        REQUIRE(NotecardEnvVarManager_setEnvVarRemovedCb(man, removedCb,
+                &removedCtx) == NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL) ==
+                NEVM_SUCCESS);
+
+        rspStr = "{\"body\":{\"var_b\":\"2\"}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL) ==
+                NEVM_SUCCESS);
+        CHECK(removed == std::vector<std::string>({"var_a", "var_c"}));
+    }
+
+    SECTION("Defaults aren't removed") {
+        const char *defaults[] = {"1", "2", "3"};
+        REQUIRE(NotecardEnvVarManager_setEnvVarRemovedCb(man, removedCb,
+                &removedCtx) == NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_setDefaults(man, vars, defaults,
+                numVars) == NEVM_SUCCESS);
+
+        rspStr = "{\"body\":{}}";
+        REQUIRE(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+                NEVM_SUCCESS);
+        CHECK(removed.empty());
+    }
+
+    SECTION("Removal detection across store growth") {
+        REQUIRE(NotecardEnvVarManager_setEnvVarRemovedCb(man, removedCb,
+                &removedCtx) == NEVM_SUCCESS);
+
+        std::string rsp = "{\"body\":{";
+        for (int i = 0; i < 40; ++i) {
+            rsp += (i == 0 ? "\"v" : ",\"v") + std::to_string(i) + "\":\"x\"";
+        }
+        rsp += "}}";
+        rspStr = rsp.c_str();
+        REQUIRE(NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL) ==
+                NEVM_SUCCESS);
+        CHECK(removed.empty());
+    }
+
+    NotecardEnvVarManager_free(man);
+}
+
+}
+
+#endif // NEVM_TEST
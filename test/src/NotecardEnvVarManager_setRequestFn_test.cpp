@@ -0,0 +1,125 @@
+/*!
+ * @file NotecardEnvVarManager_setRequestFn_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <string.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "note-c/note.h"
+
+#include "NotecardEmulator.h"
+#include "NotecardEnvVarManager.h"
+
+namespace
+{
+
+void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)var;
+    (void)val;
+    (void)ctx;
+}
+
+void checkVal(NotecardEnvVarManager *man, const char *expected)
+{
+    char buf[16];
+    REQUIRE(NotecardEnvVarManager_get(man, "var_a", buf, sizeof(buf), NULL) ==
+            NEVM_SUCCESS);
+    CHECK(strcmp(buf, expected) == 0);
+}
+
+uint32_t requests(const NotecardEmulator *emu)
+{
+    NotecardEmulatorStats stats;
+    NotecardEmulator_getStats(emu, &stats);
+
+    return stats.requests;
+}
+
+TEST_CASE("NotecardEnvVarManager_setRequestFn")
+{
+    NoteSetFnDefault(malloc, free, NotecardEmulator_delayMs,
+                     NotecardEmulator_getMs);
+
+    // One Notecard on note-c's global transport and one for each manager.
+    NotecardEmulator *global = NotecardEmulator_alloc();
+    NotecardEmulator *emuA = NotecardEmulator_alloc();
+    NotecardEmulator *emuB = NotecardEmulator_alloc();
+    REQUIRE(global != NULL);
+    REQUIRE(emuA != NULL);
+    REQUIRE(emuB != NULL);
+    NotecardEmulator_setHubVar(global, "var_a", "global");
+    NotecardEmulator_setHubVar(emuA, "var_a", "a");
+    NotecardEmulator_setHubVar(emuB, "var_a", "b");
+    NotecardEmulator_attach(global);
+
+    NotecardEnvVarManager *manA = NotecardEnvVarManager_alloc();
+    NotecardEnvVarManager *manB = NotecardEnvVarManager_alloc();
+    REQUIRE(manA != NULL);
+    REQUIRE(manB != NULL);
+    REQUIRE(NotecardEnvVarManager_setEnvVarCb(manA, userCb, NULL) ==
+            NEVM_SUCCESS);
+    REQUIRE(NotecardEnvVarManager_setEnvVarCb(manB, userCb, NULL) ==
+            NEVM_SUCCESS);
+
+    SECTION("NULL manager") {
+        CHECK(NotecardEnvVarManager_setRequestFn(NULL,
+                NotecardEmulator_requestFn, emuA) == NEVM_FAILURE);
+    }
+
+    SECTION("Each manager uses its own Notecard") {
+        REQUIRE(NotecardEnvVarManager_setRequestFn(manA,
+                NotecardEmulator_requestFn, emuA) == NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_setRequestFn(manB,
+                NotecardEmulator_requestFn, emuB) == NEVM_SUCCESS);
+
+        REQUIRE(NotecardEnvVarManager_fetch(manA, NULL, NEVM_ENV_VAR_ALL) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_fetch(manB, NULL, NEVM_ENV_VAR_ALL) ==
+                NEVM_SUCCESS);
+        checkVal(manA, "a");
+        checkVal(manB, "b");
+        CHECK(requests(emuA) == 1);
+        CHECK(requests(emuB) == 1);
+        CHECK(requests(global) == 0);
+
+        SECTION("Clearing the request function restores note-c's") {
+            REQUIRE(NotecardEnvVarManager_setRequestFn(manA, NULL, NULL) ==
+                    NEVM_SUCCESS);
+            REQUIRE(NotecardEnvVarManager_fetch(manA, NULL, NEVM_ENV_VAR_ALL)
+                    == NEVM_SUCCESS);
+            checkVal(manA, "global");
+            CHECK(requests(global) == 1);
+            CHECK(requests(emuA) == 1);
+        }
+    }
+
+    SECTION("A failed transaction fails the fetch") {
+        REQUIRE(NotecardEnvVarManager_setRequestFn(manA,
+                NotecardEmulator_requestFn, NULL) == NEVM_SUCCESS);
+        CHECK(NotecardEnvVarManager_fetch(manA, NULL, NEVM_ENV_VAR_ALL) ==
+              NEVM_FAILURE);
+    }
+
+    NotecardEnvVarManager_free(manA);
+    NotecardEnvVarManager_free(manB);
+    NotecardEmulator_free(global);
+    NotecardEmulator_free(emuA);
+    NotecardEmulator_free(emuB);
+}
+
+}
+
+#endif // NEVM_TEST
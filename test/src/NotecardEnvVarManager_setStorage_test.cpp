@@ -0,0 +1,104 @@
+/*!
+ * @file NotecardEnvVarManager_setStorage_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+
+namespace
+{
+
+int storageRead(void *ctx, uint32_t offset, void *buf, size_t len)
+{
+    (void)ctx;
+    (void)offset;
+    (void)buf;
+    (void)len;
+
+    return NEVM_SUCCESS;
+}
+
+int storageWrite(void *ctx, uint32_t offset, const void *buf, size_t len)
+{
+    (void)ctx;
+    (void)offset;
+    (void)buf;
+    (void)len;
+
+    return NEVM_SUCCESS;
+}
+
+int storageErase(void *ctx, uint32_t offset, size_t len)
+{
+    (void)ctx;
+    (void)offset;
+    (void)len;
+
+    return NEVM_SUCCESS;
+}
+
+TEST_CASE("NotecardEnvVarManager_setStorage")
+{
+    NoteSetFnDefault(malloc, free, NULL, NULL);
+
+    NotecardEnvVarStorage storage = {
+        storageRead, storageWrite, storageErase, 4096, 1024, NULL
+    };
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+
+    SECTION("NULL manager") {
+        CHECK(NotecardEnvVarManager_setStorage(NULL, &storage) ==
+              NEVM_FAILURE);
+    }
+
+    SECTION("Valid storage") {
+        CHECK(NotecardEnvVarManager_setStorage(man, &storage) ==
+              NEVM_SUCCESS);
+    }
+
+    SECTION("NULL storage disables persistence") {
+        CHECK(NotecardEnvVarManager_setStorage(man, NULL) == NEVM_SUCCESS);
+    }
+
+    SECTION("Missing function") {
+        storage.erase = NULL;
+
+        CHECK(NotecardEnvVarManager_setStorage(man, &storage) ==
+              NEVM_FAILURE);
+    }
+
+    SECTION("Fewer than two sectors") {
+        storage.size = 1024;
+
+        CHECK(NotecardEnvVarManager_setStorage(man, &storage) ==
+              NEVM_FAILURE);
+    }
+
+    SECTION("Sector too small") {
+        storage.sectorSize = 16;
+
+        CHECK(NotecardEnvVarManager_setStorage(man, &storage) ==
+              NEVM_FAILURE);
+    }
+
+    NotecardEnvVarManager_free(man);
+}
+
+}
+
+#endif // NEVM_TEST
@@ -0,0 +1,137 @@
+/*!
+ * @file NotecardEnvVarManager_setTraceCb_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <string>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fff.h"
+
+#include "note-c/note.h"
+
+#include "NotecardEnvVarManager.h"
+
+DEFINE_FFF_GLOBALS
+FAKE_VALUE_FUNC(J *, NoteRequestResponse, J *)
+
+namespace
+{
+
+const char *vars[] = {"var_a", "var_b"};
+const size_t numVars = sizeof(vars) / sizeof(vars[0]);
+std::vector<std::string> events;
+uint32_t traceCtx = 42;
+
+void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)val;
+    (void)ctx;
+
+    events.push_back(std::string("user ") + var);
+}
+
+void traceCb(int phase, bool begin, const char *detail, void *ctx)
+{
+    CHECK(ctx == &traceCtx);
+
+    std::string event = std::to_string(phase) + (begin ? " B" : " E");
+    if (detail != NULL) {
+        event += std::string(" ") + detail;
+    }
+    events.push_back(event);
+}
+
+J *NoteRequestResponse_deleteReq(J *req)
+{
+    JDelete(req);
+    return JParse("{\"body\":{\"var_a\":\"1\",\"var_b\":\"2\"}}");
+}
+
+J *NoteRequestResponse_fail(J *req)
+{
+    JDelete(req);
+    return NULL;
+}
+
+TEST_CASE("NotecardEnvVarManager_setTraceCb")
+{
+    RESET_FAKE(NoteRequestResponse);
+    NoteSetFnDefault(malloc, free, NULL, NULL);
+    events.clear();
+
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+    REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+            NEVM_SUCCESS);
+
+    SECTION("NULL manager") {
+        CHECK(NotecardEnvVarManager_setTraceCb(NULL, traceCb, &traceCtx) ==
+              NEVM_FAILURE);
+    }
+
+    SECTION("Phases are traced in order") {
+        NoteRequestResponse_fake.custom_fake = NoteRequestResponse_deleteReq;
+        REQUIRE(NotecardEnvVarManager_setTraceCb(man, traceCb, &traceCtx) ==
+                NEVM_SUCCESS);
+
+        CHECK(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+              NEVM_SUCCESS);
+
+        const std::vector<std::string> expected = {
+            std::to_string(NEVM_TRACE_FETCH) + " B",
+            std::to_string(NEVM_TRACE_BUILD_REQUEST) + " B",
+            std::to_string(NEVM_TRACE_BUILD_REQUEST) + " E",
+            std::to_string(NEVM_TRACE_TRANSACTION) + " B",
+            std::to_string(NEVM_TRACE_TRANSACTION) + " E",
+            std::to_string(NEVM_TRACE_BODY) + " B",
+            std::to_string(NEVM_TRACE_CALLBACK) + " B var_a",
+            "user var_a",
+            std::to_string(NEVM_TRACE_CALLBACK) + " E var_a",
+            std::to_string(NEVM_TRACE_CALLBACK) + " B var_b",
+            "user var_b",
+            std::to_string(NEVM_TRACE_CALLBACK) + " E var_b",
+            std::to_string(NEVM_TRACE_BODY) + " E",
+            std::to_string(NEVM_TRACE_FETCH) + " E",
+        };
+        CHECK(events == expected);
+    }
+
+    SECTION("Failed fetches still close the fetch phase") {
+        NoteRequestResponse_fake.custom_fake = NoteRequestResponse_fail;
+        REQUIRE(NotecardEnvVarManager_setTraceCb(man, traceCb, &traceCtx) ==
+                NEVM_SUCCESS);
+
+        CHECK(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+              NEVM_FAILURE);
+        REQUIRE(!events.empty());
+        CHECK(events.back() == std::to_string(NEVM_TRACE_FETCH) + " E");
+    }
+
+    SECTION("NULL trace callback disables tracing") {
+        NoteRequestResponse_fake.custom_fake = NoteRequestResponse_deleteReq;
+        REQUIRE(NotecardEnvVarManager_setTraceCb(man, NULL, NULL) ==
+                NEVM_SUCCESS);
+
+        CHECK(NotecardEnvVarManager_fetch(man, vars, numVars) ==
+              NEVM_SUCCESS);
+        CHECK(events.size() == numVars);
+    }
+
+    NotecardEnvVarManager_free(man);
+}
+
+}
+
+#endif // NEVM_TEST
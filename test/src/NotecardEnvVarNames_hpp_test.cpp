@@ -0,0 +1,151 @@
+/*!
+ * @file NotecardEnvVarNames_hpp_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "note-c/note.h"
+
+#include "NotecardEmulator.h"
+#include "NotecardEnvVarManager.hpp"
+#include "NotecardEnvVarNames.hpp"
+
+namespace
+{
+
+constexpr nevm::NameTable names("interval", "threshold", "mode");
+
+// Names sharing long prefixes, and enough of them to fill several buckets.
+constexpr nevm::NameTable many(
+    "sensor_0_rate", "sensor_1_rate", "sensor_2_rate", "sensor_3_rate",
+    "sensor_4_rate", "sensor_5_rate", "sensor_6_rate", "sensor_7_rate",
+    "sensor_0_gain", "sensor_1_gain", "sensor_2_gain", "sensor_3_gain",
+    "sensor_4_gain", "sensor_5_gain", "sensor_6_gain", "sensor_7_gain",
+    "a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l", "m", "n",
+    "o", "p", "q", "r", "s", "t", "u", "v", "w", "x", "y", "z", "", "aa");
+
+// Lookups run at compile time.
+static_assert(names.size() == 3);
+static_assert(names.find("interval") == 0);
+static_assert(names.find("mode") == 2);
+static_assert(names.find("modes") == -1);
+static_assert(names.find("") == -1);
+static_assert(many.find("sensor_7_gain") == 15);
+static_assert(many.find("") == 42);
+static_assert(std::is_trivially_destructible_v<decltype(names)>);
+
+int dispatch(std::string_view var)
+{
+    switch (names.find(var)) {
+    case names.index("interval"):
+        return 1;
+    case names.index("threshold"):
+        return 2;
+    case names.index("mode"):
+        return 3;
+    default:
+        return 0;
+    }
+}
+
+TEST_CASE("nevm::NameTable")
+{
+    SECTION("Every name maps to its index") {
+        for (size_t i = 0; i < many.size(); ++i) {
+            CHECK(many.find(many.vars()[i]) == (int)i);
+            CHECK(std::string(many.name(i)) == many.vars()[i]);
+        }
+    }
+
+    SECTION("Unknown names aren't found") {
+        const char *unknown[] = {"sensor_8_rate", "sensor_0_rat", "ab", "A",
+                                 "sensor_0_rate_", "interval"
+                                };
+        for (const char *name : unknown) {
+            CHECK(many.find(name) == -1);
+        }
+    }
+
+    SECTION("Switch dispatch") {
+        CHECK(dispatch("interval") == 1);
+        CHECK(dispatch("threshold") == 2);
+        CHECK(dispatch("mode") == 3);
+        CHECK(dispatch("other") == 0);
+        // Only the first 4 bytes are the name.
+        CHECK(dispatch(std::string_view("modest", 4)) == 3);
+    }
+
+    SECTION("Generated dispatch") {
+        std::string got;
+        auto on = [&got](const char *which) {
+            return [&got, which](std::string_view val) {
+                got = std::string(which) + "=" + std::string(val);
+            };
+        };
+        auto onInterval = on("interval");
+        auto onThreshold = on("threshold");
+        auto onMode = on("mode");
+
+        CHECK(names.dispatch("threshold", "5", onInterval, onThreshold,
+                             onMode));
+        CHECK(got == "threshold=5");
+        CHECK(names.dispatch("mode", "fast", onInterval, onThreshold, onMode));
+        CHECK(got == "mode=fast");
+
+        got.clear();
+        CHECK_FALSE(names.dispatch("other", "1", onInterval, onThreshold,
+                                   onMode));
+        CHECK(got.empty());
+    }
+
+    SECTION("Fetching the table's names") {
+        NoteSetFnDefault(malloc, free, NotecardEmulator_delayMs,
+                         NotecardEmulator_getMs);
+        NotecardEmulator *emu = NotecardEmulator_alloc();
+        REQUIRE(emu != NULL);
+        NotecardEmulator_setHubVar(emu, "interval", "60");
+        NotecardEmulator_setHubVar(emu, "mode", "fast");
+        NotecardEmulator_setHubVar(emu, "unrelated", "x");
+
+        nevm::Manager man;
+        REQUIRE(man);
+        auto requestFn = [emu](J *req) {
+            return NotecardEmulator_requestFn(req, emu);
+        };
+        REQUIRE(man.setRequestFn(requestFn) == NEVM_SUCCESS);
+        std::string vals[names.size()];
+        auto cb = [&vals](std::string_view var, std::string_view val) {
+            int idx = names.find(var);
+            REQUIRE(idx >= 0);
+            vals[idx] = val;
+        };
+        REQUIRE(man.setEnvVarCb(cb) == NEVM_SUCCESS);
+        REQUIRE(man.fetch(names.vars(), names.size()) == NEVM_SUCCESS);
+
+        CHECK(vals[names.index("interval")] == "60");
+        CHECK(vals[names.index("threshold")].empty());
+        CHECK(vals[names.index("mode")] == "fast");
+
+        NotecardEmulator_free(emu);
+    }
+}
+
+}
+
+#endif // NEVM_TEST
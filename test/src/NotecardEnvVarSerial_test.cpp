@@ -0,0 +1,138 @@
+/*!
+ * @file NotecardEnvVarSerial_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "note-c/note.h"
+
+#include "NotecardEmulator.h"
+#include "NotecardEmulatorPty.h"
+#include "NotecardEnvVarSerial.h"
+
+namespace
+{
+
+void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)var;
+    (void)val;
+    (void)ctx;
+}
+
+TEST_CASE("NotecardEnvVarSerial_requestFn")
+{
+    NoteSetFnDefault(malloc, free, NotecardEnvVarSerial_delayMs,
+                     NotecardEnvVarSerial_getMs);
+
+    SECTION("Invalid parameters") {
+        CHECK(NotecardEnvVarSerial_requestFn(NULL, NULL) == NULL);
+        CHECK(NotecardEnvVarSerial_requestFn(JCreateObject(), NULL) == NULL);
+    }
+
+    SECTION("Two Notecards") {
+        const char *vals[2] = {"a", "b"};
+        NotecardEmulator *emus[2];
+        NotecardEmulatorPty *ptys[2];
+        int fds[2];
+        NotecardEnvVarManager *mans[2];
+        for (size_t i = 0; i < 2; ++i) {
+            emus[i] = NotecardEmulator_alloc();
+            REQUIRE(emus[i] != NULL);
+            NotecardEmulator_setHubVar(emus[i], "var_a", vals[i]);
+            ptys[i] = NotecardEmulatorPty_start(emus[i]);
+            REQUIRE(ptys[i] != NULL);
+            fds[i] = NotecardEnvVarSerial_openDevice(
+                         NotecardEmulatorPty_path(ptys[i]), 115200);
+            REQUIRE(fds[i] >= 0);
+            mans[i] = NotecardEnvVarManager_alloc();
+            REQUIRE(mans[i] != NULL);
+            REQUIRE(NotecardEnvVarManager_setEnvVarCb(mans[i], userCb, NULL)
+                    == NEVM_SUCCESS);
+            REQUIRE(NotecardEnvVarManager_setRequestFn(mans[i],
+                    NotecardEnvVarSerial_requestFn, &fds[i]) == NEVM_SUCCESS);
+        }
+
+        for (size_t i = 0; i < 2; ++i) {
+            REQUIRE(NotecardEnvVarManager_fetch(mans[i], NULL,
+                                                NEVM_ENV_VAR_ALL)
+                    == NEVM_SUCCESS);
+        }
+        char buf[8];
+        for (size_t i = 0; i < 2; ++i) {
+            CHECK(NotecardEnvVarManager_get(mans[i], "var_a", buf, sizeof(buf),
+                                            NULL) == NEVM_SUCCESS);
+            CHECK(strcmp(buf, vals[i]) == 0);
+        }
+
+        for (size_t i = 0; i < 2; ++i) {
+            NotecardEnvVarManager_free(mans[i]);
+            close(fds[i]);
+            NotecardEmulatorPty_stop(ptys[i]);
+            NotecardEmulator_free(emus[i]);
+        }
+    }
+
+    SECTION("Responses longer than a read") {
+        // Several kilobytes, which arrive over many reads.
+        const int numVars = 100;
+        const std::string val(40, 'v');
+        NotecardEmulator *emu = NotecardEmulator_alloc();
+        REQUIRE(emu != NULL);
+        for (int i = 0; i < numVars; ++i) {
+            std::string var = "var_" + std::to_string(i);
+            NotecardEmulator_setHubVar(emu, var.c_str(), val.c_str());
+        }
+        NotecardEmulatorPty *pty = NotecardEmulatorPty_start(emu);
+        REQUIRE(pty != NULL);
+        int fd = NotecardEnvVarSerial_openDevice(NotecardEmulatorPty_path(pty),
+                 115200);
+        REQUIRE(fd >= 0);
+        NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+        REQUIRE(man != NULL);
+        REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+                NEVM_SUCCESS);
+        REQUIRE(NotecardEnvVarManager_setRequestFn(man,
+                NotecardEnvVarSerial_requestFn, &fd) == NEVM_SUCCESS);
+
+        // Fetch twice, so that the second transaction starts after the
+        // first one's line.
+        for (int i = 0; i < 2; ++i) {
+            REQUIRE(NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL) ==
+                    NEVM_SUCCESS);
+        }
+        char buf[64];
+        for (int i = 0; i < numVars; ++i) {
+            std::string var = "var_" + std::to_string(i);
+            CHECK(NotecardEnvVarManager_get(man, var.c_str(), buf, sizeof(buf),
+                                            NULL) == NEVM_SUCCESS);
+            CHECK(val == buf);
+        }
+
+        NotecardEnvVarManager_free(man);
+        close(fd);
+        NotecardEmulatorPty_stop(pty);
+        NotecardEmulator_free(emu);
+    }
+}
+
+}
+
+#endif // NEVM_TEST
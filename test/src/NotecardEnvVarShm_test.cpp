@@ -0,0 +1,135 @@
+/*!
+ * @file NotecardEnvVarShm_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "NotecardEnvVarShm.h"
+
+namespace
+{
+
+const char *name = "/nevm_shm_test";
+
+TEST_CASE("NotecardEnvVarShm")
+{
+    NotecardEnvVarShm_unlink(name);
+
+    NotecardEnvVarShm *writer = NotecardEnvVarShm_create(name, 4096);
+    REQUIRE(writer != NULL);
+    NotecardEnvVarShm *reader = NotecardEnvVarShm_open(name);
+    REQUIRE(reader != NULL);
+
+    char buf[32];
+    uint32_t generation = 0;
+
+    SECTION("Nothing published yet") {
+        CHECK(NotecardEnvVarShm_getGeneration(reader) == 0);
+        CHECK(NotecardEnvVarShm_get(reader, "var_a", buf, sizeof(buf), NULL)
+              == NEVM_FAILURE);
+    }
+
+    SECTION("Publish and get") {
+        const char *vars[] = {"var_a", "var_b", "var_c"};
+        const char *vals[] = {"1", "two", ""};
+        REQUIRE(NotecardEnvVarShm_publish(writer, vars, vals, 3, 7) ==
+                NEVM_SUCCESS);
+        CHECK(NotecardEnvVarShm_getGeneration(reader) == 7);
+
+        CHECK(NotecardEnvVarShm_get(reader, "var_b", buf, sizeof(buf),
+                                    &generation) == NEVM_SUCCESS);
+        CHECK(strcmp(buf, "two") == 0);
+        CHECK(generation == 7);
+        CHECK(NotecardEnvVarShm_get(reader, "var_c", buf, sizeof(buf), NULL)
+              == NEVM_SUCCESS);
+        CHECK(buf[0] == '\0');
+        CHECK(NotecardEnvVarShm_get(reader, "var_missing", buf, sizeof(buf),
+                                    NULL) == NEVM_FAILURE);
+
+        // The value and its terminator don't fit.
+        CHECK(NotecardEnvVarShm_get(reader, "var_b", buf, 3, NULL) ==
+              NEVM_FAILURE);
+
+        // A new snapshot replaces the old one entirely.
+        const char *newVars[] = {"var_a"};
+        const char *newVals[] = {"10"};
+        REQUIRE(NotecardEnvVarShm_publish(writer, newVars, newVals, 1, 8) ==
+                NEVM_SUCCESS);
+        CHECK(NotecardEnvVarShm_get(reader, "var_a", buf, sizeof(buf),
+                                    &generation) == NEVM_SUCCESS);
+        CHECK(strcmp(buf, "10") == 0);
+        CHECK(generation == 8);
+        CHECK(NotecardEnvVarShm_get(reader, "var_b", buf, sizeof(buf), NULL)
+              == NEVM_FAILURE);
+    }
+
+    SECTION("Snapshot too big for the segment") {
+        static char big[4096];
+        memset(big, 'x', sizeof(big) - 1);
+        const char *vars[] = {"var_a"};
+        const char *vals[] = {big};
+        CHECK(NotecardEnvVarShm_publish(writer, vars, vals, 1, 1) ==
+              NEVM_FAILURE);
+    }
+
+    SECTION("Readers never see a torn snapshot") {
+        // The writer keeps republishing, with every value tagged with the
+        // snapshot's generation.
+        std::atomic<bool> done(false);
+        std::thread thread([&]() {
+            const char *vars[] = {"var_a", "var_b"};
+            char valA[16];
+            char valB[16];
+            const char *vals[] = {valA, valB};
+            for (uint32_t gen = 1; gen <= 20000; ++gen) {
+                snprintf(valA, sizeof(valA), "v%u", (unsigned)gen);
+                snprintf(valB, sizeof(valB), "v%u", (unsigned)gen);
+                NotecardEnvVarShm_publish(writer, vars, vals, 2, gen);
+            }
+            done = true;
+        });
+
+        size_t reads = 0;
+        size_t mismatches = 0;
+        while (!done) {
+            if (NotecardEnvVarShm_get(reader, "var_b", buf, sizeof(buf),
+                                      &generation) != NEVM_SUCCESS) {
+                continue;
+            }
+            char expected[16];
+            snprintf(expected, sizeof(expected), "v%u", (unsigned)generation);
+            if (strcmp(buf, expected) != 0) {
+                ++mismatches;
+            }
+            ++reads;
+        }
+        thread.join();
+
+        CHECK(mismatches == 0);
+        CHECK(reads > 0);
+    }
+
+    NotecardEnvVarShm_close(reader);
+    NotecardEnvVarShm_close(writer);
+    NotecardEnvVarShm_unlink(name);
+}
+
+}
+
+#endif // NEVM_TEST
@@ -0,0 +1,180 @@
+/*!
+ * @file NotecardEnvVarSocket_test.cpp
+ *
+ * Written by the Blues Inc. team.
+ *
+ * Copyright (c) 2023 Blues Inc. MIT License. Use of this source code is
+ * governed by licenses granted by the copyright holder including that found in
+ * the
+ * <a href="https://github.com/blues/note-c/blob/master/LICENSE">LICENSE</a>
+ * file.
+ *
+ */
+
+#ifdef NEVM_TEST
+
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "note-c/note.h"
+
+#include "NotecardEmulator.h"
+#include "NotecardEnvVarSocket.h"
+
+namespace
+{
+
+const char *path = "nevm_socket_test.sock";
+
+void userCb(const char *var, const char *val, void *ctx)
+{
+    (void)var;
+    (void)val;
+    (void)ctx;
+}
+
+int connectClient(void)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    REQUIRE(fd >= 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    REQUIRE(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+
+    return fd;
+}
+
+// Serve the socket until the client has received a reply ending with end.
+std::string roundTrip(NotecardEnvVarSocket *sock, int fd, const char *req,
+                      const char *end)
+{
+    if (req != NULL) {
+        REQUIRE(send(fd, req, strlen(req), 0) == (ssize_t)strlen(req));
+    }
+
+    std::string rsp;
+    for (int i = 0; i < 100; ++i) {
+        REQUIRE(NotecardEnvVarSocket_poll(sock, 10) == NEVM_SUCCESS);
+        char buf[256];
+        ssize_t n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n > 0) {
+            rsp.append(buf, (size_t)n);
+        }
+        size_t endLen = strlen(end);
+        if (rsp.size() >= endLen &&
+                rsp.compare(rsp.size() - endLen, endLen, end) == 0) {
+            break;
+        }
+    }
+
+    return rsp;
+}
+
+TEST_CASE("NotecardEnvVarSocket")
+{
+    NoteSetFnDefault(malloc, free, NotecardEmulator_delayMs,
+                     NotecardEmulator_getMs);
+
+    NotecardEmulator *emu = NotecardEmulator_alloc();
+    REQUIRE(emu != NULL);
+    NotecardEmulator_setHubVar(emu, "var_a", "1");
+    NotecardEmulator_setHubVar(emu, "var_b", "two\nlines");
+    NotecardEmulator_attach(emu);
+
+    NotecardEnvVarManager *man = NotecardEnvVarManager_alloc();
+    REQUIRE(man != NULL);
+    REQUIRE(NotecardEnvVarManager_setEnvVarCb(man, userCb, NULL) ==
+            NEVM_SUCCESS);
+    REQUIRE(NotecardEnvVarManager_fetch(man, NULL, NEVM_ENV_VAR_ALL) ==
+            NEVM_SUCCESS);
+
+    NotecardEnvVarSocket *sock = NotecardEnvVarSocket_open(path, man);
+    REQUIRE(sock != NULL);
+    CHECK(NotecardEnvVarSocket_fd(sock) >= 0);
+
+    SECTION("Invalid parameters") {
+        CHECK(NotecardEnvVarSocket_open(NULL, man) == NULL);
+        CHECK(NotecardEnvVarSocket_open(path, NULL) == NULL);
+        CHECK(NotecardEnvVarSocket_poll(NULL, 0) == NEVM_FAILURE);
+    }
+
+    SECTION("Batched GET") {
+        int fd = connectClient();
+
+        std::string rsp = roundTrip(sock, fd, "GET var_a var_missing var_b\n",
+                                    "END\n");
+        CHECK(rsp == "VAL var_a 1\n1\n"
+              "NIL var_missing\n"
+              "VAL var_b 9\ntwo\nlines\n"
+              "END\n");
+
+        // Requests split across writes and pipelined in one write.
+        REQUIRE(send(fd, "GET va", 6, 0) == 6);
+        CHECK(roundTrip(sock, fd, "r_a\nGET\n", "END\nEND\n") ==
+              "VAL var_a 1\n1\nEND\nEND\n");
+
+        CHECK(roundTrip(sock, fd, "PUT var_a 2\r\n", "\n") ==
+              "ERR unknown request\n");
+
+        close(fd);
+    }
+
+    SECTION("Subscriptions") {
+        int subA = connectClient();
+        int subAll = connectClient();
+        int idle = connectClient();
+        CHECK(roundTrip(sock, subA, "SUB var_a\n", "\n") == "OK\n");
+        CHECK(roundTrip(sock, subAll, "SUB\n", "\n") == "OK\n");
+        CHECK(roundTrip(sock, subAll, "SUB\n", "\n") ==
+              "ERR already subscribed\n");
+        CHECK(NotecardEnvVarSocket_numClients(sock) == 3);
+
+        NotecardEnvVarSocket_notify(sock, "var_a", "10");
+        NotecardEnvVarSocket_notify(sock, "var_b", NULL);
+        CHECK(roundTrip(sock, subA, NULL, "\n10\n") == "CHG var_a 2\n10\n");
+        CHECK(roundTrip(sock, subAll, NULL, "DEL var_b\n") ==
+              "CHG var_a 2\n10\nDEL var_b\n");
+        char buf[16];
+        CHECK(recv(idle, buf, sizeof(buf), MSG_DONTWAIT) < 0);
+
+        // Disconnected subscribers are dropped.
+        close(subA);
+        for (int i = 0; i < 5; ++i) {
+            NotecardEnvVarSocket_poll(sock, 10);
+        }
+        CHECK(NotecardEnvVarSocket_numClients(sock) == 2);
+        NotecardEnvVarSocket_notify(sock, "var_a", "11");
+        CHECK(roundTrip(sock, subAll, NULL, "\n11\n") == "CHG var_a 2\n11\n");
+
+        close(subAll);
+        close(idle);
+    }
+
+    SECTION("Overlong request lines") {
+        int fd = connectClient();
+        std::string line(NEVM_SOCKET_MAX_LINE, 'x');
+        REQUIRE(send(fd, line.data(), line.size(), 0) ==
+                (ssize_t)line.size());
+        for (int i = 0; i < 10; ++i) {
+            NotecardEnvVarSocket_poll(sock, 10);
+        }
+        CHECK(NotecardEnvVarSocket_numClients(sock) == 0);
+        close(fd);
+    }
+
+    NotecardEnvVarSocket_close(sock);
+    CHECK(access(path, F_OK) != 0);
+    NotecardEnvVarManager_free(man);
+    NotecardEmulator_free(emu);
+}
+
+}
+
+#endif // NEVM_TEST